@@ -42,6 +42,12 @@ struct morecore_state {
     int v2p_entries;
 };
 
+/// RAM caps fetched ahead of time for one size
+struct ram_prefetch {
+    uint8_t count;                            ///< Number of valid caps
+    struct capref caps[RAM_ALLOC_BATCH_MAX];  ///< Caps, most recent last
+};
+
 struct ram_alloc_state {
     bool mem_connect_done;
     errval_t mem_connect_err;
@@ -50,6 +56,7 @@ struct ram_alloc_state {
     uint64_t default_minbase;
     uint64_t default_maxlimit;
     int base_capnum;
+    struct ram_prefetch prefetch[RAM_PREFETCH_MAXBITS - RAM_PREFETCH_MINBITS + 1];
 };
 
 struct skb_state {
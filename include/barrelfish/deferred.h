@@ -4,7 +4,7 @@
  */
 
 /*
- * Copyright (c) 2009, 2011, 2013, ETH Zurich.
+ * Copyright (c) 2009, 2011, 2013, 2016, ETH Zurich.
  * All rights reserved.
  *
  * This file is distributed under the terms in the attached LICENSE file.
@@ -24,10 +24,36 @@ __BEGIN_DECLS
 
 struct deferred_event {
     struct waitset_chanstate waitset_state; ///< Waitset state
-    struct deferred_event *next, *prev; ///< Next/prev in dispatcher queue
+    struct deferred_event *next, *prev; ///< Next/prev in timer wheel slot
+    struct deferred_event **slot;       ///< Timer wheel slot, NULL if none
     systime_t time;                     ///< System time for event
 };
 
+/// log2 of number of slots on every level of the timer wheel
+#define DEFERRED_WHEEL_BITS     6
+#define DEFERRED_WHEEL_SLOTS    (1 << DEFERRED_WHEEL_BITS)
+/// Number of levels of the timer wheel
+#define DEFERRED_WHEEL_LEVELS   4
+/// Approximate length of a timer wheel tick, in nanoseconds
+#define DEFERRED_WHEEL_TICK_NS  (1 << 16)
+
+/**
+ * \brief Hierarchical timer wheel holding the deferred events of a dispatcher
+ *
+ * Level 0 has one slot per tick, every higher level one slot per full
+ * rotation of the level below. Events further in the future than the top
+ * level covers are kept on the overflow list.
+ */
+struct deferred_wheel {
+    bool initialised;
+    uint8_t shift;              ///< log2 of systime units per tick
+    uint64_t cur;               ///< Current tick, up to which we have expired
+    size_t count;               ///< Number of events in the wheel
+    uint64_t occupied[DEFERRED_WHEEL_LEVELS]; ///< Bitmap of non-empty slots
+    struct deferred_event *slots[DEFERRED_WHEEL_LEVELS][DEFERRED_WHEEL_SLOTS];
+    struct deferred_event *overflow; ///< Events beyond the top level
+};
+
 systime_t get_system_time(void);
 
 void deferred_event_init(struct deferred_event *event);
@@ -19,10 +19,10 @@
 #include <barrelfish/core_state_arch.h>
 #include <barrelfish/heap.h>
 #include <barrelfish/threads.h>
+#include <barrelfish/deferred.h>
 
 struct lmp_chan;
 struct ump_chan;
-struct deferred_event;
 
 // Architecture generic user only dispatcher struct
 struct dispatcher_generic {
@@ -52,8 +52,8 @@ struct dispatcher_generic {
     struct heap lmp_endpoint_heap;
 #endif // CONFIG_INTERCONNECT_DRIVER_LMP
 
-    /// Queue of deferred events (i.e. timers)
-    struct deferred_event *deferred_events;
+    /// Deferred events (i.e. timers)
+    struct deferred_wheel deferred_events;
 
     /// The core the dispatcher is running on
     coreid_t core_id;
@@ -16,6 +16,8 @@ __BEGIN_DECLS
 
 errval_t nameservice_lookup(const char *iface, iref_t *retiref);
 errval_t nameservice_blocking_lookup(const char *iface, iref_t *retiref);
+errval_t nameservice_lookup_batch(const char **ifaces, size_t count,
+                                  iref_t *irefs);
 errval_t nameservice_register(const char *iface, iref_t iref);
 errval_t nameservice_client_blocking_bind(void);
 
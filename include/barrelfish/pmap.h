@@ -42,6 +42,9 @@ struct pmap {
     struct pmap_funcs f;
     struct vspace *vspace;      ///< The vspace this pmap is associated with
     struct slot_allocator *slot_alloc; ///< (Optional) slot allocator for vnodes
+    /// (Optional) slot allocator for the mapping caps of frames, instead of
+    /// slot_alloc. Frames mapped while it is set must be unmapped with it set.
+    struct slot_allocator *mapping_slot_alloc;
 };
 
 struct pmap_mapping_info {
@@ -24,6 +24,16 @@ __BEGIN_DECLS
 
 struct capref;
 
+/// Most caps returned by one batched allocation (mem.allocate_batch)
+#define RAM_ALLOC_BATCH_MAX     8
+
+/// Sizes (in bits) that ram_alloc prefetches in batches from the mem_serv
+#define RAM_PREFETCH_MINBITS    12
+#define RAM_PREFETCH_MAXBITS    16
+
+/// Most memory kept prefetched per size, so at most 276kB are idle in total
+#define RAM_PREFETCH_MAXBYTES   (64 * 1024)
+
 typedef errval_t (* ram_alloc_func_t)(struct capref *ret, uint8_t size_bits,
                                       uint64_t minbase, uint64_t maxlimit);
 
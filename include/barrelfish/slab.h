@@ -16,6 +16,7 @@
 #define LIBBARRELFISH_SLAB_H
 
 #include <sys/cdefs.h>
+#include <barrelfish_kpi/spinlocks_arch.h>
 
 __BEGIN_DECLS
 
@@ -47,6 +48,76 @@ void slab_free(struct slab_allocator *slabs, void *block);
 size_t slab_freecount(struct slab_allocator *slabs);
 errval_t slab_default_refill(struct slab_allocator *slabs);
 
+/// Number of blocks held by a full magazine of a slab cache
+#define SLAB_MAGAZINE_ROUNDS    16
+
+/// Number of per-dispatcher magazine slots in a slab cache
+#define SLAB_CACHE_SLOTS        8
+
+struct slab_cache;
+
+typedef errval_t (*slab_cache_refill_func_t)(struct slab_cache *sc);
+
+/// Magazine: a chain of free blocks linked through their first word
+struct slab_magazine {
+    void *head;                 ///< First block in the chain
+    uint32_t rounds;            ///< Number of blocks in the chain
+};
+
+/// Magazines of the dispatcher(s) mapping to a slot of a slab cache
+struct slab_cache_slot {
+    spinlock_t lock;            ///< Only contended if dispatchers share a slot
+    struct slab_magazine loaded, previous;
+    uint64_t allocs, frees;     ///< Operations served by this slot
+};
+
+/**
+ * \brief Slab allocator with a per-dispatcher magazine layer
+ *
+ * Allocation and free first operate on the calling dispatcher's magazines,
+ * then exchange full magazines with a lock-free depot, and only fall back
+ * to the spinlock-protected backing slab allocator when both are empty.
+ *
+ * Users refill in bulk from base pages. Large pages would commit 2MB of
+ * memory to every domain for a few kB of metadata. Slot allocators keep
+ * plain slab allocators: they are serialised by their own mutex and size
+ * their slabs for the worst case when created, so a cache would only add
+ * the memory of its magazines to every allocator.
+ */
+struct slab_cache {
+    struct slab_allocator slabs;    ///< Backing allocator, protected by lock
+    spinlock_t lock;
+    slab_cache_refill_func_t refill_func; ///< Called without lock held
+    volatile uint64_t depot;        ///< Tagged stack of full magazines
+    volatile size_t depot_mags;     ///< Number of magazines in the depot
+    volatile uint64_t depot_gets, depot_puts;
+    volatile uint64_t slow_allocs, slow_frees, refills;
+    struct slab_cache_slot slots[SLAB_CACHE_SLOTS];
+};
+
+/// Allocation and fragmentation counters of a slab cache
+struct slab_cache_stats {
+    uint64_t allocs, frees;         ///< Served by the magazines
+    uint64_t depot_gets;            ///< Full magazines taken from the depot
+    uint64_t depot_puts;            ///< Full magazines put to the depot
+    uint64_t slow_allocs;           ///< Batches taken from backing allocator
+    uint64_t slow_frees;            ///< Batches returned to backing allocator
+    uint64_t refills;               ///< Calls to the refill function
+    size_t slabs;                   ///< Slabs in the backing allocator
+    size_t partial_slabs;           ///< Slabs with both free and used blocks
+    size_t total_blocks;            ///< Blocks in all slabs
+    size_t free_blocks;             ///< Free blocks in the backing allocator
+    size_t cached_blocks;           ///< Free blocks in magazines and depot
+};
+
+void slab_cache_init(struct slab_cache *sc, size_t blocksize,
+                     slab_cache_refill_func_t refill_func);
+void slab_cache_grow(struct slab_cache *sc, void *buf, size_t buflen);
+void *slab_cache_alloc(struct slab_cache *sc);
+void slab_cache_free(struct slab_cache *sc, void *block);
+size_t slab_cache_freecount(struct slab_cache *sc);
+void slab_cache_get_stats(struct slab_cache *sc, struct slab_cache_stats *st);
+
 // size of block header
 #define SLAB_BLOCK_HDRSIZE (sizeof(void *))
 // should be able to fit the header into the block
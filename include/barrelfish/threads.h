@@ -73,6 +73,9 @@ void *thread_get_tls(void);
 void thread_set_tls_key(int, void *);
 void *thread_get_tls_key(int);
 
+typedef void (*thread_exit_hook_fn)(void);
+void thread_set_exit_hook(thread_exit_hook_fn hook);
+
 uintptr_t thread_id(void);
 uintptr_t thread_get_id(struct thread *t);
 void thread_set_id(uintptr_t id);
@@ -85,6 +85,8 @@ errval_t ump_chan_accept(struct ump_chan *uc, uintptr_t mon_id,
 errval_t ump_chan_register_send(struct ump_chan *uc, struct waitset *ws,
                                 struct event_closure closure);
 void ump_channels_retry_send_disabled(dispatcher_handle_t handle);
+size_t ump_chan_default_buflen(void);
+errval_t ump_chan_set_default_buflen(size_t buflen);
 void ump_chan_send_bind_reply(struct monitor_binding *mb,
                               struct ump_chan *uc, errval_t err,
                               uintptr_t monitor_id, struct capref notify_cap);
@@ -150,6 +152,42 @@ static inline void ump_chan_free_message(volatile struct ump_message *msg)
     ump_impl_free_message(msg);
 }
 
+/**
+ * \brief Reserve up to \p max consecutive send slots, see ump_impl_get_next_batch()
+ */
+static inline ump_index_t ump_chan_get_next_batch(struct ump_chan *uc,
+                                                  volatile struct ump_message **msgs,
+                                                  struct ump_control *ctrls,
+                                                  ump_index_t max)
+{
+    assert(uc != NULL);
+    return ump_impl_get_next_batch(&uc->send_chan, msgs, ctrls, max);
+}
+
+static inline void ump_chan_publish_batch(volatile struct ump_message **msgs,
+                                          struct ump_control *ctrls,
+                                          ump_index_t n)
+{
+    ump_impl_publish_batch(msgs, ctrls, n);
+}
+
+/**
+ * \brief Receive a run of up to \p max messages, see ump_impl_recv_batch()
+ */
+static inline ump_index_t ump_chan_recv_batch(struct ump_chan *uc,
+                                              volatile struct ump_message **msgs,
+                                              ump_index_t max)
+{
+    assert(uc != NULL);
+    return ump_impl_recv_batch(&uc->endpoint.chan, msgs, max);
+}
+
+static inline void ump_chan_free_batch(volatile struct ump_message **msgs,
+                                       ump_index_t n)
+{
+    ump_impl_free_batch(msgs, n);
+}
+
 /**
  * \brief Migrate an event registration made with
  * ump_chan_register_recv() to a new waitset
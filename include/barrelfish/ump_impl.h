@@ -78,6 +78,9 @@ typedef uint16_t ump_index_t;
 #define UMP_INDEX_BITS         (sizeof(ump_index_t) * NBBY)
 #define UMP_INDEX_MASK         ((((uintptr_t)1) << UMP_INDEX_BITS) - 1)
 
+/// Largest unidirectional UMP message buffer, in bytes (bounded by #ump_index_t)
+#define UMP_MAX_BUFLEN         ((size_t)UMP_INDEX_MASK * UMP_MSG_BYTES)
+
 /**
  * UMP direction
  */
@@ -108,6 +111,7 @@ struct ump_chan_state {
  * \param       c       Pointer to channel-state structure to initialize.
  * \param       buf     Pointer to ring buffer for the channel. Must be aligned to a cacheline.
  * \param       size    Size (in bytes) of buffer. Must be multiple of #UMP_MSG_BYTES
+ *                      and no larger than #UMP_MAX_BUFLEN
  * \param       dir     Channel direction.
  */
 static inline errval_t ump_chan_state_init(struct ump_chan_state *c,
@@ -115,7 +119,7 @@ static inline errval_t ump_chan_state_init(struct ump_chan_state *c,
                                            size_t size, enum ump_direction dir)
 {
     // check alignment and size of buffer.
-    if (size == 0 || (size % UMP_MSG_BYTES) != 0) {
+    if (size == 0 || (size % UMP_MSG_BYTES) != 0 || size > UMP_MAX_BUFLEN) {
         return LIB_ERR_UMP_BUFSIZE_INVALID;
     }
 
@@ -226,6 +230,125 @@ static inline void ump_impl_free_message(volatile struct ump_message *msg)
     msg->header.control.used = 0;
 }
 
+/// Order payload stores before the header stores that publish them
+static inline void ump_impl_barrier(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    /* the x86 memory model ensures ordering of stores, so all we need to do
+     * is prevent the compiler from reordering the instructions */
+    __asm volatile ("" : : : "memory");
+#else
+    /* use conservative GCC intrinsic */
+    __sync_synchronize();
+#endif
+}
+
+/**
+ * \brief Reserve a run of consecutive outgoing message slots on a channel,
+ *   and advance send pointer past them.
+ *
+ * Every slot is checked individually, so the run stops at the first slot the
+ * receiver has not yet freed. The caller fills in the payloads and then makes
+ * the whole run visible at once with ump_impl_publish_batch().
+ *
+ * \param c     Pointer to UMP channel-state structure.
+ * \param msgs  Array to be filled with pointers to the reserved slots
+ * \param ctrls Array of control words to be filled in, one per slot
+ * \param max   Maximum number of slots to reserve
+ *
+ * \return Number of slots reserved (possibly zero).
+ */
+static inline ump_index_t ump_impl_get_next_batch(struct ump_chan_state *c,
+                                                  volatile struct ump_message **msgs,
+                                                  struct ump_control *ctrls,
+                                                  ump_index_t max)
+{
+    assert(c->dir == UMP_OUTGOING);
+
+    ump_index_t n;
+    for (n = 0; n < max; n++) {
+        volatile struct ump_message *msg = &c->buf[c->pos];
+        if (msg->header.control.used) {
+            break;
+        }
+        msgs[n] = msg;
+        ctrls[n].used = 1;
+        ctrls[n].token = 0;
+        if (++c->pos == c->bufmsgs) {
+            c->pos = 0;
+        }
+    }
+    return n;
+}
+
+/**
+ * \brief Publish a run of slots reserved with ump_impl_get_next_batch()
+ *
+ * A single barrier orders all payload stores before the header stores. The
+ * headers are written in ring order, so the receiver never observes a gap.
+ *
+ * \param msgs  Reserved slots, with payloads filled in
+ * \param ctrls Control words for the slots
+ * \param n     Number of slots
+ */
+static inline void ump_impl_publish_batch(volatile struct ump_message **msgs,
+                                          struct ump_control *ctrls,
+                                          ump_index_t n)
+{
+    ump_impl_barrier();
+    for (ump_index_t i = 0; i < n; i++) {
+        msgs[i]->header.control = ctrls[i];
+    }
+}
+
+/**
+ * \brief Return a run of outstanding messages on 'c' and advance pointer.
+ *
+ * The messages stay owned by the receiver until they are freed, which lets
+ * the caller acknowledge the whole run at once with ump_impl_free_batch().
+ *
+ * \param c     Pointer to UMP channel-state structure.
+ * \param msgs  Array to be filled with pointers to received messages
+ * \param max   Maximum number of messages to return
+ *
+ * \return Number of messages returned (possibly zero).
+ */
+static inline ump_index_t ump_impl_recv_batch(struct ump_chan_state *c,
+                                              volatile struct ump_message **msgs,
+                                              ump_index_t max)
+{
+    assert(c->dir == UMP_INCOMING);
+
+    ump_index_t n;
+    for (n = 0; n < max; n++) {
+        volatile struct ump_message *msg = &c->buf[c->pos];
+        if (!msg->header.control.used) {
+            break;
+        }
+        msgs[n] = msg;
+        if (++c->pos == c->bufmsgs) {
+            c->pos = 0;
+        }
+    }
+    return n;
+}
+
+/**
+ * \brief Return a run of received messages to the sender
+ *
+ * Frees the slots in ring order in one sweep, instead of interleaving the
+ * acknowledgement of every slot with its processing. The sender only ever
+ * waits on the oldest slot, so in-order freeing lets it refill the ring as
+ * soon as the first line comes back.
+ */
+static inline void ump_impl_free_batch(volatile struct ump_message **msgs,
+                                       ump_index_t n)
+{
+    for (ump_index_t i = 0; i < n; i++) {
+        msgs[i]->header.control.used = 0;
+    }
+}
+
 __END_DECLS
 
 #endif // UMP_IMPL_H
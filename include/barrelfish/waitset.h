@@ -29,6 +29,7 @@ __BEGIN_DECLS
 #include <barrelfish/types.h>
 
 struct waitset;
+struct waitset_local;
 struct thread;
 
 struct event_closure {
@@ -85,6 +86,47 @@ struct waitset_chanstate {
     struct waitset_chanstate *polled_next, *polled_prev;    ///< Dispatcher's polled queue
     struct thread *wait_for;                ///< Thread waiting for this event
     struct waitset_chanstate *trigger;      ///< Chanstate that triggers this chanstate 
+    struct waitset_local *affinity;         ///< Preferred thread queue (affinity mode)
+    bool local;                             ///< Pending on affinity's local queue
+};
+
+/// Spin-then-block statistics of a waitset, see waitset_get_stats().
+/// Fields marked (*) are only collected while spinning is enabled.
+struct waitset_stats {
+    uint64_t events;        ///< Events handed out to threads
+    uint64_t spins;         ///< Spin phases entered instead of blocking at once
+    uint64_t spin_hits;     ///< Spin phases that found an event
+    uint64_t blocks;        ///< Times a thread blocked on the waitset
+    uint64_t wakeups;       ///< Blocked threads woken by a triggered event (*)
+    systime_t spin_time;    ///< Total time spent spinning
+    systime_t block_time;   ///< Total time threads spent blocked (*)
+    systime_t wakeup_time;  ///< Total time from trigger to the woken thread running (*)
+    systime_t spin_budget;  ///< Current spin budget
+    systime_t interarrival; ///< Smoothed idle time before an event arrives
+    uint64_t local_events;  ///< Events taken from the thread's own queue
+    uint64_t stolen_events; ///< Events stolen from another thread's queue
+};
+
+/// Maximum number of dispatching threads with a local queue on one waitset
+#define WAITSET_MAX_LOCAL   16
+
+/**
+ * \brief Local event queue of one dispatching thread (affinity mode)
+ *
+ * Private to the waitset, see waitset_enable_affinity().
+ */
+struct waitset_local {
+    struct thread *thread;              ///< Owning thread, NULL if the slot is free
+    struct waitset_chanstate *pending;  ///< Pending channels with affinity to it
+    struct waitset *ws;                 ///< Waitset the queue belongs to
+    struct waitset_local *next_owned;   ///< Next queue owned by the same thread
+};
+
+/// Per-thread queues of a waitset in affinity mode
+struct waitset_affinity {
+    struct waitset_local local[WAITSET_MAX_LOCAL];
+    unsigned nlocal;    ///< Number of slots ever claimed, free or not
+    unsigned cursor;    ///< Round-robin position for new channels and stealing
 };
 
 /**
@@ -101,6 +143,19 @@ struct waitset {
 
     /// Queue of threads blocked on this waitset (when no events are pending)
     struct thread *waiting_threads;
+
+    /* Spin-then-block policy, see waitset_set_spin() */
+    systime_t max_spin;     ///< Upper bound for spin_budget, 0 never spins
+    systime_t spin_budget;  ///< Time to poll before blocking
+    systime_t interarrival; ///< Smoothed idle time before an event arrives
+    systime_t wakeup_start; ///< When a blocked thread was last woken
+    bool adaptive;          ///< Derive spin_budget from interarrival
+    uint8_t probe;          ///< Waits since spinning was last tried
+
+    struct waitset_stats stats;
+
+    /// Per-thread local queues, NULL unless in affinity mode
+    struct waitset_affinity *affinity;
 };
 
 void poll_channels_disabled(dispatcher_handle_t handle);
@@ -119,6 +174,13 @@ errval_t event_dispatch_disabled(struct waitset *ws, dispatcher_handle_t handle)
 errval_t event_dispatch_debug(struct waitset *ws);
 errval_t event_dispatch_non_block(struct waitset *ws);
 
+void waitset_set_spin(struct waitset *ws, delayus_t max_spin, bool adaptive);
+void waitset_get_stats(struct waitset *ws, struct waitset_stats *stats);
+void waitset_reset_stats(struct waitset *ws);
+errval_t waitset_enable_affinity(struct waitset *ws);
+errval_t waitset_chan_set_affinity(struct waitset_chanstate *chan,
+                                   struct thread *thread);
+
 __END_DECLS
 
 #endif // BARRELFISH_WAITSET_H
@@ -0,0 +1,58 @@
+/**
+ * \file
+ * \brief Compiled demultiplexer for bfdmux filters
+ *
+ * Filters that are a conjunction of equality tests on packet fields, which is
+ * what the bfdmuxtools builders generate for sockets, are compiled into a
+ * list of (offset, width, value) terms. Terms on the IPv4 5-tuple form a key
+ * into a hash table, one table slot per combination of constrained fields, so
+ * a packet is classified with one lookup per combination in use instead of
+ * interpreting every filter. Other filters are kept in a list and run through
+ * the byte code interpreter.
+ *
+ * As with a plain list of filters, the most recently added (highest id)
+ * matching filter wins.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef __DEMUX_H__
+#define __DEMUX_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <errors/errno.h>
+
+#define DEMUX_BUCKETS       1024    ///< Hash buckets, power of two
+#define DEMUX_MAX_TERMS     16      ///< Maximum terms of a compiled filter
+#define DEMUX_KEY_FIELDS    5       ///< Fields of the IPv4 5-tuple
+#define DEMUX_SIGNATURES    (1 << DEMUX_KEY_FIELDS)
+
+struct demux_filter;
+
+/// Demultiplexer state
+struct demux {
+    struct demux_filter *buckets[DEMUX_BUCKETS];    ///< Compiled filters
+    struct demux_filter *interpreted;   ///< Other filters, newest first
+    uint32_t sig_refs[DEMUX_SIGNATURES];    ///< Filters per key signature
+    uint8_t sigs[DEMUX_SIGNATURES];     ///< Signatures in use
+    int nsigs;                          ///< Number of signatures in use
+    size_t ncompiled;                   ///< Number of compiled filters
+    size_t ninterpreted;                ///< Number of interpreted filters
+};
+
+void demux_init(struct demux *dm);
+errval_t demux_add_filter(struct demux *dm, uint8_t *code, int len,
+                          uint64_t id, void *arg, struct demux_filter **ret);
+void demux_remove_filter(struct demux *dm, struct demux_filter *f);
+void *demux_match(struct demux *dm, uint8_t *packet, int len);
+bool demux_filter_is_compiled(struct demux_filter *f);
+
+#endif
@@ -47,4 +47,7 @@ errval_t dma_bench_run(struct dma_device *dev, lpaddr_t src, lpaddr_t dst);
 
 errval_t dma_bench_run_memcpy(void *dst, void *src);
 
+errval_t dma_bench_run_sw(struct capref frame, lpaddr_t src, lpaddr_t dst,
+                          coreid_t core);
+
 #endif /* DMA_BENCH_INTERNAL_H */
@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2016 ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetsstrasse 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef LIB_SW_DMA_H
+#define LIB_SW_DMA_H
+
+struct sw_dma_device;
+struct sw_dma_channel;
+struct sw_dma_request;
+
+/*
+ * The software DMA device executes the requests with the CPU. Every channel
+ * has a worker thread which takes the descriptors from the channel's ring and
+ * copies the data, writing back the address of the last executed descriptor
+ * as the IOAT hardware does. The physical addresses of the requests are
+ * translated using the frames registered with dma_register_memory().
+ */
+
+/// Number of elements the software descriptor ring has (in bits)
+#define SW_DMA_DESC_RING_SIZE 10
+
+/// Maximum number of bytes transferred by a single descriptor
+#define SW_DMA_MAX_XFER_SIZE (1UL << 20)
+
+/// Transfers of at least this size bypass the caches with non-temporal stores
+#define SW_DMA_NONTEMPORAL_MIN (16UL * 1024)
+
+/// Maximum number of channels of a software DMA device
+#define SW_DMA_CHANNELS_MAX 8
+
+#endif  /* LIB_SW_DMA_H */
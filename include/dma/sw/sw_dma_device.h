@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2016 ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetsstrasse 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef LIB_SW_DMA_DEVICE_H
+#define LIB_SW_DMA_DEVICE_H
+
+#include <dma/dma_device.h>
+
+/// forward declaration of the device
+struct sw_dma_device;
+struct sw_dma_channel;
+
+/**
+ * \brief pointer type conversion
+ */
+static inline struct sw_dma_device *dma_device_to_sw(struct dma_device *dev)
+{
+    return (struct sw_dma_device *) dev;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ * device initialization / termination
+ * ----------------------------------------------------------------------------
+ */
+
+/**
+ * \brief initializes a software DMA device
+ *
+ * \param channels  number of channels, each one gets a worker thread
+ * \param core      core of the first worker, the other ones run on the
+ *                  following cores
+ * \param dev       returns a pointer to the device structure
+ *
+ * \returns SYS_ERR_OK on success
+ *          errval on error
+ *
+ * The domain must already have a dispatcher on the cores of the workers
+ * (see domain_new_dispatcher()). Workers on the calling core share the CPU
+ * with the caller.
+ */
+errval_t sw_dma_device_init(uint8_t channels,
+                            coreid_t core,
+                            struct sw_dma_device **dev);
+
+/**
+ * \brief terminates the device operation and frees up the allocated resources
+ *
+ * \param dev software DMA device to shutdown
+ *
+ * \returns SYS_ERR_OK on success
+ *          errval on error
+ *
+ * The requests still executing are completed first.
+ */
+errval_t sw_dma_device_shutdown(struct sw_dma_device *dev);
+
+/*
+ * ----------------------------------------------------------------------------
+ * Device Operation Functions
+ * ----------------------------------------------------------------------------
+ */
+
+/**
+ * \brief polls the channels of the software DMA device
+ *
+ * \param dev   software DMA device
+ *
+ * \returns SYS_ERR_OK on success
+ *          DMA_ERR_DEVICE_IDLE if there is nothing completed on the channels
+ *          errval on error
+ */
+errval_t sw_dma_device_poll_channels(struct dma_device *dev);
+
+#endif  /* LIB_SW_DMA_DEVICE_H */
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2016 ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetsstrasse 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef LIB_SW_DMA_REQUEST_H
+#define LIB_SW_DMA_REQUEST_H
+
+#include <dma/dma_request.h>
+
+struct sw_dma_device;
+struct sw_dma_channel;
+struct sw_dma_request;
+
+/**
+ * \brief pointer type conversion
+ */
+static inline struct sw_dma_request *dma_request_to_sw(struct dma_request *req)
+{
+    return (struct sw_dma_request *)req;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ * Request Execution
+ * ----------------------------------------------------------------------------
+ */
+
+/**
+ * \brief issues a memcpy request to the given channel
+ *
+ * \param chan  software DMA channel
+ * \param setup request setup information
+ * \param id    returns the generated request id
+ *
+ * \returns SYS_ERR_OK on success
+ *          DMA_ERR_MEM_NOT_REGISTERED if the memory was not registered
+ *          errval on failure
+ */
+errval_t sw_dma_request_memcpy_chan(struct dma_channel *chan,
+                                    struct dma_req_setup *setup,
+                                    dma_req_id_t *id);
+
+/**
+ * \brief issues a memcpy request to a channel of the given device
+ *
+ * \param dev   software DMA device
+ * \param setup request setup information
+ * \param id    returns the generated request id
+ *
+ * \returns SYS_ERR_OK on success
+ *          errval on failure
+ */
+errval_t sw_dma_request_memcpy(struct dma_device *dev,
+                               struct dma_req_setup *setup,
+                               dma_req_id_t *id);
+
+/**
+ * \brief issues a memset request to the given channel
+ *
+ * \param chan  software DMA channel
+ * \param setup request setup information
+ * \param id    returns the generated request id
+ *
+ * \returns SYS_ERR_OK on success
+ *          DMA_ERR_MEM_NOT_REGISTERED if the memory was not registered
+ *          errval on failure
+ */
+errval_t sw_dma_request_memset_chan(struct dma_channel *chan,
+                                    struct dma_req_setup *setup,
+                                    dma_req_id_t *id);
+
+/**
+ * \brief issues a memset request to a channel of the given device
+ *
+ * \param dev   software DMA device
+ * \param setup request setup information
+ * \param id    returns the generated request id
+ *
+ * \returns SYS_ERR_OK on success
+ *          errval on failure
+ */
+errval_t sw_dma_request_memset(struct dma_device *dev,
+                               struct dma_req_setup *setup,
+                               dma_req_id_t *id);
+
+#endif  /* LIB_SW_DMA_REQUEST_H */
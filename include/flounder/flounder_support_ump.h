@@ -33,11 +33,18 @@ enum flounder_ump_msgtype {
     FL_UMP_CAP_ACK = (1 << FL_UMP_MSGTYPE_BITS) - 1,
 };
 
+/// Number of received fragments whose slots are freed together
+#define FL_UMP_ACK_BATCH 8
+
 struct flounder_ump_state {
     struct ump_chan chan;
 
     struct flounder_cap_state capst; ///< State for indirect cap tx/rx machinery
     uint32_t token;        ///< Outgoing message's token
+
+    /// Received slots not yet returned to the sender
+    volatile struct ump_message *rx_acks[FL_UMP_ACK_BATCH];
+    ump_index_t rx_nacks;  ///< Number of valid entries in rx_acks
 };
 
 void flounder_stub_ump_state_init(struct flounder_ump_state *s, void *binding);
@@ -89,14 +96,32 @@ static inline int flounder_stub_ump_control_process(struct flounder_ump_state *s
 /// Emit memory barrier needed between writing UMP payload and header
 static inline void flounder_stub_ump_barrier(void)
 {
-#if defined(__i386__) || defined(__x86_64__)
-    /* the x86 memory model ensures ordering of stores, so all we need to do
-     * is prevent the compiler from reordering the instructions */
-    __asm volatile ("" : : : "memory");
-#else
-    /* use conservative GCC intrinsic */
-    __sync_synchronize();
-#endif
+    ump_impl_barrier();
+}
+
+/// Return all deferred received slots to the sender
+static inline void flounder_stub_ump_free_flush(struct flounder_ump_state *s)
+{
+    ump_chan_free_batch(s->rx_acks, s->rx_nacks);
+    s->rx_nacks = 0;
+}
+
+/**
+ * \brief Free a received message slot, coalescing it with its neighbours
+ *
+ * The slot must have been consumed in ring order and its payload must no
+ * longer be needed. Deferred slots are freed once #FL_UMP_ACK_BATCH of them
+ * have accumulated, or when the receive handler calls
+ * flounder_stub_ump_free_flush() on its way out.
+ */
+static inline void flounder_stub_ump_free_deferred(struct flounder_ump_state *s,
+                                                   volatile struct ump_message *msg)
+{
+    assert(s->rx_nacks < FL_UMP_ACK_BATCH);
+    s->rx_acks[s->rx_nacks++] = msg;
+    if (s->rx_nacks == FL_UMP_ACK_BATCH) {
+        flounder_stub_ump_free_flush(s);
+    }
 }
 
 /// Send a cap ACK (message that we are ready to receive caps)
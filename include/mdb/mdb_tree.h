@@ -98,6 +98,19 @@ errval_t mdb_insert(struct cte *new_node);
 // the cap is not present in the tree.
 errval_t mdb_remove(struct cte *node);
 
+// Insert count caps stored consecutively at first, eg. the results of a
+// retype. If they are in ascending order and no cap in the tree sorts between
+// them, the run is added as a whole in O(count + log(n)), otherwise each cap
+// is inserted separately. Returns the first error encountered, with the same
+// semantics as mdb_insert().
+errval_t mdb_insert_bulk(struct cte *first, size_t count);
+// Remove count caps stored consecutively at first. A run that is contiguous
+// in the ordering is cut out of the tree in O(count + log(n)). Returns
+// MDB_ENTRY_NOTFOUND if any of the caps was not present, after removing all
+// others. Delete and revoke do not use this: they decide per cap whether it is
+// the last copy, and work in preemptible steps of one cap each.
+errval_t mdb_remove_bulk(struct cte *first, size_t count);
+
 struct cte *mdb_predecessor(struct cte *current);
 struct cte *mdb_successor(struct cte *current);
 
@@ -134,6 +147,30 @@ errval_t mdb_find_range(mdb_root_t root, genpaddr_t address, gensize_t size,
 
 errval_t mdb_find_cap_for_address(genpaddr_t address, struct cte **ret_node);
 
+/// Maximum height of the tree, which is at most 2*log2(n+1)
+#define MDB_RANGE_ITER_DEPTH    64
+
+/**
+ * Iterator over all caps that overlap a region, in ascending order. Subtrees
+ * that end before the region are skipped, so a scan costs O(log(n)) plus the
+ * number of overlapping caps and their ancestors in the tree. The iterator is
+ * invalidated by any insert or remove.
+ */
+struct mdb_range_iter {
+    mdb_root_t root;            ///< Type root of the region
+    genpaddr_t address;         ///< Start of the region
+    genpaddr_t end;             ///< End of the region (exclusive)
+    int depth;                  ///< Number of entries on the stack
+    struct cte *stack[MDB_RANGE_ITER_DEPTH];    ///< Nodes still to visit
+};
+
+// Start an iteration over the caps of type root `root` overlapping
+// [address, address+size).
+void mdb_range_iter_init(struct mdb_range_iter *iter, mdb_root_t root,
+                         genpaddr_t address, gensize_t size);
+// Return the next overlapping cap, or NULL when the iteration is complete.
+struct cte *mdb_range_iter_next(struct mdb_range_iter *iter);
+
 bool mdb_reachable(struct cte *cte);
 
 /**
@@ -42,6 +42,31 @@ struct mmnode {
 #define MM_NODE_SIZE(maxchildbits) \
     (sizeof(struct mmnode) + sizeof(struct mmnode *) * (1UL << (maxchildbits)))
 
+/// Allocation strategy used by a memory manager instance
+enum mm_backend {
+    MM_BACKEND_TREE,    ///< B-tree of power-of-two regions (mm_init())
+    MM_BACKEND_BUDDY    ///< Binary buddy allocator (mm_init_buddy())
+};
+
+/// Number of block orders tracked by the buddy backend
+#define MM_BUDDY_ORDERS 64
+
+/// Block in the buddy backend. Private.
+// Only appears here so we can know its size
+struct mmbuddy {
+    enum nodetype type;          ///< Free, Allocated or Chunked (split in two)
+    uint8_t sizebits;            ///< Order of this block
+    struct capref cap;           ///< Cap to this block
+    genpaddr_t base;             ///< Base address of this block
+    struct mmbuddy *parent;      ///< Block this one was split from, or NULL
+    struct mmbuddy *children[2]; ///< Halves of a chunked block
+    struct mmbuddy *next, *prev; ///< Free list of this order (free blocks)
+    struct mmbuddy *nextroot;    ///< Next region given to mm_add() (roots)
+};
+
+/// Size of a node for the buddy backend
+#define MM_BUDDY_NODE_SIZE sizeof(struct mmbuddy)
+
 /**
  * \brief Memory manager instance data
  *
@@ -59,6 +84,12 @@ struct mm {
     uint8_t sizebits;            ///< Size of root node (in bits)
     uint8_t maxchildbits;        ///< Maximum number of children of every node (in bits)
     bool delete_chunked;         ///< Delete chunked capabilities if true
+    enum mm_backend backend;     ///< Allocation strategy of this instance
+
+    /* buddy backend only */
+    struct mmbuddy *buddy_roots;                  ///< Regions added to the allocator
+    struct mmbuddy *buddy_free[MM_BUDDY_ORDERS];  ///< Free blocks, per order
+    uint64_t buddy_freemap;      ///< Bit n set iff buddy_free[n] is non-empty
 };
 
 void mm_debug_print(struct mmnode *mmnode, int space);
@@ -67,6 +98,11 @@ errval_t mm_init(struct mm *mm, enum objtype objtype, genpaddr_t base,
                  slab_refill_func_t slab_refill_func,
                  slot_alloc_t slot_alloc_func, slot_refill_t slot_refill_func,
                  void *slot_alloc_inst, bool delete_chunked);
+errval_t mm_init_buddy(struct mm *mm, enum objtype objtype, genpaddr_t base,
+                       uint8_t sizebits, slab_refill_func_t slab_refill_func,
+                       slot_alloc_t slot_alloc_func,
+                       slot_refill_t slot_refill_func, void *slot_alloc_inst,
+                       bool delete_chunked);
 void mm_destroy(struct mm *mm);
 errval_t mm_add(struct mm *mm, struct capref cap, uint8_t sizebits,
                 genpaddr_t base);
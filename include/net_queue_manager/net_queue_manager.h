@@ -43,6 +43,8 @@ struct bufdesc {
     uint64_t flags;
 };
 
+struct demux_filter;
+
 struct filter {
     uint64_t filter_id;
     uint64_t filter_type;
@@ -52,6 +54,7 @@ struct filter {
     struct bufdesc pause_buffer[MAX_PAUSE_BUFFER];
     int pause_bufpos;
     struct buffer_descriptor *buffer;
+    struct demux_filter *demux;     ///< Compiled form in the demultiplexer
     struct filter *next;
 };
 
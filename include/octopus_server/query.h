@@ -24,6 +24,16 @@
 #include <octopus_server/service.h>
 #include <octopus/parser/ast.h>
 
+/**
+ * Recipient of a published record.
+ */
+struct oct_subscriber {
+    uint64_t binding;        ///< Event binding of the client
+    uint64_t client_handler; ///< Client handler function
+    uint64_t client_state;   ///< State argument supplied by the client
+    uint64_t server_id;      ///< Id of the subscription
+};
+
 /**
  * \brief Stores a binding for the given id.
  *
@@ -161,12 +171,17 @@ errval_t del_subscription(struct octopus_binding* b, uint64_t id,
  *
  * \param ast Record to match with stored subscription.
  * \param dqs Returned result of query invocation.
+ * \param subscribers Matching subscribers, ordered by subscription id. Has to
+ * be freed by the caller.
+ * \param count Number of matching subscribers.
  *
  * \retval SYS_ERR_OK
  * \retval OCT_ERR_NO_SUBSCRIBERS
  * \retval OCT_ERR_ENGINE_FAIL
+ * \retval LIB_ERR_MALLOC_FAIL
  */
-errval_t find_subscribers(struct ast_object* ast, struct oct_query_state* dqs);
+errval_t find_subscribers(struct ast_object* ast, struct oct_query_state* dqs,
+        struct oct_subscriber** subscribers, size_t* count);
 
 /**
  * \brief Find the event binding of the client based on his RPC binding.
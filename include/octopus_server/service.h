@@ -59,6 +59,8 @@ errval_t new_oct_reply_state(struct oct_reply_state**, oct_reply_handler_fn);
 
 void get_names_handler(struct octopus_binding*, const char*, octopus_trigger_t);
 void get_handler(struct octopus_binding*, const char*, octopus_trigger_t);
+void get_records_handler(struct octopus_binding*, const char*,
+                         octopus_trigger_t);
 void set_handler(struct octopus_binding*, const char*, uint64_t, octopus_trigger_t, bool);
 void get_with_idcap_handler(struct octopus_binding*, struct capref,
                             octopus_trigger_t);
@@ -73,6 +75,8 @@ void subscribe_handler(struct octopus_binding*, const char*, uint64_t, uint64_t)
 void publish_handler(struct octopus_binding*, const char*);
 void unsubscribe_handler(struct octopus_binding*, uint64_t);
 
+void oct_error_handler(struct octopus_binding*, errval_t);
+
 void get_identifier(struct octopus_binding*);
 void identify_binding(struct octopus_binding*, uint64_t, octopus_binding_type_t);
 
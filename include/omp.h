@@ -60,6 +60,16 @@ typedef enum bomp_backend {
     BOMP_BACKEND_LINUX   = 3
 } bomp_backend_t;
 
+/**
+ * BOMP barrier algorithms
+ */
+typedef enum bomp_barrier_kind {
+    BOMP_BARRIER_AUTO          = 0, ///< chosen from the NUMA topology
+    BOMP_BARRIER_CENTRAL       = 1, ///< single shared counter
+    BOMP_BARRIER_TREE          = 2, ///< combining tree following NUMA nodes
+    BOMP_BARRIER_DISSEMINATION = 3  ///< log2(n) rounds of pairwise flags
+} bomp_barrier_t;
+
 /**
  * OpenMP schedule types
  */
@@ -120,6 +130,13 @@ int bomp_switch_backend(bomp_backend_t backend);
  */
 bomp_backend_t bomp_get_backend(void);
 
+/**
+ * \brief selects the barrier algorithm used by the following parallel regions
+ *
+ * \param kind  BOMP_BARRIER_*, BOMP_BARRIER_AUTO chooses from the topology
+ */
+void bomp_set_barrier(bomp_barrier_t kind);
+
 
 ///< Default Stacksize for BOMP threads
 #define BOMP_DEFAULT_STACKSIZE (64 * 1024)
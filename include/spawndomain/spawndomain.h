@@ -53,6 +53,12 @@ struct spawninfo {
     // slot allocator for pagecn
     struct single_slot_allocator pagecn_slot_alloc;
 
+    // CNode of the spawning domain holding the caps of shared image frames
+    // and their mappings, out of reach of the new domain (NULL_CAP if unused)
+    struct capref sharedcn_cap;
+    struct single_slot_allocator sharedcn_slot_alloc;
+    void *sharedcn_slot_buf;
+
     // TLS data
     genvaddr_t tls_init_base;
     size_t tls_init_len, tls_total_len;
@@ -70,6 +76,47 @@ struct spawninfo {
     uint8_t flags;
 };
 
+/// maximum number of loadable segments of a shared image
+#define SPAWN_IMAGE_SEGMENTS_MAX 16
+
+/**
+ * \brief A loadable segment of a shared image.
+ */
+struct spawn_image_segment {
+    genvaddr_t base;            ///< page-aligned address in the new domain
+    size_t size;                ///< page-aligned size
+    uint32_t flags;             ///< ELF segment flags (PF_*)
+    size_t init_len;            ///< writable: bytes to copy, the rest is zero
+    struct vregion *vregion;    ///< loaded segment, mapped in our vspace
+};
+
+/**
+ * \brief An ELF binary loaded once to spawn domains from it repeatedly.
+ *
+ * Read-only segments are shared by all domains spawned from the image,
+ * writable ones are copied for every domain.
+ */
+struct spawn_image {
+    enum cpu_type cpu_type;
+    genvaddr_t entry;
+
+    // TLS data
+    genvaddr_t tls_init_base;
+    size_t tls_init_len, tls_total_len;
+
+    // Error handling data
+    genvaddr_t eh_frame;
+    size_t eh_frame_size;
+    genvaddr_t eh_frame_hdr;
+    size_t eh_frame_hdr_size;
+
+    struct spawn_image_segment segments[SPAWN_IMAGE_SEGMENTS_MAX];
+    unsigned int nsegments;
+
+    size_t shared_bytes;        ///< size of the shared segments
+    size_t copied_bytes;        ///< bytes copied for every domain
+};
+
 #define SPAWN_FLAGS_DEFAULT (0)
 #define SPAWN_FLAGS_NEW_DOMAIN    (1 << 0) ///< allocate a new domain ID
 #define SPAWN_FLAGS_OMP           (1 << 1) ///< do the OpenMP parsing
@@ -90,11 +137,29 @@ errval_t spawn_load_image(struct spawninfo *si, lvaddr_t binary,
                           const char *name, coreid_t coreid,
                           char *const argv[], char *const envp[],
                           struct capref inheritcn_cap, struct capref argcn_cap);
+errval_t spawn_prepare(struct spawninfo *si, enum cpu_type type);
+errval_t spawn_load_prepared_image(struct spawninfo *si, lvaddr_t binary,
+                                   size_t binary_size, const char *name,
+                                   coreid_t coreid, char *const argv[],
+                                   char *const envp[],
+                                   struct capref inheritcn_cap,
+                                   struct capref argcn_cap);
+errval_t spawn_load_shared_image(struct spawninfo *si,
+                                 struct spawn_image *image, const char *name,
+                                 coreid_t coreid, char *const argv[],
+                                 char *const envp[],
+                                 struct capref inheritcn_cap,
+                                 struct capref argcn_cap);
 errval_t spawn_run(struct spawninfo *si);
 errval_t spawn_free(struct spawninfo *si);
 
 errval_t multiboot_cleanup_mapping(void);
 
+/* spawn_image.c */
+errval_t spawn_image_create(struct spawn_image *image, lvaddr_t binary,
+                            size_t binary_size);
+errval_t spawn_image_destroy(struct spawn_image *image);
+
 /* spawn_vspace.c */
 errval_t spawn_vspace_init(struct spawninfo *si, struct capref vnode,
                            enum cpu_type cpu_type);
@@ -17,6 +17,16 @@
 
 #include <barrelfish/pmap.h>
 
+/// Page tables with more children than this use a dense child table
+#define VNODE_COMPACT_MAX   8
+
+struct vnode;
+
+/// Dense child table of a page table, indexed by page table entry
+struct vnode_index {
+    struct vnode *child[PTABLE_SIZE]; ///< Child covering each entry, or NULL
+};
+
 /// Node in the meta-data, corresponds to an actual VNode object
 struct vnode { // NB: misnomer :)
     uint16_t      entry;       ///< Page table entry of this VNode
@@ -27,7 +37,9 @@ struct vnode { // NB: misnomer :)
         struct {
             struct capref cap;         ///< VNode cap
             struct capref invokable;    ///< Copy of VNode cap that is invokable
-            struct vnode  *children;   ///< Children of this VNode
+            struct vnode  *children;   ///< Children of this VNode (compact)
+            struct vnode_index *index; ///< Dense children, NULL if compact
+            uint16_t      nchildren;   ///< Number of children
         } vnode; // for non-leaf node (maps another vnode)
         struct {
             struct capref cap;         ///< Frame cap
@@ -44,7 +56,10 @@ struct pmap_x86 {
     genvaddr_t vregion_offset;  ///< Offset into amount of reserved virtual address used
     struct vnode root;          ///< Root of the vnode tree
     errval_t (*refill_slabs)(struct pmap_x86 *); ///< Function to refill slabs
-    struct slab_allocator slab;     ///< Slab allocator for the vnode lists
+    struct slab_cache slab;         ///< Slab allocator for the vnode lists
+    struct slab_cache index_slab;   ///< Slab allocator for dense child tables
+    bool index_wanted;          ///< A page table stayed compact for lack of a table
+    size_t index_bytes;         ///< Reserved space used for dense child tables
     genvaddr_t min_mappable_va; ///< Minimum mappable virtual address
     genvaddr_t max_mappable_va; ///< Maximum mappable virtual address
     uint8_t slab_buffer[512];   ///< Initial buffer to back the allocator
@@ -0,0 +1,51 @@
+/**
+ * \file
+ * \brief Thread-caching malloc front-end on top of morecore
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef TCMALLOC_TCMALLOC_H
+#define TCMALLOC_TCMALLOC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+/// Largest request served from the size-class caches; larger ones use spans
+#define TCMALLOC_MAX_SMALL_SIZE     (32 * 1024)
+
+/// Allocator statistics, summed over all dispatchers of the domain
+struct tcmalloc_stats {
+    uint64_t central_fetches;   ///< Batches handed out to thread caches
+    uint64_t central_releases;  ///< Batches returned by thread caches
+    uint64_t transfer_hits;     ///< Fetches served from the transfer cache
+    uint64_t spans_allocated;   ///< Spans carved from the page heap
+    uint64_t spans_freed;       ///< Spans returned to the page heap
+    uint64_t large_allocs;      ///< Allocations bigger than a size class
+    size_t   heap_bytes;        ///< Bytes obtained from morecore
+    size_t   meta_bytes;        ///< Bytes used for allocator metadata
+};
+
+void *tc_malloc(size_t bytes);
+void tc_free(void *ptr);
+void *tc_realloc(void *ptr, size_t bytes);
+void *tc_calloc(size_t nmemb, size_t bytes);
+size_t tc_malloc_usable_size(void *ptr);
+
+void tcmalloc_init(void);
+void tcmalloc_thread_flush(void);
+void tcmalloc_get_stats(struct tcmalloc_stats *stats);
+
+__END_DECLS
+
+#endif // TCMALLOC_TCMALLOC_H
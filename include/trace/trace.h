@@ -126,6 +126,22 @@ static inline bool trace_cas(volatile uintptr_t *address, uintptr_t old,
     return res;
 }
 
+/*
+ * \brief increment the value at address and return its previous value
+ *
+ * NOTE: All writers of a trace buffer run on the same core. A single xadd
+ * cannot be interrupted half way, so no lock prefix and no retry is needed.
+ */
+static inline uintptr_t trace_fetch_inc(volatile uintptr_t *address)
+{
+    uintptr_t val = 1;
+    __asm volatile("xaddq %0,%1        \n\t"
+                   : "+r" (val), "+m" (*address)
+                   :
+                   : "memory");
+    return val;
+}
+
 
 #elif defined(__i386__) || defined(__arm__) || defined(__aarch64__)
 
@@ -135,6 +151,11 @@ static inline bool trace_cas(volatile uintptr_t *address, uintptr_t old,
     return false;
 }
 
+static inline uintptr_t trace_fetch_inc(volatile uintptr_t *address)
+{
+    return (*address)++;
+}
+
 #define TRACE_TIMESTAMP() 0
 
 #else
@@ -168,10 +189,18 @@ struct trace_application {
     uint64_t dcb; ///< DCB address of the application
 };
 
+/*
+ * Every core has a ring of TRACE_MAX_EVENTS events. Writers reserve the next
+ * sequence number with trace_fetch_inc() and never wait: once the ring is
+ * full, the oldest events are overwritten. Event seq is stored in slot
+ * seq % TRACE_MAX_EVENTS and is valid once commit[slot] == seq + 1, so a
+ * consumer on another core can drain the ring while tracing continues.
+ */
+
 /// Trace buffer
 struct trace_buffer {
-    volatile uintptr_t head_index;
-    volatile uintptr_t tail_index;
+    volatile uintptr_t head_index;     // Events reserved (free running)
+    volatile uintptr_t tail_index;     // Events consumed (free running)
 
     // ... flags...
     struct trace_buffer *master;       // Pointer to the trace master
@@ -187,6 +216,7 @@ struct trace_buffer {
 
     // ... events ...
     struct trace_event events[TRACE_MAX_EVENTS];
+    volatile uintptr_t commit[TRACE_MAX_EVENTS];  // seq + 1 of the slot
 
     // ... applications ...
     volatile uint8_t num_applications;
@@ -225,6 +255,8 @@ size_t trace_dump(char *buf, size_t buflen, int *number_of_events);
 size_t trace_dump_core(char *buf, size_t buflen, size_t *usedBytes,
         int *number_of_events_dumped, coreid_t specified_core,
         bool first_dump, bool isOnlyOne);
+bool trace_read_event(struct trace_buffer *tbuf, uintptr_t seq,
+                      struct trace_event *ev);
 void trace_flush(struct event_closure callback);
 void trace_set_autoflush(bool enabled);
 errval_t trace_prepare(struct event_closure callback);
@@ -268,32 +300,22 @@ void trace_init_disp(void);
  * \brief Reserve a slot in the trace buffer and write the event.
  *
  * Returns the slot index that was written.
- * Lock-free implementation.
+ * Wait-free, the oldest event is overwritten if the buffer is full.
  *
  */
 static inline uintptr_t
 trace_reserve_and_fill_slot(struct trace_event *ev,
                             struct trace_buffer *buf)
 {
-    uintptr_t i, nw;
-    struct trace_event *slot;
-
-    do {
-        i = buf->head_index;
-
-        if (buf->tail_index - buf->head_index == 1 ||
-                (buf->tail_index == 0 && (buf->head_index == TRACE_MAX_EVENTS-1))) {
-            // Buffer is full, overwrite last event
-            break;
-        }
-
-        nw = (i + 1) % TRACE_MAX_EVENTS;
-
-    } while (!trace_cas(&buf->head_index, i, nw));
-
-    // Write the event
-    slot = &buf->events[i];
-    *slot = *ev;
+    uintptr_t seq = trace_fetch_inc(&buf->head_index);
+    uintptr_t i = seq % TRACE_MAX_EVENTS;
+
+    // Invalidate the slot while it is written, x86 keeps the stores in order
+    buf->commit[i] = 0;
+    __asm volatile("" ::: "memory");
+    buf->events[i] = *ev;
+    __asm volatile("" ::: "memory");
+    buf->commit[i] = seq + 1;
 
     return i;
 }
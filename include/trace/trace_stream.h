@@ -0,0 +1,73 @@
+/**
+ * \file
+ * \brief Compact binary encoding of trace events for continuous tracing
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef LIBBARRELFISH_TRACE_STREAM_H
+#define LIBBARRELFISH_TRACE_STREAM_H
+
+#include <trace/trace.h>
+
+/*
+ * A stream starts with the 8 byte header "BFTRACE" TRACE_STREAM_VERSION,
+ * followed by records. Every record is a tag byte and its fields. Integers
+ * are LEB128 varints, signed ones zigzag encoded first.
+ *
+ *   CORE   core, t_offset(signed)   following records belong to this core
+ *   EVENT  delta, subsys, event, arg
+ *                                   timestamp is the previous timestamp of
+ *                                   the core plus delta
+ *   RAW    timestamp, raw           event whose timestamp is not after the
+ *                                   previous one (e.g. DCB records). Becomes
+ *                                   the previous timestamp unless bit 63 is set
+ *   LOST   count                    events of the core overwritten before
+ *                                   they were drained
+ *   APP    dcb, name[8]             application started on the core
+ *
+ * An event typically takes 6 to 9 bytes instead of the 16 bytes of a
+ * struct trace_event.
+ */
+
+#define TRACE_STREAM_MAGIC      "BFTRACE"
+#define TRACE_STREAM_VERSION    1
+#define TRACE_STREAM_HEADER_LEN 8
+
+#define TRACE_STREAM_CORE       0x01
+#define TRACE_STREAM_EVENT      0x02
+#define TRACE_STREAM_RAW        0x03
+#define TRACE_STREAM_LOST       0x04
+#define TRACE_STREAM_APP        0x05
+
+/// maximum size of a single record
+#define TRACE_STREAM_RECORD_MAX 48
+
+/// state of a consumer draining the trace buffers as a stream
+struct trace_stream {
+    bool     started;                          ///< header was written
+    coreid_t core;                             ///< core of the last CORE record
+    coreid_t first;                            ///< core drained first next time
+    uint64_t last_ts[TRACE_COREID_LIMIT];      ///< last timestamp per core
+    uint8_t  apps[TRACE_COREID_LIMIT];         ///< applications written
+    uint64_t events;                           ///< events written
+    uint64_t lost;                             ///< events overwritten
+};
+
+#ifndef IN_KERNEL
+
+void trace_stream_init(struct trace_stream *st);
+size_t trace_stream_drain(struct trace_stream *st, uint8_t *buf,
+                          size_t buflen);
+errval_t trace_start_continuous(void);
+
+#endif // IN_KERNEL
+
+#endif // LIBBARRELFISH_TRACE_STREAM_H
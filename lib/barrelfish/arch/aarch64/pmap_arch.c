@@ -360,7 +360,9 @@ static errval_t do_single_map(struct pmap_aarch64 *pmap, genvaddr_t vaddr, genva
     page->u.frame.flags = flags;
     page->u.frame.pte_count = pte_count;
 
-    err = pmap->p.slot_alloc->alloc(pmap->p.slot_alloc, &page->mapping);
+    struct slot_allocator *mapping_alloc = pmap->p.mapping_slot_alloc
+        ? pmap->p.mapping_slot_alloc : pmap->p.slot_alloc;
+    err = mapping_alloc->alloc(mapping_alloc, &page->mapping);
     if (err_is_fail(err)) {
         return err_push(err, LIB_ERR_SLOT_ALLOC);
     }
@@ -615,7 +617,9 @@ static errval_t do_single_unmap(struct pmap_aarch64 *pmap, genvaddr_t vaddr,
             if (err_is_fail(err)) {
                 return err_push(err, LIB_ERR_CAP_DELETE);
             }
-            err = slot_free(page->mapping);
+            struct slot_allocator *mapping_alloc = pmap->p.mapping_slot_alloc
+                ? pmap->p.mapping_slot_alloc : pmap->p.slot_alloc;
+            err = mapping_alloc->free(mapping_alloc, page->mapping);
             if (err_is_fail(err)) {
                 return err_push(err, LIB_ERR_CAP_DELETE);
             }
@@ -890,6 +894,7 @@ pmap_init(struct pmap   *pmap,
     } else { /* use default allocator for this dispatcher */
         pmap->slot_alloc = get_default_slot_allocator();
     }
+    pmap->mapping_slot_alloc = NULL;
 
     // Slab allocator for vnodes
     slab_init(&pmap_aarch64->slab, sizeof(struct vnode), NULL);
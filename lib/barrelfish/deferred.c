@@ -4,7 +4,7 @@
  */
 
 /*
- * Copyright (c) 2009, 2011, 2012, 2013, ETH Zurich.
+ * Copyright (c) 2009, 2011, 2012, 2013, 2016, ETH Zurich.
  * All rights reserved.
  *
  * This file is distributed under the terms in the attached LICENSE file.
@@ -26,16 +26,208 @@
 
 #include "waitset_chan_priv.h"
 
+/*
+ * Deferred events are kept in a hierarchical timer wheel (as in Varghese and
+ * Lauck, or the classic Linux timer code): level 0 has one slot per tick, and
+ * every slot of level l covers a full rotation of level l - 1. Events are
+ * inserted into the lowest level whose range covers them, and slots of higher
+ * levels are cascaded into lower levels as time passes. This gives O(1)
+ * register and cancel, and expiry that only touches non-empty slots.
+ */
+
+#define WHEEL_MASK          (DEFERRED_WHEEL_SLOTS - 1)
+#define WHEEL_RANGE_BITS    (DEFERRED_WHEEL_LEVELS * DEFERRED_WHEEL_BITS)
+
+static void wheel_init(struct deferred_wheel *w, systime_t now)
+{
+    // largest power of two of systime units not longer than a tick
+    systime_t tick = ns_to_systime(DEFERRED_WHEEL_TICK_NS);
+    w->shift = 0;
+    while (w->shift < 63 && ((systime_t)2 << w->shift) <= tick) {
+        w->shift++;
+    }
+    w->cur = now >> w->shift;
+    w->initialised = true;
+}
+
+static void wheel_link(struct deferred_event **slot, struct deferred_event *e)
+{
+    e->prev = NULL;
+    e->next = *slot;
+    if (*slot != NULL) {
+        (*slot)->prev = e;
+    }
+    *slot = e;
+    e->slot = slot;
+}
+
+/// Enqueue event in the slot of the lowest level covering its expiry time
+static void wheel_insert(struct deferred_wheel *w, struct deferred_event *e)
+{
+    uint64_t tick = e->time >> w->shift;
+    if (tick < w->cur) {
+        // already expired: fire at the next trigger
+        tick = w->cur;
+    }
+    uint64_t delta = tick - w->cur;
+
+    for (int l = 0; l < DEFERRED_WHEEL_LEVELS; l++) {
+        if (delta < (UINT64_C(1) << ((l + 1) * DEFERRED_WHEEL_BITS))) {
+            unsigned idx = (tick >> (l * DEFERRED_WHEEL_BITS)) & WHEEL_MASK;
+            wheel_link(&w->slots[l][idx], e);
+            w->occupied[l] |= UINT64_C(1) << idx;
+            return;
+        }
+    }
+    wheel_link(&w->overflow, e);
+}
+
+static void wheel_unlink(struct deferred_wheel *w, struct deferred_event *e)
+{
+    assert(e->slot != NULL);
+    if (e->prev == NULL) {
+        *e->slot = e->next;
+    } else {
+        e->prev->next = e->next;
+    }
+    if (e->next != NULL) {
+        e->next->prev = e->prev;
+    }
+    if (*e->slot == NULL && e->slot != &w->overflow) {
+        size_t i = e->slot - &w->slots[0][0];
+        w->occupied[i / DEFERRED_WHEEL_SLOTS]
+            &= ~(UINT64_C(1) << (i % DEFERRED_WHEEL_SLOTS));
+    }
+    e->next = e->prev = NULL;
+    e->slot = NULL;
+}
+
+/// Re-insert all events of a slot, which now belong to lower levels
+static void wheel_cascade_slot(struct deferred_wheel *w,
+                               struct deferred_event **slot)
+{
+    struct deferred_event *e = *slot, *next;
+    *slot = NULL;
+    if (slot != &w->overflow) {
+        size_t i = slot - &w->slots[0][0];
+        w->occupied[i / DEFERRED_WHEEL_SLOTS]
+            &= ~(UINT64_C(1) << (i % DEFERRED_WHEEL_SLOTS));
+    }
+    for (; e != NULL; e = next) {
+        next = e->next;
+        wheel_insert(w, e);
+    }
+}
+
+/// Cascade the higher-level slots starting at the current tick
+static void wheel_cascade(struct deferred_wheel *w)
+{
+    for (int l = 1; l < DEFERRED_WHEEL_LEVELS; l++) {
+        // level l only moves when all levels below wrap around
+        if ((w->cur & ((UINT64_C(1) << (l * DEFERRED_WHEEL_BITS)) - 1)) != 0) {
+            return;
+        }
+        unsigned idx = (w->cur >> (l * DEFERRED_WHEEL_BITS)) & WHEEL_MASK;
+        wheel_cascade_slot(w, &w->slots[l][idx]);
+    }
+    if ((w->cur & ((UINT64_C(1) << WHEEL_RANGE_BITS) - 1)) == 0) {
+        wheel_cascade_slot(w, &w->overflow);
+    }
+}
+
+/**
+ * \brief Returns a lower bound on the first tick >= from that needs work
+ *
+ * That is either a tick with a non-empty level 0 slot, or a tick at which a
+ * non-empty slot of a higher level (or the overflow list) is cascaded. The
+ * cascades for the current tick are assumed to be done already.
+ */
+static uint64_t wheel_next_tick(struct deferred_wheel *w, uint64_t from)
+{
+    uint64_t next = UINT64_MAX;
+
+    for (int l = 0; l < DEFERRED_WHEEL_LEVELS; l++) {
+        unsigned shift = l * DEFERRED_WHEEL_BITS;
+        uint64_t rotation = UINT64_C(1) << (shift + DEFERRED_WHEEL_BITS);
+        uint64_t base = from & ~(rotation - 1);
+        unsigned idx = (from >> shift) & WHEEL_MASK;
+
+        uint64_t ahead = w->occupied[l] & (~UINT64_C(0) << idx);
+        uint64_t start = base + ((uint64_t)idx << shift);
+        if (l > 0 && (start < from || start <= w->cur)) {
+            // this slot was already cascaded: it holds the next rotation
+            ahead &= ~(UINT64_C(1) << idx);
+        }
+        if (ahead != 0) {
+            next = MIN(next, base + ((uint64_t)__builtin_ctzll(ahead) << shift));
+        } else if (w->occupied[l] != 0) {
+            // only slots of the next rotation
+            next = MIN(next, base + rotation);
+        }
+    }
+    if (w->overflow != NULL) {
+        uint64_t range = UINT64_C(1) << WHEEL_RANGE_BITS;
+        uint64_t wrap = ROUND_UP(from, range);
+        next = MIN(next, wrap <= w->cur ? wrap + range : wrap);
+    }
+
+    return next;
+}
+
+/// Trigger all events in a level 0 slot that expire no later than now
+static void wheel_expire_slot(struct deferred_wheel *w, unsigned idx,
+                              systime_t now, dispatcher_handle_t dh)
+{
+    struct deferred_event **slot = &w->slots[0][idx];
+    struct deferred_event *e = *slot, *next;
+    errval_t err;
+
+    if (e == NULL) {
+        return;
+    }
+
+    // detach the whole slot and put back the events that are not yet due
+    *slot = NULL;
+    w->occupied[0] &= ~(UINT64_C(1) << idx);
+    for (; e != NULL; e = next) {
+        next = e->next;
+        if (e->time <= now) {
+            e->next = e->prev = NULL;
+            e->slot = NULL;
+            w->count--;
+            err = waitset_chan_trigger_disabled(&e->waitset_state, dh);
+            assert_disabled(err_is_ok(err));
+        } else {
+            wheel_link(slot, e);
+            w->occupied[0] |= UINT64_C(1) << idx;
+        }
+    }
+}
+
 static void update_wakeup_disabled(dispatcher_handle_t dh)
 {
     struct dispatcher_generic *dg = get_dispatcher_generic(dh);
     struct dispatcher_shared_generic *ds = get_dispatcher_shared_generic(dh);
+    struct deferred_wheel *w = &dg->deferred_events;
 
-    if (dg->deferred_events == NULL) {
+    if (w->count == 0) {
         ds->wakeup = 0;
-    } else {
-        ds->wakeup = dg->deferred_events->time;
+        return;
+    }
+
+    uint64_t tick = wheel_next_tick(w, w->cur);
+    struct deferred_event *e = w->slots[0][tick & WHEEL_MASK];
+    if (tick != w->cur && ((tick & WHEEL_MASK) == 0 || e == NULL)) {
+        // events will be cascaded: wake up at the start of the tick
+        ds->wakeup = tick << w->shift;
+        return;
+    }
+
+    systime_t wakeup = e->time;
+    for (e = e->next; e != NULL; e = e->next) {
+        wakeup = MIN(wakeup, e->time);
     }
+    ds->wakeup = wakeup;
 }
 
 /**
@@ -51,6 +243,7 @@ void deferred_event_init(struct deferred_event *event)
     assert(event != NULL);
     waitset_chanstate_init(&event->waitset_state, CHANTYPE_DEFERRED);
     event->next = event->prev = NULL;
+    event->slot = NULL;
     event->time = 0;
 }
 
@@ -72,32 +265,17 @@ errval_t deferred_event_register(struct deferred_event *event,
     err = waitset_chan_register_disabled(ws, &event->waitset_state, closure);
     if (err_is_ok(err)) {
         struct dispatcher_generic *dg = get_dispatcher_generic(dh);
+        struct deferred_wheel *w = &dg->deferred_events;
+        systime_t now = systime_now();
 
-        // determine absolute time for event
-        event->time = systime_now() + ns_to_systime((uint64_t)delay * 1000);
-        // enqueue in sorted list of pending timers
-        for (struct deferred_event *e = dg->deferred_events, *p = NULL; ;
-             p = e, e = e->next) {
-            if (e == NULL || e->time > event->time) {
-                if (p == NULL) { // insert at head
-                    assert(e == dg->deferred_events);
-                    event->prev = NULL;
-                    event->next = e;
-                    if (e != NULL) {
-                        e->prev = event;
-                    }
-                    dg->deferred_events = event;
-                } else {
-                    event->next = e;
-                    event->prev = p;
-                    p->next = event;
-                    if (e != NULL) {
-                        e->prev = event;
-                    }
-                }
-                break;
-            }
+        if (!w->initialised) {
+            wheel_init(w, now);
         }
+
+        // determine absolute time for event
+        event->time = now + ns_to_systime((uint64_t)delay * 1000);
+        wheel_insert(w, event);
+        w->count++;
     }
 
     update_wakeup_disabled(dh);
@@ -147,16 +325,10 @@ errval_t deferred_event_cancel(struct deferred_event *event)
     dispatcher_handle_t handle = disp_disable();
     errval_t err = waitset_chan_deregister_disabled(&event->waitset_state, handle);
     if (err_is_ok(err) && chanstate != CHAN_PENDING) {
-        // remove from dispatcher queue
+        // remove from timer wheel
         struct dispatcher_generic *disp = get_dispatcher_generic(handle);
-        if (event->prev == NULL) {
-            disp->deferred_events = event->next;
-        } else {
-            event->prev->next = event->next;
-        }
-        if (event->next != NULL) {
-            event->next->prev = event->prev;
-        }
+        wheel_unlink(&disp->deferred_events, event);
+        disp->deferred_events.count--;
         update_wakeup_disabled(handle);
     }
 
@@ -211,16 +383,26 @@ errval_t periodic_event_cancel(struct periodic_event *event)
 void trigger_deferred_events_disabled(dispatcher_handle_t dh, systime_t now)
 {
     struct dispatcher_generic *dg = get_dispatcher_generic(dh);
-    struct deferred_event *e;
-    errval_t err;
+    struct deferred_wheel *w = &dg->deferred_events;
 
-    for (e = dg->deferred_events; e != NULL && e->time <= now; e = e->next) {
-        err = waitset_chan_trigger_disabled(&e->waitset_state, dh);
-        assert_disabled(err_is_ok(err));
+    if (!w->initialised) {
+        return;
     }
-    dg->deferred_events = e;
-    if (e != NULL) {
-        e->prev = NULL;
+
+    uint64_t target = now >> w->shift;
+    for (;;) {
+        wheel_expire_slot(w, w->cur & WHEEL_MASK, now, dh);
+        if (w->cur >= target) {
+            break;
+        }
+        if (w->count == 0) {
+            w->cur = target;
+            break;
+        }
+        // skip ahead over empty slots, cascading where necessary
+        w->cur = MIN(wheel_next_tick(w, w->cur + 1), target);
+        wheel_cascade(w);
     }
+
     update_wakeup_disabled(dh);
 }
@@ -389,41 +389,57 @@ errval_t flounder_stub_lmp_recv_string(struct lmp_recv_msg *msg, char *str,
 void flounder_stub_ump_state_init(struct flounder_ump_state *s, void *binding)
 {
     s->token = 0;
+    s->rx_nacks = 0;
     flounder_stub_cap_state_init(&s->capst, binding);
 }
 
+/// Maximum number of buffer fragments published with a single barrier
+#define UMP_SEND_BATCH  16
+
 errval_t flounder_stub_ump_send_buf(struct flounder_ump_state *s,
                                        int msgnum, const void *bufp,
                                        size_t len, size_t *pos)
 {
-    volatile struct ump_message *msg;
+    volatile struct ump_message *msgs[UMP_SEND_BATCH];
+    struct ump_control ctrls[UMP_SEND_BATCH];
     const uint8_t *buf = bufp;
-    struct ump_control ctrl;
     int msgpos;
 
     do {
-        msg = ump_chan_get_next(&s->chan, &ctrl);
-        if (!msg)
-            return FLOUNDER_ERR_BUF_SEND_MORE;
-        flounder_stub_ump_control_fill(s, &ctrl, msgnum);
-
-        // is this the start of the buffer?
+        // count the fragments still to go, so we never reserve a slot that
+        // would be left unfilled. the length word only goes in the first one.
+        size_t words = DIVIDE_ROUND_UP(len - *pos, sizeof(uintptr_t));
         if (*pos == 0) {
-            // if so, send the length in the first word
-            msg->data[0] = len;
-            // XXX: skip as many words as the largest word size
-            msgpos = (sizeof(uint64_t) / sizeof(uintptr_t));
-        } else {
-            // otherwise use it for payload
-            msgpos = 0;
+            words += sizeof(uint64_t) / sizeof(uintptr_t);
         }
+        size_t nfrags = MAX(DIVIDE_ROUND_UP(words, UMP_PAYLOAD_WORDS), 1);
+
+        ump_index_t n = ump_chan_get_next_batch(&s->chan, msgs, ctrls,
+                                                MIN(nfrags, UMP_SEND_BATCH));
+        if (n == 0)
+            return FLOUNDER_ERR_BUF_SEND_MORE;
 
-        for (; msgpos < UMP_PAYLOAD_WORDS && *pos < len; msgpos++) {
-            msg->data[msgpos] = getword(buf, pos, len);
+        for (ump_index_t i = 0; i < n; i++) {
+            volatile struct ump_message *msg = msgs[i];
+            flounder_stub_ump_control_fill(s, &ctrls[i], msgnum);
+
+            // is this the start of the buffer?
+            if (*pos == 0) {
+                // if so, send the length in the first word
+                msg->data[0] = len;
+                // XXX: skip as many words as the largest word size
+                msgpos = (sizeof(uint64_t) / sizeof(uintptr_t));
+            } else {
+                // otherwise use it for payload
+                msgpos = 0;
+            }
+
+            for (; msgpos < UMP_PAYLOAD_WORDS && *pos < len; msgpos++) {
+                msg->data[msgpos] = getword(buf, pos, len);
+            }
         }
 
-        flounder_stub_ump_barrier();
-        msg->header.control = ctrl;
+        ump_chan_publish_batch(msgs, ctrls, n);
     } while (*pos < len);
 
     // we're done. zero out our state for the next buffer
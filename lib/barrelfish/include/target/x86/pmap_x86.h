@@ -43,9 +43,22 @@ struct vnode *find_vnode(struct vnode *root, uint16_t entry);
 bool inside_region(struct vnode *root, uint32_t entry, uint32_t npages);
 
 /**
- * \brief remove vnode `item` from list of children of `root`.
+ * \return the child of `root` following `prev` (the first one if `prev` is
+ * NULL), or NULL if there are no more children.
  */
-void remove_vnode(struct vnode *root, struct vnode *item);
+struct vnode *next_vnode(struct vnode *root, struct vnode *prev);
+
+/**
+ * \brief add `item` to the children of `root`. Switches `root` to a dense
+ * child table taken from `pmap`'s index slabs once it gets crowded.
+ */
+void add_vnode(struct pmap_x86 *pmap, struct vnode *root, struct vnode *item);
+
+/**
+ * \brief remove vnode `item` from the children of `root`.
+ */
+void remove_vnode(struct pmap_x86 *pmap, struct vnode *root,
+                  struct vnode *item);
 
 /**
  * \brief allocate vnode as child of `root` with type `type`. Allocates the
@@ -87,6 +87,8 @@ struct thread {
     struct capref recv_slots[MAX_RECV_SLOTS];///< Queued cap recv slots
     int8_t recv_slot_count;                 ///< number of currently queued recv slots
     struct waitset_chanstate *local_trigger; ///< Trigger for a local thread event
+    struct waitset_local *waitset_locals;   ///< Waitset queues it owns (affinity mode)
+    bool waitset_dispatching;               ///< Blocked waiting for any event
 };
 
 void thread_enqueue(struct thread *thread, struct thread **queue);
@@ -96,6 +98,9 @@ void thread_remove_from_queue(struct thread **queue, struct thread *thread);
 /* must only be called by dispatcher, while disabled */
 void thread_init_disabled(dispatcher_handle_t handle, bool init_domain);
 
+/* waitset.c */
+void waitset_thread_exit(struct thread *thread);
+
 /// Returns true if there is non-threaded work to be done on this dispatcher
 /// (ie. if we still need to run)
 static inline bool havework_disabled(dispatcher_handle_t handle)
@@ -13,15 +13,227 @@
  * Attn: Systems Group.
  */
 #include <stdio.h>
+#include <string.h>
 
 #include <barrelfish/barrelfish.h>
 #include <barrelfish/nameservice_client.h>
+#include <barrelfish/systime.h>
 
 #include <if/octopus_defs.h>
 #include <if/monitor_defs.h>
 #include <octopus/getset.h> // for oct_read TODO
 #include <octopus/trigger.h> // for NOP_TRIGGER
 
+/*
+ * Lookup cache
+ *
+ * Every lookup used to be a round trip to the octopus server, although
+ * service irefs hardly ever change. Resolved irefs are kept per domain: the
+ * first lookup of a name holds it for a short lease only, so domains that
+ * resolve a name once leave no state in the server. A name that is looked up
+ * again is fetched together with a one-shot trigger on the record and stays
+ * valid until the trigger reports that it was changed or deleted. Evicting a
+ * watched name removes its trigger. Batched lookups only take leases, as
+ * they do not learn the IDs of the triggers installed for them.
+ *
+ * Every invalidation advances a generation counter. A lookup only caches
+ * its result if no invalidation happened while its RPC was in flight, as
+ * the record may have changed after it was read.
+ */
+
+/// Number of names cached per domain
+#define NS_CACHE_ENTRIES   32
+/// Longer names are not cached
+#define NS_CACHE_NAME_LEN  64
+/// Time an iref is used without a trigger on its record
+#define NS_CACHE_LEASE_MS  1000
+
+struct ns_cache_entry {
+    char name[NS_CACHE_NAME_LEN]; ///< Interface name, empty if unused
+    iref_t iref;                  ///< Cached IREF, 0 if invalidated
+    systime_t expires;            ///< End of lease, unused while watched
+    bool watched;                 ///< Trigger installed for the record
+    octopus_trigger_id_t tid;     ///< ID of that trigger
+    uint64_t last_use;            ///< Lookup clock for replacement
+};
+
+static struct thread_mutex ns_cache_lock = THREAD_MUTEX_INITIALIZER;
+static struct ns_cache_entry ns_cache[NS_CACHE_ENTRIES];
+static uint64_t ns_cache_clock = 0;
+static uint64_t ns_cache_generation = 0; ///< Number of invalidations
+
+/// Caller holds ns_cache_lock
+static struct ns_cache_entry *ns_cache_find(const char *iface)
+{
+    for (size_t i = 0; i < NS_CACHE_ENTRIES; i++) {
+        if (ns_cache[i].name[0] != '\0' &&
+                strcmp(ns_cache[i].name, iface) == 0) {
+            return &ns_cache[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * \brief Looks up a cached IREF
+ *
+ * \param iface Name of interface
+ * \param retiref Returns cached IREF on a hit
+ * \param watch Set on a miss if the name was resolved before and should be
+ *              fetched with a trigger
+ * \param gen Returns the generation to pass to ns_cache_put() on a miss
+ *
+ * \retval true Cache hit
+ */
+static bool ns_cache_get(const char *iface, iref_t *retiref, bool *watch,
+                         uint64_t *gen)
+{
+    bool hit = false;
+    *watch = false;
+
+    thread_mutex_lock(&ns_cache_lock);
+    *gen = ns_cache_generation;
+    struct ns_cache_entry *e = ns_cache_find(iface);
+    if (e != NULL) {
+        e->last_use = ++ns_cache_clock;
+        if (e->iref != 0 && (e->watched || systime_now() < e->expires)) {
+            *retiref = e->iref;
+            hit = true;
+        } else {
+            *watch = !e->watched;
+        }
+    }
+    thread_mutex_unlock(&ns_cache_lock);
+
+    return hit;
+}
+
+/// Removes a trigger that no cache entry depends on anymore
+static void ns_cache_remove_trigger(struct octopus_binding *r,
+                                    octopus_trigger_id_t tid)
+{
+    // error_code is ignored: the trigger is gone if it fired meanwhile
+    errval_t error_code;
+    errval_t err = r->rpc_tx_vtbl.remove_trigger(r, tid, &error_code);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "removing unused name service trigger");
+    }
+}
+
+/**
+ * \brief Caches the result of a lookup
+ *
+ * \param iface Name of interface
+ * \param iref IREF it resolved to, 0 if unknown
+ * \param watched Whether a trigger was installed for the record
+ * \param tid ID of that trigger
+ * \param gen Generation returned by ns_cache_get() before the lookup
+ *
+ * \return ID of a trigger to remove, as its entry was evicted or the result
+ *         was dropped, or 0
+ */
+static octopus_trigger_id_t ns_cache_put(const char *iface, iref_t iref,
+                                         bool watched, octopus_trigger_id_t tid,
+                                         uint64_t gen)
+{
+    octopus_trigger_id_t unused = 0;
+
+    thread_mutex_lock(&ns_cache_lock);
+    if (iref == 0 || strlen(iface) >= NS_CACHE_NAME_LEN ||
+            gen != ns_cache_generation) {
+        // not cached, or possibly invalidated while the RPC was in flight
+        unused = watched ? tid : 0;
+        goto out;
+    }
+
+    struct ns_cache_entry *e = ns_cache_find(iface);
+    if (e == NULL) {
+        // replace an unused or the least recently used entry
+        e = &ns_cache[0];
+        for (size_t i = 0; i < NS_CACHE_ENTRIES; i++) {
+            if (ns_cache[i].name[0] == '\0') {
+                e = &ns_cache[i];
+                break;
+            }
+            if (ns_cache[i].last_use < e->last_use) {
+                e = &ns_cache[i];
+            }
+        }
+        if (e->watched) {
+            unused = e->tid;
+        }
+        strcpy(e->name, iface);
+        e->watched = false;
+    }
+    if (watched) {
+        if (e->watched) {
+            unused = tid; // the record is watched already
+        } else {
+            e->watched = true;
+            e->tid = tid;
+        }
+    }
+    e->iref = iref;
+    e->expires = systime_now() + ns_to_systime(NS_CACHE_LEASE_MS * 1000000ULL);
+    e->last_use = ++ns_cache_clock;
+
+out:
+    thread_mutex_unlock(&ns_cache_lock);
+    return unused;
+}
+
+/**
+ * \brief Drops a cached name, or all watched names if iface is NULL
+ */
+static void ns_cache_invalidate(const char *iface, size_t len)
+{
+    thread_mutex_lock(&ns_cache_lock);
+    ns_cache_generation++;
+    for (size_t i = 0; i < NS_CACHE_ENTRIES; i++) {
+        struct ns_cache_entry *e = &ns_cache[i];
+        if (iface == NULL ? e->watched : (strncmp(e->name, iface, len) == 0 &&
+                                          e->name[len] == '\0')) {
+            e->iref = 0;
+            e->watched = false;
+        }
+    }
+    thread_mutex_unlock(&ns_cache_lock);
+}
+
+/**
+ * \brief Handles triggers on records of cached names
+ *
+ * Triggers installed by lookups are not persistent, they fire once on the
+ * first change or deletion of the record.
+ */
+static void ns_cache_trigger(struct octopus_binding *b,
+                             octopus_trigger_id_t id, uint64_t trigger_fn,
+                             octopus_mode_t mode, const char *record,
+                             uint64_t state)
+{
+    if (record == NULL) {
+        ns_cache_invalidate(NULL, 0);
+    } else {
+        ns_cache_invalidate(record, strcspn(record, " {"));
+    }
+}
+
+/// Trigger requested with lookups of names that are resolved repeatedly
+static inline octopus_trigger_t ns_cache_mktrigger(bool watch)
+{
+    if (!watch) {
+        return NOP_TRIGGER;
+    }
+
+    return (octopus_trigger_t) {
+        .in_case = SYS_ERR_OK,
+        .send_to = octopus_BINDING_RPC,
+        .m = OCT_ON_SET | OCT_ON_DEL,
+        .trigger = 0,
+        .st = 0
+    };
+}
+
 /**
  * \brief Non-blocking name service lookup
  *
@@ -37,10 +249,19 @@ errval_t nameservice_lookup(const char *iface, iref_t *retiref)
         return LIB_ERR_NAMESERVICE_NOT_BOUND;
     }
 
+    iref_t cached;
+    bool watch;
+    uint64_t gen;
+    if (ns_cache_get(iface, &cached, &watch, &gen)) {
+        if (retiref != NULL) {
+            *retiref = cached;
+        }
+        return SYS_ERR_OK;
+    }
 
     struct octopus_get_names_response__rx_args reply;
-    err = r->rpc_tx_vtbl.get(r, iface, NOP_TRIGGER, reply.output, &reply.tid,
-                      &reply.error_code);
+    err = r->rpc_tx_vtbl.get(r, iface, ns_cache_mktrigger(watch), reply.output,
+                             &reply.tid, &reply.error_code);
     if (err_is_fail(err)) {
         goto out;
     }
@@ -55,7 +276,15 @@ errval_t nameservice_lookup(const char *iface, iref_t *retiref)
     uint64_t iref_number = 0;
     err = oct_read(reply.output, "_ { iref: %d }", &iref_number);
     if (err_is_fail(err) || iref_number == 0) {
+        iref_number = 0;
         err = err_push(err, LIB_ERR_NAMESERVICE_INVALID_NAME);
+    }
+    octopus_trigger_id_t unused = ns_cache_put(iface, iref_number, watch,
+                                               reply.tid, gen);
+    if (unused != 0) {
+        ns_cache_remove_trigger(r, unused);
+    }
+    if (err_is_fail(err)) {
         goto out;
     }
     if (retiref != NULL) {
@@ -81,6 +310,16 @@ errval_t nameservice_blocking_lookup(const char *iface, iref_t *retiref)
         return LIB_ERR_NAMESERVICE_NOT_BOUND;
     }
 
+    iref_t cached;
+    bool watch;
+    uint64_t gen;
+    if (ns_cache_get(iface, &cached, &watch, &gen)) {
+        if (retiref != NULL) {
+            *retiref = cached;
+        }
+        return SYS_ERR_OK;
+    }
+
     struct octopus_wait_for_response__rx_args reply;
     err = r->rpc_tx_vtbl.wait_for(r, iface, reply.record, &reply.error_code);
     if (err_is_fail(err)) {
@@ -100,6 +339,8 @@ errval_t nameservice_blocking_lookup(const char *iface, iref_t *retiref)
         err = err_push(err, LIB_ERR_NAMESERVICE_INVALID_NAME);
         goto out;
     }
+    // wait_for installs no trigger, the record is cached under a lease
+    ns_cache_put(iface, iref_number, false, 0, gen);
     if (retiref != NULL) {
         *retiref = iref_number;
     }
@@ -108,6 +349,122 @@ out:
     return err;
 }
 
+/**
+ * \brief Resolves a batch of names with at most one RPC per full message
+ *
+ * Names found in the cache are not sent to the name server. Unlike
+ * nameservice_lookup() an unknown name is not an error.
+ *
+ * \param ifaces Names of interfaces (must not contain spaces)
+ * \param count Number of names
+ * \param irefs Returns the IREF of every name, 0 for unknown names. May be
+ *              NULL to only fill the cache for later lookups.
+ */
+errval_t nameservice_lookup_batch(const char **ifaces, size_t count,
+                                  iref_t *irefs)
+{
+    errval_t err = SYS_ERR_OK;
+
+    struct octopus_binding *r = get_octopus_binding();
+    if (r == NULL) {
+        return LIB_ERR_NAMESERVICE_NOT_BOUND;
+    }
+    if (count == 0) {
+        return SYS_ERR_OK;
+    }
+
+    const size_t max_len = octopus__get_records_call_names_MAX_ARGUMENT_SIZE;
+    char *names = malloc(max_len);
+    size_t *pending = malloc(count * sizeof(size_t));
+    struct octopus_get_records_response__rx_args *reply =
+            malloc(sizeof(*reply));
+    if (names == NULL || pending == NULL || reply == NULL) {
+        err = LIB_ERR_MALLOC_FAIL;
+        goto out;
+    }
+
+    size_t next = 0;
+    while (next < count) {
+        // collect misses until the request is full
+        size_t len = 0, npending = 0;
+        uint64_t gen = 0;
+        for (; next < count; next++) {
+            iref_t cached = 0;
+            bool watch;
+            uint64_t name_gen;
+            if (ns_cache_get(ifaces[next], &cached, &watch, &name_gen)) {
+                if (irefs != NULL) {
+                    irefs[next] = cached;
+                }
+                continue;
+            }
+
+            size_t name_len = strlen(ifaces[next]);
+            if (len + name_len + 2 > max_len) {
+                break;
+            }
+            memcpy(names + len, ifaces[next], name_len);
+            len += name_len;
+            names[len++] = ' ';
+            if (npending == 0) {
+                gen = name_gen;
+            }
+            pending[npending++] = next;
+        }
+        if (npending == 0) {
+            if (next < count) {
+                // a single name does not fit into a request
+                err = OCT_ERR_QUERY_SIZE;
+                goto out;
+            }
+            break;
+        }
+        names[len - 1] = '\0';
+
+        // the IDs of triggers would not be returned, lease the names only
+        err = r->rpc_tx_vtbl.get_records(r, names, NOP_TRIGGER,
+                                         reply->output, &reply->error_code);
+        if (err_is_fail(err)) {
+            goto out;
+        }
+        err = reply->error_code;
+        if (err_is_fail(err)) {
+            goto out;
+        }
+
+        // one line per requested name, empty if there is no record
+        char *line = reply->output;
+        for (size_t i = 0; i < npending; i++) {
+            char *end = strchr(line, '\n');
+            if (end == NULL) {
+                err = LIB_ERR_NAMESERVICE_INVALID_NAME;
+                goto out;
+            }
+            *end = '\0';
+
+            uint64_t iref_number = 0;
+            if (*line != '\0') {
+                err = oct_read(line, "_ { iref: %d }", &iref_number);
+                if (err_is_fail(err)) {
+                    iref_number = 0;
+                }
+                ns_cache_put(ifaces[pending[i]], iref_number, false, 0, gen);
+            }
+            if (irefs != NULL) {
+                irefs[pending[i]] = iref_number;
+            }
+            line = end + 1;
+        }
+    }
+    err = SYS_ERR_OK;
+
+out:
+    free(reply);
+    free(pending);
+    free(names);
+    return err;
+}
+
 /**
  * \brief Register with name service
  *
@@ -132,6 +489,9 @@ errval_t nameservice_register(const char *iface, iref_t iref)
     }
     snprintf(record, len+1, format, iface, iref);
 
+    // don't hand out a replaced IREF from our own cache
+    ns_cache_invalidate(iface, strlen(iface));
+
     octopus_trigger_id_t tid;
     errval_t error_code;
     err = r->rpc_tx_vtbl.set(r, record, 0, NOP_TRIGGER, 0, NULL, &tid, &error_code);
@@ -167,6 +527,7 @@ static void bind_continuation(void *st_arg, errval_t err,
         b->error_handler = error_handler;
 
         octopus_rpc_client_init(b);
+        b->rx_vtbl.trigger = ns_cache_trigger;
         set_octopus_binding(b);
     }
 
@@ -72,6 +72,109 @@ static errval_t ram_alloc_remote(struct capref *ret, uint8_t size_bits,
     return result;
 }
 
+/**
+ * \brief Serve an allocation from the prefetch cache of its size
+ *
+ * An empty cache is refilled with one mem.allocate_batch call, which leaves
+ * at most RAM_PREFETCH_MAXBYTES in the cache. Returns false if no batch could
+ * be requested, in which case the caller has to fall back to a single
+ * allocation.
+ */
+static bool ram_alloc_prefetched(struct capref *ret, uint8_t size_bits,
+                                 errval_t *reterr)
+{
+    struct ram_alloc_state *ram_alloc_state = get_ram_alloc_state();
+    struct ram_prefetch *pf =
+        &ram_alloc_state->prefetch[size_bits - RAM_PREFETCH_MINBITS];
+
+    thread_mutex_lock(&ram_alloc_state->ram_alloc_lock);
+
+    if (pf->count > 0) {
+        *ret = pf->caps[--pf->count];
+        thread_mutex_unlock(&ram_alloc_state->ram_alloc_lock);
+        *reterr = SYS_ERR_OK;
+        return true;
+    }
+
+    // Receiving the batch takes one slot per cap. If that could make the
+    // slot allocator grow (and call ram_alloc with the lock held), leave it
+    // to ram_alloc_remote, which knows how to deal with that.
+    struct slot_alloc_state *sas = get_slot_alloc_state();
+    struct slot_allocator *ca = (struct slot_allocator*)(&sas->defca);
+    if (ca->space <= RAM_ALLOC_BATCH_MAX + 1) {
+        thread_mutex_unlock(&ram_alloc_state->ram_alloc_lock);
+        return false;
+    }
+
+    struct capref caps[RAM_ALLOC_BATCH_MAX];
+    uint8_t allocated = 0;
+    uint8_t count = MIN(RAM_ALLOC_BATCH_MAX,
+                        1 + (RAM_PREFETCH_MAXBYTES >> size_bits));
+    errval_t err, result;
+
+    struct mem_binding *b = get_mem_client();
+    err = b->rpc_tx_vtbl.allocate_batch(b, size_bits, 0, 0, count,
+                                        &result, &allocated, &caps[0], &caps[1],
+                                        &caps[2], &caps[3], &caps[4], &caps[5],
+                                        &caps[6], &caps[7]);
+    if (err_is_ok(err) && err_is_ok(result)) {
+        assert(allocated > 0 && allocated <= count);
+        *ret = caps[0];
+        for (uint8_t i = allocated - 1; i > 0; i--) {
+            pf->caps[pf->count++] = caps[i];
+        }
+    }
+
+    thread_mutex_unlock(&ram_alloc_state->ram_alloc_lock);
+
+    *reterr = err_is_fail(err) ? err : result;
+    return true;
+}
+
+/**
+ * \brief Give the memory of all prefetched caps back to the mem_serv
+ *
+ * Deleting the last copy of a RAM cap returns it through the monitor.
+ */
+static void ram_release_prefetched(void)
+{
+    struct ram_alloc_state *ram_alloc_state = get_ram_alloc_state();
+    struct ram_prefetch prefetch[RAM_PREFETCH_MAXBITS - RAM_PREFETCH_MINBITS + 1];
+
+    thread_mutex_lock(&ram_alloc_state->ram_alloc_lock);
+    memcpy(prefetch, ram_alloc_state->prefetch, sizeof(prefetch));
+    memset(ram_alloc_state->prefetch, 0, sizeof(ram_alloc_state->prefetch));
+    thread_mutex_unlock(&ram_alloc_state->ram_alloc_lock);
+
+    for (int i = 0; i < RAM_PREFETCH_MAXBITS - RAM_PREFETCH_MINBITS + 1; i++) {
+        while (prefetch[i].count > 0) {
+            errval_t err = cap_destroy(prefetch[i].caps[--prefetch[i].count]);
+            if (err_is_fail(err)) {
+                DEBUG_ERR(err, "cap_destroy of prefetched RAM");
+            }
+        }
+    }
+}
+
+/* remote version of ram_alloc that batches small unconstrained allocations */
+static errval_t ram_alloc_remote_batched(struct capref *ret, uint8_t size_bits,
+                                         uint64_t minbase, uint64_t maxlimit)
+{
+    errval_t err;
+
+    if (!(minbase == 0 && maxlimit == 0 && size_bits >= RAM_PREFETCH_MINBITS
+          && size_bits <= RAM_PREFETCH_MAXBITS
+          && ram_alloc_prefetched(ret, size_bits, &err))) {
+        err = ram_alloc_remote(ret, size_bits, minbase, maxlimit);
+    }
+
+    // memory is short, don't sit on prefetched caps others could use
+    if (err_is_fail(err)) {
+        ram_release_prefetched();
+    }
+    return err;
+}
+
 
 void ram_set_affinity(uint64_t minbase, uint64_t maxlimit)
 {
@@ -191,10 +294,11 @@ void ram_alloc_init(void)
     ram_alloc_state->default_minbase  = 0;
     ram_alloc_state->default_maxlimit = 0;
     ram_alloc_state->base_capnum      = 0;
+    memset(ram_alloc_state->prefetch, 0, sizeof(ram_alloc_state->prefetch));
 }
 
 /**
- * \brief Set ram_alloc to the default ram_alloc_remote or to a given function
+ * \brief Set ram_alloc to the default remote allocator or to a given function
  *
  * If local_allocator is NULL, it will be initialized to the default
  * remote allocator.
@@ -224,7 +328,7 @@ errval_t ram_alloc_set(ram_alloc_func_t local_allocator)
     }
 
     if (err_is_ok(ram_alloc_state->mem_connect_err)) {
-        ram_alloc_state->ram_alloc_func = ram_alloc_remote;
+        ram_alloc_state->ram_alloc_func = ram_alloc_remote_batched;
     }
     return ram_alloc_state->mem_connect_err;
 }
@@ -7,7 +7,7 @@
  */
 
 /*
- * Copyright (c) 2008, 2009, 2010, ETH Zurich.
+ * Copyright (c) 2008, 2009, 2010, 2016, ETH Zurich.
  * All rights reserved.
  *
  * This file is distributed under the terms in the attached LICENSE file.
@@ -15,7 +15,9 @@
  * ETH Zurich D-INFK, Haldeneggsteig 4, CH-8092 Zurich. Attn: Systems Group.
  */
 
+#include <string.h>
 #include <barrelfish/barrelfish.h>
+#include <barrelfish/dispatch.h>
 #include <barrelfish/slab.h>
 #include <barrelfish/static_assert.h>
 
@@ -208,3 +210,334 @@ errval_t slab_default_refill(struct slab_allocator *slabs)
 {
     return slab_refill_pages(slabs, BASE_PAGE_SIZE);
 }
+
+/*
+ * Magazine layer ("slab cache")
+ *
+ * Free blocks are cached in magazines of SLAB_MAGAZINE_ROUNDS blocks, chained
+ * through their first word. Every dispatcher operates on the two magazines of
+ * its slot (loaded and previous) with the dispatcher disabled, so the common
+ * case never touches shared state. Full magazines are exchanged through the
+ * depot, a lock-free stack linked through the second word of each magazine's
+ * first block, and protected against ABA by a generation tag packed in the
+ * same 64-bit word. Only when the depot is empty (or overflowing) do we take
+ * the spinlock of the backing slab allocator.
+ */
+
+/// Maximum number of full magazines kept in the depot
+#define SLAB_DEPOT_MAX      (2 * SLAB_CACHE_SLOTS)
+
+#if UINTPTR_MAX == UINT64_MAX
+#define DEPOT_PTR_BITS      48
+#else
+#define DEPOT_PTR_BITS      32
+#endif
+#define DEPOT_PTR_MASK      ((UINT64_C(1) << DEPOT_PTR_BITS) - 1)
+
+static inline void *depot_ptr(uint64_t d)
+{
+    return (void *)(uintptr_t)(d & DEPOT_PTR_MASK);
+}
+
+static inline uint64_t depot_next(uint64_t d, void *ptr)
+{
+    uint64_t tag = (d >> DEPOT_PTR_BITS) + 1;
+    assert(((uintptr_t)ptr & ~DEPOT_PTR_MASK) == 0);
+    return (tag << DEPOT_PTR_BITS) | (uintptr_t)ptr;
+}
+
+static inline uint64_t depot_read(struct slab_cache *sc)
+{
+#if UINTPTR_MAX == UINT64_MAX
+    return sc->depot;
+#else
+    // avoid torn reads of the 64-bit word
+    return __sync_val_compare_and_swap(&sc->depot, 0, 0);
+#endif
+}
+
+/// Link word between magazines in the depot
+static inline void **mag_link(void *head)
+{
+    return &((void **)head)[1];
+}
+
+static void depot_push(struct slab_cache *sc, void *head)
+{
+    uint64_t old, new;
+    do {
+        old = depot_read(sc);
+        *mag_link(head) = depot_ptr(old);
+        new = depot_next(old, head);
+    } while (!__sync_bool_compare_and_swap(&sc->depot, old, new));
+    __sync_fetch_and_add(&sc->depot_mags, 1);
+    __sync_fetch_and_add(&sc->depot_puts, 1);
+}
+
+static void *depot_pop(struct slab_cache *sc)
+{
+    uint64_t old, new;
+    void *head;
+    do {
+        old = depot_read(sc);
+        head = depot_ptr(old);
+        if (head == NULL) {
+            return NULL;
+        }
+        // blocks are never unmapped, so this read is safe even if another
+        // dispatcher popped the magazine meanwhile (the tag catches that)
+        new = depot_next(old, *mag_link(head));
+    } while (!__sync_bool_compare_and_swap(&sc->depot, old, new));
+    __sync_fetch_and_sub(&sc->depot_mags, 1);
+    __sync_fetch_and_add(&sc->depot_gets, 1);
+    return head;
+}
+
+static inline struct slab_cache_slot *cache_slot(struct slab_cache *sc)
+{
+    return &sc->slots[disp_get_core_id() % SLAB_CACHE_SLOTS];
+}
+
+/// Takes up to a magazine worth of blocks from the backing allocator
+static void backend_fill(struct slab_cache *sc, struct slab_magazine *mag)
+{
+    acquire_spinlock(&sc->lock);
+    while (mag->rounds < SLAB_MAGAZINE_ROUNDS) {
+        void *block = slab_alloc(&sc->slabs);
+        if (block == NULL) {
+            break;
+        }
+        *(void **)block = mag->head;
+        mag->head = block;
+        mag->rounds++;
+    }
+    release_spinlock(&sc->lock);
+    if (mag->rounds > 0) {
+        __sync_fetch_and_add(&sc->slow_allocs, 1);
+    }
+}
+
+/// Returns a chain of blocks to the backing allocator
+static void backend_drain(struct slab_cache *sc, void *head)
+{
+    acquire_spinlock(&sc->lock);
+    while (head != NULL) {
+        void *next = *(void **)head;
+        slab_free(&sc->slabs, head);
+        head = next;
+    }
+    release_spinlock(&sc->lock);
+    __sync_fetch_and_add(&sc->slow_frees, 1);
+}
+
+/**
+ * \brief Initialise a new slab cache
+ *
+ * \param sc Pointer to slab cache instance, to be filled-in
+ * \param blocksize Size of blocks to be allocated by this cache
+ * \param refill_func Function to call when out of memory (or NULL). It is
+ *                    called without any lock held, and must add memory
+ *                    with #slab_cache_grow.
+ */
+void slab_cache_init(struct slab_cache *sc, size_t blocksize,
+                     slab_cache_refill_func_t refill_func)
+{
+    memset(sc, 0, sizeof(*sc));
+    // magazines in the depot use the first two words of a block
+    slab_init(&sc->slabs, MAX(blocksize, 2 * sizeof(void *)), NULL);
+    sc->refill_func = refill_func;
+}
+
+/**
+ * \brief Add memory (a new slab) to a slab cache
+ *
+ * \param sc Pointer to slab cache instance
+ * \param buf Pointer to start of memory region
+ * \param buflen Size of memory region (in bytes)
+ */
+void slab_cache_grow(struct slab_cache *sc, void *buf, size_t buflen)
+{
+    acquire_spinlock(&sc->lock);
+    slab_grow(&sc->slabs, buf, buflen);
+    release_spinlock(&sc->lock);
+}
+
+/**
+ * \brief Allocate a new block from the slab cache
+ *
+ * \param sc Pointer to slab cache instance
+ *
+ * \returns Pointer to block on success, NULL on error (out of memory)
+ */
+void *slab_cache_alloc(struct slab_cache *sc)
+{
+    for (;;) {
+        bool was_enabled;
+        dispatcher_handle_t handle = disp_try_disable(&was_enabled);
+        struct slab_cache_slot *slot = cache_slot(sc);
+        acquire_spinlock(&slot->lock);
+
+        if (slot->loaded.rounds == 0) {
+            if (slot->previous.rounds > 0) {
+                struct slab_magazine tmp = slot->loaded;
+                slot->loaded = slot->previous;
+                slot->previous = tmp;
+            } else {
+                void *head = depot_pop(sc);
+                if (head != NULL) {
+                    slot->loaded.head = head;
+                    slot->loaded.rounds = SLAB_MAGAZINE_ROUNDS;
+                } else {
+                    backend_fill(sc, &slot->loaded);
+                }
+            }
+        }
+
+        void *block = NULL;
+        if (slot->loaded.rounds > 0) {
+            block = slot->loaded.head;
+            slot->loaded.head = *(void **)block;
+            slot->loaded.rounds--;
+            slot->allocs++;
+        }
+
+        release_spinlock(&slot->lock);
+        if (was_enabled) {
+            disp_enable(handle);
+        }
+
+        if (block != NULL) {
+            return block;
+        }
+
+        /* out of memory. try refill function if we have one */
+        if (sc->refill_func == NULL) {
+            return NULL;
+        }
+        errval_t err = sc->refill_func(sc);
+        __sync_fetch_and_add(&sc->refills, 1);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "slab cache refill_func failed");
+            return NULL;
+        }
+    }
+}
+
+/**
+ * \brief Free a block to the slab cache
+ *
+ * \param sc Pointer to slab cache instance
+ * \param block Pointer to block previously returned by #slab_cache_alloc
+ */
+void slab_cache_free(struct slab_cache *sc, void *block)
+{
+    if (block == NULL) {
+        return;
+    }
+
+    void *drain = NULL;
+
+    bool was_enabled;
+    dispatcher_handle_t handle = disp_try_disable(&was_enabled);
+    struct slab_cache_slot *slot = cache_slot(sc);
+    acquire_spinlock(&slot->lock);
+
+    if (slot->loaded.rounds == SLAB_MAGAZINE_ROUNDS) {
+        if (slot->previous.rounds == SLAB_MAGAZINE_ROUNDS) {
+            if (sc->depot_mags < SLAB_DEPOT_MAX) {
+                depot_push(sc, slot->previous.head);
+            } else {
+                drain = slot->previous.head;
+            }
+            slot->previous.head = NULL;
+            slot->previous.rounds = 0;
+        }
+        struct slab_magazine tmp = slot->loaded;
+        slot->loaded = slot->previous;
+        slot->previous = tmp;
+    }
+
+    *(void **)block = slot->loaded.head;
+    slot->loaded.head = block;
+    slot->loaded.rounds++;
+    slot->frees++;
+
+    release_spinlock(&slot->lock);
+    if (was_enabled) {
+        disp_enable(handle);
+    }
+
+    if (drain != NULL) {
+        backend_drain(sc, drain);
+    }
+}
+
+/**
+ * \brief Returns the count of free blocks available to the caller
+ *
+ * This counts the blocks in the backing allocator, the depot and the
+ * magazines of the calling dispatcher, but not blocks cached by other
+ * dispatchers, which cannot be allocated from here without a refill.
+ *
+ * \param sc Pointer to slab cache instance
+ *
+ * \returns Free block count
+ */
+size_t slab_cache_freecount(struct slab_cache *sc)
+{
+    acquire_spinlock(&sc->lock);
+    size_t ret = slab_freecount(&sc->slabs);
+    release_spinlock(&sc->lock);
+
+    ret += sc->depot_mags * SLAB_MAGAZINE_ROUNDS;
+
+    bool was_enabled;
+    dispatcher_handle_t handle = disp_try_disable(&was_enabled);
+    struct slab_cache_slot *slot = cache_slot(sc);
+    acquire_spinlock(&slot->lock);
+    ret += slot->loaded.rounds + slot->previous.rounds;
+    release_spinlock(&slot->lock);
+    if (was_enabled) {
+        disp_enable(handle);
+    }
+
+    return ret;
+}
+
+/**
+ * \brief Returns allocation and fragmentation statistics of a slab cache
+ *
+ * The counters are sampled without stopping concurrent users and are thus
+ * only approximate.
+ *
+ * \param sc Pointer to slab cache instance
+ * \param st Statistics, to be filled-in
+ */
+void slab_cache_get_stats(struct slab_cache *sc, struct slab_cache_stats *st)
+{
+    memset(st, 0, sizeof(*st));
+
+    for (int i = 0; i < SLAB_CACHE_SLOTS; i++) {
+        st->allocs += sc->slots[i].allocs;
+        st->frees += sc->slots[i].frees;
+        st->cached_blocks += sc->slots[i].loaded.rounds
+                             + sc->slots[i].previous.rounds;
+    }
+    st->cached_blocks += sc->depot_mags * SLAB_MAGAZINE_ROUNDS;
+    st->depot_gets = sc->depot_gets;
+    st->depot_puts = sc->depot_puts;
+    st->slow_allocs = sc->slow_allocs;
+    st->slow_frees = sc->slow_frees;
+    st->refills = sc->refills;
+
+    acquire_spinlock(&sc->lock);
+    for (struct slab_head *sh = sc->slabs.slabs; sh != NULL; sh = sh->next) {
+        st->slabs++;
+        st->total_blocks += sh->total;
+        st->free_blocks += sh->free;
+        if (sh->free != 0 && sh->free != sh->total) {
+            st->partial_slabs++;
+        }
+    }
+    release_spinlock(&sc->lock);
+}
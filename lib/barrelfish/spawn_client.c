@@ -414,6 +414,13 @@ errval_t spawn_program_on_all_cores(bool same_core, const char *path,
         goto out;
     }
 
+    // resolve all spawnds in one round trip, bind_client() finds them cached
+    err = nameservice_lookup_batch((const char **)names, count, NULL);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "nameservice_lookup_batch");
+        err = SYS_ERR_OK;
+    }
+
     for (size_t c = 0; c < count; c++) {
         coreid_t coreid;
         int ret = sscanf(names[c], "spawn.%hhu", &coreid);
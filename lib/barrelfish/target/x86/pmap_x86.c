@@ -13,10 +13,106 @@
  * ETH Zurich D-INFK, Haldeneggsteig 4, CH-8092 Zurich. Attn: Systems Group.
  */
 
+#include <string.h>
 #include <barrelfish/barrelfish.h>
 #include <barrelfish/pmap.h>
 #include "target/x86/pmap_x86.h"
 
+/// Number of page table entries covered by a child
+static inline size_t vnode_span(struct vnode *n)
+{
+    return n->is_vnode ? 1 : n->u.frame.pte_count;
+}
+
+/// Point all entries covered by `n` in the dense table of `root` at `val`
+static void index_set(struct vnode *root, struct vnode *n, struct vnode *val)
+{
+    size_t end = MIN(n->entry + vnode_span(n), PTABLE_SIZE);
+    for (size_t i = n->entry; i < end; i++) {
+        assert(root->u.vnode.index->child[i] == (val ? NULL : n));
+        root->u.vnode.index->child[i] = val;
+    }
+}
+
+/// Switch `root` from a list of children to a dense child table
+static void index_promote(struct pmap_x86 *pmap, struct vnode *root)
+{
+    struct vnode_index *index = slab_cache_alloc(&pmap->index_slab);
+    if (index == NULL) {
+        // no table available: stay in compact mode, ask for a refill
+        pmap->index_wanted = true;
+        return;
+    }
+    memset(index, 0, sizeof(*index));
+    root->u.vnode.index = index;
+
+    for (struct vnode *n = root->u.vnode.children; n != NULL; n = n->next) {
+        index_set(root, n, n);
+    }
+    root->u.vnode.children = NULL;
+}
+
+/// Switch `root` from a dense child table back to a list of children
+static void index_demote(struct pmap_x86 *pmap, struct vnode *root)
+{
+    struct vnode_index *index = root->u.vnode.index;
+    struct vnode *head = NULL;
+
+    // build the list in ascending order of entries
+    for (int i = PTABLE_SIZE - 1; i >= 0; i--) {
+        struct vnode *n = index->child[i];
+        if (n != NULL && n->entry == i) {
+            n->next = head;
+            head = n;
+        }
+    }
+
+    root->u.vnode.children = head;
+    root->u.vnode.index = NULL;
+    slab_cache_free(&pmap->index_slab, index);
+}
+
+struct vnode *next_vnode(struct vnode *root, struct vnode *prev)
+{
+    assert(root != NULL);
+    assert(root->is_vnode);
+
+    struct vnode_index *index = root->u.vnode.index;
+    if (index == NULL) {
+        return prev == NULL ? root->u.vnode.children : prev->next;
+    }
+
+    // children never overlap, so the first used entry after prev starts one
+    for (size_t i = prev == NULL ? 0 : prev->entry + vnode_span(prev);
+         i < PTABLE_SIZE; i++) {
+        if (index->child[i] != NULL) {
+            assert(index->child[i]->entry == i);
+            return index->child[i];
+        }
+    }
+    return NULL;
+}
+
+void add_vnode(struct pmap_x86 *pmap, struct vnode *root, struct vnode *item)
+{
+    assert(root->is_vnode);
+    assert(item->entry < PTABLE_SIZE);
+
+    if (root->u.vnode.index == NULL &&
+        root->u.vnode.nchildren >= VNODE_COMPACT_MAX) {
+        index_promote(pmap, root);
+    }
+
+    if (root->u.vnode.index != NULL) {
+        item->next = NULL;
+        index_set(root, item, item);
+    } else {
+        item->next = root->u.vnode.children;
+        root->u.vnode.children = item;
+    }
+    root->u.vnode.nchildren++;
+}
+
 // this should work for x86_64 and x86_32.
 bool has_vnode(struct vnode *root, uint32_t entry, size_t len,
                bool only_pages)
@@ -29,13 +125,32 @@ bool has_vnode(struct vnode *root, uint32_t entry, size_t len,
 
     // region we check [entry .. end_entry)
 
+    if (root->u.vnode.index != NULL) {
+        // every entry covered by a child points to it
+        for (uint32_t i = entry; i < MIN(end_entry, PTABLE_SIZE); i++) {
+            n = root->u.vnode.index->child[i];
+            if (n == NULL) {
+                continue;
+            }
+            if (!n->is_vnode || !only_pages ||
+                has_vnode(n, 0, PTABLE_SIZE, true)) {
+                return true;
+            }
+            // page table without pages: skip to next entry
+        }
+        return false;
+    }
+
     for (n = root->u.vnode.children; n; n = n->next) {
         // n is page table, we need to check if it's anywhere inside the
         // region to check [entry .. end_entry)
         // this amounts to n->entry == entry for len = 1
         if (n->is_vnode && n->entry >= entry && n->entry < end_entry) {
             if (only_pages) {
-                return has_vnode(n, 0, PTABLE_SIZE, true);
+                if (has_vnode(n, 0, PTABLE_SIZE, true)) {
+                    return true;
+                }
+                continue;
             }
 #ifdef LIBBARRELFISH_DEBUG_PMAP
             debug_printf("1: found page table inside our region\n");
@@ -92,6 +207,11 @@ struct vnode *find_vnode(struct vnode *root, uint16_t entry)
     assert(root->is_vnode);
     struct vnode *n;
 
+    if (root->u.vnode.index != NULL) {
+        assert(entry < PTABLE_SIZE);
+        return root->u.vnode.index->child[entry];
+    }
+
     for(n = root->u.vnode.children; n != NULL; n = n->next) {
         if (!n->is_vnode) {
             // check whether entry is inside a large region
@@ -118,6 +238,12 @@ bool inside_region(struct vnode *root, uint32_t entry, uint32_t npages)
 
     struct vnode *n;
 
+    if (root->u.vnode.index != NULL) {
+        n = entry < PTABLE_SIZE ? root->u.vnode.index->child[entry] : NULL;
+        return n != NULL && !n->is_vnode &&
+               entry + npages <= n->entry + n->u.frame.pte_count;
+    }
+
     for (n = root->u.vnode.children; n; n = n->next) {
         if (!n->is_vnode) {
             uint16_t end = n->entry + n->u.frame.pte_count;
@@ -130,20 +256,32 @@ bool inside_region(struct vnode *root, uint32_t entry, uint32_t npages)
     return false;
 }
 
-void remove_vnode(struct vnode *root, struct vnode *item)
+void remove_vnode(struct pmap_x86 *pmap, struct vnode *root,
+                  struct vnode *item)
 {
     assert(root->is_vnode);
+    assert(root->u.vnode.nchildren > 0);
+
+    if (root->u.vnode.index != NULL) {
+        index_set(root, item, NULL);
+        root->u.vnode.nchildren--;
+        if (root->u.vnode.nchildren <= VNODE_COMPACT_MAX / 2) {
+            index_demote(pmap, root);
+        }
+        return;
+    }
+
     struct vnode *walk = root->u.vnode.children;
     struct vnode *prev = NULL;
     while (walk) {
         if (walk == item) {
             if (prev) {
                 prev->next = walk->next;
-                return;
             } else {
                 root->u.vnode.children = walk->next;
-                return;
             }
+            root->u.vnode.nchildren--;
+            return;
         }
         prev = walk;
         walk = walk->next;
@@ -160,7 +298,7 @@ errval_t alloc_vnode(struct pmap_x86 *pmap, struct vnode *root,
 {
     errval_t err;
 
-    struct vnode *newvnode = slab_alloc(&pmap->slab);
+    struct vnode *newvnode = slab_cache_alloc(&pmap->slab);
     if (newvnode == NULL) {
         return LIB_ERR_SLAB_ALLOC_FAIL;
     }
@@ -205,9 +343,10 @@ errval_t alloc_vnode(struct pmap_x86 *pmap, struct vnode *root,
     // The VNode meta data
     newvnode->is_vnode  = true;
     newvnode->entry     = entry;
-    newvnode->next      = root->u.vnode.children;
-    root->u.vnode.children = newvnode;
-    newvnode->u.vnode.children = NULL;
+    newvnode->u.vnode.children  = NULL;
+    newvnode->u.vnode.index     = NULL;
+    newvnode->u.vnode.nchildren = 0;
+    add_vnode(pmap, root, newvnode);
 
     *retvnode = newvnode;
     return SYS_ERR_OK;
@@ -218,7 +357,9 @@ void remove_empty_vnodes(struct pmap_x86 *pmap, struct vnode *root,
 {
     errval_t err;
     uint32_t end_entry = entry + len;
-    for (struct vnode *n = root->u.vnode.children; n; n = n->next) {
+    struct vnode *next;
+    for (struct vnode *n = next_vnode(root, NULL); n; n = next) {
+        next = next_vnode(root, n);
         if (n->entry >= entry && n->entry < end_entry) {
             // sanity check and skip leaf entries
             if (!n->is_vnode) {
@@ -227,7 +368,7 @@ void remove_empty_vnodes(struct pmap_x86 *pmap, struct vnode *root,
             // here we know that all vnodes we're interested in are
             // page tables
             assert(n->is_vnode);
-            if (n->u.vnode.children) {
+            if (n->u.vnode.nchildren > 0) {
                 remove_empty_vnodes(pmap, n, 0, PTABLE_SIZE);
             }
 
@@ -272,8 +413,11 @@ void remove_empty_vnodes(struct pmap_x86 *pmap, struct vnode *root,
             }
 
             // remove vnode from list
-            remove_vnode(root, n);
-            slab_free(&pmap->slab, n);
+            remove_vnode(pmap, root, n);
+            if (n->u.vnode.index != NULL) {
+                slab_cache_free(&pmap->index_slab, n->u.vnode.index);
+            }
+            slab_cache_free(&pmap->slab, n);
         }
     }
 }
@@ -316,7 +460,8 @@ static errval_t serialise_tree(int depth, struct vnode *v,
     };
 
     // depth-first walk
-    for (struct vnode *c = v->u.vnode.children; c != NULL; c = c->next) {
+    for (struct vnode *c = next_vnode(v, NULL); c != NULL;
+         c = next_vnode(v, c)) {
         err = serialise_tree(depth + 1, c, out, outlen, outpos);
         if (err_is_fail(err)) {
             return err;
@@ -371,7 +516,7 @@ static errval_t deserialise_tree(struct pmap *pmap, struct serial_entry **in,
         }
 
         // allocate storage for the new vnode
-        struct vnode *n = slab_alloc(&pmapx->slab);
+        struct vnode *n = slab_cache_alloc(&pmapx->slab);
         assert(n != NULL);
 
         // populate it and append to parent's list of children
@@ -381,8 +526,9 @@ static errval_t deserialise_tree(struct pmap *pmap, struct serial_entry **in,
         n->u.vnode.cap.slot      = (*in)->slot;
         n->u.vnode.invokable     = n->u.vnode.cap;
         n->u.vnode.children      = NULL;
-        n->next                  = parent->u.vnode.children;
-        parent->u.vnode.children = n;
+        n->u.vnode.index         = NULL;
+        n->u.vnode.nchildren     = 0;
+        add_vnode(pmapx, parent, n);
 
         (*in)++;
         (*inlen)--;
@@ -31,6 +31,9 @@
 #include "target/x86/pmap_x86.h"
 
 
+// Minimum amount of memory added to the slab allocator by refill_slabs
+#define SLAB_REFILL_BULK_BYTES  (16 * BASE_PAGE_SIZE)
+
 // Location and size of virtual address space reserved for mapping
 // frames backing refill_slabs
 #define META_DATA_RESERVED_BASE ((lvaddr_t)1UL*1024*1024*1024)
@@ -191,18 +194,19 @@ static errval_t do_single_map(struct pmap_x86 *pmap, genvaddr_t vaddr,
     }
 
     // setup userspace mapping
-    struct vnode *page = slab_alloc(&pmap->slab);
+    struct vnode *page = slab_cache_alloc(&pmap->slab);
     assert(page);
     page->is_vnode = false;
     page->entry = base;
-    page->next  = ptable->u.vnode.children;
-    ptable->u.vnode.children = page;
     page->u.frame.cap = frame;
     page->u.frame.offset = offset;
     page->u.frame.flags = flags;
     page->u.frame.pte_count = pte_count;
+    add_vnode(pmap, ptable, page);
 
-    err = pmap->p.slot_alloc->alloc(pmap->p.slot_alloc, &page->mapping);
+    struct slot_allocator *mapping_alloc = pmap->p.mapping_slot_alloc
+        ? pmap->p.mapping_slot_alloc : pmap->p.slot_alloc;
+    err = mapping_alloc->alloc(mapping_alloc, &page->mapping);
     if (err_is_fail(err)) {
         return err_push(err, LIB_ERR_SLOT_ALLOC);
     }
@@ -344,10 +348,16 @@ static errval_t refill_slabs(struct pmap_x86 *pmap, size_t request)
     errval_t err;
 
     /* Keep looping till we have #request slabs */
-    while (slab_freecount(&pmap->slab) < request) {
+    while (slab_cache_freecount(&pmap->slab) < request) {
         // Amount of bytes required for #request
-        size_t bytes = SLAB_STATIC_SIZE(request - slab_freecount(&pmap->slab),
-                                        sizeof(struct vnode));
+        size_t free = slab_cache_freecount(&pmap->slab);
+        size_t bytes = SLAB_STATIC_SIZE(request - free, sizeof(struct vnode));
+
+        /* Refill in bulk, unless mapping the bigger chunk needs a recursion */
+        if (bytes < SLAB_REFILL_BULK_BYTES &&
+            free >= max_slabs_for_mapping(SLAB_REFILL_BULK_BYTES)) {
+            bytes = SLAB_REFILL_BULK_BYTES;
+        }
 
         /* Get a frame of that size */
         struct capref cap;
@@ -358,7 +368,7 @@ static errval_t refill_slabs(struct pmap_x86 *pmap, size_t request)
 
         /* If we do not have enough slabs to map the frame in, recurse */
         size_t required_slabs_for_frame = max_slabs_for_mapping(bytes);
-        if (slab_freecount(&pmap->slab) < required_slabs_for_frame) {
+        if (slab_cache_freecount(&pmap->slab) < required_slabs_for_frame) {
             // If we recurse, we require more slabs than to map a single page
             assert(required_slabs_for_frame > 4);
 
@@ -382,7 +392,7 @@ static errval_t refill_slabs(struct pmap_x86 *pmap, size_t request)
 
         /* Grow the slab */
         lvaddr_t buf = vspace_genvaddr_to_lvaddr(genvaddr);
-        slab_grow(&pmap->slab, (void*)buf, bytes);        
+        slab_cache_grow(&pmap->slab, (void*)buf, bytes);        
     }
 
     return SYS_ERR_OK;
@@ -432,7 +442,7 @@ static errval_t map(struct pmap *pmap, genvaddr_t vaddr, struct capref frame,
     }
 
     // Refill slab allocator if necessary
-    size_t slabs_free = slab_freecount(&x86->slab);
+    size_t slabs_free = slab_cache_freecount(&x86->slab);
     max_slabs += 4; // minimum amount required to map a page
     if (slabs_free < max_slabs) {
         struct pmap *mypmap = get_current_pmap();
@@ -448,7 +458,7 @@ static errval_t map(struct pmap *pmap, genvaddr_t vaddr, struct capref frame,
             if (!buf) {
                 return LIB_ERR_MALLOC_FAIL;
             }
-            slab_grow(&x86->slab, buf, bytes);
+            slab_cache_grow(&x86->slab, buf, bytes);
         }
     }
 
@@ -515,12 +525,14 @@ static errval_t do_single_unmap(struct pmap_x86 *pmap, genvaddr_t vaddr,
             if (err_is_fail(err)) {
                 return err_push(err, LIB_ERR_CAP_DELETE);
             }
-            err = pmap->p.slot_alloc->free(pmap->p.slot_alloc, page->mapping);
+            struct slot_allocator *mapping_alloc = pmap->p.mapping_slot_alloc
+                ? pmap->p.mapping_slot_alloc : pmap->p.slot_alloc;
+            err = mapping_alloc->free(mapping_alloc, page->mapping);
             if (err_is_fail(err)) {
                 return err_push(err, LIB_ERR_SLOT_FREE);
             }
-            remove_vnode(pt, page);
-            slab_free(&pmap->slab, page);
+            remove_vnode(pmap, pt, page);
+            slab_cache_free(&pmap->slab, page);
         }
         else {
             printf("couldn't find vnode\n");
@@ -797,14 +809,17 @@ static errval_t dump(struct pmap *pmap, struct pmap_dump_info *buf, size_t bufle
     // iterate over pdpt entries
     size_t pdir_index;
 #if CONFIG_PAE
-    for (pdir = pdpt->u.vnode.children; pdir != NULL; pdir = pdir->next) {
+    for (pdir = next_vnode(pdpt, NULL); pdir != NULL;
+         pdir = next_vnode(pdpt, pdir)) {
         pdpt_index = pdir->entry;
         // iterate over pdir entries
 #endif
-        for (pt = pdir->u.vnode.children; pt != NULL; pt = pt->next) {
+        for (pt = next_vnode(pdir, NULL); pt != NULL;
+             pt = next_vnode(pdir, pt)) {
             pdir_index = pt->entry;
             // iterate over pt entries
-            for (frame = pt->u.vnode.children; frame != NULL; frame = frame->next) {
+            for (frame = next_vnode(pt, NULL); frame != NULL;
+                 frame = next_vnode(pt, frame)) {
                 if (*items_written < buflen) {
 #if CONFIG_PAE
                     buf_->pdpt_index = pdpt_index;
@@ -833,7 +848,7 @@ static errval_t determine_addr_raw(struct pmap *pmap, size_t size,
 {
     struct pmap_x86 *x86 = (struct pmap_x86 *)pmap;
 
-    struct vnode *walk_pdir = x86->root.u.vnode.children;
+    struct vnode *walk_pdir = next_vnode(&x86->root, NULL);
     assert(walk_pdir != NULL); // assume there's always at least one existing entry
 
     if (alignment == 0) {
@@ -855,7 +870,7 @@ static errval_t determine_addr_raw(struct pmap *pmap, size_t size,
     while (walk_pdir) {
         assert(walk_pdir->is_vnode);
         f[walk_pdir->entry] = false;
-        walk_pdir = walk_pdir->next;
+        walk_pdir = next_vnode(&x86->root, walk_pdir);
     }
     genvaddr_t first_free = 384;
     // XXX: breaks for PAE
@@ -913,15 +928,23 @@ errval_t pmap_x86_32_init(struct pmap *pmap, struct vspace *vspace,
     } else { /* use default allocator for this dispatcher */
         pmap->slot_alloc = get_default_slot_allocator();
     }
+    pmap->mapping_slot_alloc = NULL;
 
     /* x86 specific portion */
-    slab_init(&x86->slab, sizeof(struct vnode), NULL);
-    slab_grow(&x86->slab, x86->slab_buffer,
-              sizeof(x86->slab_buffer));
+    slab_cache_init(&x86->slab, sizeof(struct vnode), NULL);
+    slab_cache_grow(&x86->slab, x86->slab_buffer,
+                    sizeof(x86->slab_buffer));
+    // XXX: the reserved metadata region is too small to also hold dense
+    // child tables, so page tables always stay in compact (list) mode
+    slab_cache_init(&x86->index_slab, sizeof(struct vnode_index), NULL);
+    x86->index_wanted = false;
+    x86->index_bytes = 0;
     x86->refill_slabs = min_refill_slabs;
 
     x86->root.u.vnode.cap       = vnode;
     x86->root.u.vnode.children  = NULL;
+    x86->root.u.vnode.index     = NULL;
+    x86->root.u.vnode.nchildren = 0;
     x86->root.is_vnode  = true;
     x86->root.next      = NULL;
 
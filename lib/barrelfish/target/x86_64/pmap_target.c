@@ -33,11 +33,17 @@
 // Size of virtual region mapped by a single PML4 entry
 #define PML4_MAPPING_SIZE ((genvaddr_t)512*512*512*BASE_PAGE_SIZE)
 
+// Minimum amount of memory added to the slab allocator by refill_slabs
+#define SLAB_REFILL_BULK_BYTES  (16 * BASE_PAGE_SIZE)
+
 // Location and size of virtual address space reserved for mapping
 // frames backing refill_slabs
 #define META_DATA_RESERVED_BASE (PML4_MAPPING_SIZE * (disp_get_core_id() + 1))
 #define META_DATA_RESERVED_SIZE (X86_64_BASE_PAGE_SIZE * 80000)
 
+// Part of the reserved space that may back dense child tables
+#define INDEX_RESERVED_MAX      (META_DATA_RESERVED_SIZE / 16)
+
 /**
  * \brief Translate generic vregion flags to architecture specific pmap flags
  */
@@ -275,18 +281,19 @@ static errval_t do_single_map(struct pmap_x86 *pmap, genvaddr_t vaddr,
     }
 
     // setup userspace mapping
-    struct vnode *page = slab_alloc(&pmap->slab);
+    struct vnode *page = slab_cache_alloc(&pmap->slab);
     assert(page);
     page->is_vnode = false;
     page->entry = table_base;
-    page->next  = ptable->u.vnode.children;
-    ptable->u.vnode.children = page;
     page->u.frame.cap = frame;
     page->u.frame.offset = offset;
     page->u.frame.flags = flags;
     page->u.frame.pte_count = pte_count;
+    add_vnode(pmap, ptable, page);
 
-    err = pmap->p.slot_alloc->alloc(pmap->p.slot_alloc, &page->mapping);
+    struct slot_allocator *mapping_alloc = pmap->p.mapping_slot_alloc
+        ? pmap->p.mapping_slot_alloc : pmap->p.slot_alloc;
+    err = mapping_alloc->alloc(mapping_alloc, &page->mapping);
     if (err_is_fail(err)) {
         return err_push(err, LIB_ERR_SLOT_ALLOC);
     }
@@ -492,10 +499,16 @@ static errval_t refill_slabs(struct pmap_x86 *pmap, size_t request)
     errval_t err;
 
     /* Keep looping till we have #request slabs */
-    while (slab_freecount(&pmap->slab) < request) {
+    while (slab_cache_freecount(&pmap->slab) < request) {
         // Amount of bytes required for #request
-        size_t bytes = SLAB_STATIC_SIZE(request - slab_freecount(&pmap->slab),
-                                        sizeof(struct vnode));
+        size_t free = slab_cache_freecount(&pmap->slab);
+        size_t bytes = SLAB_STATIC_SIZE(request - free, sizeof(struct vnode));
+
+        /* Refill in bulk, unless mapping the bigger chunk needs a recursion */
+        if (bytes < SLAB_REFILL_BULK_BYTES &&
+            free >= max_slabs_for_mapping(SLAB_REFILL_BULK_BYTES)) {
+            bytes = SLAB_REFILL_BULK_BYTES;
+        }
 
         /* Get a frame of that size */
         struct capref cap;
@@ -506,7 +519,7 @@ static errval_t refill_slabs(struct pmap_x86 *pmap, size_t request)
 
         /* If we do not have enough slabs to map the frame in, recurse */
         size_t required_slabs_for_frame = max_slabs_for_mapping(bytes);
-        if (slab_freecount(&pmap->slab) < required_slabs_for_frame) {
+        if (slab_cache_freecount(&pmap->slab) < required_slabs_for_frame) {
             // If we recurse, we require more slabs than to map a single page
             assert(required_slabs_for_frame > 4);
 
@@ -530,7 +543,7 @@ static errval_t refill_slabs(struct pmap_x86 *pmap, size_t request)
 
         /* Grow the slab */
         lvaddr_t buf = vspace_genvaddr_to_lvaddr(genvaddr);
-        slab_grow(&pmap->slab, (void*)buf, bytes);
+        slab_cache_grow(&pmap->slab, (void*)buf, bytes);
     }
 
     return SYS_ERR_OK;
@@ -542,6 +555,59 @@ static errval_t min_refill_slabs(struct pmap_x86 *pmap)
     return refill_slabs(pmap, 5);
 }
 
+/**
+ * \brief Refill dense child tables used for crowded page tables
+ *
+ * \param pmap     The pmap object to refill in
+ *
+ * Called once a page table crossed VNODE_COMPACT_MAX without a table being
+ * available. Uses the same reserved address space as refill_slabs(), but at
+ * most INDEX_RESERVED_MAX of it. Page tables fall back to a list of children
+ * when no table is available, so this does not fail once that is used up.
+ */
+static errval_t refill_index_slabs(struct pmap_x86 *pmap)
+{
+    errval_t err;
+    size_t bytes = SLAB_REFILL_BULK_BYTES;
+
+    pmap->index_wanted = false;
+    if (pmap->index_bytes + bytes > INDEX_RESERVED_MAX) {
+        // leave the rest of the region for vnodes
+        return SYS_ERR_OK;
+    }
+
+    /* Make sure we have enough slabs to map the tables */
+    err = refill_slabs(pmap, max_slabs_for_mapping(bytes) + 5);
+    if (err_is_fail(err)) {
+        return err_push(err, LIB_ERR_SLAB_REFILL);
+    }
+
+    struct capref cap;
+    err = frame_alloc(&cap, bytes, &bytes);
+    if (err_is_fail(err)) {
+        return err_push(err, LIB_ERR_FRAME_ALLOC);
+    }
+
+    genvaddr_t genvaddr = pmap->vregion_offset;
+    assert(genvaddr + bytes < vregion_get_base_addr(&pmap->vregion) +
+           vregion_get_size(&pmap->vregion));
+
+    err = do_map(pmap, genvaddr, cap, 0, bytes,
+                 VREGION_FLAGS_READ_WRITE, NULL, NULL);
+    if (err_is_fail(err)) {
+        cap_destroy(cap);
+        return err_push(err, LIB_ERR_PMAP_DO_MAP);
+    }
+    // only claim the range once it is mapped, a failed map leaves it free
+    pmap->vregion_offset += (genvaddr_t)bytes;
+    pmap->index_bytes += bytes;
+
+    lvaddr_t buf = vspace_genvaddr_to_lvaddr(genvaddr);
+    slab_cache_grow(&pmap->index_slab, (void*)buf, bytes);
+
+    return SYS_ERR_OK;
+}
+
 /**
  * \brief Create page mappings
  *
@@ -598,8 +664,16 @@ static errval_t map(struct pmap *pmap, genvaddr_t vaddr, struct capref frame,
         max_slabs = max_slabs_for_mapping(size);
     }
 
+    // A page table went without a dense child table, get some for it
+    if (x86->index_wanted && pmap == get_current_pmap()) {
+        err = refill_index_slabs(x86);
+        if (err_is_fail(err)) {
+            return err_push(err, LIB_ERR_SLAB_REFILL);
+        }
+    }
+
     // Refill slab allocator if necessary
-    size_t slabs_free = slab_freecount(&x86->slab);
+    size_t slabs_free = slab_cache_freecount(&x86->slab);
 
     max_slabs += 5; // minimum amount required to map a page
     if (slabs_free < max_slabs) {
@@ -616,7 +690,7 @@ static errval_t map(struct pmap *pmap, genvaddr_t vaddr, struct capref frame,
             if (!buf) {
                 return LIB_ERR_MALLOC_FAIL;
             }
-            slab_grow(&x86->slab, buf, bytes);
+            slab_cache_grow(&x86->slab, buf, bytes);
         }
     }
 
@@ -714,13 +788,15 @@ static errval_t do_single_unmap(struct pmap_x86 *pmap, genvaddr_t vaddr,
         if (err_is_fail(err)) {
             return err_push(err, LIB_ERR_CAP_DELETE);
         }
-        err = pmap->p.slot_alloc->free(pmap->p.slot_alloc, info.page->mapping);
+        struct slot_allocator *mapping_alloc = pmap->p.mapping_slot_alloc
+            ? pmap->p.mapping_slot_alloc : pmap->p.slot_alloc;
+        err = mapping_alloc->free(mapping_alloc, info.page->mapping);
         if (err_is_fail(err)) {
             return err_push(err, LIB_ERR_SLOT_FREE);
         }
         // Free up the resources
-        remove_vnode(info.page_table, info.page);
-        slab_free(&pmap->slab, info.page);
+        remove_vnode(pmap, info.page_table, info.page);
+        slab_cache_free(&pmap->slab, info.page);
     }
 
     return SYS_ERR_OK;
@@ -987,16 +1063,20 @@ static errval_t dump(struct pmap *pmap, struct pmap_dump_info *buf, size_t bufle
 
     // iterate over PML4 entries
     size_t pml4_index, pdpt_index, pdir_index;
-    for (pdpt = pml4->u.vnode.children; pdpt != NULL; pdpt = pdpt->next) {
+    for (pdpt = next_vnode(pml4, NULL); pdpt != NULL;
+         pdpt = next_vnode(pml4, pdpt)) {
         pml4_index = pdpt->entry;
         // iterate over pdpt entries
-        for (pdir = pdpt->u.vnode.children; pdir != NULL; pdir = pdir->next) {
+        for (pdir = next_vnode(pdpt, NULL); pdir != NULL;
+             pdir = next_vnode(pdpt, pdir)) {
             pdpt_index = pdir->entry;
             // iterate over pdir entries
-            for (pt = pdir->u.vnode.children; pt != NULL; pt = pt->next) {
+            for (pt = next_vnode(pdir, NULL); pt != NULL;
+                 pt = next_vnode(pdir, pt)) {
                 pdir_index = pt->entry;
                 // iterate over pt entries
-                for (frame = pt->u.vnode.children; frame != NULL; frame = frame->next) {
+                for (frame = next_vnode(pt, NULL); frame != NULL;
+                     frame = next_vnode(pt, frame)) {
                     if (*items_written < buflen) {
                         buf_->pml4_index = pml4_index;
                         buf_->pdpt_index = pdpt_index;
@@ -1020,7 +1100,7 @@ static errval_t determine_addr_raw(struct pmap *pmap, size_t size,
 {
     struct pmap_x86 *x86 = (struct pmap_x86 *)pmap;
 
-    struct vnode *walk_pml4 = x86->root.u.vnode.children;
+    struct vnode *walk_pml4 = next_vnode(&x86->root, NULL);
     assert(walk_pml4 != NULL); // assume there's always at least one existing entry
 
     if (alignment == 0) {
@@ -1042,7 +1122,7 @@ static errval_t determine_addr_raw(struct pmap *pmap, size_t size,
         //debug_printf("looping over pml4 entries\n");
         assert(walk_pml4->is_vnode);
         f[walk_pml4->entry] = false;
-        walk_pml4 = walk_pml4->next;
+        walk_pml4 = next_vnode(&x86->root, walk_pml4);
     }
     genvaddr_t first_free = 16;
     for (; first_free < 512; first_free++) {
@@ -1093,11 +1173,15 @@ errval_t pmap_x86_64_init(struct pmap *pmap, struct vspace *vspace,
     } else { /* use default allocator for this dispatcher */
         pmap->slot_alloc = get_default_slot_allocator();
     }
+    pmap->mapping_slot_alloc = NULL;
 
     /* x86 specific portion */
-    slab_init(&x86->slab, sizeof(struct vnode), NULL);
-    slab_grow(&x86->slab, x86->slab_buffer,
-              sizeof(x86->slab_buffer));
+    slab_cache_init(&x86->slab, sizeof(struct vnode), NULL);
+    slab_cache_grow(&x86->slab, x86->slab_buffer,
+                    sizeof(x86->slab_buffer));
+    slab_cache_init(&x86->index_slab, sizeof(struct vnode_index), NULL);
+    x86->index_wanted = false;
+    x86->index_bytes = 0;
     x86->refill_slabs = min_refill_slabs;
 
     x86->root.is_vnode          = true;
@@ -1112,6 +1196,8 @@ errval_t pmap_x86_64_init(struct pmap *pmap, struct vspace *vspace,
     assert(!capref_is_null(x86->root.u.vnode.cap));
     assert(!capref_is_null(x86->root.u.vnode.invokable));
     x86->root.u.vnode.children  = NULL;
+    x86->root.u.vnode.index     = NULL;
+    x86->root.u.vnode.nchildren = 0;
     x86->root.next              = NULL;
 
     // choose a minimum mappable VA for most domains; enough to catch NULL
@@ -61,14 +61,16 @@ static struct thread staticthread = {
 static struct thread_mutex staticthread_lock = THREAD_MUTEX_INITIALIZER;
 
 /// Storage metadata for thread structures (and TLS data)
-static struct slab_allocator thread_slabs;
+static struct slab_cache thread_slabs;
 static struct vspace_mmu_aware thread_slabs_vm;
 
-// XXX: mutex and spinlock protecting thread slabs in spanned domains
-/* This ought to be just a mutex. However, thread_create() is called on the
- * inter-disp message handler thread, and if it blocks in a mutex, there is no
- * way to wake it up and we will deadlock. This is a quick-fix workaround:
- *   The spinlock protects the data structure
+// XXX: mutex and spinlock protecting the thread slab region in spanned domains
+/* The slab cache itself is safe to use from all dispatchers, but growing it
+ * maps more of thread_slabs_vm, which is not. This ought to be just a mutex.
+ * However, thread_create() is called on the inter-disp message handler thread,
+ * and if it blocks in a mutex, there is no way to wake it up and we will
+ * deadlock. This is a quick-fix workaround:
+ *   The spinlock protects the region
  *   The mutex avoids unneccessary spinning (it is acquired first when safe)
  */
 static spinlock_t thread_slabs_spinlock;
@@ -96,6 +98,9 @@ static void thread_entry(thread_func_t start_func, void *start_data)
 /// int counter for assigning initial thread ids
 static uintptr_t threadid = 0;
 
+/// Optional callback run by every thread in thread_exit(), before teardown
+static thread_exit_hook_fn thread_exit_hook = NULL;
+
 #ifndef NDEBUG
 /// Debugging assertions on thread queues
 static void check_queue(struct thread *queue)
@@ -207,22 +212,44 @@ void thread_remove_from_queue(struct thread **queue, struct thread *thread)
 #endif
 }
 
-/// Refill backing storage for thread region
-static errval_t refill_thread_slabs(struct slab_allocator *slabs)
-{
-    assert(slabs == &thread_slabs);
+/// Number of thread structures mapped at once when refilling thread slabs
+#define THREAD_SLABS_REFILL     16
 
+/// Map and add memory for (up to) \p nblocks threads to the thread slabs
+static errval_t grow_thread_slabs(size_t nblocks)
+{
     size_t size;
     void *buf;
     errval_t err;
 
     size_t blocksize = sizeof(struct thread) + tls_block_total_len;
-    err = vspace_mmu_aware_map(&thread_slabs_vm, blocksize, &buf, &size);
+    err = vspace_mmu_aware_map(&thread_slabs_vm, nblocks * blocksize
+                               + sizeof(struct slab_head), &buf, &size);
+    if (err_no(err) == LIB_ERR_VSPACE_MMU_AWARE_NO_SPACE && nblocks > 1) {
+        // region almost exhausted: fall back to a single block
+        err = vspace_mmu_aware_map(&thread_slabs_vm, blocksize, &buf, &size);
+    }
     if (err_is_fail(err)) {
-        return err_push(err, LIB_ERR_VSPACE_MMU_AWARE_MAP);
+        return err;
     }
 
-    slab_grow(slabs, buf, size);
+    slab_cache_grow(&thread_slabs, buf, size);
+
+    return SYS_ERR_OK;
+}
+
+/// Refill backing storage for thread region
+static errval_t refill_thread_slabs(struct slab_cache *sc)
+{
+    assert(sc == &thread_slabs);
+
+    // no mutex as it may deadlock: see comment for thread_slabs_spinlock
+    acquire_spinlock(&thread_slabs_spinlock);
+    errval_t err = grow_thread_slabs(THREAD_SLABS_REFILL);
+    release_spinlock(&thread_slabs_spinlock);
+    if (err_is_fail(err)) {
+        return err_push(err, LIB_ERR_VSPACE_MMU_AWARE_MAP);
+    }
 
     return SYS_ERR_OK;
 }
@@ -257,6 +284,8 @@ static void thread_init(dispatcher_handle_t disp, struct thread *newthread)
     newthread->rpc_in_progress = false;
     newthread->async_error = SYS_ERR_OK;
     newthread->local_trigger = NULL;
+    newthread->waitset_locals = NULL;
+    newthread->waitset_dispatching = false;
 }
 
 /**
@@ -363,11 +392,7 @@ static void free_thread(struct thread *thread)
         free(thread->tls_dtv);
     }
 
-    thread_mutex_lock(&thread_slabs_mutex);
-    acquire_spinlock(&thread_slabs_spinlock);
-    slab_free(&thread_slabs, thread->slab); // frees thread itself
-    release_spinlock(&thread_slabs_spinlock);
-    thread_mutex_unlock(&thread_slabs_mutex);
+    slab_cache_free(&thread_slabs, thread->slab); // frees thread itself
 }
 
 /**
@@ -390,12 +415,7 @@ struct thread *thread_create_unrunnable(thread_func_t start_func, void *arg,
     }
 
     // allocate space for TCB + initial TLS data
-    // no mutex as it may deadlock: see comment for thread_slabs_spinlock
-    // thread_mutex_lock(&thread_slabs_mutex);
-    acquire_spinlock(&thread_slabs_spinlock);
-    void *space = slab_alloc(&thread_slabs);
-    release_spinlock(&thread_slabs_spinlock);
-    // thread_mutex_unlock(&thread_slabs_mutex);
+    void *space = slab_cache_alloc(&thread_slabs);
     if (space == NULL) {
         free(stack);
         return NULL;
@@ -833,6 +853,13 @@ void thread_exit(int status)
 {
     struct thread *me = thread_self();
 
+    if (thread_exit_hook != NULL) {
+        thread_exit_hook();
+    }
+
+    // hand the events queued for us on waitsets back to the other threads
+    waitset_thread_exit(me);
+
     thread_mutex_lock(&me->exit_lock);
 
     // if this is the static thread, we don't need to do anything but cleanup
@@ -1175,7 +1202,7 @@ static int bootstrap_thread(struct spawn_domain_params *params)
     if (err_is_fail(err)) {
         USER_PANIC_ERR(err, "vspace_mmu_aware_init for thread region failed\n");
     }
-    slab_init(&thread_slabs, blocksize, refill_thread_slabs);
+    slab_cache_init(&thread_slabs, blocksize, refill_thread_slabs);
 
     if (init_domain_global) {
         // run main() on this thread, since we can't allocate
@@ -1284,17 +1311,13 @@ void threads_prepare_to_span(dispatcher_handle_t newdh)
         thread_mutex_lock(&thread_slabs_mutex);
         acquire_spinlock(&thread_slabs_spinlock);
 
-        while (slab_freecount(&thread_slabs) < MAX_THREADS - 1) {
-            struct capref frame;
-            size_t size;
-            void *buf;
+        size_t free;
+        while ((free = slab_cache_freecount(&thread_slabs)) < MAX_THREADS - 1) {
             errval_t err;
 
-            size_t blocksize = sizeof(struct thread) + tls_block_total_len;
-            err = vspace_mmu_aware_map(&thread_slabs_vm, blocksize,
-                                       &buf, &size);
+            err = grow_thread_slabs(MIN(MAX_THREADS - 1 - free,
+                                        THREAD_SLABS_REFILL));
             if (err_is_fail(err)) {
-                slot_free(frame);
                 if (err_no(err) == LIB_ERR_VSPACE_MMU_AWARE_NO_SPACE) {
                     // we've wasted space with fragmentation
                     // cross our fingers and hope for the best...
@@ -1303,8 +1326,6 @@ void threads_prepare_to_span(dispatcher_handle_t newdh)
                 USER_PANIC_ERR(err, "in vspace_mmu_aware_map while prefilling "
                                "thread slabs\n");
             }
-
-            slab_grow(&thread_slabs, buf, size);
         }
 
         release_spinlock(&thread_slabs_spinlock);
@@ -1415,6 +1436,19 @@ void *thread_get_tls_key(int key)
     return me->userptrs[key];
 }
 
+/**
+ * \brief Install a callback that every exiting thread runs in its own context.
+ *
+ * Used by libraries that keep per-thread state (eg. malloc thread caches)
+ * and need to release it before the thread is torn down.
+ *
+ * \param hook Callback, or NULL to remove the current one.
+ */
+void thread_set_exit_hook(thread_exit_hook_fn hook)
+{
+    thread_exit_hook = hook;
+}
+
 /**
  * \brief Set the exception handler function for the current thread.
  *        Optionally also change its stack, and return the old values.
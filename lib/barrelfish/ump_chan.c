@@ -69,6 +69,33 @@ errval_t ump_chan_init(struct ump_chan *uc,
     return SYS_ERR_OK;
 }
 
+/// Buffer size used by generic flounder binds for each direction of a channel
+static size_t default_buflen = DEFAULT_UMP_BUFLEN;
+
+/// Return the per-direction buffer size used for new UMP bindings
+size_t ump_chan_default_buflen(void)
+{
+    return default_buflen;
+}
+
+/**
+ * \brief Change the per-direction buffer size used for new UMP bindings
+ *
+ * Affects only channels bound afterwards through the generic flounder bind
+ * path; the accepting side always uses the sizes chosen by the binder.
+ *
+ * \param buflen Size in bytes, rounded up to #UMP_MSG_BYTES
+ */
+errval_t ump_chan_set_default_buflen(size_t buflen)
+{
+    buflen = ROUND_UP(buflen, UMP_MSG_BYTES);
+    if (buflen == 0 || buflen > UMP_MAX_BUFLEN) {
+        return LIB_ERR_UMP_BUFSIZE_INVALID;
+    }
+    default_buflen = buflen;
+    return SYS_ERR_OK;
+}
+
 /// Destroy the local state associated with a given channel
 void ump_chan_destroy(struct ump_chan *uc)
 {
@@ -23,6 +23,8 @@
 #include <barrelfish/waitset_chan.h>
 #include <barrelfish/threads.h>
 #include <barrelfish/dispatch.h>
+#include <barrelfish/deferred.h>
+#include <barrelfish/systime.h>
 #include "threads_priv.h"
 #include "waitset_chan_priv.h"
 #include <stdio.h>
@@ -30,6 +32,10 @@
 
 #include <flounder/flounder.h>
 
+#ifdef CONFIG_INTERCONNECT_DRIVER_LMP
+#  include <barrelfish/lmp_endpoints.h>
+#endif
+
 #ifdef CONFIG_INTERCONNECT_DRIVER_UMP
 #  include <barrelfish/ump_endpoint.h>
 #endif
@@ -98,6 +104,124 @@ static void enqueue_polled(struct waitset_chanstate **queue,
     }
 }
 
+/// Return whether a local queue belongs to the given waitset
+static inline bool waitset_owns_local(struct waitset *ws,
+                                      struct waitset_local *l)
+{
+    return ws->affinity != NULL && l >= ws->affinity->local
+           && l < ws->affinity->local + ws->affinity->nlocal
+           && l->thread != NULL;
+}
+
+/// Dequeue a pending chanstate from the global or local queue holding it
+static void dequeue_pending(struct waitset *ws, struct waitset_chanstate *chan)
+{
+    if (chan->local) {
+        dequeue(&chan->affinity->pending, chan);
+        chan->local = false;
+    } else {
+        dequeue(&ws->pending, chan);
+    }
+}
+
+/// Check whether a thread is blocked on the waitset
+static bool waitset_has_waiter(struct waitset *ws, struct thread *thread)
+{
+    struct thread *t = ws->waiting_threads;
+
+    if (t == NULL) {
+        return false;
+    }
+    do {
+        if (t == thread) {
+            return true;
+        }
+        t = t->next;
+    } while (t != ws->waiting_threads);
+    return false;
+}
+
+/// Check whether a thread is blocked on the waitset waiting for any event,
+/// rather than for the reply of an RPC
+static bool waitset_has_dispatcher(struct waitset *ws, struct thread *thread)
+{
+    return thread->waitset_dispatching && waitset_has_waiter(ws, thread);
+}
+
+/// Find the local queue of a thread, optionally claiming a free one
+static struct waitset_local *waitset_local_find(struct waitset *ws,
+                                                struct thread *thread,
+                                                bool claim)
+{
+    struct waitset_affinity *a = ws->affinity;
+    struct waitset_local *l = NULL;
+
+    assert(thread != NULL);
+    for (unsigned i = 0; i < a->nlocal; i++) {
+        if (a->local[i].thread == thread) {
+            return &a->local[i];
+        }
+        if (l == NULL && a->local[i].thread == NULL) {
+            l = &a->local[i];
+        }
+    }
+    if (!claim) {
+        return NULL;
+    }
+    if (l == NULL) {
+        if (a->nlocal == WAITSET_MAX_LOCAL) {
+            return NULL;
+        }
+        l = &a->local[a->nlocal++];
+    }
+
+    l->thread = thread;
+    l->pending = NULL;
+    l->ws = ws;
+    l->next_owned = thread->waitset_locals;
+    thread->waitset_locals = l;
+    return l;
+}
+
+/// Remove a claimed local queue from the list of its owner
+static void waitset_local_unlink(struct waitset_local *l)
+{
+    struct waitset_local **p = &l->thread->waitset_locals;
+
+    while (*p != l) {
+        assert(*p != NULL);
+        p = &(*p)->next_owned;
+    }
+    *p = l->next_owned;
+    l->next_owned = NULL;
+}
+
+/// Choose a local queue for a channel without affinity, preferring threads
+/// waiting to dispatch
+static struct waitset_local *waitset_local_pick(struct waitset *ws)
+{
+    struct waitset_affinity *a = ws->affinity;
+
+    if (a->nlocal == 0) {
+        return NULL;
+    }
+    for (unsigned i = 0; i < a->nlocal; i++) {
+        unsigned idx = (a->cursor + i) % a->nlocal;
+        if (a->local[idx].thread != NULL
+            && waitset_has_dispatcher(ws, a->local[idx].thread)) {
+            a->cursor = idx + 1;
+            return &a->local[idx];
+        }
+    }
+    for (unsigned i = 0; i < a->nlocal; i++) {
+        unsigned idx = a->cursor++ % a->nlocal;
+        if (a->local[idx].thread != NULL) {
+            return &a->local[idx];
+        }
+    }
+    return NULL;
+}
+
 /**
  * \brief Initialise a new waitset
  */
@@ -106,6 +230,12 @@ void waitset_init(struct waitset *ws)
     assert(ws != NULL);
     ws->pending = ws->polled = ws->idle = ws->waiting = NULL;
     ws->waiting_threads = NULL;
+    ws->max_spin = ws->spin_budget = ws->interarrival = 0;
+    ws->wakeup_start = 0;
+    ws->adaptive = false;
+    ws->probe = 0;
+    memset(&ws->stats, 0, sizeof(ws->stats));
+    ws->affinity = NULL;
 }
 
 /**
@@ -119,6 +249,20 @@ errval_t waitset_destroy(struct waitset *ws)
     if (ws->pending || ws->waiting_threads) {
         return LIB_ERR_WAITSET_IN_USE;
     }
+    if (ws->affinity != NULL) {
+        for (unsigned i = 0; i < ws->affinity->nlocal; i++) {
+            if (ws->affinity->local[i].pending != NULL) {
+                return LIB_ERR_WAITSET_IN_USE;
+            }
+        }
+        for (unsigned i = 0; i < ws->affinity->nlocal; i++) {
+            if (ws->affinity->local[i].thread != NULL) {
+                waitset_local_unlink(&ws->affinity->local[i]);
+            }
+        }
+        free(ws->affinity);
+        ws->affinity = NULL;
+    }
 
     // remove idle and polled channels from waitset
     struct waitset_chanstate *chan, *next;
@@ -151,6 +295,129 @@ errval_t waitset_destroy(struct waitset *ws)
     return SYS_ERR_OK;
 }
 
+/**
+ * \brief Configure the spin-then-block policy of a waitset
+ *
+ * A thread that finds no pending event first polls the waitset's channels
+ * for up to the spin budget, and only then blocks. This trades CPU time for
+ * not paying the full wakeup latency on channels that need polling (UMP).
+ * Spinning is skipped while other threads of the dispatcher are runnable.
+ *
+ * With \p adaptive set, the budget follows twice the smoothed idle time
+ * observed before events arrive, and drops to zero (block at once) when that
+ * exceeds \p max_spin. A zero budget is still probed now and then, so the
+ * policy notices when traffic becomes dense again.
+ *
+ * The times in waitset_get_stats() are only measured while spinning is
+ * enabled, so the default configuration does not read the clock on every
+ * event.
+ *
+ * \param ws        Waitset
+ * \param max_spin  Maximum spin budget in microseconds, 0 disables spinning
+ * \param adaptive  Adjust the budget to the observed inter-arrival time
+ */
+void waitset_set_spin(struct waitset *ws, delayus_t max_spin, bool adaptive)
+{
+    assert(ws != NULL);
+    dispatcher_handle_t handle = disp_disable();
+    ws->max_spin = ns_to_systime(max_spin * 1000);
+    ws->spin_budget = ws->max_spin;
+    ws->interarrival = ws->max_spin / 2;
+    ws->adaptive = adaptive;
+    ws->probe = 0;
+    disp_enable(handle);
+}
+
+/**
+ * \brief Return the spin-then-block statistics of a waitset
+ */
+void waitset_get_stats(struct waitset *ws, struct waitset_stats *stats)
+{
+    assert(ws != NULL && stats != NULL);
+    dispatcher_handle_t handle = disp_disable();
+    *stats = ws->stats;
+    stats->spin_budget = ws->spin_budget;
+    stats->interarrival = ws->interarrival;
+    disp_enable(handle);
+}
+
+/// Reset the counters returned by waitset_get_stats()
+void waitset_reset_stats(struct waitset *ws)
+{
+    assert(ws != NULL);
+    dispatcher_handle_t handle = disp_disable();
+    memset(&ws->stats, 0, sizeof(ws->stats));
+    disp_enable(handle);
+}
+
+/**
+ * \brief Switch a waitset to affinity mode
+ *
+ * Every thread dispatching events on the waitset gets its own queue of
+ * pending channels (up to #WAITSET_MAX_LOCAL threads at a time; any further
+ * threads only see the shared queue). When a thread exits, its queue is
+ * released and the channels pending on it move to the shared queue. A channel sticks to the thread it was first
+ * handed to, which keeps its state in that thread's working set and avoids
+ * scanning one shared queue on every event. Threads that run out of local
+ * work steal from the other queues. Events addressed to a particular thread
+ * (RPC replies) keep going through the shared queue.
+ *
+ * There is no way back; the queues are freed by waitset_destroy().
+ */
+errval_t waitset_enable_affinity(struct waitset *ws)
+{
+    assert(ws != NULL);
+    struct waitset_affinity *a = calloc(1, sizeof(*a));
+    if (a == NULL) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+
+    dispatcher_handle_t handle = disp_disable();
+    if (ws->affinity == NULL) {
+        ws->affinity = a;
+        a = NULL;
+    }
+    disp_enable(handle);
+
+    free(a);
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Direct future events of a channel to a given dispatching thread
+ *
+ * \param chan    Registered channel on a waitset in affinity mode
+ * \param thread  Thread that should handle the channel's events
+ */
+errval_t waitset_chan_set_affinity(struct waitset_chanstate *chan,
+                                   struct thread *thread)
+{
+    errval_t err = SYS_ERR_OK;
+    dispatcher_handle_t handle = disp_disable();
+    struct waitset *ws = chan->waitset;
+
+    if (ws == NULL) {
+        err = LIB_ERR_CHAN_NOT_REGISTERED;
+    } else if (ws->affinity == NULL) {
+        err = LIB_ERR_WAITSET_NO_AFFINITY;
+    } else {
+        struct waitset_local *l = waitset_local_find(ws, thread, true);
+        if (l == NULL) {
+            err = LIB_ERR_WAITSET_AFFINITY_FULL;
+        } else if (chan->local) {
+            // move an already pending event along with the channel
+            dequeue(&chan->affinity->pending, chan);
+            enqueue(&l->pending, chan);
+        }
+        if (l != NULL) {
+            chan->affinity = l;
+        }
+    }
+
+    disp_enable(handle);
+    return err;
+}
+
 /// Check if the thread can receive the event
 static bool waitset_can_receive(struct waitset_chanstate *chan,
                                 struct thread *thread)
@@ -169,6 +436,25 @@ static bool waitset_can_receive(struct waitset_chanstate *chan,
     return res;
 }
 
+/// Returns the first channel on a local queue that the thread can receive
+static struct waitset_chanstate *local_pending_event(struct waitset_local *l,
+                                                     struct thread *me)
+{
+    struct waitset_chanstate *chan = l->pending;
+
+    if (chan == NULL) {
+        return NULL;
+    }
+    do {
+        if (waitset_can_receive(chan, me)) {
+            assert_disabled(chan->state == CHAN_PENDING);
+            return chan;
+        }
+        chan = chan->next;
+    } while (chan != l->pending);
+    return NULL;
+}
+
 /// Returns a channel with a pending event on the given waitset matching
 /// our thread
 static struct waitset_chanstate *get_pending_event_disabled(struct waitset *ws,
@@ -188,6 +474,14 @@ static struct waitset_chanstate *get_pending_event_disabled(struct waitset *ws,
         return NULL;
     }
     struct waitset_chanstate *chan;
+    struct waitset_local *own = NULL;
+    // check our own local queue first
+    if (ws->affinity != NULL) {
+        own = waitset_local_find(ws, me, false);
+        if (own != NULL && (chan = local_pending_event(own, me)) != NULL) {
+            return chan;
+        }
+    }
     // check a waiting queue for matching event
     for (chan = ws->waiting; chan; ) {
         if (waitset_can_receive(chan, me)) {
@@ -208,6 +502,16 @@ static struct waitset_chanstate *get_pending_event_disabled(struct waitset *ws,
         if (chan == ws->pending)
             break;
     }
+    // steal from the other threads' local queues
+    if (ws->affinity != NULL) {
+        struct waitset_affinity *a = ws->affinity;
+        for (unsigned i = 0; i < a->nlocal; i++) {
+            struct waitset_local *l = &a->local[(a->cursor + i) % a->nlocal];
+            if (l != own && (chan = local_pending_event(l, me)) != NULL) {
+                return chan;
+            }
+        }
+    }
     return NULL;
 }
 
@@ -265,7 +569,7 @@ static void reregister_channel(struct waitset *ws, struct waitset_chanstate *cha
 {
     assert(chan->waitset == ws);
     if (chan->state == CHAN_PENDING) {
-        dequeue(&ws->pending, chan);
+        dequeue_pending(ws, chan);
     } else {
         assert(chan->state == CHAN_WAITING);
         dequeue(&ws->waiting, chan);
@@ -292,6 +596,12 @@ static struct thread * find_recipient(struct waitset *ws,
 
     if (!t)
         return NULL;
+    // prefer dispatching threads, a thread in an RPC only takes its reply
+    do {
+        if (t->waitset_dispatching && waitset_can_receive(channel, t))
+            return t;
+        t = t->next;
+    } while (t != ws->waiting_threads);
     do {
         if (waitset_can_receive(channel, t))
             return t;
@@ -303,14 +613,171 @@ static struct thread * find_recipient(struct waitset *ws,
 /// Wake up other thread if there's more pending events
 static void wake_up_other_thread(dispatcher_handle_t handle, struct waitset *ws)
 {
-    if (ws->pending && ws->waiting_threads) {
-        struct thread *t;
+    bool more = ws->pending != NULL;
+
+    // a blocked thread can steal from any non-empty local queue
+    if (!more && ws->affinity != NULL && ws->waiting_threads) {
+        for (unsigned i = 0; i < ws->affinity->nlocal && !more; i++) {
+            more = ws->affinity->local[i].pending != NULL;
+        }
+    }
+
+    if (more && ws->waiting_threads) {
+        struct thread *t = ws->waiting_threads;
 
+        // prefer a thread that is able to take any event
+        do {
+            if (t->waitset_dispatching) {
+                ws->waiting_threads = t;
+                break;
+            }
+            t = t->next;
+        } while (t != ws->waiting_threads);
         t = thread_unblock_one_disabled(handle, &ws->waiting_threads, NULL);
         assert_disabled(t == NULL); // shouldn't see a remote thread
     }
 }
 
+/**
+ * \brief Release the local queues of an exiting thread
+ *
+ * Channels pending on them go back to the shared queue of their waitset,
+ * and a blocked thread is woken to handle them.
+ */
+void waitset_thread_exit(struct thread *thread)
+{
+    dispatcher_handle_t handle = disp_disable();
+    struct waitset_local *l, *next;
+
+    for (l = thread->waitset_locals; l != NULL; l = next) {
+        struct waitset *ws = l->ws;
+        struct waitset_chanstate *chan;
+
+        next = l->next_owned;
+        while ((chan = l->pending) != NULL) {
+            dequeue(&l->pending, chan);
+            chan->local = false;
+            enqueue(&ws->pending, chan);
+        }
+        l->thread = NULL;
+        l->next_owned = NULL;
+        wake_up_other_thread(handle, ws);
+    }
+    thread->waitset_locals = NULL;
+
+    disp_enable(handle);
+}
+
+/**
+ * \brief Queue a newly pending channel and wake a thread to handle it
+ *
+ * In affinity mode, events that any thread may handle go to the local queue
+ * of the channel's thread if that thread is blocked waiting to dispatch, and
+ * wake it. Otherwise the owner is busy or waits for an RPC reply, which it
+ * would wait for forever if the reply depends on this event; the event then
+ * goes to the shared queue and wakes a dispatching thread.
+ */
+static void waitset_make_pending_disabled(struct waitset *ws,
+                                          struct waitset_chanstate *chan,
+                                          dispatcher_handle_t handle)
+{
+    struct thread *thread = NULL;
+
+    chan->state = CHAN_PENDING;
+    chan->local = false;
+    if (ws->affinity != NULL && chan->wait_for == NULL
+        && (chan->token == 0 || (chan->token & 1))) {
+        if (!waitset_owns_local(ws, chan->affinity)) {
+            chan->affinity = waitset_local_pick(ws);
+        }
+        // queue locally only for an owner that waits to dispatch
+        if (chan->affinity != NULL
+            && waitset_has_dispatcher(ws, chan->affinity->thread)) {
+            enqueue(&chan->affinity->pending, chan);
+            chan->local = true;
+            thread = chan->affinity->thread;
+        }
+    }
+    if (!chan->local) {
+        enqueue(&ws->pending, chan);
+        // is there a thread blocked on this waitset? if so, awaken it
+        thread = find_recipient(ws, chan, thread_self_disabled());
+    }
+
+    if (thread) {
+        struct thread *t;
+        if (ws->max_spin != 0) {
+            ws->wakeup_start = systime_now();
+        }
+        ws->waiting_threads = thread;
+        t = thread_unblock_one_disabled(handle, &ws->waiting_threads, chan);
+        assert_disabled(t == NULL);
+    }
+}
+
+/// Feed the idle time before an event into the adaptive spin budget
+static void waitset_update_spin(struct waitset *ws, systime_t idle)
+{
+    // exponentially weighted moving average with weight 1/8
+    ws->interarrival = ws->interarrival - ws->interarrival / 8 + idle / 8;
+    if (ws->adaptive) {
+        systime_t budget = 2 * ws->interarrival;
+        ws->spin_budget = budget <= ws->max_spin ? budget : 0;
+    }
+}
+
+/**
+ * \brief Poll the waitset's event sources for up to the spin budget
+ *
+ * \returns true if an event became pending on the waitset
+ */
+static bool waitset_spin_disabled(struct waitset *ws,
+                                  struct waitset_chanstate *waitfor,
+                                  struct waitset_chanstate *waitfor2,
+                                  dispatcher_handle_t handle)
+{
+    struct thread *me = thread_self_disabled();
+    systime_t budget = ws->spin_budget;
+
+    if (ws->max_spin == 0 || me->next != me) {
+        return false;
+    }
+    if (budget == 0) {
+        // occasionally try spinning anyway, to pick up a change in traffic
+        if (++ws->probe < 16) {
+            return false;
+        }
+        budget = ws->max_spin;
+    }
+    ws->probe = 0;
+    ws->stats.spins++;
+
+#ifdef CONFIG_INTERCONNECT_DRIVER_LMP
+    struct dispatcher_shared_generic *disp =
+        get_dispatcher_shared_generic(handle);
+#endif
+    systime_t start = systime_now(), now;
+    do {
+#ifdef CONFIG_INTERCONNECT_DRIVER_LMP
+        if (disp->lmp_delivered != disp->lmp_seen) {
+            lmp_endpoints_poll_disabled(handle);
+        }
+#endif
+        poll_channels_disabled(handle);
+        now = systime_now();
+        trigger_deferred_events_disabled(handle, now);
+        if (ws->pending || get_pending_event_disabled(ws, waitfor, waitfor2)) {
+            ws->stats.spin_hits++;
+            ws->stats.spin_time += now - start;
+            return true;
+        }
+        // stop if polling made another thread runnable
+    } while (me->next == me && now - start < budget);
+
+    ws->stats.spin_time += now - start;
+    return false;
+}
+
 /**
  * \brief Get next pending event
  *
@@ -338,6 +805,12 @@ errval_t get_next_event_disabled(struct waitset *ws,
     dispatcher_handle_t handle, bool debug)
 {
     struct waitset_chanstate * chan;
+    systime_t wait_start = 0;
+
+    // become one of the waitset's dispatching threads
+    if (ws->affinity != NULL && waitfor == NULL) {
+        waitset_local_find(ws, thread_self_disabled(), true);
+    }
 
 // debug_printf("%s: %p %p %p %p\n", __func__, __builtin_return_address(0), __builtin_return_address(1), __builtin_return_address(2), __builtin_return_address(3));
     for (;;) {
@@ -345,6 +818,13 @@ errval_t get_next_event_disabled(struct waitset *ws,
         if (chan) {
             *retchannel = chan;
             *retclosure = chan->closure;
+            if (chan->local) {
+                if (chan->affinity->thread == thread_self_disabled()) {
+                    ws->stats.local_events++;
+                } else {
+                    ws->stats.stolen_events++;
+                }
+            }
             chan->wait_for = NULL;
             chan->token = 0;
             if (chan->persistent)
@@ -352,13 +832,38 @@ errval_t get_next_event_disabled(struct waitset *ws,
             else
                 waitset_chan_deregister_disabled(chan, handle);
             wake_up_other_thread(handle, ws);
+            ws->stats.events++;
+            if (wait_start != 0 && ws->max_spin != 0) {
+                waitset_update_spin(ws, systime_now() - wait_start);
+            }
     // debug_printf("%s.%d: %p\n", __func__, __LINE__, retclosure->handler);
             return SYS_ERR_OK;
         }
         chan = ws->pending; // check a pending queue
-        if (!chan) { // if nothing then wait
+        if (!chan) { // if nothing then spin for a while, and wait
+            // without spinning, keep reading the clock off the event path
+            bool timed = ws->max_spin != 0;
+            if (timed && wait_start == 0) {
+                wait_start = systime_now();
+            }
+            if (waitset_spin_disabled(ws, waitfor, waitfor2, handle)) {
+                continue;
+            }
+            ws->stats.blocks++;
+            systime_t block_start = timed ? systime_now() : 0;
+            thread_self_disabled()->waitset_dispatching = (waitfor == NULL);
             thread_block_disabled(handle, &ws->waiting_threads);
             disp_disable();
+            thread_self_disabled()->waitset_dispatching = false;
+            if (timed) {
+                systime_t now = systime_now();
+                ws->stats.block_time += now - block_start;
+                if (ws->wakeup_start != 0) {
+                    ws->stats.wakeups++;
+                    ws->stats.wakeup_time += now - ws->wakeup_start;
+                }
+            }
+            ws->wakeup_start = 0;
         } else { // something but it's not our event
             if (!ws->waiting_threads) { // no other thread interested in
                 dequeue(&ws->pending, chan);
@@ -583,6 +1088,8 @@ void waitset_chanstate_init(struct waitset_chanstate *chan,
     chan->token = 0;
     chan->wait_for = NULL;
     chan->trigger = NULL;
+    chan->affinity = NULL;
+    chan->local = false;
 }
 
 /**
@@ -754,7 +1261,7 @@ errval_t waitset_chan_deregister_disabled(struct waitset_chanstate *chan,
         break;
 
     case CHAN_PENDING:
-        dequeue(&ws->pending, chan);
+        dequeue_pending(ws, chan);
         break;
 
     case CHAN_WAITING:
@@ -813,7 +1320,7 @@ void waitset_chan_migrate(struct waitset_chanstate *chan,
         break;
 
     case CHAN_PENDING:
-        dequeue(&ws->pending, chan);
+        dequeue_pending(ws, chan);
         enqueue(&new_ws->pending, chan);
         break;
 
@@ -829,6 +1336,7 @@ void waitset_chan_migrate(struct waitset_chanstate *chan,
 
     // Remember new waitset association
     chan->waitset = new_ws;
+    chan->affinity = NULL;
 }
 
 /**
@@ -864,17 +1372,7 @@ errval_t waitset_chan_trigger_disabled(struct waitset_chanstate *chan,
     }
 
     // else mark channel pending and move to end of pending event queue
-    enqueue(&ws->pending, chan);
-    chan->state = CHAN_PENDING;
-
-    // is there a thread blocked on this waitset? if so, awaken it with the event
-    struct thread *thread = find_recipient(ws, chan, thread_self_disabled());
-    if (thread) {
-        struct thread *t;
-        ws->waiting_threads = thread;
-        t = thread_unblock_one_disabled(handle, &ws->waiting_threads, chan);
-        assert_disabled(t == NULL);
-    }
+    waitset_make_pending_disabled(ws, chan, handle);
     return SYS_ERR_OK;
 }
 
@@ -928,19 +1426,7 @@ errval_t waitset_chan_trigger_closure_disabled(struct waitset *ws,
 
     // mark channel pending and place on end of pending event queue
     chan->waitset = ws;
-    enqueue(&ws->pending, chan);
-    // if (first)
-    //     ws->pending = chan;
-    chan->state = CHAN_PENDING;
-
-    // is there a thread blocked on this waitset? if so, awaken it with the event
-    struct thread *thread = find_recipient(ws, chan, thread_self_disabled());
-    if (thread) {
-        struct thread *t;
-        ws->waiting_threads = thread;
-        t = thread_unblock_one_disabled(handle, &ws->waiting_threads, chan);
-        assert_disabled(t == NULL);
-    }
+    waitset_make_pending_disabled(ws, chan, handle);
     return SYS_ERR_OK;
 }
 
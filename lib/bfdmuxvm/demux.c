@@ -0,0 +1,447 @@
+/**
+ * \file
+ * \brief Compiled demultiplexer for bfdmux filters
+ *
+ * A filter is compiled if its byte code is a tree of OP_AND nodes whose
+ * leaves are OP_EQUAL tests between a packet load and an immediate. Each
+ * leaf becomes a term. Terms that test one of the IPv4 5-tuple fields at the
+ * offsets used by the filter builders in bfdmuxtools make up the key of the
+ * filter; the set of fields in the key is its signature. Remaining terms (the
+ * MAC address, typically) are checked after the key matched.
+ *
+ * A packet is looked up once for every signature in use, which for sockets is
+ * usually one or two (listening and connected), independent of the number of
+ * filters.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <string.h>
+#include <sys/endian.h>
+#include <barrelfish/barrelfish.h>
+#include <bfdmuxvm/vm.h>
+#include <bfdmuxvm/demux.h>
+
+/// Equality test of a packet field against a constant
+struct demux_term {
+    uint64_t offset;            ///< Byte offset in the packet
+    uint64_t value;             ///< Expected value, in host byte order
+    uint8_t width;              ///< Field width in bytes
+};
+
+struct demux_filter {
+    uint64_t id;                ///< Priority, highest matching id wins
+    void *arg;                  ///< Returned by demux_match()
+    uint8_t *code;              ///< Byte code (not copied)
+    int len;                    ///< Length of the byte code
+    bool compiled;              ///< Filter is in the hash table
+    uint8_t sig;                ///< Key fields constrained by the filter
+    uint64_t key[DEMUX_KEY_FIELDS];     ///< Values of the key fields
+    int nterms;                 ///< Number of remaining terms
+    struct demux_term terms[DEMUX_MAX_TERMS];   ///< Remaining terms
+    struct demux_filter *next;  ///< Next in hash chain or interpreted list
+};
+
+/// Location of the 5-tuple fields, as tested by the bfdmuxtools builders
+static const struct {
+    uint16_t offset;
+    uint8_t width;
+} key_fields[DEMUX_KEY_FIELDS] = {
+    { 23, 1 },  // IP protocol
+    { 26, 4 },  // IP source
+    { 30, 4 },  // IP destination
+    { 34, 2 },  // TCP/UDP source port
+    { 36, 2 },  // TCP/UDP destination port
+};
+
+/**
+ * \brief Loads a field like the OP_LOAD* instructions of the interpreter
+ * @return false, if the field is not within the packet
+ */
+static inline bool load_field(uint8_t *packet, int len, uint64_t offset,
+                              uint8_t width, uint64_t *value)
+{
+    if (offset >= len || width > len - offset) {
+        return false;
+    }
+
+    uint8_t *p = packet + offset;
+    switch (width) {
+    case 1:
+        *value = *p;
+        break;
+    case 2: {
+        uint16_t v;
+        memcpy(&v, p, sizeof(v));
+        *value = be16toh(v);
+        break;
+    }
+    case 4: {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        *value = be32toh(v);
+        break;
+    }
+    default: {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        *value = be64toh(v);
+        break;
+    }
+    }
+    return true;
+}
+
+static inline uint32_t hash_key(uint8_t sig, uint64_t *key)
+{
+    uint64_t h = sig * 0x9e3779b97f4a7c15ULL;
+    for (int i = 0; i < DEMUX_KEY_FIELDS; i++) {
+        if (sig & (1 << i)) {
+            h = (h ^ key[i]) * 0x9e3779b97f4a7c15ULL;
+        }
+    }
+    return (h >> 32) & (DEMUX_BUCKETS - 1);
+}
+
+/*
+ * Compilation. The parser follows the layout that calc() in vm.c expects and
+ * gives up on anything that is not a conjunction of equality tests.
+ */
+
+/// Parse an immediate, leaving *offset at its last byte
+static bool parse_imm(uint8_t *code, int len, size_t *offset, uint64_t *value)
+{
+    size_t width;
+    switch (code[*offset]) {
+    case OP_INT8:
+        width = 1;
+        break;
+    case OP_INT16:
+        width = 2;
+        break;
+    case OP_INT32:
+        width = 4;
+        break;
+    case OP_INT64:
+        width = 8;
+        break;
+    default:
+        return false;
+    }
+    if (*offset + width >= len) {
+        return false;
+    }
+
+    // immediates are stored in host byte order
+    uint8_t *p = code + *offset + 1;
+    switch (width) {
+    case 1:
+        *value = *p;
+        break;
+    case 2: {
+        uint16_t v;
+        memcpy(&v, p, sizeof(v));
+        *value = v;
+        break;
+    }
+    case 4: {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        *value = v;
+        break;
+    }
+    default:
+        memcpy(value, p, sizeof(*value));
+        break;
+    }
+    *offset += width;
+    return true;
+}
+
+/// Parse an immediate or a load with an immediate address
+static bool parse_operand(uint8_t *code, int len, size_t *offset,
+                          uint8_t *load_width, uint64_t *value)
+{
+    switch (code[*offset]) {
+    case OP_LOAD8:
+        *load_width = 1;
+        break;
+    case OP_LOAD16:
+        *load_width = 2;
+        break;
+    case OP_LOAD32:
+        *load_width = 4;
+        break;
+    case OP_LOAD64:
+        *load_width = 8;
+        break;
+    default:
+        *load_width = 0;
+        return parse_imm(code, len, offset, value);
+    }
+    *offset += 1;
+    return *offset < len && parse_imm(code, len, offset, value);
+}
+
+static bool parse_expr(uint8_t *code, int len, size_t *offset,
+                       struct demux_term *terms, int *nterms)
+{
+    if (*offset >= len) {
+        return false;
+    }
+
+    switch (code[*offset]) {
+    case OP_AND:
+        // opcode and 32 bit subtree size, then both operands
+        *offset += 5;
+        if (!parse_expr(code, len, offset, terms, nterms)) {
+            return false;
+        }
+        *offset += 1;
+        return parse_expr(code, len, offset, terms, nterms);
+
+    case OP_EQUAL: {
+        uint8_t width[2];
+        uint64_t value[2];
+        for (int i = 0; i < 2; i++) {
+            *offset += 1;
+            if (*offset >= len ||
+                !parse_operand(code, len, offset, &width[i], &value[i])) {
+                return false;
+            }
+        }
+        if (width[0] == 0 && width[1] == 0) {
+            // constant, only a true one can be left out of the conjunction
+            return value[0] == value[1];
+        }
+        if (width[0] != 0 && width[1] != 0) {
+            return false;
+        }
+        if (*nterms == DEMUX_MAX_TERMS) {
+            return false;
+        }
+        int load = width[0] != 0 ? 0 : 1;
+        terms[*nterms].offset = value[load];
+        terms[*nterms].width = width[load];
+        terms[*nterms].value = value[1 - load];
+        (*nterms)++;
+        return true;
+    }
+
+    default: {
+        // a constant filter, such as "1"
+        uint64_t value;
+        return parse_imm(code, len, offset, &value) && value != 0;
+    }
+    }
+}
+
+static bool compile_filter_code(struct demux_filter *f)
+{
+    struct demux_term terms[DEMUX_MAX_TERMS];
+    int nterms = 0;
+    size_t offset = 0;
+
+    if (!parse_expr(f->code, f->len, &offset, terms, &nterms)) {
+        return false;
+    }
+
+    f->sig = 0;
+    f->nterms = 0;
+    memset(f->key, 0, sizeof(f->key));
+    for (int t = 0; t < nterms; t++) {
+        int i;
+        for (i = 0; i < DEMUX_KEY_FIELDS; i++) {
+            if (terms[t].offset == key_fields[i].offset &&
+                terms[t].width == key_fields[i].width &&
+                !(f->sig & (1 << i))) {
+                break;
+            }
+        }
+        if (i < DEMUX_KEY_FIELDS) {
+            f->sig |= 1 << i;
+            f->key[i] = terms[t].value;
+        } else {
+            f->terms[f->nterms++] = terms[t];
+        }
+    }
+    return true;
+}
+
+/*
+ * Bookkeeping of signatures in use.
+ */
+
+static void sig_ref(struct demux *dm, uint8_t sig)
+{
+    if (dm->sig_refs[sig]++ == 0) {
+        dm->sigs[dm->nsigs++] = sig;
+    }
+}
+
+static void sig_unref(struct demux *dm, uint8_t sig)
+{
+    assert(dm->sig_refs[sig] > 0);
+    if (--dm->sig_refs[sig] == 0) {
+        for (int i = 0; i < dm->nsigs; i++) {
+            if (dm->sigs[i] == sig) {
+                dm->sigs[i] = dm->sigs[--dm->nsigs];
+                break;
+            }
+        }
+    }
+}
+
+static bool filter_matches(struct demux_filter *f, uint64_t *key,
+                           uint8_t *packet, int len)
+{
+    for (int i = 0; i < DEMUX_KEY_FIELDS; i++) {
+        if ((f->sig & (1 << i)) && f->key[i] != key[i]) {
+            return false;
+        }
+    }
+    for (int t = 0; t < f->nterms; t++) {
+        uint64_t value;
+        if (!load_field(packet, len, f->terms[t].offset, f->terms[t].width,
+                        &value) || value != f->terms[t].value) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * \brief Initialises an empty demultiplexer
+ */
+void demux_init(struct demux *dm)
+{
+    memset(dm, 0, sizeof(*dm));
+}
+
+/**
+ * \brief Adds a filter to the demultiplexer
+ * @param code Filter byte code. Must stay valid until the filter is removed.
+ * @param len Length of the byte code
+ * @param id Priority of the filter; if several filters match, the one with
+ *           the highest id is returned. Ids must be unique.
+ * @param arg Value returned by demux_match() if this filter matches
+ * @param[out] ret Handle for demux_remove_filter()
+ */
+errval_t demux_add_filter(struct demux *dm, uint8_t *code, int len,
+                          uint64_t id, void *arg, struct demux_filter **ret)
+{
+    struct demux_filter *f = malloc(sizeof(*f));
+    if (f == NULL) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+
+    f->id = id;
+    f->arg = arg;
+    f->code = code;
+    f->len = len;
+    f->compiled = compile_filter_code(f);
+
+    if (f->compiled) {
+        uint32_t bucket = hash_key(f->sig, f->key);
+        f->next = dm->buckets[bucket];
+        dm->buckets[bucket] = f;
+        sig_ref(dm, f->sig);
+        dm->ncompiled++;
+    } else {
+        // keep the list sorted by descending id
+        struct demux_filter **p = &dm->interpreted;
+        while (*p != NULL && (*p)->id > id) {
+            p = &(*p)->next;
+        }
+        f->next = *p;
+        *p = f;
+        dm->ninterpreted++;
+    }
+
+    *ret = f;
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Removes and frees a filter
+ */
+void demux_remove_filter(struct demux *dm, struct demux_filter *f)
+{
+    struct demux_filter **p;
+    if (f->compiled) {
+        p = &dm->buckets[hash_key(f->sig, f->key)];
+    } else {
+        p = &dm->interpreted;
+    }
+
+    while (*p != f) {
+        assert(*p != NULL);
+        p = &(*p)->next;
+    }
+    *p = f->next;
+
+    if (f->compiled) {
+        sig_unref(dm, f->sig);
+        dm->ncompiled--;
+    } else {
+        dm->ninterpreted--;
+    }
+    free(f);
+}
+
+/**
+ * \brief Finds the filter with the highest id that matches a packet
+ * @return The arg of the matching filter, or NULL if no filter matches
+ */
+void *demux_match(struct demux *dm, uint8_t *packet, int len)
+{
+    uint64_t key[DEMUX_KEY_FIELDS];
+    uint8_t avail = 0;
+    for (int i = 0; i < DEMUX_KEY_FIELDS; i++) {
+        if (load_field(packet, len, key_fields[i].offset, key_fields[i].width,
+                       &key[i])) {
+            avail |= 1 << i;
+        }
+    }
+
+    struct demux_filter *best = NULL;
+    for (int s = 0; s < dm->nsigs; s++) {
+        uint8_t sig = dm->sigs[s];
+        if (sig & ~avail) {
+            continue;
+        }
+        struct demux_filter *f = dm->buckets[hash_key(sig, key)];
+        for (; f != NULL; f = f->next) {
+            if (f->sig == sig && (best == NULL || f->id > best->id) &&
+                filter_matches(f, key, packet, len)) {
+                best = f;
+            }
+        }
+    }
+
+    // only interpreted filters newer than the best match can change it
+    struct demux_filter *f = dm->interpreted;
+    for (; f != NULL && (best == NULL || f->id > best->id); f = f->next) {
+        if (execute_filter(f->code, f->len, packet, len, NULL)) {
+            best = f;
+            break;
+        }
+    }
+
+    return best != NULL ? best->arg : NULL;
+}
+
+/**
+ * \brief Returns whether a filter is matched without the interpreter
+ */
+bool demux_filter_is_compiled(struct demux_filter *f)
+{
+    return f->compiled;
+}
@@ -115,6 +115,7 @@ static void xomp_start_processing(void (*fn)(void *),
     xdata->data = data;
     xdata->thread_id = 0;
     xdata->barrier = barrier;
+    bomp_loop_combined(&xdata->combined);
     bomp_set_tls(xdata);
 
     struct xomp_task *task = calloc(1, sizeof(struct xomp_task));
@@ -145,6 +146,9 @@ static void xomp_end_processing(void)
     /* Clear the barrier created */
     bomp_clear_barrier(g_bomp_state->tld[i]->work->barrier);
 
+    // the work of the main thread is freed along with tld
+    free(g_bomp_state->tld[i]);
+    g_bomp_state->backend.set_tls(NULL);
     free(g_bomp_state->tld);
 
     g_bomp_state->tld = NULL;
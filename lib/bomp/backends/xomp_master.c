@@ -1194,6 +1194,8 @@ errval_t xomp_master_do_work(struct xomp_task *task)
         work->barrier = NULL;
         work->thread_id = threadid;
         work->num_threads = g_bomp_state->num_threads;
+        work->loop_gen = 0;
+        bomp_loop_combined(&work->combined);
 
         if (i <= local_threads) {
             work->num_vtreads = XOMP_VTHREADS;
@@ -529,6 +529,7 @@ static void do_work_rx(struct xomp_binding *b,
     XWP_DEBUG("do_work_rx: calling fnct %p with argument %p\n", fnct, work->data);
 
     for (uint32_t i = 0; i < work->num_vtreads; ++i) {
+        work->loop_gen = 0;
         fnct(work->data);
         work->thread_id++;
     }
@@ -6,19 +6,326 @@
  * If you do not find this file, copies can be found by writing to:
  * ETH Zurich D-INFK, Universitaetsstrasse 6, CH-8092 Zurich. Attn: Systems Group.
  */
+#include <string.h>
 #include <bomp_internal.h>
+#include <numa.h>
 
 /*
  * These functions implement the BARRIER construct
+ *
+ * A central counter makes every thread of the team write the same cache line
+ * and spin on it, which gets expensive once the team spans several NUMA
+ * nodes. Larger teams therefore use one of:
+ *
+ * - a combining tree: threads of a NUMA node arrive at a node-local leaf, the
+ *   last thread to arrive continues to the parent. The thread completing the
+ *   root releases the tree top down, so threads spin on node-local lines.
+ * - a dissemination barrier: in round r thread i signals thread
+ *   i + 2^r (mod n) and waits for thread i - 2^r. No counters are shared and
+ *   every thread is done after ceil(log2(n)) rounds.
  */
 
+/// barrier asked for with bomp_set_barrier()
+static bomp_barrier_t barrier_kind = BOMP_BARRIER_AUTO;
+
+/// 0: not initialized, 1: NUMA topology available, -1: not available
+static int barrier_numa = 0;
+
+static inline void barrier_spin(volatile unsigned long *flag,
+                                unsigned long episode)
+{
+    uint64_t waitcnt = 0;
+
+    while (*flag < episode) {
+        if (waitcnt == 0x400) {
+            waitcnt = 0;
+            thread_yield();
+        }
+        waitcnt++;
+    }
+}
+
+static void barrier_tree_wait(struct bomp_team_barrier *b, unsigned tid,
+                              unsigned long episode)
+{
+    int completed[BOMP_BARRIER_DEPTH_MAX];
+    int ncompleted = 0;
+
+    int n = b->threads[tid].leaf;
+    while (n >= 0) {
+        struct bomp_barrier_node *node = &b->nodes[n];
+        if (__sync_fetch_and_add(&node->count, 1) != node->max - 1) {
+            barrier_spin(&node->release, episode);
+            break;
+        }
+        /* nobody arrives here again before we release the node */
+        node->count = 0;
+        assert(ncompleted < BOMP_BARRIER_DEPTH_MAX);
+        completed[ncompleted++] = n;
+        n = node->parent;
+    }
+
+    while (ncompleted > 0) {
+        b->nodes[completed[--ncompleted]].release = episode;
+    }
+}
+
+static void barrier_dissemination_wait(struct bomp_team_barrier *b,
+                                       unsigned tid, unsigned long episode)
+{
+    for (unsigned r = 0; r < b->rounds; r++) {
+        unsigned partner = (tid + (1U << r)) % b->nthreads;
+        b->flags[partner * b->rounds + r].episode = episode;
+        barrier_spin(&b->flags[tid * b->rounds + r].episode, episode);
+    }
+}
+
+/**
+ * \brief waits until all threads of the team reached the barrier
+ *
+ * \param b     barrier of the team
+ * \param tid   id of the calling thread within the team
+ */
+void bomp_team_barrier_wait(struct bomp_team_barrier *b, unsigned tid)
+{
+    assert(tid < b->nthreads);
+
+    unsigned long episode = ++b->threads[tid].episode;
+
+    switch (b->kind) {
+        case BOMP_BARRIER_TREE:
+            barrier_tree_wait(b, tid, episode);
+            break;
+        case BOMP_BARRIER_DISSEMINATION:
+            barrier_dissemination_wait(b, tid, episode);
+            break;
+        default:
+            bomp_barrier_wait(&b->central);
+            break;
+    }
+}
+
+/**
+ * \brief returns the NUMA node thread tid of the team will run on
+ *
+ * Only known for the shared address space backend, which places thread i on
+ * core i * BOMP_DEFAULT_CORE_STRIDE counted from the master's core.
+ */
+static nodeid_t barrier_thread_node(unsigned tid)
+{
+    if (barrier_numa != 1 || g_bomp_state->backend_type != BOMP_BACKEND_BOMP) {
+        return (nodeid_t)-1;
+    }
+
+    coreid_t core = disp_get_core_id() + tid * BOMP_DEFAULT_CORE_STRIDE;
+    if (core > numa_max_core()) {
+        return (nodeid_t)-1;
+    }
+    return numa_node_of_cpu(core);
+}
+
+/**
+ * \brief builds the combining tree, leaves never span NUMA nodes
+ */
+static void barrier_tree_build(struct bomp_team_barrier *b,
+                               const nodeid_t *numa)
+{
+    unsigned nthreads = b->nthreads;
+
+    /* order the threads by node, stable for threads of the same node */
+    unsigned *order = malloc(nthreads * sizeof(unsigned));
+    assert(order != NULL);
+    for (unsigned i = 0; i < nthreads; i++) {
+        unsigned j = i;
+        while (j > 0 && numa[order[j - 1]] > numa[i]) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    /* leaves */
+    unsigned nnodes = 0;
+    struct bomp_barrier_node *leaf = NULL;
+    for (unsigned i = 0; i < nthreads; i++) {
+        unsigned tid = order[i];
+        if (leaf == NULL || leaf->max == BOMP_BARRIER_FANIN
+                        || leaf->numa != numa[tid]) {
+            leaf = &b->nodes[nnodes++];
+            leaf->numa = numa[tid];
+            leaf->parent = -1;
+        }
+        leaf->max++;
+        b->threads[tid].leaf = nnodes - 1;
+    }
+    free(order);
+
+    /*
+     * inner levels: combine nodes of the same NUMA node first. If that does
+     * not halve the level, combine neighbours regardless of their node, which
+     * bounds the depth of the tree by log2(nthreads) + 1.
+     */
+    unsigned first = 0;
+    while (nnodes - first > 1) {
+        unsigned last = nnodes;
+        bool mix = false;
+        for (;;) {
+            unsigned groups = 0;
+            nodeid_t numa_prev = 0;
+            unsigned size = 0;
+            for (unsigned n = first; n < last; n++) {
+                if (groups == 0 || size == BOMP_BARRIER_FANIN
+                        || (!mix && b->nodes[n].numa != numa_prev)) {
+                    groups++;
+                    size = 0;
+                    numa_prev = b->nodes[n].numa;
+                }
+                size++;
+            }
+            if (mix || groups <= (last - first + 1) / 2) {
+                break;
+            }
+            mix = true;
+        }
+
+        struct bomp_barrier_node *parent = NULL;
+        for (unsigned n = first; n < last; n++) {
+            if (parent == NULL || parent->max == BOMP_BARRIER_FANIN
+                    || (!mix && parent->numa != b->nodes[n].numa)) {
+                parent = &b->nodes[nnodes++];
+                parent->numa = b->nodes[n].numa;
+                parent->parent = -1;
+            } else if (parent->numa != b->nodes[n].numa) {
+                parent->numa = (nodeid_t)-1;
+            }
+            parent->max++;
+            b->nodes[n].parent = nnodes - 1;
+        }
+        first = last;
+    }
+
+    assert(nnodes <= b->nnodes);
+    b->nnodes = nnodes;
+}
+
+static bomp_barrier_t barrier_select(unsigned nthreads, const nodeid_t *numa)
+{
+    if (barrier_kind != BOMP_BARRIER_AUTO) {
+        return barrier_kind;
+    }
+
+    for (unsigned i = 1; i < nthreads; i++) {
+        if (numa[i] != numa[0]) {
+            return BOMP_BARRIER_TREE;
+        }
+    }
+
+    if (nthreads <= BOMP_BARRIER_FLAT_MAX) {
+        return BOMP_BARRIER_CENTRAL;
+    }
+
+    return BOMP_BARRIER_DISSEMINATION;
+}
+
+static void barrier_free(struct bomp_team_barrier *b)
+{
+    free(b->threads);
+    free(b->nodes);
+    free(b->flags);
+    free(b);
+}
+
+/**
+ * \brief prepares the barrier for a team of nthreads threads
+ *
+ * The barrier is kept for the following teams as long as their size and the
+ * requested kind do not change.
+ */
+void bomp_barrier_region_start(unsigned nthreads)
+{
+    struct bomp_team_barrier *b = g_bomp_state->barrier;
+
+    if (b != NULL && b->nthreads == nthreads && b->requested == barrier_kind) {
+        return;
+    }
+
+    if (barrier_numa == 0) {
+        barrier_numa = err_is_ok(numa_available()) ? 1 : -1;
+    }
+
+    if (b != NULL) {
+        barrier_free(b);
+    }
+
+    b = calloc(1, sizeof(*b));
+    assert(b != NULL);
+    b->requested = barrier_kind;
+    b->nthreads = nthreads;
+    bomp_barrier_init(&b->central, nthreads);
+
+    int ret = posix_memalign((void **)&b->threads, BOMP_BARRIER_CACHELINE,
+                             nthreads * sizeof(struct bomp_barrier_thread));
+    assert(ret == 0);
+    memset(b->threads, 0, nthreads * sizeof(struct bomp_barrier_thread));
+
+    nodeid_t *numa = malloc(nthreads * sizeof(nodeid_t));
+    assert(numa != NULL);
+    for (unsigned i = 0; i < nthreads; i++) {
+        numa[i] = barrier_thread_node(i);
+    }
+
+    b->kind = barrier_select(nthreads, numa);
+    switch (b->kind) {
+        case BOMP_BARRIER_TREE:
+            /* every inner level has at most half the nodes of the one below */
+            b->nnodes = 2 * nthreads;
+            ret = posix_memalign((void **)&b->nodes, BOMP_BARRIER_CACHELINE,
+                                 b->nnodes * sizeof(struct bomp_barrier_node));
+            assert(ret == 0);
+            memset(b->nodes, 0, b->nnodes * sizeof(struct bomp_barrier_node));
+            barrier_tree_build(b, numa);
+            break;
+        case BOMP_BARRIER_DISSEMINATION:
+            while ((1U << b->rounds) < nthreads) {
+                b->rounds++;
+            }
+            ret = posix_memalign((void **)&b->flags, BOMP_BARRIER_CACHELINE,
+                                 nthreads * b->rounds
+                                    * sizeof(struct bomp_barrier_flag));
+            assert(ret == 0);
+            memset(b->flags, 0,
+                   nthreads * b->rounds * sizeof(struct bomp_barrier_flag));
+            break;
+        default:
+            b->kind = BOMP_BARRIER_CENTRAL;
+            break;
+    }
+
+    free(numa);
+    g_bomp_state->barrier = b;
+}
+
+void bomp_set_barrier(bomp_barrier_t kind)
+{
+    assert(!omp_in_parallel());
+    barrier_kind = kind;
+}
+
 void GOMP_barrier(void)
 {
     assert(g_bomp_state);
 
     struct bomp_thread_local_data *th_local_data = g_bomp_state->backend.get_tls();
     assert(th_local_data != NULL);
-    bomp_barrier_wait(th_local_data->work->barrier);
+
+    /* the XOMP workers do not share the team barrier */
+    struct bomp_team_barrier *barrier = g_bomp_state->barrier;
+    if (barrier == NULL || g_bomp_state->backend_type == BOMP_BACKEND_XOMP) {
+        bomp_barrier_wait(th_local_data->work->barrier);
+        return;
+    }
+
+    bomp_team_barrier_wait(barrier, th_local_data->work->thread_id);
 }
 
 bool GOMP_barrier_cancel (void)
@@ -52,6 +52,8 @@ struct bomp_state
     bool behaviour_nested;
     bool behaviour_dynamic;
     struct bomp_thread_local_data **tld;
+    struct bomp_loop_state *loops; ///< work sharing state of FOR constructs
+    struct bomp_team_barrier *barrier; ///< barrier of the BARRIER construct
 };
 
 
@@ -0,0 +1,76 @@
+/**
+ * \file
+ * \brief Team barriers of the BARRIER construct
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef __BOMP_BARRIER_H
+#define __BOMP_BARRIER_H
+
+/// size of a cache line, threads spin on flags in separate lines
+#define BOMP_BARRIER_CACHELINE 64
+
+/// number of children of a node of the combining tree
+#define BOMP_BARRIER_FANIN 4
+
+/// maximum depth of the combining tree
+#define BOMP_BARRIER_DEPTH_MAX 16
+
+/// teams on a single NUMA node up to this size use the central barrier
+#define BOMP_BARRIER_FLAT_MAX 4
+
+/*
+ * All barriers count episodes: a thread passing its n-th barrier of the team
+ * waits until a flag reached n. Flags only grow, hence they never have to be
+ * reset and the barrier can be reused by the next team of the same size.
+ */
+
+/// a flag of the dissemination barrier, written by one thread only
+struct bomp_barrier_flag
+{
+    volatile unsigned long episode;   ///< last episode signalled
+} __attribute__((aligned(BOMP_BARRIER_CACHELINE)));
+
+/// node of the combining tree barrier
+struct bomp_barrier_node
+{
+    volatile unsigned count;          ///< children arrived in this episode
+    unsigned max;                     ///< number of children
+    int parent;                       ///< parent node, -1 for the root
+    nodeid_t numa;                    ///< NUMA node of the subtree, -1: mixed
+    volatile unsigned long release;   ///< last episode released
+} __attribute__((aligned(BOMP_BARRIER_CACHELINE)));
+
+/// state of a thread, only accessed by the thread itself
+struct bomp_barrier_thread
+{
+    unsigned long episode;            ///< barriers passed by the thread
+    int leaf;                         ///< tree node the thread arrives at
+} __attribute__((aligned(BOMP_BARRIER_CACHELINE)));
+
+/// barrier of a team, shared by all its threads
+struct bomp_team_barrier
+{
+    bomp_barrier_t kind;              ///< never BOMP_BARRIER_AUTO
+    bomp_barrier_t requested;         ///< kind asked for when created
+    unsigned nthreads;                ///< size of the team
+    unsigned rounds;                  ///< dissemination: ceil(log2(nthreads))
+    unsigned nnodes;                  ///< tree: number of nodes
+    struct bomp_barrier central;      ///< central counter barrier
+    struct bomp_barrier_thread *threads; ///< nthreads thread states
+    struct bomp_barrier_node *nodes;  ///< tree: leaves first, root last
+    struct bomp_barrier_flag *flags;  ///< dissemination: rounds per thread
+};
+
+void bomp_barrier_region_start(unsigned nthreads);
+void bomp_team_barrier_wait(struct bomp_team_barrier *barrier, unsigned tid);
+
+#endif  /* __BOMP_BARRIER_H */
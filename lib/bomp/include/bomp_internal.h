@@ -20,6 +20,8 @@
 #include <abi.h>
 #include <icv.h>
 #include <bomp_backend.h>
+#include <bomp_loop.h>
+#include <bomp_barrier.h>
 
 #include <barrelfish/barrelfish.h>
 
@@ -63,6 +65,9 @@ struct bomp_work {
     unsigned num_threads;
     unsigned num_vtreads;
     struct bomp_barrier *barrier;
+    struct bomp_loop *loop;     ///< loop the thread is working on
+    unsigned long loop_gen;     ///< loops entered in this parallel region
+    struct bomp_loop_bounds combined; ///< combined loop, if not sharing memory
 };
 
 struct bomp_thread_local_data {
@@ -0,0 +1,78 @@
+/**
+ * \file
+ * \brief Work sharing state of the FOR construct
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef __BOMP_LOOP_H
+#define __BOMP_LOOP_H
+
+/// number of loops a thread may run ahead of the slowest thread (nowait)
+#define BOMP_LOOP_SLOTS 4
+
+/// size of a cache line, the ranges of two threads never share one
+#define BOMP_LOOP_CACHELINE 64
+
+/*
+ * Iterations are numbered 0..n-1 and every thread owns a contiguous range of
+ * them. The owner takes chunks from the front of its range, threads that ran
+ * out of work steal the back half of another range, preferring threads on
+ * the same NUMA node.
+ */
+struct bomp_loop_range
+{
+    bomp_lock_t lock;
+    uint32_t lock_pad;      ///< bomp_lock() tests 64 bits, keep them zero
+    long next;              ///< first iteration not taken yet (static: trip)
+    long end;               ///< end of the range (exclusive)
+} __attribute__((aligned(BOMP_LOOP_CACHELINE)));
+
+/// a single work sharing loop of the team
+struct bomp_loop
+{
+    bomp_lock_t lock;
+    uint32_t lock_pad;            ///< bomp_lock() tests 64 bits
+    volatile unsigned long gen;   ///< loop number held plus one, 0 if unused
+    volatile unsigned refs;       ///< threads that have not left the loop
+    unsigned nthreads;            ///< size of the team running the loop
+    omp_sched_t sched;            ///< schedule, never OMP_SCHED_AUTO
+    long start;                   ///< first value of the loop variable
+    long incr;                    ///< increment of the loop variable
+    long chunk;                   ///< minimum chunk size, 0 for static blocks
+    long iterations;              ///< total number of iterations
+    struct bomp_loop_range *ranges; ///< nthreads ranges
+};
+
+/// bounds of a combined parallel loop, entered on the first _next call
+struct bomp_loop_bounds
+{
+    bool valid;                   ///< the region runs a combined loop
+    omp_sched_t sched;
+    long start;
+    long end;
+    long incr;
+    long chunk;
+};
+
+/// loop state of a team, shared by all its threads
+struct bomp_loop_state
+{
+    struct bomp_loop slots[BOMP_LOOP_SLOTS];
+    unsigned max_threads;         ///< number of ranges allocated per slot
+    bool numa;                    ///< NUMA topology is known
+    nodeid_t *nodes;              ///< node of every thread, -1 if unknown
+};
+
+void bomp_loop_region_start(unsigned nthreads);
+void bomp_loop_region_end(void);
+void bomp_loop_combined(struct bomp_loop_bounds *bounds);
+
+#endif  /* __BOMP_LOOP_H */
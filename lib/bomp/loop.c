@@ -7,6 +7,7 @@
  * ETH Zurich D-INFK, Universitaetsstrasse 6, CH-8092 Zurich. Attn: Systems Group.
  */
 #include <bomp_internal.h>
+#include <numa.h>
 
 /*
  * this implements the FOR constructs
@@ -29,16 +30,407 @@
  * GOMP_parallel_loop_static (subfunction, NULL, 0, lb, ub+1, 1, 0);
  * subfunction (NULL);
  * GOMP_parallel_end ();
+ *
+ * Dynamic and guided loops are load balanced by work stealing: every thread
+ * starts with a contiguous share of the iterations and takes chunks from its
+ * front. A thread that runs out steals the back half of the share of another
+ * thread, first from threads on its own NUMA node. Static loops never steal.
+ *
+ * The threads of the XOMP backend do not share memory with the master. They
+ * run every loop in static blocks, the bounds of a combined parallel loop
+ * are passed to them along with their work.
  */
 
-bool GOMP_loop_ordered_runtime_start(long start,
-                                     long end,
-                                     long incr,
-                                     long *istart,
-                                     long *iend)
+/// combined parallel loop, entered by the threads on their first _next call
+static struct bomp_loop_bounds pending;
+
+/// 0: not initialized, 1: NUMA topology available, -1: not available
+static int loop_numa = 0;
+
+static long loop_iterations(long start, long end, long incr)
 {
-    assert(!"NYI");
-    return 0;
+    if (incr > 0) {
+        return start < end ? (end - start + incr - 1) / incr : 0;
+    } else {
+        return start > end ? (start - end - incr - 1) / -incr : 0;
+    }
+}
+
+/**
+ * \brief returns the work of the calling thread if the team shares memory and
+ *        the calling thread is inside a parallel region
+ */
+static struct bomp_work *loop_get_work(void)
+{
+    if (g_bomp_state == NULL || g_bomp_state->tld == NULL
+        || g_bomp_state->loops == NULL
+        || g_bomp_state->backend_type == BOMP_BACKEND_XOMP) {
+        return NULL;
+    }
+
+    struct bomp_thread_local_data *tls = g_bomp_state->backend.get_tls();
+    return tls ? tls->work : NULL;
+}
+
+/**
+ * \brief hands out the static block of the calling thread
+ *
+ * Used outside of parallel regions and for teams that do not share memory
+ * with the master.
+ */
+static bool loop_static_block(long start, long end, long incr,
+                              long *istart, long *iend)
+{
+    long n = loop_iterations(start, end, incr);
+    long nthreads = omp_get_num_threads();
+    long tid = omp_get_thread_num();
+
+    long lo = (n / nthreads) * tid + MIN(tid, n % nthreads);
+    long hi = lo + n / nthreads + (tid < n % nthreads ? 1 : 0);
+    if (lo == hi) {
+        return false;
+    }
+
+    *istart = start + lo * incr;
+    *iend = start + hi * incr;
+    return true;
+}
+
+static void loop_init(struct bomp_loop *loop, omp_sched_t sched, long start,
+                      long end, long incr, long chunk)
+{
+    unsigned n = g_bomp_state->num_threads;
+    assert(n <= g_bomp_state->loops->max_threads);
+
+    loop->nthreads = n;
+    loop->sched = (sched == OMP_SCHED_AUTO) ? OMP_SCHED_GUIDED : sched;
+    loop->start = start;
+    loop->incr = incr;
+    loop->iterations = loop_iterations(start, end, incr);
+    if (loop->sched == OMP_SCHED_STATIC) {
+        loop->chunk = chunk > 0 ? chunk : 0;
+    } else {
+        loop->chunk = chunk > 0 ? chunk : 1;
+    }
+
+    long share = loop->iterations / n, rest = loop->iterations % n;
+    for (unsigned t = 0; t < n; t++) {
+        struct bomp_loop_range *r = &loop->ranges[t];
+        if (loop->sched == OMP_SCHED_STATIC && loop->chunk > 0) {
+            // round robin chunks, next counts the chunks taken by the thread
+            r->next = 0;
+            r->end = 0;
+        } else {
+            r->next = share * t + MIN(t, rest);
+            r->end = r->next + share + (t < rest ? 1 : 0);
+        }
+    }
+}
+
+/**
+ * \brief enters the next loop of the parallel region
+ *
+ * The first thread to arrive sets the loop up, threads may be up to
+ * BOMP_LOOP_SLOTS loops ahead of the slowest thread of the team.
+ */
+static void loop_enter(struct bomp_work *work, omp_sched_t sched, long start,
+                       long end, long incr, long chunk)
+{
+    struct bomp_loop_state *ls = g_bomp_state->loops;
+
+    unsigned long gen = work->loop_gen++;
+    if (gen == 0 && ls->numa) {
+        ls->nodes[work->thread_id] = numa_current_node();
+    }
+
+    struct bomp_loop *loop = &ls->slots[gen % BOMP_LOOP_SLOTS];
+    bomp_lock(&loop->lock);
+    while (loop->gen != gen + 1) {
+        if (loop->refs == 0) {
+            loop_init(loop, sched, start, end, incr, chunk);
+            loop->refs = loop->nthreads;
+            loop->gen = gen + 1;
+            break;
+        }
+        // slowest thread is still in the loop that used the slot before
+        bomp_unlock(&loop->lock);
+        thread_yield();
+        bomp_lock(&loop->lock);
+    }
+    bomp_unlock(&loop->lock);
+
+    work->loop = loop;
+}
+
+/// returns the size of the next chunk taken from a range with left iterations
+static inline long loop_chunk_size(struct bomp_loop *loop, long left)
+{
+    long size = loop->chunk;
+    if (loop->sched == OMP_SCHED_GUIDED) {
+        // halving the own share shrinks the chunks like remaining/nthreads
+        size = MAX(size, (left + 1) / 2);
+    }
+    return MIN(size, left);
+}
+
+static bool loop_take(struct bomp_loop *loop, struct bomp_loop_range *r,
+                      long *lo, long *hi)
+{
+    bool found = false;
+
+    bomp_lock(&r->lock);
+    long left = r->end - r->next;
+    if (left > 0) {
+        *lo = r->next;
+        *hi = r->next + loop_chunk_size(loop, left);
+        r->next = *hi;
+        found = true;
+    }
+    bomp_unlock(&r->lock);
+
+    return found;
+}
+
+static bool loop_take_static(struct bomp_loop *loop, unsigned tid,
+                             long *lo, long *hi)
+{
+    struct bomp_loop_range *r = &loop->ranges[tid];
+
+    if (loop->chunk == 0) {
+        // one block per thread
+        if (r->next == r->end) {
+            return false;
+        }
+        *lo = r->next;
+        *hi = r->end;
+        r->next = r->end;
+        return true;
+    }
+
+    long first = (r->next * loop->nthreads + tid) * loop->chunk;
+    if (first >= loop->iterations) {
+        return false;
+    }
+    *lo = first;
+    *hi = MIN(first + loop->chunk, loop->iterations);
+    r->next++;
+    return true;
+}
+
+/**
+ * \brief steals half of the remaining iterations of another thread
+ *
+ * Keeps the first chunk of the stolen iterations for the caller and makes the
+ * rest its new range, so others can in turn steal from it.
+ */
+static bool loop_steal(struct bomp_loop *loop, unsigned tid, long *lo, long *hi)
+{
+    struct bomp_loop_state *ls = g_bomp_state->loops;
+    nodeid_t mine = ls->nodes[tid];
+
+    // first pass: threads on the own node, second pass: all others
+    for (int pass = ls->numa ? 0 : 1; pass < 2; pass++) {
+        for (unsigned i = 1; i < loop->nthreads; i++) {
+            unsigned victim = (tid + i) % loop->nthreads;
+            bool local = ls->numa && ls->nodes[victim] == mine;
+            if ((pass == 0) != local) {
+                continue;
+            }
+
+            struct bomp_loop_range *r = &loop->ranges[victim];
+            if (r->end - r->next <= 0) {
+                continue;
+            }
+
+            long from = 0, to = 0;
+            bomp_lock(&r->lock);
+            long left = r->end - r->next;
+            if (left > 0) {
+                long size = left <= loop->chunk ? left : (left + 1) / 2;
+                to = r->end;
+                from = to - size;
+                r->end = from;
+            }
+            bomp_unlock(&r->lock);
+            if (from == to) {
+                continue;
+            }
+
+            *lo = from;
+            *hi = from + loop_chunk_size(loop, to - from);
+
+            struct bomp_loop_range *own = &loop->ranges[tid];
+            bomp_lock(&own->lock);
+            own->next = *hi;
+            own->end = to;
+            bomp_unlock(&own->lock);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * \brief hands out the static block of a combined loop to a thread of a team
+ *        that does not share memory with the master, once per thread
+ */
+static bool loop_next_unshared(long *istart, long *iend)
+{
+    if (g_bomp_state == NULL
+        || g_bomp_state->backend_type != BOMP_BACKEND_XOMP) {
+        return false;
+    }
+
+    struct bomp_thread_local_data *tls = g_bomp_state->backend.get_tls();
+    struct bomp_work *work = tls ? tls->work : NULL;
+    if (work == NULL || !work->combined.valid || work->loop_gen != 0) {
+        return false;
+    }
+    work->loop_gen = 1;
+
+    return loop_static_block(work->combined.start, work->combined.end,
+                             work->combined.incr, istart, iend);
+}
+
+static bool loop_next(long *istart, long *iend)
+{
+    struct bomp_work *work = loop_get_work();
+    if (work == NULL) {
+        // static blocks of other loops are handed out completely by _start
+        return loop_next_unshared(istart, iend);
+    }
+
+    if (work->loop == NULL) {
+        if (!pending.valid || work->loop_gen != 0) {
+            return false;
+        }
+        loop_enter(work, pending.sched, pending.start, pending.end,
+                   pending.incr, pending.chunk);
+    }
+
+    struct bomp_loop *loop = work->loop;
+    unsigned tid = work->thread_id;
+    long lo, hi;
+    bool found;
+
+    if (loop->sched == OMP_SCHED_STATIC) {
+        found = loop_take_static(loop, tid, &lo, &hi);
+    } else {
+        found = loop_take(loop, &loop->ranges[tid], &lo, &hi)
+                || loop_steal(loop, tid, &lo, &hi);
+    }
+    if (!found) {
+        return false;
+    }
+
+    *istart = loop->start + lo * loop->incr;
+    *iend = loop->start + hi * loop->incr;
+    return true;
+}
+
+static bool loop_start(omp_sched_t sched, long start, long end, long incr,
+                       long chunk, long *istart, long *iend)
+{
+    struct bomp_work *work = loop_get_work();
+    if (work == NULL) {
+        return loop_static_block(start, end, incr, istart, iend);
+    }
+
+    loop_enter(work, sched, start, end, incr, chunk);
+    return loop_next(istart, iend);
+}
+
+static void loop_set_pending(omp_sched_t sched, long start, long end,
+                             long incr, long chunk)
+{
+    pending.sched = sched;
+    pending.start = start;
+    pending.end = end;
+    pending.incr = incr;
+    pending.chunk = chunk;
+    pending.valid = true;
+}
+
+/**
+ * \brief sets up the loop state for a new team
+ *
+ * Called by the master before the threads of the team are started.
+ */
+void bomp_loop_region_start(unsigned nthreads)
+{
+    struct bomp_loop_state *ls = g_bomp_state->loops;
+
+    if (loop_numa == 0) {
+        loop_numa = err_is_ok(numa_available()) ? 1 : -1;
+    }
+
+    if (ls == NULL || ls->max_threads < nthreads) {
+        if (ls != NULL) {
+            for (int i = 0; i < BOMP_LOOP_SLOTS; i++) {
+                free(ls->slots[i].ranges);
+            }
+            free(ls->nodes);
+            free(ls);
+        }
+
+        ls = calloc(1, sizeof(*ls));
+        assert(ls != NULL);
+        ls->max_threads = nthreads;
+        ls->nodes = calloc(nthreads, sizeof(nodeid_t));
+        assert(ls->nodes != NULL);
+        for (int i = 0; i < BOMP_LOOP_SLOTS; i++) {
+            void *ranges;
+            int ret = posix_memalign(&ranges, BOMP_LOOP_CACHELINE,
+                                     nthreads * sizeof(struct bomp_loop_range));
+            assert(ret == 0);
+            ls->slots[i].ranges = ranges;
+        }
+        g_bomp_state->loops = ls;
+    }
+
+    ls->numa = (loop_numa == 1);
+    for (unsigned i = 0; i < ls->max_threads; i++) {
+        ls->nodes[i] = (nodeid_t)-1;
+    }
+    for (int i = 0; i < BOMP_LOOP_SLOTS; i++) {
+        ls->slots[i].gen = 0;
+        ls->slots[i].refs = 0;
+        for (unsigned t = 0; t < ls->max_threads; t++) {
+            ls->slots[i].ranges[t].lock = 0;
+            ls->slots[i].ranges[t].lock_pad = 0;
+        }
+    }
+}
+
+/**
+ * \brief forgets the combined loop of the team that just ended
+ */
+void bomp_loop_region_end(void)
+{
+    pending.valid = false;
+}
+
+/**
+ * \brief returns the combined loop of the region being started
+ *
+ * Used by backends whose threads do not share memory with the master, to
+ * pass the loop on with the work of every thread.
+ */
+void bomp_loop_combined(struct bomp_loop_bounds *bounds)
+{
+    *bounds = pending;
+}
+
+bool GOMP_loop_static_start(long start,
+                            long end,
+                            long incr,
+                            long chunk_size,
+                            long *istart,
+                            long *iend)
+{
+    return loop_start(OMP_SCHED_STATIC, start, end, incr, chunk_size, istart,
+                      iend);
 }
 
 bool GOMP_loop_dynamic_start(long start,
@@ -47,16 +439,67 @@ bool GOMP_loop_dynamic_start(long start,
                              long chunk_size,
                              long *istart,
                              long *iend)
+{
+    return loop_start(OMP_SCHED_DYNAMIC, start, end, incr, chunk_size, istart,
+                      iend);
+}
+
+bool GOMP_loop_guided_start(long start,
+                            long end,
+                            long incr,
+                            long chunk_size,
+                            long *istart,
+                            long *iend)
+{
+    return loop_start(OMP_SCHED_GUIDED, start, end, incr, chunk_size, istart,
+                      iend);
+}
+
+bool GOMP_loop_runtime_start(long start,
+                             long end,
+                             long incr,
+                             long *istart,
+                             long *iend)
+{
+    omp_sched_t sched;
+    int chunk_size;
+    omp_get_schedule(&sched, &chunk_size);
+
+    return loop_start(sched, start, end, incr, chunk_size, istart, iend);
+}
+
+bool GOMP_loop_ordered_runtime_start(long start,
+                                     long end,
+                                     long incr,
+                                     long *istart,
+                                     long *iend)
 {
     assert(!"NYI");
     return 0;
 }
 
+bool GOMP_loop_static_next(long *istart,
+                           long *iend)
+{
+    return loop_next(istart, iend);
+}
+
+bool GOMP_loop_dynamic_next(long *istart,
+                            long *iend)
+{
+    return loop_next(istart, iend);
+}
+
+bool GOMP_loop_guided_next(long *istart,
+                           long *iend)
+{
+    return loop_next(istart, iend);
+}
+
 bool GOMP_loop_runtime_next(long *istart,
                             long *iend)
 {
-    assert(!"NYI");
-    return 0;
+    return loop_next(istart, iend);
 }
 
 bool GOMP_loop_ordered_runtime_next(long *istart,
@@ -66,20 +509,129 @@ bool GOMP_loop_ordered_runtime_next(long *istart,
     return 0;
 }
 
-bool GOMP_loop_dynamic_next(long *istart,
-                            long *iend)
+void GOMP_parallel_loop_static_start(void (*fn)(void *),
+                                     void *data,
+                                     unsigned num_threads,
+                                     long start,
+                                     long end,
+                                     long incr,
+                                     long chunk_size)
 {
-    assert(!"NYI");
-    return 0;
+    loop_set_pending(OMP_SCHED_STATIC, start, end, incr, chunk_size);
+    GOMP_parallel_start(fn, data, num_threads);
+}
+
+void GOMP_parallel_loop_dynamic_start(void (*fn)(void *),
+                                      void *data,
+                                      unsigned num_threads,
+                                      long start,
+                                      long end,
+                                      long incr,
+                                      long chunk_size)
+{
+    loop_set_pending(OMP_SCHED_DYNAMIC, start, end, incr, chunk_size);
+    GOMP_parallel_start(fn, data, num_threads);
+}
+
+void GOMP_parallel_loop_guided_start(void (*fn)(void *),
+                                     void *data,
+                                     unsigned num_threads,
+                                     long start,
+                                     long end,
+                                     long incr,
+                                     long chunk_size)
+{
+    loop_set_pending(OMP_SCHED_GUIDED, start, end, incr, chunk_size);
+    GOMP_parallel_start(fn, data, num_threads);
+}
+
+void GOMP_parallel_loop_runtime_start(void (*fn)(void *),
+                                      void *data,
+                                      unsigned num_threads,
+                                      long start,
+                                      long end,
+                                      long incr)
+{
+    omp_sched_t sched;
+    int chunk_size;
+    omp_get_schedule(&sched, &chunk_size);
+
+    loop_set_pending(sched, start, end, incr, chunk_size);
+    GOMP_parallel_start(fn, data, num_threads);
+}
+
+void GOMP_parallel_loop_static(void (*fn)(void *),
+                               void *data,
+                               unsigned num_threads,
+                               long start,
+                               long end,
+                               long incr,
+                               long chunk_size,
+                               unsigned flags)
+{
+    GOMP_parallel_loop_static_start(fn, data, num_threads, start, end, incr,
+                                    chunk_size);
+    fn(data);
+    GOMP_parallel_end();
+}
+
+void GOMP_parallel_loop_dynamic(void (*fn)(void *),
+                                void *data,
+                                unsigned num_threads,
+                                long start,
+                                long end,
+                                long incr,
+                                long chunk_size,
+                                unsigned flags)
+{
+    GOMP_parallel_loop_dynamic_start(fn, data, num_threads, start, end, incr,
+                                     chunk_size);
+    fn(data);
+    GOMP_parallel_end();
+}
+
+void GOMP_parallel_loop_guided(void (*fn)(void *),
+                               void *data,
+                               unsigned num_threads,
+                               long start,
+                               long end,
+                               long incr,
+                               long chunk_size,
+                               unsigned flags)
+{
+    GOMP_parallel_loop_guided_start(fn, data, num_threads, start, end, incr,
+                                    chunk_size);
+    fn(data);
+    GOMP_parallel_end();
+}
+
+void GOMP_parallel_loop_runtime(void (*fn)(void *),
+                                void *data,
+                                unsigned num_threads,
+                                long start,
+                                long end,
+                                long incr,
+                                unsigned flags)
+{
+    GOMP_parallel_loop_runtime_start(fn, data, num_threads, start, end, incr);
+    fn(data);
+    GOMP_parallel_end();
 }
 
 void GOMP_loop_end_nowait(void)
 {
-    assert(!"NYI");
+    struct bomp_work *work = loop_get_work();
+    if (work != NULL && work->loop != NULL) {
+        __sync_fetch_and_sub(&work->loop->refs, 1);
+        work->loop = NULL;
+    }
 }
 
 void GOMP_loop_end(void)
 {
-    assert(!"NYI");
+    struct bomp_work *work = loop_get_work();
+    GOMP_loop_end_nowait();
+    if (work != NULL) {
+        GOMP_barrier();
+    }
 }
-
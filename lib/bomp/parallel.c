@@ -49,6 +49,8 @@ void GOMP_parallel_start(void (*fn)(void *),
 
             nthreads = g_bomp_state->bomp_threads;
         }
+        bomp_loop_region_start(nthreads);
+        bomp_barrier_region_start(nthreads);
         g_bomp_state->backend.start_processing(fn, data, nthreads);
     }
     g_bomp_state->nested++;
@@ -63,6 +65,7 @@ void GOMP_parallel_end(void)
     assert(g_bomp_state != NULL);
     if (g_bomp_state->nested == 1) {
         g_bomp_state->backend.end_processing();
+        bomp_loop_region_end();
     }
     g_bomp_state->nested--;
 }
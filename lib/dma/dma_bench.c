@@ -18,6 +18,7 @@
 
 #include <dma_internal.h>
 #include <dma/dma_bench.h>
+#include <dma/sw/sw_dma_device.h>
 #include <dma_device_internal.h>
 #include <dma_channel_internal.h>
 #include <dma_request_internal.h>
@@ -303,3 +304,45 @@ errval_t dma_bench_run_memcpy(void *dst, void *src)
 
     return SYS_ERR_OK;
 }
+
+/**
+ * \brief runs the benchmark on a software DMA device
+ *
+ * \param frame frame containing the source and destination buffers
+ * \param src   physical address of the source buffer
+ * \param dst   physical address of the destination buffer
+ * \param core  core of the worker copying the data
+ *
+ * Gives the numbers to compare with dma_bench_run() on a hardware device and
+ * with dma_bench_run_memcpy() on the same buffers.
+ */
+errval_t dma_bench_run_sw(struct capref frame, lpaddr_t src, lpaddr_t dst,
+                          coreid_t core)
+{
+    errval_t err;
+
+    struct sw_dma_device *dev;
+    err = sw_dma_device_init(1, core, &dev);
+    if (err_is_fail(err)) {
+        return err;
+    }
+
+    err = dma_register_memory((struct dma_device *)dev, frame);
+    if (err_is_fail(err)) {
+        sw_dma_device_shutdown(dev);
+        return err;
+    }
+
+    debug_printf("starting benchmark software DMA (worker on core %u)\n", core);
+    debug_printf("======================================\n");
+
+    err = dma_bench_run((struct dma_device *)dev, src, dst);
+
+    debug_printf("======================================\n");
+
+    errval_t err2 = sw_dma_device_shutdown(dev);
+    if (err_is_fail(err)) {
+        return err;
+    }
+    return err2;
+}
@@ -50,6 +50,15 @@
 #define XPHI_DEBUG_DESC_ENABLED    1
 #define XPHI_DEBUG_INTR_ENABLED    1
 
+/*
+ * ---------------------------------------------------------------------------
+ *  Software DMA debug switches
+ */
+#define SW_DMA_DEBUG_ENABLED        1
+#define SWDMA_DEBUG_CHAN_ENABLED    1
+#define SWDMA_DEBUG_DEVICE_ENABLED  1
+#define SWDMA_DEBUG_REQUEST_ENABLED 1
+
 /*
  * ---------------------------------------------------------------------------
  *  DMA client debug switches
@@ -194,6 +203,33 @@
 #endif
 
 
+/*
+ * --------------------------------------------------------------------------
+ *  Software DMA Debug output generation
+ */
+
+#if (LIB_DMA_DEBUG_ENABLED && SW_DMA_DEBUG_ENABLED)
+#define SWDMA_DEBUG_PRINT(x...) debug_printf(x)
+#else
+#define SWDMA_DEBUG_PRINT(x... )
+#endif
+#if SWDMA_DEBUG_CHAN_ENABLED
+#define SWDMACHAN_DEBUG(x...) SWDMA_DEBUG_PRINT("[swdma chan.%04x] " x)
+#else
+#define SWDMACHAN_DEBUG(x...)
+#endif
+#if SWDMA_DEBUG_REQUEST_ENABLED
+#define SWDMAREQ_DEBUG(x...) SWDMA_DEBUG_PRINT("[swdma req] " x)
+#else
+#define SWDMAREQ_DEBUG(x...)
+#endif
+#if SWDMA_DEBUG_DEVICE_ENABLED
+#define SWDMADEV_DEBUG(x...) SWDMA_DEBUG_PRINT("[swdma dev.%02x] " x)
+#else
+#define SWDMADEV_DEBUG(x...)
+#endif
+
+
 /*
  * --------------------------------------------------------------------------
  *  DMA Client debug output generation
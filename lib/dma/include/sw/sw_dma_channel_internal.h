@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2016 ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetsstrasse 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef SW_DMA_CHANNEL_INTERNAL_H
+#define SW_DMA_CHANNEL_INTERNAL_H
+
+#include <dma_channel_internal.h>
+
+/**
+ * \brief initializes a new software DMA channel and starts its worker
+ *
+ * \param dev       software DMA device
+ * \param id        id of this channel
+ * \param core      core the worker runs on
+ * \param ret_chan  returned channel pointer
+ *
+ * \returns SYS_ERR_OK on success
+ */
+errval_t sw_dma_channel_init(struct sw_dma_device *dev,
+                             uint8_t id,
+                             coreid_t core,
+                             struct sw_dma_channel **ret_chan);
+
+/**
+ * \brief stops the worker of the channel and frees up its resources
+ *
+ * \param chan  software DMA channel
+ *
+ * \returns SYS_ERR_OK on success
+ */
+errval_t sw_dma_channel_free(struct sw_dma_channel *chan);
+
+/**
+ * \brief returns the descriptor ring of a channel
+ *
+ * \param chan  software DMA channel
+ */
+struct dma_ring *sw_dma_channel_get_ring(struct sw_dma_channel *chan);
+
+/**
+ * \brief enqueues a request onto the channel and hands its descriptors to
+ *        the worker
+ *
+ * \param chan  software DMA channel
+ * \param req   software DMA request to be submitted
+ *
+ * \returns SYS_ERR_OK on success
+ */
+errval_t sw_dma_channel_submit_request(struct sw_dma_channel *chan,
+                                       struct sw_dma_request *req);
+
+/**
+ * \brief polls the software DMA channel for completed requests
+ *
+ * \param chan  DMA channel
+ *
+ * \returns SYS_ERR_OK if there was something processed
+ *          DMA_ERR_CHAN_IDLE if there was no request on the channel
+ */
+errval_t sw_dma_channel_poll(struct dma_channel *chan);
+
+#endif /* SW_DMA_CHANNEL_INTERNAL_H */
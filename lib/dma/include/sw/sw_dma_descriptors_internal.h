@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2016 ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetsstrasse 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef SW_DMA_DESCRIPTORS_INTERNAL_H
+#define SW_DMA_DESCRIPTORS_INTERNAL_H
+
+#include <dma_descriptor_internal.h>
+
+/// size of a software descriptor, one per cache line
+#define SW_DMA_DESC_SIZE 64
+
+/// alignment of the software descriptors
+#define SW_DMA_DESC_ALIGN 64
+
+/* descriptor operations */
+#define SW_DMA_DESC_OP_NOP      0
+#define SW_DMA_DESC_OP_MEMCPY   1
+#define SW_DMA_DESC_OP_MEMSET   2
+
+/**
+ * descriptor as read by the worker of a software DMA channel. The addresses
+ * are already translated to virtual addresses of our domain.
+ */
+struct sw_dma_desc
+{
+    lvaddr_t src;          ///< source address (memcpy)
+    lvaddr_t dst;          ///< destination address
+    uint64_t bytes;        ///< number of bytes to transfer
+    uint64_t val;          ///< value to set (memset)
+    uint32_t op;           ///< SW_DMA_DESC_OP_*
+};
+
+STATIC_ASSERT(sizeof(struct sw_dma_desc) <= SW_DMA_DESC_SIZE,
+              "software DMA descriptor too large");
+
+static inline struct sw_dma_desc *sw_dma_desc_get(struct dma_descriptor *desc)
+{
+    return (struct sw_dma_desc *) dma_desc_get_desc_handle(desc);
+}
+
+/**
+ * \brief initializes a memcpy descriptor
+ *
+ * \param desc  DMA descriptor
+ * \param src   virtual address of the source
+ * \param dst   virtual address of the destination
+ * \param size  number of bytes to copy
+ */
+static inline void sw_dma_desc_fill_memcpy(struct dma_descriptor *desc,
+                                           lvaddr_t src,
+                                           lvaddr_t dst,
+                                           uint64_t size)
+{
+    struct sw_dma_desc *d = sw_dma_desc_get(desc);
+    d->src = src;
+    d->dst = dst;
+    d->bytes = size;
+    d->val = 0;
+    d->op = SW_DMA_DESC_OP_MEMCPY;
+}
+
+/**
+ * \brief initializes a memset descriptor
+ *
+ * \param desc  DMA descriptor
+ * \param val   the 8 byte pattern to set
+ * \param dst   virtual address of the destination
+ * \param size  number of bytes to set
+ */
+static inline void sw_dma_desc_fill_memset(struct dma_descriptor *desc,
+                                           uint64_t val,
+                                           lvaddr_t dst,
+                                           uint64_t size)
+{
+    struct sw_dma_desc *d = sw_dma_desc_get(desc);
+    d->src = 0;
+    d->dst = dst;
+    d->bytes = size;
+    d->val = val;
+    d->op = SW_DMA_DESC_OP_MEMSET;
+}
+
+/**
+ * \brief initializes a NOP descriptor
+ *
+ * \param desc  DMA descriptor
+ */
+static inline void sw_dma_desc_fill_nop(struct dma_descriptor *desc)
+{
+    struct sw_dma_desc *d = sw_dma_desc_get(desc);
+    d->src = 0;
+    d->dst = 0;
+    d->bytes = 0;
+    d->val = 0;
+    d->op = SW_DMA_DESC_OP_NOP;
+}
+
+#endif /* SW_DMA_DESCRIPTORS_INTERNAL_H */
@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2016 ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetsstrasse 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef SW_DMA_DEVICE_INTERNAL_H
+#define SW_DMA_DEVICE_INTERNAL_H
+
+#include <dma_device_internal.h>
+#include <dma/sw/sw_dma_device.h>
+
+/**
+ * \brief translates a physical address range of a request into the virtual
+ *        address where it is mapped in our domain
+ *
+ * \param dev    software DMA device
+ * \param paddr  physical address
+ * \param bytes  size of the range
+ * \param vaddr  returns the virtual address
+ *
+ * \returns SYS_ERR_OK on success
+ *          DMA_ERR_MEM_NOT_REGISTERED if the range is not within a frame
+ *          registered with the device
+ */
+errval_t sw_dma_device_translate(struct sw_dma_device *dev,
+                                 lpaddr_t paddr,
+                                 size_t bytes,
+                                 lvaddr_t *vaddr);
+
+#endif /* SW_DMA_DEVICE_INTERNAL_H */
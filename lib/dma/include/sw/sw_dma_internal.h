@@ -0,0 +1,16 @@
+/*
+ * Copyright (c) 2016 ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetsstrasse 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef SW_DMA_INTERNAL_H
+#define SW_DMA_INTERNAL_H
+
+#include <dma_internal.h>
+#include <dma/sw/sw_dma.h>
+
+#endif /* SW_DMA_INTERNAL_H */
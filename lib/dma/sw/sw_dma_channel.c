@@ -0,0 +1,470 @@
+/*
+ * Copyright (c) 2016, ETH Zurich. All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetsstrasse 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <string.h>
+#include <barrelfish/barrelfish.h>
+
+#include <dma_ring_internal.h>
+#include <sw/sw_dma_internal.h>
+#include <sw/sw_dma_device_internal.h>
+#include <sw/sw_dma_channel_internal.h>
+#include <sw/sw_dma_descriptors_internal.h>
+#include <sw/sw_dma_request_internal.h>
+
+#include <debug.h>
+
+#if defined(__x86_64__) && !defined(__k1om__)
+/// copy with SSE2 non-temporal stores
+#define SW_DMA_SIMD 1
+#else
+#define SW_DMA_SIMD 0
+#endif
+
+/*
+ * The channel mimics the interface of the IOAT hardware: the issuing thread
+ * writes the descriptors into the ring and bumps dmacount, the worker executes
+ * them in order and writes back the physical address of the last executed
+ * descriptor to completion. Both are on their own cache line.
+ */
+struct sw_dma_channel
+{
+    struct dma_channel common;
+
+    struct dma_ring *ring;           ///< Descriptor ring
+    lpaddr_t last_completion;        ///< completion processed last
+    coreid_t core;                   ///< core of the worker
+    struct thread *worker;           ///< worker thread
+
+    uint8_t pad0[CACHE_LINE_SIZE];
+    volatile uint16_t dmacount;      ///< number of issued descriptors
+    volatile uint8_t stop;           ///< worker exits when idle
+    uint8_t pad1[CACHE_LINE_SIZE];
+    volatile lpaddr_t completion;    ///< address of last executed descriptor
+    uint8_t pad2[CACHE_LINE_SIZE];
+};
+
+/*
+ * ----------------------------------------------------------------------------
+ * Copy Engine
+ * ----------------------------------------------------------------------------
+ */
+
+#if SW_DMA_SIMD
+/**
+ * \brief copies with non-temporal stores, which do not pollute the caches with
+ *        the destination
+ */
+static void copy_nontemporal(uint8_t *dst,
+                             const uint8_t *src,
+                             size_t bytes)
+{
+    /* align the destination to a cache line */
+    size_t head = (-(uintptr_t) dst) & (CACHE_LINE_SIZE - 1);
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    bytes -= head;
+
+    for (; bytes >= CACHE_LINE_SIZE; bytes -= CACHE_LINE_SIZE) {
+        __asm volatile("movdqu    0(%1), %%xmm0\n\t"
+                       "movdqu   16(%1), %%xmm1\n\t"
+                       "movdqu   32(%1), %%xmm2\n\t"
+                       "movdqu   48(%1), %%xmm3\n\t"
+                       "movntdq %%xmm0,  0(%0)\n\t"
+                       "movntdq %%xmm1, 16(%0)\n\t"
+                       "movntdq %%xmm2, 32(%0)\n\t"
+                       "movntdq %%xmm3, 48(%0)\n\t"
+                       :
+                       : "r" (dst), "r" (src)
+                       : "xmm0", "xmm1", "xmm2", "xmm3", "memory");
+        dst += CACHE_LINE_SIZE;
+        src += CACHE_LINE_SIZE;
+    }
+
+    memcpy(dst, src, bytes);
+}
+
+/**
+ * \brief sets memory to a repeated 8 byte pattern with non-temporal stores
+ */
+static void set_nontemporal(uint8_t *dst,
+                            uint64_t val,
+                            size_t bytes)
+{
+    uint8_t *pattern = (uint8_t *) &val;
+
+    /* align the destination to a cache line */
+    size_t head = (-(uintptr_t) dst) & (CACHE_LINE_SIZE - 1);
+    for (size_t i = 0; i < head; ++i) {
+        dst[i] = pattern[i & 0x7];
+    }
+
+    /* the pattern as seen from the aligned destination */
+    uint8_t rot = head & 0x7;
+    uint64_t v = val;
+    if (rot) {
+        v = (val >> (8 * rot)) | (val << (64 - 8 * rot));
+    }
+
+    size_t pos = head;
+    __asm volatile("movq       %0, %%xmm0\n\t"
+                   "punpcklqdq %%xmm0, %%xmm0"
+                   :
+                   : "r" (v)
+                   : "xmm0");
+    for (; bytes - pos >= CACHE_LINE_SIZE; pos += CACHE_LINE_SIZE) {
+        __asm volatile("movntdq %%xmm0,  0(%0)\n\t"
+                       "movntdq %%xmm0, 16(%0)\n\t"
+                       "movntdq %%xmm0, 32(%0)\n\t"
+                       "movntdq %%xmm0, 48(%0)\n\t"
+                       :
+                       : "r" (dst + pos)
+                       : "memory");
+    }
+
+    for (; pos < bytes; ++pos) {
+        dst[pos] = pattern[pos & 0x7];
+    }
+}
+#endif
+
+/**
+ * \brief executes a single descriptor
+ */
+static void worker_execute(struct sw_dma_desc *desc)
+{
+    uint8_t *dst = (uint8_t *) desc->dst;
+
+    switch (desc->op) {
+        case SW_DMA_DESC_OP_MEMCPY:
+#if SW_DMA_SIMD
+            if (desc->bytes >= SW_DMA_NONTEMPORAL_MIN) {
+                copy_nontemporal(dst, (uint8_t *) desc->src, desc->bytes);
+                break;
+            }
+#endif
+            memcpy(dst, (void *) desc->src, desc->bytes);
+            break;
+        case SW_DMA_DESC_OP_MEMSET:
+#if SW_DMA_SIMD
+            if (desc->bytes >= SW_DMA_NONTEMPORAL_MIN) {
+                set_nontemporal(dst, desc->val, desc->bytes);
+                break;
+            }
+#endif
+            for (uint64_t i = 0; i < desc->bytes; ++i) {
+                dst[i] = ((uint8_t *) &desc->val)[i & 0x7];
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * \brief worker thread executing the descriptors of a channel
+ */
+static int channel_worker(void *arg)
+{
+    struct sw_dma_channel *chan = arg;
+
+    uint16_t executed = 0;
+
+    for (;;) {
+        uint16_t dmacount = chan->dmacount;
+        if (executed == dmacount) {
+            if (chan->stop) {
+                break;
+            }
+            thread_yield();
+            continue;
+        }
+
+        /* read the descriptors only after the doorbell */
+        __sync_synchronize();
+
+        do {
+            struct dma_descriptor *desc = dma_ring_get_desc(chan->ring,
+                                                            executed++);
+            worker_execute(sw_dma_desc_get(desc));
+
+            /* the data must be visible before the completion */
+#if SW_DMA_SIMD
+            __asm volatile("sfence" ::: "memory");
+#else
+            __sync_synchronize();
+#endif
+            chan->completion = dma_desc_get_paddr(desc);
+        } while (executed != dmacount);
+    }
+
+    SWDMACHAN_DEBUG("worker exits after %u descriptors\n", chan->common.id,
+                    executed);
+
+    return 0;
+}
+
+/**
+ * \brief processes the completed descriptors of a DMA channel and finishes
+ *        the requests
+ *
+ * \param chan             software DMA channel
+ * \param compl_addr_phys  physical address of the last completed descriptor
+ *
+ * \returns SYS_ERR_OK on if the request was processed to completion
+ *          DMA_ERR_CHAN_IDLE if there was no descriptor to process
+ *          DMA_ERR_REQUEST_UNFINISHED if the request is still not finished
+ *          errval on error
+ */
+static errval_t channel_process_descriptors(struct sw_dma_channel *chan,
+                                            lpaddr_t compl_addr_phys)
+{
+    errval_t err;
+
+    if (!compl_addr_phys) {
+        return DMA_ERR_CHAN_IDLE;
+    }
+
+    SWDMACHAN_DEBUG("processing [%016lx] wrnxt: %u, tail: %u, issued: %u\n",
+                    chan->common.id, compl_addr_phys,
+                    dma_ring_get_write_next(chan->ring),
+                    dma_ring_get_tail(chan->ring),
+                    dma_ring_get_issued(chan->ring));
+
+    uint16_t active_count = dma_ring_get_active(chan->ring);
+
+    struct dma_descriptor *desc;
+    struct dma_request *req;
+    struct dma_request *req_head;
+
+    uint8_t request_done = 0;
+
+    for (uint16_t i = 0; i < active_count; i++) {
+        desc = dma_ring_get_tail_desc(chan->ring);
+
+        /*
+         * check if there is a request associated with the descriptor
+         * this indicates the last descriptor of a request
+         */
+        req = dma_desc_get_request(desc);
+        if (req) {
+            req_head = dma_channel_deq_request_head(&chan->common);
+            assert(req_head == req);
+            err = sw_dma_request_process((struct sw_dma_request *) req);
+            if (err_is_fail(err)) {
+                dma_channel_enq_request_head(&chan->common, req_head);
+                return err;
+            }
+            request_done = 1;
+        }
+
+        /* this was the last completed descriptor */
+        if (dma_desc_get_paddr(desc) == compl_addr_phys) {
+            break;
+        }
+    }
+
+    chan->last_completion = compl_addr_phys;
+
+    if (request_done) {
+        return SYS_ERR_OK;
+    }
+
+    return DMA_ERR_REQUEST_UNFINISHED;
+}
+
+/**
+ * \brief hands the pending descriptors to the worker
+ *
+ * \param chan  software DMA channel
+ *
+ * \returns number of submitted descriptors
+ */
+static uint16_t channel_issue_pending(struct sw_dma_channel *chan)
+{
+    uint16_t pending = dma_ring_get_pendig(chan->ring);
+
+    SWDMACHAN_DEBUG("issuing %u pending descriptors to worker\n",
+                    chan->common.id, pending);
+
+    if (pending > 0) {
+        uint16_t dmacnt = dma_ring_submit_pending(chan->ring);
+
+        /* the descriptors must be visible before the doorbell */
+        __sync_synchronize();
+        chan->dmacount = dmacnt;
+    }
+
+    return pending;
+}
+
+/*
+ * ============================================================================
+ * Library Internal Interface
+ * ============================================================================
+ */
+
+/**
+ * \brief initializes a new software DMA channel and starts its worker
+ *
+ * \param dev       software DMA device
+ * \param id        id of this channel
+ * \param core      core the worker runs on
+ * \param ret_chan  returned channel pointer
+ *
+ * \returns SYS_ERR_OK on success
+ */
+errval_t sw_dma_channel_init(struct sw_dma_device *dev,
+                             uint8_t id,
+                             coreid_t core,
+                             struct sw_dma_channel **ret_chan)
+{
+    errval_t err;
+
+    struct sw_dma_channel *chan = calloc(1, sizeof(*chan));
+    if (chan == NULL) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+
+    struct dma_device *dma_dev = (struct dma_device *) dev;
+    struct dma_channel *dma_chan = &chan->common;
+
+    dma_chan->id = dma_channel_id_build(dma_device_get_id(dma_dev), id);
+    dma_chan->device = dma_dev;
+    dma_chan->max_xfer_size = SW_DMA_MAX_XFER_SIZE;
+    chan->core = core;
+
+    SWDMACHAN_DEBUG("initialize channel with worker on core %u\n",
+                    dma_chan->id, core);
+
+    err = dma_ring_alloc(SW_DMA_DESC_RING_SIZE, SW_DMA_DESC_ALIGN,
+                         SW_DMA_DESC_SIZE, 0x0, dma_chan, &chan->ring);
+    if (err_is_fail(err)) {
+        free(chan);
+        return err;
+    }
+
+    err = domain_thread_create_on(core, channel_worker, chan, &chan->worker);
+    if (err_is_fail(err)) {
+        dma_ring_free(chan->ring);
+        free(chan);
+        return err;
+    }
+
+    dma_chan->state = DMA_CHAN_ST_RUNNING;
+    dma_chan->f.memcpy = sw_dma_request_memcpy_chan;
+    dma_chan->f.memset = sw_dma_request_memset_chan;
+    dma_chan->f.poll = sw_dma_channel_poll;
+
+    *ret_chan = chan;
+
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief stops the worker of the channel and frees up its resources
+ *
+ * \param chan  software DMA channel
+ *
+ * \returns SYS_ERR_OK on success
+ */
+errval_t sw_dma_channel_free(struct sw_dma_channel *chan)
+{
+    errval_t err;
+
+    chan->stop = 1;
+    err = domain_thread_join(chan->worker, NULL);
+    if (err_is_fail(err)) {
+        return err;
+    }
+
+    /* finish the requests executed in the meantime */
+    while (chan->common.req_list.head != NULL) {
+        err = sw_dma_channel_poll(&chan->common);
+        if (err_is_fail(err) && err_no(err) != DMA_ERR_CHAN_IDLE) {
+            return err;
+        }
+    }
+
+    err = dma_ring_free(chan->ring);
+    if (err_is_fail(err)) {
+        return err;
+    }
+
+    free(chan);
+
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief returns the descriptor ring of a channel
+ *
+ * \param chan  software DMA channel
+ */
+inline struct dma_ring *sw_dma_channel_get_ring(struct sw_dma_channel *chan)
+{
+    return chan->ring;
+}
+
+/**
+ * \brief enqueues a request onto the channel and hands its descriptors to
+ *        the worker
+ *
+ * \param chan  software DMA channel
+ * \param req   software DMA request to be submitted
+ *
+ * \returns SYS_ERR_OK on success
+ */
+errval_t sw_dma_channel_submit_request(struct sw_dma_channel *chan,
+                                       struct sw_dma_request *req)
+{
+    SWDMACHAN_DEBUG("submit request [%016lx]\n", chan->common.id,
+                    dma_request_get_id((struct dma_request * )req));
+
+    dma_channel_enq_request_tail(&chan->common, (struct dma_request *) req);
+
+    channel_issue_pending(chan);
+
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief polls the software DMA channel for completed requests
+ *
+ * \param chan  DMA channel
+ *
+ * \returns SYS_ERR_OK if there was something processed
+ *          DMA_ERR_CHAN_IDLE if there was no request on the channel
+ */
+errval_t sw_dma_channel_poll(struct dma_channel *chan)
+{
+    errval_t err;
+
+    struct sw_dma_channel *sw_chan = (struct sw_dma_channel *) chan;
+
+    /* check if there can be something to process */
+    if (chan->req_list.head == NULL) {
+        return DMA_ERR_CHAN_IDLE;
+    }
+
+    lpaddr_t compl_addr_phys = sw_chan->completion;
+    if (compl_addr_phys == sw_chan->last_completion) {
+        return DMA_ERR_CHAN_IDLE;
+    }
+
+    err = channel_process_descriptors(sw_chan, compl_addr_phys);
+    switch (err_no(err)) {
+        case SYS_ERR_OK:
+            /* this means we processed a descriptor request */
+            return SYS_ERR_OK;
+        case DMA_ERR_REQUEST_UNFINISHED:
+            return DMA_ERR_CHAN_IDLE;
+        default:
+            return err;
+    }
+}
@@ -0,0 +1,325 @@
+/*
+ * Copyright (c) 2016, ETH Zurich. All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetsstrasse 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <barrelfish/barrelfish.h>
+#include <bench/bench.h>
+
+#include <sw/sw_dma_internal.h>
+#include <sw/sw_dma_device_internal.h>
+#include <sw/sw_dma_channel_internal.h>
+
+#include <debug.h>
+
+/**
+ * frame registered with a software DMA device
+ */
+struct sw_dma_mem
+{
+    struct dma_mem mem;             ///< where the frame is mapped
+    struct sw_dma_mem *next;        ///< next registered frame
+};
+
+/**
+ * software DMA device representation
+ */
+struct sw_dma_device
+{
+    struct dma_device common;
+
+    struct sw_dma_mem *regions;     ///< registered frames
+    struct sw_dma_mem *last_hit;    ///< frame of the last translation
+};
+
+/// counter for device ID enumeration, counting down to not collide with
+/// the hardware devices
+static dma_dev_id_t device_id = 0xFF;
+
+/*
+ * ----------------------------------------------------------------------------
+ * memory registration
+ * ----------------------------------------------------------------------------
+ */
+
+static errval_t device_register_memory(struct dma_device *dev,
+                                       struct capref frame)
+{
+    errval_t err;
+
+    struct sw_dma_device *sw_dev = (struct sw_dma_device *) dev;
+
+    struct frame_identity id;
+    err = frame_identify(frame, &id);
+    if (err_is_fail(err)) {
+        return err;
+    }
+
+    for (struct sw_dma_mem *r = sw_dev->regions; r != NULL; r = r->next) {
+        if (id.base < r->mem.paddr + r->mem.bytes
+            && r->mem.paddr < id.base + id.bytes) {
+            return DMA_ERR_MEM_OVERLAP;
+        }
+    }
+
+    struct sw_dma_mem *r = calloc(1, sizeof(*r));
+    if (r == NULL) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+
+    err = vspace_map_one_frame((void **) &r->mem.vaddr, id.bytes, frame, NULL,
+                               NULL);
+    if (err_is_fail(err)) {
+        free(r);
+        return err;
+    }
+
+    r->mem.paddr = id.base;
+    r->mem.bytes = id.bytes;
+    r->mem.frame = frame;
+
+    SWDMADEV_DEBUG("registered [%016lx] of %lu bytes at %016lx\n", dev->id,
+                   r->mem.paddr, r->mem.bytes, r->mem.vaddr);
+
+    r->next = sw_dev->regions;
+    sw_dev->regions = r;
+
+    return SYS_ERR_OK;
+}
+
+static errval_t device_deregister_memory(struct dma_device *dev,
+                                         struct capref frame)
+{
+    errval_t err;
+
+    struct sw_dma_device *sw_dev = (struct sw_dma_device *) dev;
+
+    struct frame_identity id;
+    err = frame_identify(frame, &id);
+    if (err_is_fail(err)) {
+        return err;
+    }
+
+    struct sw_dma_mem **prev = &sw_dev->regions;
+    for (struct sw_dma_mem *r = sw_dev->regions; r != NULL; r = r->next) {
+        if (r->mem.paddr == id.base && r->mem.bytes == id.bytes) {
+            err = vspace_unmap((void *) r->mem.vaddr);
+            if (err_is_fail(err)) {
+                return err;
+            }
+            *prev = r->next;
+            if (sw_dev->last_hit == r) {
+                sw_dev->last_hit = NULL;
+            }
+            free(r);
+            return SYS_ERR_OK;
+        }
+        prev = &r->next;
+    }
+
+    return DMA_ERR_MEM_NOT_REGISTERED;
+}
+
+/*
+ * ===========================================================================
+ * Library Internal Interface
+ * ===========================================================================
+ */
+
+/**
+ * \brief translates a physical address range of a request into the virtual
+ *        address where it is mapped in our domain
+ *
+ * \param dev    software DMA device
+ * \param paddr  physical address
+ * \param bytes  size of the range
+ * \param vaddr  returns the virtual address
+ *
+ * \returns SYS_ERR_OK on success
+ *          DMA_ERR_MEM_NOT_REGISTERED if the range is not within a frame
+ *          registered with the device
+ */
+errval_t sw_dma_device_translate(struct sw_dma_device *dev,
+                                 lpaddr_t paddr,
+                                 size_t bytes,
+                                 lvaddr_t *vaddr)
+{
+    struct sw_dma_mem *r = dev->last_hit;
+    if (r == NULL || paddr < r->mem.paddr
+        || paddr + bytes > r->mem.paddr + r->mem.bytes) {
+        for (r = dev->regions; r != NULL; r = r->next) {
+            if (paddr >= r->mem.paddr
+                && paddr + bytes <= r->mem.paddr + r->mem.bytes) {
+                break;
+            }
+        }
+        if (r == NULL) {
+            return DMA_ERR_MEM_NOT_REGISTERED;
+        }
+        dev->last_hit = r;
+    }
+
+    *vaddr = r->mem.vaddr + (paddr - r->mem.paddr);
+
+    return SYS_ERR_OK;
+}
+
+/*
+ * ===========================================================================
+ * Public Interface
+ * ===========================================================================
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ * device initialization / termination
+ * ----------------------------------------------------------------------------
+ */
+
+/**
+ * \brief initializes a software DMA device
+ *
+ * \param channels  number of channels, each one gets a worker thread
+ * \param core      core of the first worker, the other ones run on the
+ *                  following cores
+ * \param dev       returns a pointer to the device structure
+ *
+ * \returns SYS_ERR_OK on success
+ *          errval on error
+ */
+errval_t sw_dma_device_init(uint8_t channels,
+                            coreid_t core,
+                            struct sw_dma_device **dev)
+{
+    errval_t err;
+
+    if (channels == 0 || channels > SW_DMA_CHANNELS_MAX) {
+        return DMA_ERR_ARG_INVALID;
+    }
+
+    struct sw_dma_device *sw_device = calloc(1, sizeof(*sw_device));
+    if (sw_device == NULL) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+
+#if DMA_BENCH_ENABLED
+     bench_init();
+#endif
+
+    struct dma_device *dma_dev = &sw_device->common;
+
+    dma_dev->id = device_id--;
+    dma_dev->type = DMA_DEV_TYPE_SW;
+    dma_dev->irq_type = DMA_IRQ_DISABLED;
+    dma_dev->state = DMA_DEV_ST_CHAN_ENUM;
+
+    dma_dev->channels.c = calloc(channels, sizeof(*dma_dev->channels.c));
+    if (dma_dev->channels.c == NULL) {
+        free(sw_device);
+        return LIB_ERR_MALLOC_FAIL;
+    }
+
+    SWDMADEV_DEBUG("initializing %u channels on cores %u..%u\n", dma_dev->id,
+                   channels, core, core + channels - 1);
+
+    for (uint8_t i = 0; i < channels; ++i) {
+        struct dma_channel **chan = &dma_dev->channels.c[i];
+        err = sw_dma_channel_init(sw_device, i, core + i,
+                                  (struct sw_dma_channel **) chan);
+        if (err_is_fail(err)) {
+            sw_dma_device_shutdown(sw_device);
+            return err;
+        }
+        dma_dev->channels.count++;
+    }
+
+    dma_dev->f.register_memory = device_register_memory;
+    dma_dev->f.deregister_memory = device_deregister_memory;
+    dma_dev->f.poll = sw_dma_device_poll_channels;
+
+    dma_dev->state = DMA_DEV_ST_RUNNING;
+
+    *dev = sw_device;
+
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief terminates the device operation and frees up the allocated resources
+ *
+ * \param dev software DMA device to shutdown
+ *
+ * \returns SYS_ERR_OK on success
+ *          errval on error
+ */
+errval_t sw_dma_device_shutdown(struct sw_dma_device *dev)
+{
+    errval_t err;
+
+    struct dma_device *dma_dev = &dev->common;
+
+    for (uint8_t i = 0; i < dma_dev->channels.count; ++i) {
+        struct sw_dma_channel *chan;
+        chan = (struct sw_dma_channel *) dma_dev->channels.c[i];
+        err = sw_dma_channel_free(chan);
+        if (err_is_fail(err)) {
+            return err;
+        }
+    }
+
+    while (dev->regions != NULL) {
+        err = device_deregister_memory(dma_dev, dev->regions->mem.frame);
+        if (err_is_fail(err)) {
+            return err;
+        }
+    }
+
+    free(dma_dev->channels.c);
+    free(dev);
+
+    return SYS_ERR_OK;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ * Device Operation Functions
+ * ----------------------------------------------------------------------------
+ */
+
+/**
+ * \brief polls the channels of the software DMA device
+ *
+ * \param dev   software DMA device
+ *
+ * \returns SYS_ERR_OK on success
+ *          DMA_ERR_DEVICE_IDLE if there is nothing completed on the channels
+ *          errval on error
+ */
+errval_t sw_dma_device_poll_channels(struct dma_device *dev)
+{
+    errval_t err;
+
+    uint8_t idle = 0x1;
+
+    for (uint8_t i = 0; i < dev->channels.count; ++i) {
+        err = sw_dma_channel_poll(dev->channels.c[i]);
+        switch (err_no(err)) {
+            case DMA_ERR_CHAN_IDLE:
+                break;
+            case SYS_ERR_OK:
+                idle = 0;
+                break;
+            default:
+                return err;
+        }
+    }
+
+    if (idle) {
+        return DMA_ERR_DEVICE_IDLE;
+    }
+
+    return SYS_ERR_OK;
+}
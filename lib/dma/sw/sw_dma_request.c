@@ -0,0 +1,342 @@
+/*
+ * Copyright (c) 2016, ETH Zurich. All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetsstrasse 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <barrelfish/barrelfish.h>
+
+#include <dma_ring_internal.h>
+#include <sw/sw_dma_internal.h>
+#include <sw/sw_dma_device_internal.h>
+#include <sw/sw_dma_channel_internal.h>
+#include <sw/sw_dma_request_internal.h>
+#include <sw/sw_dma_descriptors_internal.h>
+
+#include <debug.h>
+
+/**
+ * represents the software DMA requests
+ */
+struct sw_dma_request
+{
+    struct dma_request common;
+    struct dma_descriptor *desc_head;
+    struct dma_descriptor *desc_tail;
+};
+
+/*
+ * ---------------------------------------------------------------------------
+ * Request Management
+ * ---------------------------------------------------------------------------
+ */
+
+/// caches allocated requests which are no longer used
+static struct dma_request *req_free_list = NULL;
+
+/**
+ * \brief allocates a software DMA request structure
+ *
+ * \returns software DMA request
+ *          NULL on failure
+ */
+static struct sw_dma_request *request_alloc(void)
+{
+    struct sw_dma_request *ret;
+
+    if (req_free_list) {
+        ret = (struct sw_dma_request *) req_free_list;
+        req_free_list = ret->common.next;
+
+        DMAREQ_DEBUG("meta: reusing request %p. freelist:%p\n", ret, req_free_list);
+
+        return ret;
+    }
+    return calloc(1, sizeof(*ret));
+}
+
+/**
+ * \brief frees up the used DMA request structure
+ *
+ * \param req   DMA request to be freed
+ */
+static void request_free(struct sw_dma_request *req)
+{
+    DMAREQ_DEBUG("meta: freeing request %p.\n", req);
+    req->desc_head = NULL;
+    req->desc_tail = NULL;
+    req->common.next = req_free_list;
+    req_free_list = &req->common;
+}
+
+/*
+ * ---------------------------------------------------------------------------
+ * Helper Functions
+ * ---------------------------------------------------------------------------
+ */
+
+inline static uint32_t req_num_desc_needed(struct sw_dma_channel *chan,
+                                           size_t bytes)
+{
+    struct dma_channel *dma_chan = (struct dma_channel *) chan;
+    uint32_t max_xfer_size = dma_channel_get_max_xfer_size(dma_chan);
+    bytes += (max_xfer_size - 1);
+    return (uint32_t) (bytes / max_xfer_size);
+}
+
+/*
+ * ===========================================================================
+ * Library Internal Interface
+ * ===========================================================================
+ */
+
+/**
+ * \brief handles the processing of completed DMA requests
+ *
+ * \param req   the DMA request to process
+ *
+ * \returns SYS_ERR_OK on sucess
+ *          errval on failure
+ */
+errval_t sw_dma_request_process(struct sw_dma_request *req)
+{
+    errval_t err;
+
+    req->common.state = DMA_REQ_ST_DONE;
+
+    err = dma_request_process(&req->common);
+    if (err_is_fail(err)) {
+        return err;
+    }
+
+    request_free(req);
+
+    return SYS_ERR_OK;
+}
+
+/*
+ * ===========================================================================
+ * Public Interface
+ * ===========================================================================
+ */
+
+/**
+ * \brief issues a memcpy request to the given channel
+ *
+ * \param chan  software DMA channel
+ * \param setup request setup information
+ * \param id    returns the generated request id
+ *
+ * \returns SYS_ERR_OK on success
+ *          DMA_ERR_MEM_NOT_REGISTERED if the memory was not registered
+ *          errval on failure
+ */
+errval_t sw_dma_request_memcpy_chan(struct dma_channel *chan,
+                                    struct dma_req_setup *setup,
+                                    dma_req_id_t *id)
+{
+    errval_t err;
+
+    assert(chan->device->type == DMA_DEV_TYPE_SW);
+
+    struct sw_dma_channel *sw_chan = (struct sw_dma_channel *) chan;
+    struct sw_dma_device *sw_dev = (struct sw_dma_device *) chan->device;
+
+    uint32_t num_desc = req_num_desc_needed(sw_chan, setup->args.memcpy.bytes);
+
+    SWDMAREQ_DEBUG("DMA Memcpy request: [0x%016lx]->[0x%016lx] of %lu bytes (%u desc)\n",
+                   setup->args.memcpy.src, setup->args.memcpy.dst,
+                   setup->args.memcpy.bytes, num_desc);
+
+    lvaddr_t src, dst;
+    err = sw_dma_device_translate(sw_dev, setup->args.memcpy.src,
+                                  setup->args.memcpy.bytes, &src);
+    if (err_is_fail(err)) {
+        return err;
+    }
+    err = sw_dma_device_translate(sw_dev, setup->args.memcpy.dst,
+                                  setup->args.memcpy.bytes, &dst);
+    if (err_is_fail(err)) {
+        return err;
+    }
+
+    struct dma_ring *ring = sw_dma_channel_get_ring(sw_chan);
+
+    if (num_desc > dma_ring_get_space(ring)) {
+        SWDMAREQ_DEBUG("Too less space in ring: %u / %u\n", num_desc,
+                       dma_ring_get_space(ring));
+        return DMA_ERR_NO_DESCRIPTORS;
+    }
+
+    struct sw_dma_request *req = request_alloc();
+    if (req == NULL) {
+        SWDMAREQ_DEBUG("No request descriptors for holding request data\n");
+        return DMA_ERR_NO_REQUESTS;
+    }
+
+    dma_request_common_init(&req->common, chan, setup->type);
+
+    struct dma_descriptor *desc;
+    size_t length = setup->args.memcpy.bytes;
+    size_t bytes, max_xfer_size = dma_channel_get_max_xfer_size(chan);
+    do {
+        desc = dma_ring_get_next_desc(ring);
+
+        if (!req->desc_head) {
+            req->desc_head = desc;
+        }
+        if (length <= max_xfer_size) {
+            /* the last one */
+            bytes = length;
+            req->desc_tail = desc;
+        } else {
+            bytes = max_xfer_size;
+        }
+
+        sw_dma_desc_fill_memcpy(desc, src, dst, bytes);
+        dma_desc_set_request(desc, NULL);
+
+        length -= bytes;
+        src += bytes;
+        dst += bytes;
+    } while (length > 0);
+
+    req->common.setup = *setup;
+
+    if (id) {
+        *id = req->common.id;
+    }
+    /* set the request pointer in the last descriptor */
+    dma_desc_set_request(desc, &req->common);
+
+    assert(req->desc_tail);
+    assert(dma_desc_get_request(req->desc_tail));
+
+    return sw_dma_channel_submit_request(sw_chan, req);
+}
+
+/**
+ * \brief issues a memcpy request to a channel of the given device
+ *
+ * \param dev   software DMA device
+ * \param setup request setup information
+ * \param id    returns the generated request id
+ *
+ * \returns SYS_ERR_OK on success
+ *          errval on failure
+ */
+errval_t sw_dma_request_memcpy(struct dma_device *dev,
+                               struct dma_req_setup *setup,
+                               dma_req_id_t *id)
+{
+    struct dma_channel *chan = dma_device_get_channel(dev);
+    return sw_dma_request_memcpy_chan(chan, setup, id);
+}
+
+/**
+ * \brief issues a memset request to the given channel
+ *
+ * \param chan  software DMA channel
+ * \param setup request setup information
+ * \param id    returns the generated request id
+ *
+ * \returns SYS_ERR_OK on success
+ *          DMA_ERR_MEM_NOT_REGISTERED if the memory was not registered
+ *          errval on failure
+ */
+errval_t sw_dma_request_memset_chan(struct dma_channel *chan,
+                                    struct dma_req_setup *setup,
+                                    dma_req_id_t *id)
+{
+    errval_t err;
+
+    assert(chan->device->type == DMA_DEV_TYPE_SW);
+
+    struct sw_dma_channel *sw_chan = (struct sw_dma_channel *) chan;
+    struct sw_dma_device *sw_dev = (struct sw_dma_device *) chan->device;
+
+    uint32_t num_desc = req_num_desc_needed(sw_chan, setup->args.memset.bytes);
+
+    SWDMAREQ_DEBUG("DMA Memset request: [0x%016lx] of %lu bytes (%u desc)\n",
+                   setup->args.memset.dst, setup->args.memset.bytes, num_desc);
+
+    lvaddr_t dst;
+    err = sw_dma_device_translate(sw_dev, setup->args.memset.dst,
+                                  setup->args.memset.bytes, &dst);
+    if (err_is_fail(err)) {
+        return err;
+    }
+
+    struct dma_ring *ring = sw_dma_channel_get_ring(sw_chan);
+
+    if (num_desc > dma_ring_get_space(ring)) {
+        SWDMAREQ_DEBUG("Too less space in ring: %u / %u\n", num_desc,
+                       dma_ring_get_space(ring));
+        return DMA_ERR_NO_DESCRIPTORS;
+    }
+
+    struct sw_dma_request *req = request_alloc();
+    if (req == NULL) {
+        SWDMAREQ_DEBUG("No request descriptors for holding request data\n");
+        return DMA_ERR_NO_REQUESTS;
+    }
+
+    dma_request_common_init(&req->common, chan, setup->type);
+
+    struct dma_descriptor *desc;
+    size_t length = setup->args.memset.bytes;
+    size_t bytes, max_xfer_size = dma_channel_get_max_xfer_size(chan);
+    do {
+        desc = dma_ring_get_next_desc(ring);
+
+        if (!req->desc_head) {
+            req->desc_head = desc;
+        }
+        if (length <= max_xfer_size) {
+            /* the last one */
+            bytes = length;
+            req->desc_tail = desc;
+        } else {
+            bytes = max_xfer_size;
+        }
+
+        sw_dma_desc_fill_memset(desc, setup->args.memset.val, dst, bytes);
+        dma_desc_set_request(desc, NULL);
+
+        length -= bytes;
+        dst += bytes;
+    } while (length > 0);
+
+    req->common.setup = *setup;
+
+    if (id) {
+        *id = req->common.id;
+    }
+    /* set the request pointer in the last descriptor */
+    dma_desc_set_request(desc, &req->common);
+
+    assert(req->desc_tail);
+    assert(dma_desc_get_request(req->desc_tail));
+
+    return sw_dma_channel_submit_request(sw_chan, req);
+}
+
+/**
+ * \brief issues a memset request to a channel of the given device
+ *
+ * \param dev   software DMA device
+ * \param setup request setup information
+ * \param id    returns the generated request id
+ *
+ * \returns SYS_ERR_OK on success
+ *          errval on failure
+ */
+errval_t sw_dma_request_memset(struct dma_device *dev,
+                               struct dma_req_setup *setup,
+                               dma_req_id_t *id)
+{
+    struct dma_channel *chan = dma_device_get_channel(dev);
+    return sw_dma_request_memset_chan(chan, setup, id);
+}
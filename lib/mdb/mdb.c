@@ -220,9 +220,7 @@ bool mdb_is_sane(void)
  */
 void set_init_mapping(struct cte *dest_start, size_t num)
 {
-    for (size_t i = 0; i < num; i++) {
-        mdb_insert(&dest_start[i]);
-    }
+    mdb_insert_bulk(dest_start, num);
 }
 
 /// Remove one cap from the mapping database
@@ -1006,6 +1006,248 @@ mdb_successor(struct cte *current)
     return mdb_sub_find_greater(C(current), mdb_root, false, true);
 }
 
+/*
+ * Bulk operations.
+ *
+ * These work on whole subtrees: split() cuts a tree in two at a key and
+ * join() concatenates two trees around a key, both in O(log n). A run of
+ * siblings that falls between two neighbouring entries of the tree is
+ * inserted by building a perfectly balanced tree from it in O(k) and joining
+ * it with the two halves of the existing tree, instead of descending and
+ * rebalancing once per cap.
+ *
+ * The bulk operations detach the tree from mdb_root while they work on it, so
+ * mdb_skew() and mdb_split() do not update the root for intermediate trees.
+ */
+
+static inline int
+mdb_sub_level(struct cte *cte)
+{
+    return cte ? N(cte)->level : -1;
+}
+
+/// Join two trees with all entries in left < key < right. Returns the new root.
+static struct cte*
+mdb_sub_join(struct cte *left, struct cte *key, struct cte *right)
+{
+    assert(key);
+    int left_level = mdb_sub_level(left);
+    int right_level = mdb_sub_level(right);
+
+    if (left_level == right_level) {
+        N(key)->left = left;
+        N(key)->right = right;
+        N(key)->level = left_level + 1;
+        mdb_update_end(key);
+        return key;
+    }
+    else if (left_level > right_level) {
+        // descend right spine of the higher tree, as an insert of its maximum
+        N(left)->right = mdb_sub_join(N(left)->right, key, right);
+        mdb_update_end(left);
+        left = mdb_skew(left);
+        return mdb_split(left);
+    }
+    else {
+        // descend left spine of the higher tree, as an insert of its minimum
+        N(right)->left = mdb_sub_join(left, key, N(right)->left);
+        mdb_update_end(right);
+        right = mdb_skew(right);
+        return mdb_split(right);
+    }
+}
+
+/**
+ * Split a tree into the entries less than and greater than key. If key itself
+ * is in the tree, it is taken out and *found is set.
+ */
+static void
+mdb_sub_split(struct cte *current, struct cte *key, struct cte **ret_left,
+              struct cte **ret_right, bool *found)
+{
+    if (!current) {
+        *ret_left = *ret_right = NULL;
+        return;
+    }
+
+    struct cte *left, *right;
+    int compare = compare_caps(C(key), C(current), true);
+    if (compare < 0) {
+        mdb_sub_split(N(current)->left, key, ret_left, &left, found);
+        *ret_right = mdb_sub_join(left, current, N(current)->right);
+    }
+    else if (compare > 0) {
+        mdb_sub_split(N(current)->right, key, &right, ret_right, found);
+        *ret_left = mdb_sub_join(N(current)->left, current, right);
+    }
+    else {
+        *ret_left = N(current)->left;
+        *ret_right = N(current)->right;
+        N(current)->left = N(current)->right = NULL;
+        N(current)->level = 0;
+        *found = true;
+    }
+}
+
+/// Join two trees with all entries in left < right
+static struct cte*
+mdb_sub_join_trees(struct cte *left, struct cte *right)
+{
+    if (!left) {
+        return right;
+    }
+    if (!right) {
+        return left;
+    }
+
+    struct cte *min = right;
+    while (N(min)->left) {
+        min = N(min)->left;
+    }
+    struct cte *empty;
+    bool found = false;
+    mdb_sub_split(right, min, &empty, &right, &found);
+    assert(found && !empty);
+
+    return mdb_sub_join(left, min, right);
+}
+
+/**
+ * Build a balanced tree from an array of ctes that is sorted in ascending
+ * order. The left half of every subtree is never larger than the right half,
+ * so nodes with only one child have a right leaf at the same level.
+ */
+static struct cte*
+mdb_sub_build(struct cte *ctes, size_t count)
+{
+    if (!count) {
+        return NULL;
+    }
+
+    size_t mid = (count - 1) / 2;
+    struct cte *node = &ctes[mid];
+    N(node)->left = mdb_sub_build(ctes, mid);
+    N(node)->right = mdb_sub_build(ctes + mid + 1, count - mid - 1);
+    N(node)->level = mdb_sub_level(N(node)->left) + 1;
+    mdb_update_end(node);
+    return node;
+}
+
+static bool
+mdb_is_sorted_run(struct cte *first, size_t count)
+{
+    for (size_t i = 1; i < count; i++) {
+        if (compare_caps(C(&first[i-1]), C(&first[i]), true) >= 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static errval_t
+mdb_insert_each(struct cte *first, size_t count)
+{
+    errval_t err, ret = SYS_ERR_OK;
+    for (size_t i = 0; i < count; i++) {
+        err = mdb_insert(&first[i]);
+        if (err_is_fail(err) && err_is_ok(ret)) {
+            ret = err;
+        }
+    }
+    return ret;
+}
+
+errval_t
+mdb_insert_bulk(struct cte *first, size_t count)
+{
+    MDB_TRACE_ENTER(mdb_root, "%p, %zu", first, count);
+
+    if (count <= 1 || !mdb_is_sorted_run(first, count)) {
+        return mdb_insert_each(first, count);
+    }
+
+    // the fast path needs an empty slot in the ordering for the whole run
+    struct cte *next = mdb_sub_find_greater(C(first), mdb_root, true, true);
+    if (next && compare_caps(C(next), C(&first[count-1]), true) <= 0) {
+        return mdb_insert_each(first, count);
+    }
+
+    struct cte *left, *right, *root = mdb_root;
+    bool found = false;
+    mdb_root = NULL;
+    mdb_sub_split(root, first, &left, &right, &found);
+    assert(!found);
+
+    struct cte *run = mdb_sub_build(first + 1, count - 2);
+    root = mdb_sub_join(left, first, run);
+    root = mdb_sub_join(root, &first[count-1], right);
+    set_root(root);
+
+    CHECK_INVARIANTS(mdb_root, first, true);
+    errval_t err = SYS_ERR_OK;
+    MDB_TRACE_LEAVE_SUB_RET("%"PRIuPTR, err, mdb_root);
+}
+
+/**
+ * Take apart a tree of entries that were between the ends of a run that is
+ * being removed. Members of the run are dropped, anything else (the run was
+ * not contiguous in the ordering) is inserted again. Returns the number of
+ * run members found.
+ */
+static size_t
+mdb_sub_drop_run(struct cte *current, struct cte *first, struct cte *last)
+{
+    if (!current) {
+        return 0;
+    }
+
+    size_t dropped = mdb_sub_drop_run(N(current)->left, first, last)
+                   + mdb_sub_drop_run(N(current)->right, first, last);
+
+    N(current)->left = N(current)->right = NULL;
+    N(current)->level = 0;
+    if (current > first && current < last) {
+        return dropped + 1;
+    }
+
+    errval_t err = mdb_insert(current);
+    assert(err_is_ok(err));
+    return dropped;
+}
+
+errval_t
+mdb_remove_bulk(struct cte *first, size_t count)
+{
+    errval_t ret = SYS_ERR_OK;
+    MDB_TRACE_ENTER(mdb_root, "%p, %zu", first, count);
+
+    if (count <= 1 || !mdb_is_sorted_run(first, count)) {
+        for (size_t i = 0; i < count; i++) {
+            errval_t err = mdb_remove(&first[i]);
+            if (err_is_fail(err) && err_is_ok(ret)) {
+                ret = err;
+            }
+        }
+        MDB_TRACE_LEAVE_SUB_RET("%"PRIuPTR, ret, mdb_root);
+    }
+
+    struct cte *last = &first[count-1];
+    struct cte *left, *middle, *right, *root = mdb_root;
+    bool found_first = false, found_last = false;
+    mdb_root = NULL;
+    mdb_sub_split(root, first, &left, &right, &found_first);
+    mdb_sub_split(right, last, &middle, &right, &found_last);
+    set_root(mdb_sub_join_trees(left, right));
+
+    size_t dropped = mdb_sub_drop_run(middle, first, last);
+    if (!found_first || !found_last || dropped != count - 2) {
+        ret = CAPS_ERR_MDB_ENTRY_NOTFOUND;
+    }
+
+    CHECK_INVARIANTS(mdb_root, first, false);
+    MDB_TRACE_LEAVE_SUB_RET("%"PRIuPTR, ret, mdb_root);
+}
+
 /*
  * The range query.
  */
@@ -1292,6 +1534,70 @@ mdb_find_cap_for_address(genpaddr_t address, struct cte **ret_node)
     return SYS_ERR_OK;
 }
 
+/*
+ * Range iterator.
+ */
+
+static void
+mdb_range_iter_descend(struct mdb_range_iter *iter, struct cte *current)
+{
+    while (current) {
+        struct mdbnode *node = N(current);
+        if (node->end_root < iter->root ||
+            (node->end_root == iter->root && node->end <= iter->address))
+        {
+            // nothing in this subtree reaches into the range
+            return;
+        }
+
+        mdb_root_t current_root = get_type_root(C(current)->type);
+        if (current_root < iter->root) {
+            // current and its left subtree are before the range
+            current = node->right;
+        }
+        else if (current_root > iter->root ||
+                 get_address(C(current)) >= iter->end)
+        {
+            // current and its right subtree are after the range
+            current = node->left;
+        }
+        else {
+            assert(iter->depth < MDB_RANGE_ITER_DEPTH);
+            iter->stack[iter->depth++] = current;
+            current = node->left;
+        }
+    }
+}
+
+void
+mdb_range_iter_init(struct mdb_range_iter *iter, mdb_root_t root,
+                    genpaddr_t address, gensize_t size)
+{
+    assert(iter);
+    iter->root = root;
+    iter->address = address;
+    iter->end = address + size;
+    iter->depth = 0;
+    mdb_range_iter_descend(iter, mdb_root);
+}
+
+struct cte*
+mdb_range_iter_next(struct mdb_range_iter *iter)
+{
+    assert(iter);
+    while (iter->depth > 0) {
+        struct cte *current = iter->stack[--iter->depth];
+        mdb_range_iter_descend(iter, N(current)->right);
+
+        // current starts before the end of the range, check that it ends
+        // after its start
+        if (get_address(C(current)) + get_size(C(current)) > iter->address) {
+            return current;
+        }
+    }
+    return NULL;
+}
+
 bool mdb_reachable(struct cte *cte)
 {
     return mdb_is_reachable(mdb_root, cte);
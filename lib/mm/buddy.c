@@ -0,0 +1,381 @@
+/**
+ * \file
+ * \brief Buddy backend of the memory manager
+ *
+ * Every region handed to mm_add() becomes the root of a binary tree of
+ * blocks. A block is split by retyping its cap into two halves; free blocks
+ * are kept on one list per order, and a bitmap records which lists are
+ * non-empty, so an unconstrained allocation finds the smallest fitting block
+ * with a single bit scan instead of walking the tree.
+ *
+ * Every block carries its own cap, so the free blocks of an order are kept
+ * on a list rather than in a bitmap indexed by position, which would need a
+ * separate lookup from bit to block.
+ *
+ * When the allocator keeps chunked caps (delete_chunked == false), a freed
+ * block whose buddy is also free is merged back into its parent: both halves
+ * are revoked and deleted, which makes the parent cap retypeable again.
+ * Otherwise freed blocks stay at their order, as they do in the B-tree
+ * backend.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <barrelfish/barrelfish.h>
+#include <mm/mm.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "buddy.h"
+
+#define UNBITS_GENPA(bits) (((genpaddr_t)1) << (bits))
+
+static inline genpaddr_t block_limit(struct mmbuddy *node)
+{
+    return node->base + UNBITS_GENPA(node->sizebits);
+}
+
+static void freelist_push(struct mm *mm, struct mmbuddy *node)
+{
+    assert(node->type == NodeType_Free);
+
+    node->prev = NULL;
+    node->next = mm->buddy_free[node->sizebits];
+    if (node->next != NULL) {
+        node->next->prev = node;
+    }
+    mm->buddy_free[node->sizebits] = node;
+    mm->buddy_freemap |= (uint64_t)1 << node->sizebits;
+}
+
+static void freelist_remove(struct mm *mm, struct mmbuddy *node)
+{
+    if (node->prev != NULL) {
+        node->prev->next = node->next;
+    } else {
+        assert(mm->buddy_free[node->sizebits] == node);
+        mm->buddy_free[node->sizebits] = node->next;
+        if (node->next == NULL) {
+            mm->buddy_freemap &= ~((uint64_t)1 << node->sizebits);
+        }
+    }
+    if (node->next != NULL) {
+        node->next->prev = node->prev;
+    }
+    node->next = node->prev = NULL;
+}
+
+static struct mmbuddy *new_block(struct mm *mm, struct capref cap,
+                                 uint8_t sizebits, genpaddr_t base,
+                                 struct mmbuddy *parent)
+{
+    struct mmbuddy *node = slab_alloc(&mm->slabs);
+    if (node != NULL) {
+        node->type = NodeType_Free;
+        node->sizebits = sizebits;
+        node->cap = cap;
+        node->base = base;
+        node->parent = parent;
+        node->children[0] = node->children[1] = NULL;
+        node->next = node->prev = NULL;
+        node->nextroot = NULL;
+    }
+    return node;
+}
+
+/**
+ * \brief Return whether a block contains a naturally aligned (relative to the
+ * block) sub-block of the given size within [minbase, maxlimit)
+ */
+static bool block_fits(struct mmbuddy *node, uint8_t sizebits,
+                       genpaddr_t minbase, genpaddr_t maxlimit)
+{
+    genpaddr_t size = UNBITS_GENPA(sizebits);
+    genpaddr_t start = MAX(minbase, node->base);
+    genpaddr_t cand = node->base + DIVIDE_ROUND_UP(start - node->base, size) * size;
+
+    return cand + size <= MIN(block_limit(node), maxlimit);
+}
+
+/// Split a free block (which must not be on a free list) into two free halves
+static errval_t split_block(struct mm *mm, struct mmbuddy *node)
+{
+    errval_t err;
+
+    assert(node->type == NodeType_Free);
+    assert(node->sizebits > 0);
+
+    uint8_t halfbits = node->sizebits - 1;
+
+    // get the nodes first, so a failure does not leave allocated slots behind
+    struct mmbuddy *lo = new_block(mm, NULL_CAP, halfbits, node->base, node);
+    struct mmbuddy *hi = new_block(mm, NULL_CAP, halfbits,
+                                   node->base + UNBITS_GENPA(halfbits), node);
+    if (lo == NULL || hi == NULL) {
+        if (lo != NULL) {
+            slab_free(&mm->slabs, lo);
+        }
+        if (hi != NULL) {
+            slab_free(&mm->slabs, hi);
+        }
+        return MM_ERR_NEW_NODE;
+    }
+
+    struct capref cap;
+    err = mm->slot_alloc(mm->slot_alloc_inst, 2, &cap);
+    if (err_no(err) == LIB_ERR_SLOT_ALLOC_NO_SPACE && mm->slot_refill) {
+        err = mm->slot_refill(mm->slot_alloc_inst);
+        if (err_is_ok(err)) {
+            err = mm->slot_alloc(mm->slot_alloc_inst, 2, &cap);
+        }
+    }
+    if (err_is_fail(err)) {
+        slab_free(&mm->slabs, lo);
+        slab_free(&mm->slabs, hi);
+        return err_push(err, MM_ERR_CHUNK_SLOT_ALLOC);
+    }
+    lo->cap = cap;
+    hi->cap = cap;
+    hi->cap.slot++;
+
+    err = cap_retype(cap, node->cap, 0, mm->objtype, UNBITS_GENPA(halfbits), 2);
+    if (err_is_fail(err)) {
+        slab_free(&mm->slabs, lo);
+        slab_free(&mm->slabs, hi);
+        return err_push(err, LIB_ERR_CAP_RETYPE);
+    }
+
+    if (mm->delete_chunked) {
+        err = cap_delete(node->cap);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "cap_delete for chunked cap failed. Ignoring.");
+        }
+    }
+
+    node->type = NodeType_Chunked;
+    node->children[0] = lo;
+    node->children[1] = hi;
+    freelist_push(mm, lo);
+    freelist_push(mm, hi);
+
+    return SYS_ERR_OK;
+}
+
+/// Find the smallest free block that can hold the request
+static struct mmbuddy *find_block(struct mm *mm, uint8_t sizebits,
+                                  genpaddr_t minbase, genpaddr_t maxlimit)
+{
+    uint64_t orders = mm->buddy_freemap & ~(UNBITS_GENPA(sizebits) - 1);
+    bool unconstrained = minbase <= mm->base
+        && maxlimit >= mm->base + UNBITS_GENPA(mm->sizebits);
+
+    while (orders != 0) {
+        uint8_t order = __builtin_ctzll(orders);
+        struct mmbuddy *node = mm->buddy_free[order];
+
+        if (unconstrained) {
+            return node;
+        }
+        for (; node != NULL; node = node->next) {
+            if (block_fits(node, sizebits, minbase, maxlimit)) {
+                return node;
+            }
+        }
+        orders &= orders - 1;
+    }
+
+    return NULL;
+}
+
+errval_t mm_buddy_add(struct mm *mm, struct capref cap, uint8_t sizebits,
+                      genpaddr_t base)
+{
+    if (sizebits >= MM_BUDDY_ORDERS) {
+        return MM_ERR_OUT_OF_BOUNDS;
+    }
+
+    genpaddr_t limit = base + UNBITS_GENPA(sizebits);
+    for (struct mmbuddy *r = mm->buddy_roots; r != NULL; r = r->nextroot) {
+        if (base < block_limit(r) && r->base < limit) {
+            return MM_ERR_ALREADY_PRESENT;
+        }
+    }
+
+    struct mmbuddy *node = new_block(mm, cap, sizebits, base, NULL);
+    if (node == NULL) {
+        return MM_ERR_NEW_NODE;
+    }
+
+    node->nextroot = mm->buddy_roots;
+    mm->buddy_roots = node;
+    freelist_push(mm, node);
+
+    return SYS_ERR_OK;
+}
+
+errval_t mm_buddy_alloc_range(struct mm *mm, uint8_t sizebits,
+                              genpaddr_t minbase, genpaddr_t maxlimit,
+                              struct capref *retcap, genpaddr_t *retbase)
+{
+    errval_t err;
+
+    if (sizebits >= MM_BUDDY_ORDERS) {
+        return MM_ERR_NOT_FOUND;
+    }
+
+    struct mmbuddy *node = find_block(mm, sizebits, minbase, maxlimit);
+    if (node == NULL) {
+        return MM_ERR_NOT_FOUND;
+    }
+    freelist_remove(mm, node);
+
+    /* split down to the requested size, following the fitting half */
+    while (node->sizebits > sizebits) {
+        err = split_block(mm, node);
+        if (err_is_fail(err)) {
+            freelist_push(mm, node);
+            return err_push(err, MM_ERR_CHUNK_NODE);
+        }
+        struct mmbuddy *child = node->children[0];
+        if (!block_fits(child, sizebits, minbase, maxlimit)) {
+            child = node->children[1];
+        }
+        freelist_remove(mm, child);
+        node = child;
+    }
+
+    assert(node->base >= minbase && block_limit(node) <= maxlimit);
+    node->type = NodeType_Allocated;
+
+    assert(retcap != NULL);
+    *retcap = node->cap;
+    if (retbase != NULL) {
+        *retbase = node->base;
+    }
+
+    return SYS_ERR_OK;
+}
+
+errval_t mm_buddy_free(struct mm *mm, struct capref cap, genpaddr_t base,
+                       uint8_t sizebits)
+{
+    errval_t err;
+
+    struct mmbuddy *node = mm->buddy_roots;
+    while (node != NULL && (base < node->base || base >= block_limit(node))) {
+        node = node->nextroot;
+    }
+
+    /* descend to the block of the given size */
+    while (node != NULL && node->type == NodeType_Chunked
+           && node->sizebits > sizebits) {
+        genpaddr_t mid = node->base + UNBITS_GENPA(node->sizebits - 1);
+        node = node->children[base >= mid];
+    }
+
+    if (node == NULL || node->type != NodeType_Allocated
+        || node->base != base || node->sizebits != sizebits) {
+        return MM_ERR_NOT_FOUND;
+    }
+
+    node->type = NodeType_Free;
+    node->cap = cap;
+
+    /* merge with free buddies, as long as we still hold the parent caps */
+    while (!mm->delete_chunked && node->parent != NULL) {
+        struct mmbuddy *parent = node->parent;
+        struct mmbuddy *buddy = parent->children[parent->children[0] == node];
+        if (buddy->type != NodeType_Free) {
+            break;
+        }
+
+        // the parent can only be retyped again once no copies or
+        // descendants of the halves are left, also not in the clients
+        err = cap_revoke(node->cap);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "cap_revoke while merging buddies. Not merging.");
+            break;
+        }
+        err = cap_revoke(buddy->cap);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "cap_revoke while merging buddies. Not merging.");
+            break;
+        }
+
+        err = cap_delete(buddy->cap);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "cap_delete while merging buddies. Not merging.");
+            break;
+        }
+        err = cap_delete(node->cap);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "cap_delete while merging buddies. Not merging.");
+            // recreate the cap of the buddy, so both halves stay usable
+            err = cap_retype(buddy->cap, parent->cap, buddy->base - parent->base,
+                             mm->objtype, UNBITS_GENPA(buddy->sizebits), 1);
+            if (err_is_fail(err)) {
+                // without a cap the buddy cannot be handed out anymore
+                DEBUG_ERR(err, "cap_retype to restore a buddy. Dropping it.");
+                freelist_remove(mm, buddy);
+                buddy->type = NodeType_Allocated;
+            }
+            break;
+        }
+
+        freelist_remove(mm, buddy);
+        slab_free(&mm->slabs, node);
+        slab_free(&mm->slabs, buddy);
+        parent->children[0] = parent->children[1] = NULL;
+        parent->type = NodeType_Free;
+        node = parent;
+    }
+
+    freelist_push(mm, node);
+
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Initialise a memory manager instance using the buddy backend
+ *
+ * Takes the same arguments as mm_init(), apart from the branching factor,
+ * which is always two.
+ *
+ * \note The buddy backend can only merge free blocks if it keeps the caps to
+ * chunked regions, ie. if delete_chunked is false.
+ */
+errval_t mm_init_buddy(struct mm *mm, enum objtype objtype, genpaddr_t base,
+                       uint8_t sizebits, slab_refill_func_t slab_refill_func,
+                       slot_alloc_t slot_alloc_func,
+                       slot_refill_t slot_refill_func, void *slot_alloc_inst,
+                       bool delete_chunked)
+{
+    errval_t err;
+
+    err = mm_init(mm, objtype, base, sizebits, 1, slab_refill_func,
+                  slot_alloc_func, slot_refill_func, slot_alloc_inst,
+                  delete_chunked);
+    if (err_is_fail(err)) {
+        return err;
+    }
+
+    mm->backend = MM_BACKEND_BUDDY;
+    mm->buddy_roots = NULL;
+    for (int i = 0; i < MM_BUDDY_ORDERS; i++) {
+        mm->buddy_free[i] = NULL;
+    }
+    mm->buddy_freemap = 0;
+
+    /* buddy blocks are larger than two-child tree nodes */
+    slab_init(&mm->slabs, MAX(MM_BUDDY_NODE_SIZE, MM_NODE_SIZE(1)),
+              slab_refill_func);
+
+    return SYS_ERR_OK;
+}
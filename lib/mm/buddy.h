@@ -0,0 +1,26 @@
+/**
+ * \file
+ * \brief Buddy backend of the memory manager. Private to lib/mm.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef MM_BUDDY_H
+#define MM_BUDDY_H
+
+errval_t mm_buddy_add(struct mm *mm, struct capref cap, uint8_t sizebits,
+                      genpaddr_t base);
+errval_t mm_buddy_alloc_range(struct mm *mm, uint8_t sizebits,
+                              genpaddr_t minbase, genpaddr_t maxlimit,
+                              struct capref *retcap, genpaddr_t *retbase);
+errval_t mm_buddy_free(struct mm *mm, struct capref cap, genpaddr_t base,
+                       uint8_t sizebits);
+
+#endif // MM_BUDDY_H
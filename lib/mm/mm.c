@@ -37,6 +37,8 @@
 #include <stdio.h>
 #include <inttypes.h>
 
+#include "buddy.h"
+
 #if 1
 bool mm_debug = false;
 # define DEBUG(s, x...) do { if (mm_debug) debug_printf("MM: " s, x); } while(0)
@@ -513,6 +515,7 @@ errval_t mm_init(struct mm *mm, enum objtype objtype, genpaddr_t base,
     mm->slot_refill = slot_refill_func;
     mm->slot_alloc_inst = slot_alloc_inst;
     mm->delete_chunked = delete_chunked;
+    mm->backend = MM_BACKEND_TREE;
 
     /* init slab allocator */
     slab_init(&mm->slabs, MM_NODE_SIZE(maxchildbits), slab_refill_func);
@@ -549,6 +552,10 @@ errval_t mm_add(struct mm *mm, struct capref cap, uint8_t sizebits, genpaddr_t b
         return MM_ERR_OUT_OF_BOUNDS;
     }
 
+    if (mm->backend == MM_BACKEND_BUDDY) {
+        return mm_buddy_add(mm, cap, sizebits, base);
+    }
+
     /* check that base is properly aligned to size */
     // We do not care about alignment anymore?!
     //assert((base & (UNBITS_GENPA(sizebits) - 1)) == 0);
@@ -706,6 +713,11 @@ errval_t mm_alloc_range(struct mm *mm, uint8_t sizebits, genpaddr_t minbase,
         return MM_ERR_OUT_OF_BOUNDS;
     }
 
+    if (mm->backend == MM_BACKEND_BUDDY) {
+        return mm_buddy_alloc_range(mm, sizebits, minbase, maxlimit, retcap,
+                                    retbase);
+    }
+
     if (mm->root == NULL) {
         return MM_ERR_NOT_FOUND; // nothing added
     }
@@ -774,6 +786,10 @@ errval_t mm_realloc_range(struct mm *mm, uint8_t sizebits, genpaddr_t base,
     // We do not care about alignment anymore?!
     //assert((base & (UNBITS_GENPA(sizebits) - 1)) == 0);
 
+    if (mm->backend == MM_BACKEND_BUDDY) {
+        return LIB_ERR_NOT_IMPLEMENTED;
+    }
+
     if (mm->root == NULL) {
         return MM_ERR_NOT_FOUND; // nothing added
     }
@@ -836,6 +852,10 @@ errval_t mm_realloc_range(struct mm *mm, uint8_t sizebits, genpaddr_t base,
 errval_t mm_free(struct mm *mm, struct capref cap, genpaddr_t base,
                  uint8_t sizebits)
 {
+    if (mm->backend == MM_BACKEND_BUDDY) {
+        return mm_buddy_free(mm, cap, base, sizebits);
+    }
+
     // find node, then mark it as free
     genpaddr_t nodebase;
     uint8_t nodesizebits;
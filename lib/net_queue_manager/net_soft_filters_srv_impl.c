@@ -28,6 +28,7 @@
 #include <trace_definitions/trace_defs.h>
 #include <net_queue_manager/net_queue_manager.h>
 #include <bfdmuxvm/vm.h>
+#include <bfdmuxvm/demux.h>
 #include <if/net_soft_filters_defs.h>
 #include <if/net_soft_filters_defs.h>
 #include <if/net_queue_manager_defs.h>
@@ -100,6 +101,7 @@ static void*    rx_ring_virt = NULL;
 
 // filters state:
 static struct filter *rx_filters;
+static struct demux rx_demux;   ///< Classifies packets against rx_filters
 static struct filter arp_filter_rx;
 static struct filter arp_filter_tx;
 
@@ -323,6 +325,21 @@ static errval_t register_filter(struct net_soft_filters_binding *cc, uint64_t id
     new_filter_rx->filter_id = filter_id_counter;
     new_filter_rx->filter_type = ftype;
     new_filter_rx->buffer = buffer_rx;
+
+    errval_t dm_err = demux_add_filter(&rx_demux, new_filter_rx->data, len_rx,
+                                       filter_id_counter, new_filter_rx,
+                                       &new_filter_rx->demux);
+    if (err_is_fail(dm_err)) {
+        DEBUG_ERR(dm_err, "adding filter to the demultiplexer");
+        *err = ETHERSRV_ERR_NOT_ENOUGH_MEM;
+        *filter_id = 0;
+        free(new_filter_rx->data);
+        free(new_filter_tx->data);
+        free(new_filter_rx);
+        free(new_filter_tx);
+        return SYS_ERR_OK;
+    }
+
     new_filter_rx->next = rx_filters;
     new_filter_rx->paused = paused ? true : false;
     rx_filters = new_filter_rx;
@@ -362,6 +379,8 @@ static struct filter *delete_from_filter_list(struct filter *head,
             }
             return head;
         }                       /* end if: filter_id found */
+        prev = head;
+        head = head->next;
     }                           /* end while: for each element in list */
     return NULL;                /* could not not find the id. */
 }
@@ -391,6 +410,8 @@ static errval_t deregister_filter(struct net_soft_filters_binding *cc,
     }
 
     if (rx_filter) {
+        demux_remove_filter(&rx_demux, rx_filter->demux);
+        free(rx_filter->data);
         free(rx_filter);
     }
 
@@ -611,33 +632,21 @@ static void send_arp_to_all(void *data, uint64_t len, uint64_t flags)
 
 struct filter *execute_filters(void *data, size_t len)
 {
-    struct filter *head = rx_filters;
-    int res, error;
-
-    int i = 0;
-
-//      ETHERSRV_DEBUG("Starting the filter matching....\n");
     // TODO: gracefully handle the error cases, although I think
     // it is not really necessary. since it could only mean we have
     // received a corrupted packet.
-    while (head) {
-        res = execute_filter(head->data, head->len, (uint8_t *) data,
-                             len, &error);
-        if (res) {
-            // FIXME IK: we need some way of testing how precise a match is
-            // and take the most precise match (ie with the least wildcards)
-            // Currently we just take the most recently added filter as
-            // reflected by the order in the list.
-            ETHERSRV_DEBUG("##### Filter_id [%" PRIu64 "] type[%" PRIu64
-                           "] matched giving buff [%" PRIu64 "].., len [%" PRIu64 "]\n",
-                           head->filter_id, head->filter_type,
-                           head->buffer->buffer_id, len);
-            return head;
-        }
-        head = head->next;
-        ++i;
+    // FIXME IK: we need some way of testing how precise a match is
+    // and take the most precise match (ie with the least wildcards)
+    // Currently we just take the most recently added filter, which the
+    // demultiplexer picks by filter id.
+    struct filter *head = demux_match(&rx_demux, (uint8_t *) data, len);
+    if (head != NULL) {
+        ETHERSRV_DEBUG("##### Filter_id [%" PRIu64 "] type[%" PRIu64
+                       "] matched giving buff [%" PRIu64 "].., len [%" PRIu64 "]\n",
+                       head->filter_id, head->filter_type,
+                       head->buffer->buffer_id, len);
     }
-    return NULL;
+    return head;
 }
 
 /** Return virtual address for RX buffer. */
@@ -715,6 +724,7 @@ void init_soft_filters_service(char *service_name, uint64_t qid,
     init_rx_ring(rx_bufsz);
 
     filter_id_counter = 0;
+    demux_init(&rx_demux);
     snprintf(sf_srv_name, sizeof(sf_srv_name), "%s_%"PRIu64"",
             service_name, qid);
     errval_t err = net_soft_filters_export(NULL, export_soft_filters_cb,
@@ -34,6 +34,7 @@ static struct export_state {
 static const struct octopus_rx_vtbl rpc_rx_vtbl = {
         .get_names_call = get_names_handler,
         .get_call = get_handler,
+        .get_records_call = get_records_handler,
         .set_call = set_handler,
         .get_with_idcap_call = get_with_idcap_handler,
         .set_with_idcap_call = set_with_idcap_handler,
@@ -77,6 +78,7 @@ static errval_t rpc_connect_cb(void *st, struct octopus_binding *b)
 
     // copy my message receive handler vtable to the binding
     b->rx_vtbl = rpc_rx_vtbl;
+    b->error_handler = oct_error_handler;
 
     // accept the connection (we could return an error to refuse it)
     return SYS_ERR_OK;
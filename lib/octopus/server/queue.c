@@ -18,6 +18,9 @@
 static void oct_rpc_send_next(void *arg)
 {
     struct octopus_binding *b = arg;
+    if (b->st == NULL) {
+        return; // emptied by oct_rpc_remove_reply()
+    }
 
     struct oct_reply_state* current = oct_rpc_dequeue_reply(b);
 
@@ -58,3 +61,17 @@ struct oct_reply_state* oct_rpc_dequeue_reply(struct octopus_binding *b)
     return head;
 }
 
+/**
+ * Takes a reply state out of the queue of a binding without sending it.
+ */
+void oct_rpc_remove_reply(struct octopus_binding *b,
+        struct oct_reply_state* st)
+{
+    struct oct_reply_state** walk = (struct oct_reply_state**) &(b->st);
+    for (; *walk != NULL; walk = &(*walk)->next) {
+        if (*walk == st) {
+            *walk = st->next;
+            return;
+        }
+    }
+}
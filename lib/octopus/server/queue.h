@@ -23,5 +23,7 @@
 void oct_rpc_enqueue_reply(struct octopus_binding *b,
         struct oct_reply_state* st);
 struct oct_reply_state* oct_rpc_dequeue_reply(struct octopus_binding *b);
+void oct_rpc_remove_reply(struct octopus_binding *b,
+        struct oct_reply_state* st);
 
 #endif // OCTOPUS_QUEUE_H
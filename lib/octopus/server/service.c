@@ -113,7 +113,11 @@ static void trigger_send_handler(struct octopus_binding* b,
             oct_rpc_enqueue_reply(b, drs);
             return;
         }
-        USER_PANIC_ERR(err, "SKB sending %s failed!", __FUNCTION__);
+        // Triggers outlive their clients (i.e., name service watches of
+        // domains that have exited), don't take the server down for them.
+        DEBUG_ERR(err, "SKB sending %s failed, dropping trigger",
+                __FUNCTION__);
+        free_oct_reply_state(drs);
     }
 }
 
@@ -294,6 +298,115 @@ out:
     free_ast(ast);
 }
 
+static void get_records_reply(struct octopus_binding* b,
+        struct oct_reply_state* drt)
+{
+    errval_t err;
+    char* reply = err_is_ok(drt->error) ?
+            drt->query_state.std_out.buffer : NULL;
+    err = b->tx_vtbl.get_records_response(b, MKCONT(free_oct_reply_state, drt),
+            reply, drt->error);
+    if (err_is_fail(err)) {
+        if (err_no(err) == FLOUNDER_ERR_TX_BUSY) {
+            oct_rpc_enqueue_reply(b, drt);
+            return;
+        }
+        USER_PANIC_ERR(err, "SKB sending %s failed!", __FUNCTION__);
+    }
+}
+
+/**
+ * \brief Appends the record matching a single name to the batch output.
+ *
+ * A missing record is written as an empty line, the trigger is installed
+ * for every name on its own.
+ */
+static errval_t get_records_append(struct octopus_binding* b,
+        const char* name, octopus_trigger_t t, struct oct_query_state* scratch,
+        struct skb_writer* out)
+{
+    struct ast_object* ast = NULL;
+    errval_t err = generate_ast(name, &ast);
+    if (err_is_fail(err)) {
+        return err;
+    }
+
+    scratch->std_out.buffer[0] = '\0';
+    scratch->std_out.length = 0;
+    scratch->std_err.buffer[0] = '\0';
+    scratch->std_err.length = 0;
+
+    err = get_record(ast, scratch);
+    install_trigger(b, ast, t, err);
+    free_ast(ast);
+
+    size_t len = 0;
+    if (err_is_ok(err)) {
+        len = strlen(scratch->std_out.buffer);
+        while (len > 0 && (scratch->std_out.buffer[len-1] == '\n' ||
+                           scratch->std_out.buffer[len-1] == ' ')) {
+            len--;
+        }
+    }
+    else if (err_no(err) != OCT_ERR_NO_RECORD) {
+        return err;
+    }
+
+    if (out->length + len + 2 >
+            octopus__get_records_response_output_MAX_ARGUMENT_SIZE) {
+        return OCT_ERR_QUERY_SIZE;
+    }
+    memcpy(out->buffer + out->length, scratch->std_out.buffer, len);
+    out->length += len;
+    out->buffer[out->length++] = '\n';
+    out->buffer[out->length] = '\0';
+
+    return SYS_ERR_OK;
+}
+
+void get_records_handler(struct octopus_binding *b, const char *names,
+                         octopus_trigger_t t)
+{
+    OCT_DEBUG(" get_records_handler: %s\n", names);
+
+    errval_t err = SYS_ERR_OK;
+
+    struct oct_reply_state* drs = NULL;
+    struct oct_query_state* scratch = NULL;
+    char* copy = NULL;
+
+    err = new_oct_reply_state(&drs, get_records_reply);
+    assert(err_is_ok(err));
+
+    err = check_query_length(names);
+    if (err_is_fail(err)) {
+        goto out;
+    }
+
+    scratch = malloc(sizeof(struct oct_query_state));
+    copy = strdup(names);
+    if (scratch == NULL || copy == NULL) {
+        err = LIB_ERR_MALLOC_FAIL;
+        goto out;
+    }
+
+    char* save = NULL;
+    for (char* name = strtok_r(copy, " ", &save); name != NULL;
+            name = strtok_r(NULL, " ", &save)) {
+        err = get_records_append(b, name, t, scratch, &drs->query_state.std_out);
+        if (err_is_fail(err)) {
+            break;
+        }
+    }
+
+out:
+    drs->error = err;
+    drs->reply(b, drs);
+
+    free(copy);
+    free(scratch);
+}
+
 static void set_reply(struct octopus_binding* b, struct oct_reply_state* drs)
 {
     char* record = err_is_ok(drs->error) && drs->return_record ?
@@ -716,23 +829,190 @@ static void unsubscribe_reply(struct octopus_binding* b,
     }
 }
 
-static void send_subscribed_message(struct octopus_binding* b, struct oct_reply_state* drs)
+/**
+ * Published record, shared by all notifications sent for it.
+ */
+struct publication {
+    size_t refcount;
+    char record[];
+};
+
+struct notification {
+    struct notification* next;
+    struct publication* pub; ///< NULL for the removal of a subscription
+    uint64_t client_handler;
+    uint64_t client_state;
+    uint64_t server_id;
+    octopus_mode_t mode;
+};
+
+/**
+ * Notifications waiting to be sent on the event binding of a client. They are
+ * sent back to back from the send continuation, the reply state only goes
+ * into the binding queue (see queue.c) while the binding is busy.
+ */
+struct notify_queue {
+    struct oct_reply_state drs; ///< Must be first, see notify_send_next()
+    struct notify_queue* next; ///< Next queue in the same hash bucket
+    struct octopus_binding* binding;
+    struct notification* head;
+    struct notification* tail;
+    bool sending; ///< Head is in flight or drs is queued on the binding
+};
+
+#define NOTIFY_BUCKETS 256
+static struct notify_queue* notify_queues[NOTIFY_BUCKETS];
+
+static void notify_send_next(struct octopus_binding* b,
+        struct oct_reply_state* drs);
+
+static struct notify_queue** notify_bucket(struct octopus_binding* b)
+{
+    return &notify_queues[((uintptr_t) b >> 4) % NOTIFY_BUCKETS];
+}
+
+static struct notify_queue* get_notify_queue(struct octopus_binding* b)
 {
-    errval_t err = SYS_ERR_OK;
-    char* record = drs->query_state.std_out.buffer[0] != '\0' ?
-            drs->query_state.std_out.buffer : NULL;
+    struct notify_queue** bucket = notify_bucket(b);
+
+    struct notify_queue* q = *bucket;
+    while (q != NULL && q->binding != b) {
+        q = q->next;
+    }
+    if (q != NULL) {
+        return q;
+    }
 
-    err = b->tx_vtbl.subscription(b, MKCONT(free_oct_reply_state, drs),
-            drs->server_id, drs->client_handler,
-            drs->mode, record, drs->client_state);
+    q = calloc(1, sizeof(struct notify_queue));
+    if (q == NULL) {
+        return NULL;
+    }
+    q->drs.reply = notify_send_next;
+    q->drs.binding = b;
+    q->binding = b;
+    q->next = *bucket;
+    *bucket = q;
+
+    return q;
+}
+
+static void put_publication(struct publication* pub)
+{
+    if (pub != NULL && --pub->refcount == 0) {
+        free(pub);
+    }
+}
+
+/**
+ * Frees the queue of a binding that failed, together with the notifications
+ * that can no longer be sent on it. A later binding at the same address thus
+ * starts with an empty queue.
+ */
+static void release_notify_queue(struct octopus_binding* b)
+{
+    struct notify_queue** walk = notify_bucket(b);
+    while (*walk != NULL && (*walk)->binding != b) {
+        walk = &(*walk)->next;
+    }
+    if (*walk == NULL) {
+        return;
+    }
+
+    struct notify_queue* q = *walk;
+    *walk = q->next;
+    oct_rpc_remove_reply(b, &q->drs);
+
+    while (q->head != NULL) {
+        struct notification* n = q->head;
+        q->head = n->next;
+        put_publication(n->pub);
+        free(n);
+    }
+    free(q);
+}
+
+void oct_error_handler(struct octopus_binding* b, errval_t err)
+{
+    DEBUG_ERR(err, "octopus binding failed, dropping its notifications");
+    release_notify_queue(b);
+}
+
+static void notify_sent(void* arg)
+{
+    struct notify_queue* q = arg;
+    struct notification* n = q->head;
+
+    q->head = n->next;
+    if (q->head == NULL) {
+        q->tail = NULL;
+    }
+    put_publication(n->pub);
+    free(n);
+
+    if (q->head != NULL) {
+        notify_send_next(q->binding, &q->drs);
+    }
+    else {
+        q->sending = false;
+    }
+}
+
+static void notify_send_next(struct octopus_binding* b,
+        struct oct_reply_state* drs)
+{
+    struct notify_queue* q = (struct notify_queue*) drs;
+    struct notification* n = q->head;
+    assert(n != NULL);
+
+    errval_t err = b->tx_vtbl.subscription(b, MKCONT(notify_sent, q),
+            n->server_id, n->client_handler, n->mode,
+            n->pub != NULL ? n->pub->record : NULL, n->client_state);
     if (err_is_fail(err)) {
         if (err_no(err) == FLOUNDER_ERR_TX_BUSY) {
             oct_rpc_enqueue_reply(b, drs);
             return;
         }
-        USER_PANIC_ERR(err, "SKB sending %s failed!", __FUNCTION__);
+        DEBUG_ERR(err, "SKB sending %s failed, dropping notifications",
+                __FUNCTION__);
+        release_notify_queue(b);
     }
+}
 
+/**
+ * Appends the notifications first..last to the queue and starts sending if
+ * the queue was idle.
+ */
+static void notify_enqueue(struct notify_queue* q, struct notification* first,
+        struct notification* last)
+{
+    last->next = NULL;
+    if (q->tail != NULL) {
+        q->tail->next = first;
+    }
+    else {
+        q->head = first;
+    }
+    q->tail = last;
+
+    if (!q->sending) {
+        q->sending = true;
+        notify_send_next(q->binding, &q->drs);
+    }
+}
+
+static struct notification* new_notification(struct oct_subscriber* s,
+        struct publication* pub, octopus_mode_t mode)
+{
+    struct notification* n = malloc(sizeof(struct notification));
+    if (n != NULL) {
+        n->next = NULL;
+        n->pub = pub;
+        n->client_handler = s->client_handler;
+        n->client_state = s->client_state;
+        n->server_id = s->server_id;
+        n->mode = mode;
+    }
+    return n;
 }
 
 void unsubscribe_handler(struct octopus_binding *b, uint64_t id)
@@ -747,32 +1027,24 @@ void unsubscribe_handler(struct octopus_binding *b, uint64_t id)
 
     err = del_subscription(b, id, &srs->query_state);
     if (err_is_ok(err)) {
-        uint64_t binding;
-        uint64_t client_handler;
-        uint64_t client_state;
-        uint64_t server_id;
-
+        struct oct_subscriber subscriber;
         skb_read_output_at(srs->query_state.std_out.buffer,
                 "subscriber(%"SCNu64", %"SCNu64", %"SCNu64", %"SCNu64")",
-                &binding, &client_handler, &client_state, &server_id);
-
-        struct oct_reply_state* subscriber = NULL;
-        err = new_oct_reply_state(&subscriber,
-                send_subscribed_message);
-        assert(err_is_ok(err));
-
-#if defined(__i386__) || defined(__arm__)
-        subscriber->binding = (struct octopus_binding*)(uint32_t)binding;
-#else
-        subscriber->binding = (struct octopus_binding*)binding;
-#endif
-        subscriber->client_handler = client_handler;
-        subscriber->client_state = client_state;
-        subscriber->server_id = server_id;
-        subscriber->mode = OCT_REMOVED;
+                &subscriber.binding, &subscriber.client_handler,
+                &subscriber.client_state, &subscriber.server_id);
+
+        // goes through the queue to arrive after pending notifications
+        struct notify_queue* q = get_notify_queue(
+                (struct octopus_binding*)(uintptr_t) subscriber.binding);
+        struct notification* n = new_notification(&subscriber, NULL,
+                OCT_REMOVED);
+        if (q == NULL || n == NULL) {
+            USER_PANIC("no memory to notify removed subscription");
+        }
 
-        OCT_DEBUG("publish msg to: recipient:%"PRIu64" id:%"PRIu64"\n", binding, server_id);
-        subscriber->reply(subscriber->binding, subscriber);
+        OCT_DEBUG("publish msg to: recipient:%"PRIu64" id:%"PRIu64"\n",
+                subscriber.binding, subscriber.server_id);
+        notify_enqueue(q, n, n);
     }
 
     srs->error = err;
@@ -793,6 +1065,72 @@ static void publish_reply(struct octopus_binding* b, struct oct_reply_state* drs
     }
 }
 
+static int compare_subscribers(const void* a, const void* b)
+{
+    const struct oct_subscriber* sa = a;
+    const struct oct_subscriber* sb = b;
+    if (sa->binding != sb->binding) {
+        return sa->binding < sb->binding ? -1 : 1;
+    }
+    return (sa->server_id > sb->server_id) - (sa->server_id < sb->server_id);
+}
+
+/**
+ * Queues a notification for every subscriber. Subscribers are grouped by
+ * their event binding so every client gets its notifications appended to
+ * its queue in one batch.
+ */
+static void notify_subscribers(const char* record,
+        struct oct_subscriber* subscribers, size_t count)
+{
+    size_t len = strlen(record) + 1;
+    struct publication* pub = malloc(sizeof(struct publication) + len);
+    if (pub == NULL) {
+        DEBUG_ERR(LIB_ERR_MALLOC_FAIL, "dropped publication %s", record);
+        return;
+    }
+    memcpy(pub->record, record, len);
+    pub->refcount = count + 1;
+
+    qsort(subscribers, count, sizeof(struct oct_subscriber),
+            compare_subscribers);
+
+    for (size_t i = 0; i < count; ) {
+        uint64_t binding = subscribers[i].binding;
+        struct notify_queue* q = get_notify_queue(
+                (struct octopus_binding*)(uintptr_t) binding);
+
+        struct notification* first = NULL;
+        struct notification* last = NULL;
+        for (; i < count && subscribers[i].binding == binding; i++) {
+            struct notification* n = q == NULL ? NULL :
+                    new_notification(&subscribers[i], pub, OCT_ON_PUBLISH);
+            if (n == NULL) {
+                DEBUG_ERR(LIB_ERR_MALLOC_FAIL, "dropped notification %"PRIu64,
+                        subscribers[i].server_id);
+                put_publication(pub);
+                continue;
+            }
+
+            OCT_DEBUG("publish msg to: recipient:%"PRIu64" id:%"PRIu64"\n",
+                    binding, n->server_id);
+            if (last != NULL) {
+                last->next = n;
+            }
+            else {
+                first = n;
+            }
+            last = n;
+        }
+
+        if (first != NULL) {
+            notify_enqueue(q, first, last);
+        }
+    }
+
+    put_publication(pub);
+}
+
 void publish_handler(struct octopus_binding *b, const char* record)
 {
     OCT_DEBUG("publish_handler query: %s\n", record);
@@ -817,48 +1155,18 @@ void publish_handler(struct octopus_binding *b, const char* record)
         goto out2;
     }
 
+    struct oct_subscriber* subscribers = NULL;
+    size_t count = 0;
+    err = find_subscribers(ast, &drs->query_state, &subscribers, &count);
 
-    if (err_is_ok(err)) {
-        err = find_subscribers(ast, &drs->query_state);
-        if (err_is_ok(err)) {
-            // Reply to publisher
-            drs->error = err;
-            drs->reply(b, drs);
-
-
-            struct list_parser_status status;
-            skb_read_list_init_offset(&status, drs->query_state.std_out.buffer, 0);
-
-            // TODO remove skb list parser dependency
-            // Send to all subscribers
-            uint64_t binding;
-            uint64_t client_handler;
-            uint64_t client_state;
-            uint64_t server_id;
-
-            while (skb_read_list(&status, "subscriber(%"SCNu64", %"SCNu64", %"SCNu64", %"SCNu64")",
-                    &binding, &client_handler, &client_state, &server_id)) {
-
-                struct oct_reply_state* subscriber = NULL;
-                err = new_oct_reply_state(&subscriber,
-                        send_subscribed_message);
-                assert(err_is_ok(err));
-#if defined(__i386__) || defined(__arm__)
-                subscriber->binding = (struct octopus_binding*)(uint32_t)binding;
-#else
-                subscriber->binding = (struct octopus_binding*)binding;
-#endif
-                subscriber->client_handler = client_handler;
-                strcpy(subscriber->query_state.std_out.buffer, record);
-                subscriber->client_state = client_state;
-                subscriber->server_id = server_id;
-                subscriber->mode = OCT_ON_PUBLISH;
-
-                OCT_DEBUG("publish msg to: recipient:%"PRIu64" id:%"PRIu64"\n", binding, server_id);
-                subscriber->reply(subscriber->binding, subscriber);
-            }
-        }
+    // Reply to publisher, delivery to the subscribers is asynchronous
+    drs->error = err;
+    drs->reply(b, drs);
+
+    if (err_is_ok(err) && count > 0) {
+        notify_subscribers(record, subscribers, count);
     }
+    free(subscribers);
 
 out2:
     free_ast(ast);
@@ -28,6 +28,38 @@
 
 extern char **environ;
 
+/*
+ * The root CNode, the L2 CNodes created for the new domain and its DCB are
+ * retyped from a single RAM region, one invocation per range of consecutive
+ * slots. Layout of the region, in units of OBJSIZE_L2CNODE:
+ *
+ *   0      root CNode
+ *   1-3    taskcn, pagecn, basecn
+ *   4-6    slot_alloc cnodes
+ *   7      DCB
+ */
+#define SPAWN_CSPACE_RAM_BITS   (L2_CNODE_BITS + OBJBITS_CTE + 3)
+
+STATIC_ASSERT(ROOTCN_SLOT_PAGECN == ROOTCN_SLOT_TASKCN + 1 &&
+              ROOTCN_SLOT_BASE_PAGE_CN == ROOTCN_SLOT_TASKCN + 2,
+              "taskcn, pagecn and basecn are created at once");
+STATIC_ASSERT(ROOTCN_SLOT_SLOT_ALLOC1 == ROOTCN_SLOT_SLOT_ALLOC0 + 1 &&
+              ROOTCN_SLOT_SLOT_ALLOC2 == ROOTCN_SLOT_SLOT_ALLOC0 + 2,
+              "slot_alloc cnodes are created at once");
+
+/**
+ * \brief Returns a cnoderef to an L2 CNode in the root CNode of the domain
+ */
+static struct cnoderef spawn_foreign_cnode(struct spawninfo *si, cslot_t slot)
+{
+    struct cnoderef cnode = {
+        .croot = get_cap_addr(si->rootcn_cap),
+        .cnode = ROOTCN_SLOT_ADDR(slot),
+        .level = CNODE_TYPE_OTHER,
+    };
+    return cnode;
+}
+
 /**
  * \brief Setup an initial cspace
  *
@@ -38,28 +70,43 @@ static errval_t spawn_setup_cspace(struct spawninfo *si)
     errval_t err;
     struct capref t1;
 
+    assert(OBJSIZE_DISPATCHER <= OBJSIZE_L2CNODE);
+    si->sharedcn_cap = NULL_CAP;
+    si->sharedcn_slot_buf = NULL;
+
+    struct capref cspace_ram;
+    err = ram_alloc(&cspace_ram, SPAWN_CSPACE_RAM_BITS);
+    if (err_is_fail(err)) {
+        return err_push(err, LIB_ERR_RAM_ALLOC);
+    }
+
     /* Create root CNode */
-    err = cnode_create_l1(&si->rootcn_cap, &si->rootcn);
+    err = slot_alloc(&si->rootcn_cap);
+    if (err_is_fail(err)) {
+        return err_push(err, LIB_ERR_SLOT_ALLOC);
+    }
+    err = cap_retype(si->rootcn_cap, cspace_ram, 0, ObjType_L1CNode,
+                     OBJSIZE_L2CNODE, 1);
     if (err_is_fail(err)) {
         return err_push(err, SPAWN_ERR_CREATE_ROOTCN);
     }
+    si->rootcn = build_cnoderef(si->rootcn_cap, CNODE_TYPE_ROOT);
 
-    /* Create taskcn */
-    err = cnode_create_foreign_l2(si->rootcn_cap, ROOTCN_SLOT_TASKCN, &si->taskcn);
+    /* Create taskcn, pagecn and basecn */
+    t1.cnode = si->rootcn;
+    t1.slot  = ROOTCN_SLOT_TASKCN;
+    err = cap_retype(t1, cspace_ram, OBJSIZE_L2CNODE, ObjType_L2CNode,
+                     OBJSIZE_L2CNODE, 3);
     if (err_is_fail(err)) {
         return err_push(err, SPAWN_ERR_CREATE_TASKCN);
     }
+    si->taskcn = spawn_foreign_cnode(si, ROOTCN_SLOT_TASKCN);
+    si->pagecn = spawn_foreign_cnode(si, ROOTCN_SLOT_PAGECN);
 
     /* Create slot_alloc_cnode */
-    err = cnode_create_foreign_l2(si->rootcn_cap, ROOTCN_SLOT_SLOT_ALLOC0, NULL);
-    if (err_is_fail(err)) {
-        return err_push(err, SPAWN_ERR_CREATE_SLOTALLOC_CNODE);
-    }
-    err = cnode_create_foreign_l2(si->rootcn_cap, ROOTCN_SLOT_SLOT_ALLOC1, NULL);
-    if (err_is_fail(err)) {
-        return err_push(err, SPAWN_ERR_CREATE_SLOTALLOC_CNODE);
-    }
-    err = cnode_create_foreign_l2(si->rootcn_cap, ROOTCN_SLOT_SLOT_ALLOC2, NULL);
+    t1.slot  = ROOTCN_SLOT_SLOT_ALLOC0;
+    err = cap_retype(t1, cspace_ram, 4 * OBJSIZE_L2CNODE, ObjType_L2CNode,
+                     OBJSIZE_L2CNODE, 3);
     if (err_is_fail(err)) {
         return err_push(err, SPAWN_ERR_CREATE_SLOTALLOC_CNODE);
     }
@@ -69,11 +116,17 @@ static errval_t spawn_setup_cspace(struct spawninfo *si)
     if (err_is_fail(err)) {
         return err_push(err, LIB_ERR_SLOT_ALLOC);
     }
-    err = dispatcher_create(si->dcb);
+    err = cap_retype(si->dcb, cspace_ram, 7 * OBJSIZE_L2CNODE,
+                     ObjType_Dispatcher, 0, 1);
     if (err_is_fail(err)) {
         return err_push(err, SPAWN_ERR_CREATE_DISPATCHER);
     }
 
+    err = cap_destroy(cspace_ram);
+    if (err_is_fail(err)) {
+        return err_push(err, LIB_ERR_CAP_DESTROY);
+    }
+
     // Copy DCB to new taskcn
     t1.cnode = si->taskcn;
     t1.slot  = TASKCN_SLOT_DISPATCHER;
@@ -114,13 +167,7 @@ static errval_t spawn_setup_cspace(struct spawninfo *si)
     memset(&si->argspg, 0, sizeof(si->argspg));
 
     /* Fill up basecn */
-    struct cnoderef basecn;
-
-    // Create basecn in our rootcn so we can copy stuff in there
-    err = cnode_create_foreign_l2(si->rootcn_cap, ROOTCN_SLOT_BASE_PAGE_CN, &basecn);
-    if (err_is_fail(err)) {
-        return err_push(err, LIB_ERR_CNODE_CREATE);
-    }
+    struct cnoderef basecn = spawn_foreign_cnode(si, ROOTCN_SLOT_BASE_PAGE_CN);
 
     // get big RAM cap for L2_CNODE_SLOTS BASE_PAGE_SIZEd caps
     struct capref ram;
@@ -152,13 +199,7 @@ static errval_t spawn_setup_vspace(struct spawninfo *si)
 {
     errval_t err;
 
-    /* Create pagecn */
-    err = cnode_create_foreign_l2(si->rootcn_cap, ROOTCN_SLOT_PAGECN, &si->pagecn);
-    if (err_is_fail(err)) {
-        return err_push(err, SPAWN_ERR_CREATE_PAGECN);
-    }
-
-    /* Init pagecn's slot allocator */
+    /* Init pagecn's slot allocator, pagecn was created with the cspace */
     si->pagecn_cap.cnode = si->rootcn;
     si->pagecn_cap.slot = ROOTCN_SLOT_PAGECN;
 
@@ -687,54 +728,18 @@ static errval_t spawn_setup_argcn(struct spawninfo *si,
     return SYS_ERR_OK;
 }
 
-
 /**
- * \brief Load an image
- *
- * \param si            Struct used by the library
- * \param binary        The image to load
- * \param type          The type of arch to load for
- * \param name          Name of the image required only to place it in disp
- *                      struct
- * \param coreid        Coreid to load for, required only to place it in disp
- *                      struct
- * \param argv          Command-line arguments, NULL-terminated
- * \param envp          Environment, NULL-terminated
- * \param inheritcn_cap Cap to a CNode containing capabilities to be inherited
- * \param argcn_cap     Cap to a CNode containing capabilities passed as
- *                      arguments
+ * \brief Set up the rest of a domain whose image was loaded
  */
-errval_t spawn_load_image(struct spawninfo *si, lvaddr_t binary,
-                          size_t binary_size, enum cpu_type type,
-                          const char *name, coreid_t coreid,
-                          char *const argv[], char *const envp[],
-                          struct capref inheritcn_cap, struct capref argcn_cap)
+static errval_t spawn_load_finish(struct spawninfo *si, coreid_t coreid,
+                                  const char *name, genvaddr_t entry,
+                                  void *arch_info, char *const argv[],
+                                  char *const envp[],
+                                  struct capref inheritcn_cap,
+                                  struct capref argcn_cap)
 {
     errval_t err;
 
-    si->cpu_type = type;
-
-    /* Initialize cspace */
-    err = spawn_setup_cspace(si);
-    if (err_is_fail(err)) {
-        return err_push(err, SPAWN_ERR_SETUP_CSPACE);
-    }
-
-    /* Initialize vspace */
-    err = spawn_setup_vspace(si);
-    if (err_is_fail(err)) {
-        return err_push(err, SPAWN_ERR_VSPACE_INIT);
-    }
-
-    si->name = name;
-    genvaddr_t entry;
-    void* arch_info;
-    /* Load the image */
-    err = spawn_arch_load(si, binary, binary_size, &entry, &arch_info);
-    if (err_is_fail(err)) {
-        return err_push(err, SPAWN_ERR_LOAD);
-    }
-
     /* Setup dispatcher frame */
     err = spawn_setup_dispatcher(si, coreid, name, entry, arch_info);
     if (err_is_fail(err)) {
@@ -799,6 +804,136 @@ errval_t spawn_load_image(struct spawninfo *si, lvaddr_t binary,
     return SYS_ERR_OK;
 }
 
+/**
+ * \brief Set up the cspace and vspace of a domain to be spawned
+ *
+ * None of this depends on the image, so it can be done ahead of time, e.g.
+ * while the image is read or between spawn requests. The image is loaded
+ * with spawn_load_prepared_image() or spawn_load_shared_image().
+ *
+ * \param si            Struct used by the library
+ * \param type          The type of arch to load for
+ */
+errval_t spawn_prepare(struct spawninfo *si, enum cpu_type type)
+{
+    errval_t err;
+
+    si->cpu_type = type;
+
+    /* Initialize cspace */
+    err = spawn_setup_cspace(si);
+    if (err_is_fail(err)) {
+        return err_push(err, SPAWN_ERR_SETUP_CSPACE);
+    }
+
+    /* Initialize vspace */
+    err = spawn_setup_vspace(si);
+    if (err_is_fail(err)) {
+        return err_push(err, SPAWN_ERR_VSPACE_INIT);
+    }
+
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Load an image
+ *
+ * \param si            Struct used by the library
+ * \param binary        The image to load
+ * \param type          The type of arch to load for
+ * \param name          Name of the image required only to place it in disp
+ *                      struct
+ * \param coreid        Coreid to load for, required only to place it in disp
+ *                      struct
+ * \param argv          Command-line arguments, NULL-terminated
+ * \param envp          Environment, NULL-terminated
+ * \param inheritcn_cap Cap to a CNode containing capabilities to be inherited
+ * \param argcn_cap     Cap to a CNode containing capabilities passed as
+ *                      arguments
+ */
+errval_t spawn_load_image(struct spawninfo *si, lvaddr_t binary,
+                          size_t binary_size, enum cpu_type type,
+                          const char *name, coreid_t coreid,
+                          char *const argv[], char *const envp[],
+                          struct capref inheritcn_cap, struct capref argcn_cap)
+{
+    errval_t err;
+
+    err = spawn_prepare(si, type);
+    if (err_is_fail(err)) {
+        return err;
+    }
+
+    return spawn_load_prepared_image(si, binary, binary_size, name, coreid,
+                                     argv, envp, inheritcn_cap, argcn_cap);
+}
+
+/**
+ * \brief Load an image into a domain set up with spawn_prepare()
+ *
+ * Parameters as for spawn_load_image().
+ */
+errval_t spawn_load_prepared_image(struct spawninfo *si, lvaddr_t binary,
+                                   size_t binary_size, const char *name,
+                                   coreid_t coreid, char *const argv[],
+                                   char *const envp[],
+                                   struct capref inheritcn_cap,
+                                   struct capref argcn_cap)
+{
+    errval_t err;
+
+    si->name = name;
+    genvaddr_t entry;
+    void* arch_info;
+    /* Load the image */
+    err = spawn_arch_load(si, binary, binary_size, &entry, &arch_info);
+    if (err_is_fail(err)) {
+        return err_push(err, SPAWN_ERR_LOAD);
+    }
+
+    return spawn_load_finish(si, coreid, name, entry, arch_info, argv, envp,
+                             inheritcn_cap, argcn_cap);
+}
+
+/**
+ * \brief Load a shared image into a domain set up with spawn_prepare()
+ *
+ * Like spawn_load_prepared_image(), but maps the read-only segments of the
+ * image instead of loading the binary again. See spawn_image_create().
+ *
+ * \param si            Struct used by the library
+ * \param image         The image to load
+ * \param name          Name of the image required only to place it in disp
+ *                      struct
+ * \param coreid        Coreid to load for, required only to place it in disp
+ *                      struct
+ * \param argv          Command-line arguments, NULL-terminated
+ * \param envp          Environment, NULL-terminated
+ * \param inheritcn_cap Cap to a CNode containing capabilities to be inherited
+ * \param argcn_cap     Cap to a CNode containing capabilities passed as
+ *                      arguments
+ */
+errval_t spawn_load_shared_image(struct spawninfo *si,
+                                 struct spawn_image *image, const char *name,
+                                 coreid_t coreid, char *const argv[],
+                                 char *const envp[],
+                                 struct capref inheritcn_cap,
+                                 struct capref argcn_cap)
+{
+    errval_t err;
+
+    assert(si->cpu_type == image->cpu_type);
+
+    si->name = name;
+    err = spawn_image_map(si, image);
+    if (err_is_fail(err)) {
+        return err_push(err, SPAWN_ERR_LOAD);
+    }
+
+    return spawn_load_finish(si, coreid, name, image->entry, NULL, argv, envp,
+                             inheritcn_cap, argcn_cap);
+}
+
 /**
  * \brief Spawn a domain with the given args
  */
@@ -988,6 +1123,10 @@ errval_t spawn_free(struct spawninfo *si)
     cap_destroy(si->dispframe);
     cap_destroy(si->dcb);
     cap_destroy(si->argspg);
+    if (!capref_is_null(si->sharedcn_cap)) {
+        cap_destroy(si->sharedcn_cap);
+    }
+    free(si->sharedcn_slot_buf);
 
     return SYS_ERR_OK;
 }
@@ -1002,8 +1141,6 @@ errval_t spawn_span_domain(struct spawninfo *si, struct capref vroot,
                            struct capref disp_frame)
 {
     errval_t err;
-    struct capref t1;
-    struct cnoderef cnode;
 
     /* Spawn cspace */
     err = spawn_setup_cspace(si);
@@ -1011,20 +1148,8 @@ errval_t spawn_span_domain(struct spawninfo *si, struct capref vroot,
         return err;
     }
 
-    /* Create pagecn: default L2 CNode size */
-    t1.cnode = si->rootcn;
-    t1.slot  = ROOTCN_SLOT_PAGECN;
-    err = cnode_create_raw(t1, NULL, ObjType_L2CNode, L2_CNODE_SLOTS, NULL);
-    if (err_is_fail(err)) {
-        return err_push(err, SPAWN_ERR_CREATE_PAGECN);
-    }
-    // XXX: fix build_cnoderef()
-    cnode.croot = get_cap_addr(si->rootcn_cap);
-    cnode.cnode = ROOTCN_SLOT_ADDR(ROOTCN_SLOT_PAGECN);
-    cnode.level = CNODE_TYPE_OTHER;
-
-    // Copy root of pagetable
-    si->vtree.cnode = cnode;
+    // Copy root of pagetable, pagecn was created with the cspace
+    si->vtree.cnode = si->pagecn;
     si->vtree.slot = 0;
     err = cap_copy(si->vtree, vroot);
     if (err_is_fail(err)) {
@@ -23,4 +23,6 @@ errval_t spawn_symval_register(const char *binary, uint32_t idx,
                                const char *symname, genvaddr_t addres);
 errval_t spawn_symval_lookup(const char *binary, uint32_t idx, char **ret_name,
                              genvaddr_t *ret_addr);
+
+errval_t spawn_image_map(struct spawninfo *si, struct spawn_image *image);
 #endif
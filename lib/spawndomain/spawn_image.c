@@ -0,0 +1,402 @@
+/**
+ * \file
+ * \brief Shared images: ELF binaries loaded once and spawned many times
+ *
+ * An image keeps the segments of a binary as loaded (and relocated) by the
+ * ELF loader. Domains spawned from it map the frames of its read-only
+ * segments directly. The caps to these frames carry all rights, so neither
+ * the copies used for the mappings nor the mapping caps are placed in the
+ * cspace of the new domain: with either of them it could remap the shared
+ * text writable under every other instance. They are kept in a CNode of the
+ * spawning domain instead (si->sharedcn_cap), to be deleted once the new
+ * domain is gone. Writable segments get fresh frames, of which only the
+ * initialized part is copied: the rest is zero-filled by the kernel when
+ * the frames are created. The frames of a large BSS are therefore never
+ * mapped here, only into the new domain.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <string.h>
+#include <barrelfish/barrelfish.h>
+#include <barrelfish/cpu_arch.h>
+#include <spawndomain/spawndomain.h>
+#include <elf/elf.h>
+#include "spawn.h"
+
+#if defined(__i386__)
+#define EM_HOST EM_386
+#elif defined(__k1om__)
+#define EM_HOST EM_K1OM
+#elif defined(__x86_64__)
+#define EM_HOST EM_X86_64
+#elif defined(__arm__)
+#define EM_HOST EM_ARM
+#elif defined(__aarch64__)
+#define EM_HOST EM_AARCH64
+#else
+#error "Unexpected architecture."
+#endif
+
+/**
+ * \brief Convert elf flags to vregion flags
+ */
+static vregion_flags_t elf_to_vregion_flags(uint32_t flags)
+{
+    vregion_flags_t vregion_flags = 0;
+
+    if (flags & PF_R) {
+        vregion_flags |= VREGION_FLAGS_READ;
+    }
+    if (flags & PF_W) {
+        vregion_flags |= VREGION_FLAGS_WRITE;
+    }
+    if (flags & PF_X) {
+        vregion_flags |= VREGION_FLAGS_EXECUTE;
+    }
+
+    return vregion_flags;
+}
+
+/**
+ * \brief Back size bytes of our vspace by new frames
+ *
+ * \param map_len  only the frames overlapping the first map_len bytes are
+ *                 mapped
+ * \param cnode    CNode to create the frames in from *slot on, or NULL to
+ *                 allocate slots
+ */
+static errval_t map_new_frames(size_t size, size_t map_len,
+                               struct cnoderef *cnode, cslot_t *slot,
+                               struct vregion **retvregion)
+{
+    errval_t err;
+
+    struct memobj *memobj = malloc(sizeof(struct memobj_anon));
+    if (memobj == NULL) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+    struct vregion *vregion = malloc(sizeof(struct vregion));
+    if (vregion == NULL) {
+        free(memobj);
+        return LIB_ERR_MALLOC_FAIL;
+    }
+
+    err = memobj_create_anon((struct memobj_anon *)memobj, size, 0);
+    if (err_is_fail(err)) {
+        free(vregion);
+        free(memobj);
+        return err_push(err, LIB_ERR_MEMOBJ_CREATE_ANON);
+    }
+    err = vregion_map(vregion, get_current_vspace(), memobj, 0, size,
+                      VREGION_FLAGS_READ_WRITE);
+    if (err_is_fail(err)) {
+        memobj_destroy_anon(memobj, false);
+        free(vregion);
+        free(memobj);
+        return err_push(err, LIB_ERR_VSPACE_MAP);
+    }
+
+    size_t sz;
+    for (size_t offset = 0; offset < size; offset += sz) {
+        sz = 1UL << log2floor(size - offset);
+        struct capref frame;
+        if (cnode != NULL) {
+            frame.cnode = *cnode;
+            frame.slot = (*slot)++;
+            err = frame_create(frame, sz, NULL);
+        } else {
+            err = frame_alloc(&frame, sz, NULL);
+        }
+        if (err_is_fail(err)) {
+            err = err_push(err, LIB_ERR_FRAME_CREATE);
+            goto error;
+        }
+        err = memobj->f.fill(memobj, offset, frame, sz);
+        if (err_is_fail(err)) {
+            err = err_push(err, LIB_ERR_MEMOBJ_FILL);
+            goto error;
+        }
+        if (offset >= map_len) {
+            continue;
+        }
+        err = memobj->f.pagefault(memobj, vregion, offset, 0);
+        if (err_is_fail(err)) {
+            err = err_push(err, LIB_ERR_MEMOBJ_PAGEFAULT_HANDLER);
+            goto error;
+        }
+    }
+
+    *retvregion = vregion;
+    return SYS_ERR_OK;
+
+ error:
+    memobj_destroy_anon(memobj, cnode == NULL);
+    free(vregion);
+    free(memobj);
+    return err;
+}
+
+static errval_t image_allocate(void *state, genvaddr_t base, size_t size,
+                               uint32_t flags, void **retbase)
+{
+    errval_t err;
+
+    struct spawn_image *image = state;
+    if (image->nsegments == SPAWN_IMAGE_SEGMENTS_MAX) {
+        return SPAWN_ERR_IMAGE_SEGMENTS;
+    }
+
+    // Increase size by space wasted on first page due to page-alignment
+    size_t base_offset = BASE_PAGE_OFFSET(base);
+    size += base_offset;
+    base -= base_offset;
+    // Page-align
+    size = ROUND_UP(size, BASE_PAGE_SIZE);
+
+    struct spawn_image_segment *seg = &image->segments[image->nsegments];
+    err = map_new_frames(size, size, NULL, NULL, &seg->vregion);
+    if (err_is_fail(err)) {
+        return err;
+    }
+    seg->base = base;
+    seg->size = size;
+    seg->flags = flags;
+    image->nsegments++;
+
+    genvaddr_t genvaddr = vregion_get_base_addr(seg->vregion) + base_offset;
+    *retbase = (void *)vspace_genvaddr_to_lvaddr(genvaddr);
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Returns the number of bytes up to the last non-zero one
+ */
+static size_t segment_init_len(struct spawn_image_segment *seg)
+{
+    uint64_t *words = (uint64_t *)
+        vspace_genvaddr_to_lvaddr(vregion_get_base_addr(seg->vregion));
+    size_t n = seg->size / sizeof(uint64_t);
+
+    while (n > 0 && words[n - 1] == 0) {
+        n--;
+    }
+    return n * sizeof(uint64_t);
+}
+
+/**
+ * \brief Load an ELF binary into a shared image
+ *
+ * \param image         Image to initialize
+ * \param binary        The binary to load
+ * \param binary_size   Size of the binary
+ *
+ * The binary is not referenced after this returns.
+ */
+errval_t spawn_image_create(struct spawn_image *image, lvaddr_t binary,
+                            size_t binary_size)
+{
+    errval_t err;
+
+    memset(image, 0, sizeof(*image));
+
+#ifndef __x86__
+    // The ARM loaders hand the GOT of the binary to the new dispatcher,
+    // which an image does not keep.
+    return SPAWN_ERR_UNSUPPORTED_TARGET_ARCH;
+#endif
+
+    image->cpu_type = CURRENT_CPU_TYPE;
+
+    err = elf_load_tls(EM_HOST, image_allocate, image, binary, binary_size,
+                       &image->entry, &image->tls_init_base,
+                       &image->tls_init_len, &image->tls_total_len);
+    if (err_is_fail(err)) {
+        spawn_image_destroy(image);
+        return err;
+    }
+
+    lvaddr_t eh_frame, eh_frame_hdr;
+    err = elf_get_eh_info(binary, binary_size, &eh_frame,
+                          &image->eh_frame_size, &eh_frame_hdr,
+                          &image->eh_frame_hdr_size);
+    if (err_is_fail(err)) {
+        spawn_image_destroy(image);
+        return err;
+    }
+    image->eh_frame = vspace_lvaddr_to_genvaddr(eh_frame);
+    image->eh_frame_hdr = vspace_lvaddr_to_genvaddr(eh_frame_hdr);
+
+    for (unsigned i = 0; i < image->nsegments; i++) {
+        struct spawn_image_segment *seg = &image->segments[i];
+        if (seg->flags & PF_W) {
+            seg->init_len = segment_init_len(seg);
+            image->copied_bytes += seg->init_len;
+        } else {
+            image->shared_bytes += seg->size;
+        }
+    }
+
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Free the frames of an image
+ *
+ * Domains spawned from the image keep their copies of the shared frames.
+ */
+errval_t spawn_image_destroy(struct spawn_image *image)
+{
+    errval_t err = SYS_ERR_OK;
+
+    for (unsigned i = 0; i < image->nsegments; i++) {
+        struct vregion *vregion = image->segments[i].vregion;
+        struct memobj *memobj = vregion_get_memobj(vregion);
+        errval_t err2 = memobj_destroy_anon(memobj, true);
+        if (err_is_fail(err2)) {
+            err = err2;
+        }
+        free(vregion);
+        free(memobj);
+    }
+    image->nsegments = 0;
+
+    return err;
+}
+
+/**
+ * \brief Map the segments of an image into the domain being spawned
+ *
+ * Counterpart of spawn_arch_load() for shared images.
+ */
+errval_t spawn_image_map(struct spawninfo *si, struct spawn_image *image)
+{
+    errval_t err;
+
+    // Reset the elfloader_slot
+    si->elfload_slot = 0;
+    si->vregions = 0;
+
+    struct capref cnode_cap = {
+        .cnode = si->rootcn,
+        .slot  = ROOTCN_SLOT_SEGCN,
+    };
+    struct capref local_cnode_cap;
+    err = cnode_create_l2(&local_cnode_cap, &si->segcn);
+    if (err_is_fail(err)) {
+        return err_push(err, SPAWN_ERR_CREATE_SEGCN);
+    }
+    // Copy SegCN into new domain's cspace
+    err = cap_copy(cnode_cap, local_cnode_cap);
+    if (err_is_fail(err)) {
+        return err_push(err, SPAWN_ERR_MINT_SEGCN);
+    }
+
+    // CNode for the shared frames and their mappings, in our cspace only
+    struct cnoderef sharedcn;
+    err = cnode_create_l2(&si->sharedcn_cap, &sharedcn);
+    if (err_is_fail(err)) {
+        return err_push(err, LIB_ERR_CNODE_CREATE);
+    }
+    size_t bufsize = SINGLE_SLOT_ALLOC_BUFLEN(L2_CNODE_SLOTS);
+    si->sharedcn_slot_buf = malloc(bufsize);
+    if (si->sharedcn_slot_buf == NULL) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+    err = single_slot_alloc_init_raw(&si->sharedcn_slot_alloc,
+                                     si->sharedcn_cap, sharedcn,
+                                     L2_CNODE_SLOTS, si->sharedcn_slot_buf,
+                                     bufsize);
+    if (err_is_fail(err)) {
+        return err_push(err, LIB_ERR_SINGLE_SLOT_ALLOC_INIT_RAW);
+    }
+    struct slot_allocator *shared_alloc = &si->sharedcn_slot_alloc.a;
+    struct pmap *spawn_pmap = vspace_get_pmap(si->vspace);
+
+    for (unsigned i = 0; i < image->nsegments; i++) {
+        struct spawn_image_segment *seg = &image->segments[i];
+        bool shared = !(seg->flags & PF_W);
+
+        struct vregion *vregion = seg->vregion;
+        if (!shared) {
+            err = map_new_frames(seg->size, seg->init_len, &si->segcn,
+                                 &si->elfload_slot, &vregion);
+            if (err_is_fail(err)) {
+                return err;
+            }
+            memcpy((void *)vspace_genvaddr_to_lvaddr(
+                       vregion_get_base_addr(vregion)),
+                   (void *)vspace_genvaddr_to_lvaddr(
+                       vregion_get_base_addr(seg->vregion)),
+                   seg->init_len);
+        }
+
+        /* Map into spawn vspace */
+        struct memobj *spawn_memobj = NULL;
+        struct vregion *spawn_vregion = NULL;
+        err = spawn_vspace_map_anon_fixed_attr(si, seg->base, seg->size,
+                                               &spawn_vregion, &spawn_memobj,
+                                               elf_to_vregion_flags(seg->flags));
+        if (err_is_fail(err)) {
+            return err_push(err, SPAWN_ERR_VSPACE_MAP);
+        }
+
+        if (shared) {
+            spawn_pmap->mapping_slot_alloc = shared_alloc;
+        }
+        struct memobj_anon *m = (struct memobj_anon *)vregion_get_memobj(vregion);
+        for (struct memobj_frame_list *f = m->frame_list; f != NULL;
+             f = f->next) {
+            struct capref frame = f->frame;
+            if (shared) {
+                err = shared_alloc->alloc(shared_alloc, &frame);
+                if (err_is_ok(err)) {
+                    err = cap_copy(frame, f->frame);
+                }
+                if (err_is_fail(err)) {
+                    err = err_push(err, LIB_ERR_CAP_COPY);
+                    break;
+                }
+            }
+            err = spawn_memobj->f.fill(spawn_memobj, f->offset, frame, f->size);
+            if (err_is_fail(err)) {
+                err = err_push(err, LIB_ERR_MEMOBJ_FILL);
+                break;
+            }
+            err = spawn_memobj->f.pagefault(spawn_memobj, spawn_vregion,
+                                            f->offset, 0);
+            if (err_is_fail(err)) {
+                err = err_push(err, LIB_ERR_MEMOBJ_PAGEFAULT_HANDLER);
+                break;
+            }
+        }
+        spawn_pmap->mapping_slot_alloc = NULL;
+        if (err_is_fail(err)) {
+            return err;
+        }
+
+        si->vregion[si->vregions] = vregion;
+        si->base[si->vregions++] = seg->base;
+    }
+
+    si->tls_init_base = image->tls_init_base;
+    si->tls_init_len = image->tls_init_len;
+    si->tls_total_len = image->tls_total_len;
+    si->eh_frame = image->eh_frame;
+    si->eh_frame_size = image->eh_frame_size;
+    si->eh_frame_hdr = image->eh_frame_hdr;
+    si->eh_frame_hdr_size = image->eh_frame_hdr_size;
+
+    /* delete our copy of segcn cap */
+    err = cap_destroy(local_cnode_cap);
+    assert(err_is_ok(err));
+
+    return SYS_ERR_OK;
+}
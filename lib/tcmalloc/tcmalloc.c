@@ -0,0 +1,987 @@
+/**
+ * \file
+ * \brief Thread-caching malloc front-end on top of morecore.
+ *
+ * Small requests are rounded up to one of TC_NUM_CLASSES size classes and
+ * served from a per-thread free list without taking any lock. Thread caches
+ * refill from and drain to a per-dispatcher central cache in batches. Each
+ * central free list keeps a small transfer cache of ready-made batches in
+ * front of the spans backing the size class, so that the common
+ * producer/consumer pattern between threads never touches span metadata.
+ *
+ * Spans are runs of pages handed out by a per-dispatcher page heap, which
+ * grows through sys_morecore_alloc(), i.e. the morecore of libbarrelfish. A
+ * radix page map translates any heap address back to its span, so free()
+ * does not need a per-object header.
+ *
+ * Memory is never handed back to morecore: vspace_mmu_aware can only shrink
+ * at the top of its region, which a span allocator cannot guarantee.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <string.h>
+#include <barrelfish/barrelfish.h>
+#include <barrelfish/core_state.h>
+#include <k_r_malloc.h>
+#include <tcmalloc/tcmalloc.h>
+
+/// Number of size classes; class 0 denotes spans of large allocations
+#define TC_NUM_CLASSES          41
+
+/// Aim to move about this many bytes per batch between thread and central
+#define TC_BATCH_BYTES          (64 * 1024)
+
+/// Upper bound on the objects moved in one batch
+#define TC_MAX_BATCH            32
+
+/// Number of full batches kept per central free list
+#define TC_TRANSFER_SLOTS       16
+
+/// Upper bound on the length of a thread cache free list
+#define TC_MAX_LIST_LENGTH      1024
+
+/// Bytes a thread may cache before it is scavenged
+#define TC_MAX_THREAD_CACHE     (2 * 1024 * 1024)
+
+/// Page heap buckets; the last one holds all spans of that length and up
+#define TC_PAGEHEAP_BUCKETS     128
+
+/// Minimum amount to grow the page heap by
+#define TC_HEAP_GROW            LARGE_PAGE_SIZE
+
+/// Granularity of metadata allocations from morecore
+#define TC_META_CHUNK           (64 * 1024)
+
+/// Alignment of metadata objects, to keep them on separate cache lines
+#define TC_META_ALIGN           64
+
+/// Page map radix levels, covering the user part of the virtual address space
+#ifdef __LP64__
+#define TC_PAGEMAP_BITS         (48 - BASE_PAGE_BITS)
+#else
+#define TC_PAGEMAP_BITS         (32 - BASE_PAGE_BITS)
+#endif
+#define TC_PM_LEAF_BITS         ((TC_PAGEMAP_BITS + 2) / 3)
+#define TC_PM_MID_BITS          ((TC_PAGEMAP_BITS + 2) / 3)
+#define TC_PM_ROOT_BITS         (TC_PAGEMAP_BITS - TC_PM_LEAF_BITS - TC_PM_MID_BITS)
+
+/* Defined in lib/barrelfish/morecore.c */
+typedef void *(*morecore_alloc_func_t)(size_t bytes, size_t *retbytes);
+extern morecore_alloc_func_t sys_morecore_alloc;
+
+/* Hooks of the K&R malloc in newlib (oldmalloc.c, oldrealloc.c) */
+typedef void *(*alt_malloc_t)(size_t bytes);
+extern alt_malloc_t alt_malloc;
+typedef void (*alt_free_t)(void *p);
+extern alt_free_t alt_free;
+typedef void *(*alt_realloc_t)(void *p, size_t bytes);
+extern alt_realloc_t alt_realloc;
+
+/// Magic value oldmalloc stores in the header of allocated blocks
+#define OLDMALLOC_MAGIC         0xdeadbeef
+
+struct tc_arena;
+
+/// A run of pages, either free or carved into objects of one size class
+struct tc_span {
+    lvaddr_t            start;          ///< Address of the first page
+    size_t              npages;         ///< Length in pages
+    struct tc_arena     *arena;         ///< Page heap owning the pages
+    struct tc_span      *next, *prev;   ///< Page heap bucket or central list
+    void                *objects;       ///< Free objects (small spans only)
+    uint32_t            inuse;          ///< Objects not on the span free list
+    uint8_t             sizeclass;      ///< Size class, 0 for large spans
+    bool                free;           ///< Span is in the page heap
+};
+
+/// Central free list of one size class on one dispatcher
+struct tc_central {
+    struct thread_mutex lock;
+    void                *transfer[TC_TRANSFER_SLOTS]; ///< Full batches
+    unsigned            ntransfer;      ///< Used transfer slots
+    struct tc_span      *nonempty;      ///< Spans with free objects
+    uint64_t            fetches, releases, transfer_hits;
+};
+
+/// Per-dispatcher allocator state
+struct tc_arena {
+    coreid_t            core;
+    struct thread_mutex heap_lock;      ///< Protects page heap and descriptors
+    struct tc_span      *freespans[TC_PAGEHEAP_BUCKETS]; ///< Free spans by length
+    struct tc_span      *spare_descs;   ///< Unused span descriptors
+    uint64_t            spans_allocated, spans_freed, large_allocs;
+    size_t              heap_bytes;
+    struct tc_central   central[TC_NUM_CLASSES];
+};
+
+/// Per-thread free list of one size class
+struct tc_freelist {
+    void                *head;
+    uint32_t            length;
+    uint32_t            max_length;     ///< Drain a batch beyond this length
+};
+
+/// Per-thread cache
+struct tc_threadcache {
+    struct tc_freelist  lists[TC_NUM_CLASSES];
+    size_t              size;           ///< Bytes held in all lists
+    struct tc_threadcache *next;        ///< Link in list of spare caches
+};
+
+struct tc_pm_leaf {
+    struct tc_span      *spans[1UL << TC_PM_LEAF_BITS];
+};
+
+struct tc_pm_mid {
+    struct tc_pm_leaf   *leaves[1UL << TC_PM_MID_BITS];
+};
+
+static size_t class_size[TC_NUM_CLASSES];
+static uint32_t class_batch[TC_NUM_CLASSES];
+static uint32_t class_pages[TC_NUM_CLASSES];
+
+/// Protects arenas, the page map interior nodes and metadata allocation
+static struct thread_mutex global_lock = THREAD_MUTEX_INITIALIZER;
+static struct tc_arena *arenas[MAX_CPUS];
+static struct tc_pm_mid *pagemap[1UL << TC_PM_ROOT_BITS];
+static struct tc_threadcache *spare_caches;
+static char *meta_cur;
+static size_t meta_left, meta_bytes;
+static bool tc_initialized;
+
+static __thread struct tc_threadcache *tc_cache;
+
+static inline void *obj_next(void *obj)
+{
+    return *(void **)obj;
+}
+
+static inline void obj_set_next(void *obj, void *next)
+{
+    *(void **)obj = next;
+}
+
+static inline size_t size_to_class(size_t size)
+{
+    assert(size <= TCMALLOC_MAX_SMALL_SIZE);
+    if (size <= 128) {
+        return size == 0 ? 1 : (size + 15) >> 4;
+    }
+    // four classes per power of two above 128 bytes
+    size_t lg = (sizeof(unsigned long) * 8 - 1) - __builtin_clzl(size - 1);
+    return 9 + (lg - 7) * 4 + ((size - 1 - (1UL << lg)) >> (lg - 2));
+}
+
+static void init_size_classes(void)
+{
+    for (size_t cl = 1; cl < TC_NUM_CLASSES; cl++) {
+        size_t size;
+        if (cl <= 8) {
+            size = cl * 16;
+        } else {
+            size_t lg = 7 + (cl - 9) / 4;
+            size = (1UL << lg) + ((cl - 9) % 4 + 1) * (1UL << (lg - 2));
+        }
+        assert(size_to_class(size) == cl);
+
+        class_size[cl] = size;
+        class_batch[cl] = MAX(2, MIN(TC_MAX_BATCH, TC_BATCH_BYTES / size));
+        class_pages[cl] = DIVIDE_ROUND_UP(size * MAX(8, class_batch[cl]),
+                                          BASE_PAGE_SIZE);
+    }
+    assert(class_size[TC_NUM_CLASSES - 1] == TCMALLOC_MAX_SMALL_SIZE);
+}
+
+/**
+ * \brief Get memory from libbarrelfish's morecore.
+ *
+ * morecore state is per dispatcher and protected by the malloc lock.
+ */
+static void *tc_morecore(size_t bytes, size_t *retbytes)
+{
+    struct morecore_state *state = get_morecore_state();
+    thread_mutex_lock(&state->mutex);
+    void *buf = sys_morecore_alloc(bytes, retbytes);
+    thread_mutex_unlock(&state->mutex);
+    return buf;
+}
+
+/// Allocate zeroed metadata. Called with global_lock held.
+static void *meta_alloc(size_t bytes)
+{
+    bytes = ROUND_UP(bytes, TC_META_ALIGN);
+    if (bytes > meta_left) {
+        size_t got;
+        void *buf = tc_morecore(MAX(bytes, TC_META_CHUNK), &got);
+        if (buf == NULL || got < bytes) {
+            return NULL;
+        }
+        meta_cur = buf;
+        meta_left = got;
+        meta_bytes += got;
+    }
+    void *ret = meta_cur;
+    meta_cur += bytes;
+    meta_left -= bytes;
+    memset(ret, 0, bytes);
+    return ret;
+}
+
+static inline struct tc_span *pagemap_get(lvaddr_t page)
+{
+    if (page >> TC_PAGEMAP_BITS) {
+        return NULL;
+    }
+    struct tc_pm_mid *mid = pagemap[page >> (TC_PM_LEAF_BITS + TC_PM_MID_BITS)];
+    if (mid == NULL) {
+        return NULL;
+    }
+    struct tc_pm_leaf *leaf =
+        mid->leaves[(page >> TC_PM_LEAF_BITS) & MASK(TC_PM_MID_BITS)];
+    if (leaf == NULL) {
+        return NULL;
+    }
+    return leaf->spans[page & MASK(TC_PM_LEAF_BITS)];
+}
+
+/// Make sure page map nodes exist for a page range. Called with global_lock.
+static bool pagemap_ensure(lvaddr_t page, size_t npages)
+{
+    assert(((page + npages - 1) >> TC_PAGEMAP_BITS) == 0);
+    for (lvaddr_t p = page; p < page + npages;
+         p = ROUND_UP(p + 1, 1UL << TC_PM_LEAF_BITS)) {
+        size_t ri = p >> (TC_PM_LEAF_BITS + TC_PM_MID_BITS);
+        if (pagemap[ri] == NULL) {
+            struct tc_pm_mid *mid = meta_alloc(sizeof(struct tc_pm_mid));
+            if (mid == NULL) {
+                return false;
+            }
+            pagemap[ri] = mid;
+        }
+        size_t mi = (p >> TC_PM_LEAF_BITS) & MASK(TC_PM_MID_BITS);
+        if (pagemap[ri]->leaves[mi] == NULL) {
+            struct tc_pm_leaf *leaf = meta_alloc(sizeof(struct tc_pm_leaf));
+            if (leaf == NULL) {
+                return false;
+            }
+            pagemap[ri]->leaves[mi] = leaf;
+        }
+    }
+    return true;
+}
+
+/// Set a page map entry. Nodes must exist (see pagemap_ensure()).
+static inline void pagemap_set(lvaddr_t page, struct tc_span *span)
+{
+    struct tc_pm_mid *mid = pagemap[page >> (TC_PM_LEAF_BITS + TC_PM_MID_BITS)];
+    struct tc_pm_leaf *leaf =
+        mid->leaves[(page >> TC_PM_LEAF_BITS) & MASK(TC_PM_MID_BITS)];
+    leaf->spans[page & MASK(TC_PM_LEAF_BITS)] = span;
+}
+
+/// Map the first and last page of a span, or all pages of a small span
+static void pagemap_set_span(struct tc_span *span)
+{
+    lvaddr_t first = span->start >> BASE_PAGE_BITS;
+    if (span->sizeclass != 0) {
+        for (size_t i = 0; i < span->npages; i++) {
+            pagemap_set(first + i, span);
+        }
+    } else {
+        pagemap_set(first, span);
+        pagemap_set(first + span->npages - 1, span);
+    }
+}
+
+static struct tc_arena *arena_create(coreid_t core)
+{
+    thread_mutex_lock(&global_lock);
+    struct tc_arena *a = arenas[core];
+    if (a == NULL) {
+        a = meta_alloc(sizeof(struct tc_arena));
+        if (a != NULL) {
+            a->core = core;
+            thread_mutex_init(&a->heap_lock);
+            for (size_t cl = 0; cl < TC_NUM_CLASSES; cl++) {
+                thread_mutex_init(&a->central[cl].lock);
+            }
+            arenas[core] = a;
+        }
+    }
+    thread_mutex_unlock(&global_lock);
+    return a;
+}
+
+/// Allocator state of the calling dispatcher
+static inline struct tc_arena *get_arena(void)
+{
+    coreid_t core = disp_get_core_id();
+    struct tc_arena *a = arenas[core];
+    if (a == NULL) {
+        a = arena_create(core);
+    }
+    return a;
+}
+
+/*
+ * Page heap. All functions below are called with the arena's heap_lock held.
+ */
+
+static struct tc_span *desc_alloc(struct tc_arena *a)
+{
+    struct tc_span *s = a->spare_descs;
+    if (s != NULL) {
+        a->spare_descs = s->next;
+        memset(s, 0, sizeof(*s));
+        return s;
+    }
+    thread_mutex_lock(&global_lock);
+    s = meta_alloc(sizeof(struct tc_span));
+    thread_mutex_unlock(&global_lock);
+    return s;
+}
+
+static void desc_free(struct tc_arena *a, struct tc_span *s)
+{
+    s->next = a->spare_descs;
+    a->spare_descs = s;
+}
+
+static inline size_t bucket_index(size_t npages)
+{
+    return MIN(npages, TC_PAGEHEAP_BUCKETS - 1);
+}
+
+static void heap_insert(struct tc_arena *a, struct tc_span *s)
+{
+    s->free = true;
+    s->sizeclass = 0;
+    s->objects = NULL;
+    s->inuse = 0;
+    pagemap_set_span(s);
+
+    struct tc_span **bucket = &a->freespans[bucket_index(s->npages)];
+    s->prev = NULL;
+    s->next = *bucket;
+    if (*bucket != NULL) {
+        (*bucket)->prev = s;
+    }
+    *bucket = s;
+}
+
+static void heap_remove(struct tc_arena *a, struct tc_span *s)
+{
+    assert(s->free);
+    if (s->prev != NULL) {
+        s->prev->next = s->next;
+    } else {
+        a->freespans[bucket_index(s->npages)] = s->next;
+    }
+    if (s->next != NULL) {
+        s->next->prev = s->prev;
+    }
+    s->next = s->prev = NULL;
+    s->free = false;
+}
+
+/// Return a span to the page heap, coalescing it with free neighbours
+static void heap_release(struct tc_arena *a, struct tc_span *s)
+{
+    lvaddr_t first = s->start >> BASE_PAGE_BITS;
+
+    struct tc_span *prev = pagemap_get(first - 1);
+    if (prev != NULL && prev->free && prev->arena == a) {
+        heap_remove(a, prev);
+        s->start = prev->start;
+        s->npages += prev->npages;
+        desc_free(a, prev);
+    }
+
+    first = s->start >> BASE_PAGE_BITS;
+    struct tc_span *next = pagemap_get(first + s->npages);
+    if (next != NULL && next->free && next->arena == a) {
+        heap_remove(a, next);
+        s->npages += next->npages;
+        desc_free(a, next);
+    }
+
+    heap_insert(a, s);
+}
+
+static bool heap_grow(struct tc_arena *a, size_t npages)
+{
+    size_t got;
+    void *buf = tc_morecore(MAX(npages * BASE_PAGE_SIZE, TC_HEAP_GROW), &got);
+    if (buf == NULL) {
+        return false;
+    }
+    assert(((lvaddr_t)buf & BASE_PAGE_MASK) == 0);
+
+    size_t n = got / BASE_PAGE_SIZE;
+    thread_mutex_lock(&global_lock);
+    bool ok = pagemap_ensure((lvaddr_t)buf >> BASE_PAGE_BITS, n);
+    thread_mutex_unlock(&global_lock);
+    if (!ok) {
+        return false;
+    }
+
+    struct tc_span *s = desc_alloc(a);
+    if (s == NULL) {
+        return false;
+    }
+    s->start = (lvaddr_t)buf;
+    s->npages = n;
+    s->arena = a;
+    a->heap_bytes += got;
+    heap_release(a, s);
+    return true;
+}
+
+static struct tc_span *heap_find(struct tc_arena *a, size_t npages)
+{
+    for (size_t b = bucket_index(npages); b < TC_PAGEHEAP_BUCKETS; b++) {
+        for (struct tc_span *s = a->freespans[b]; s != NULL; s = s->next) {
+            if (s->npages >= npages) {
+                return s;
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * \brief Carve a span of npages out of the page heap.
+ *
+ * \param sizeclass Size class the span is going to be used for, 0 if large
+ */
+static struct tc_span *heap_alloc(struct tc_arena *a, size_t npages,
+                                  uint8_t sizeclass)
+{
+    thread_mutex_lock(&a->heap_lock);
+
+    struct tc_span *s = heap_find(a, npages);
+    if (s == NULL) {
+        // morecore may return less than asked for, hence search again
+        if (!heap_grow(a, npages) || (s = heap_find(a, npages)) == NULL) {
+            thread_mutex_unlock(&a->heap_lock);
+            return NULL;
+        }
+    }
+    heap_remove(a, s);
+
+    if (s->npages > npages) {
+        struct tc_span *rest = desc_alloc(a);
+        if (rest != NULL) {
+            rest->start = s->start + npages * BASE_PAGE_SIZE;
+            rest->npages = s->npages - npages;
+            rest->arena = a;
+            heap_insert(a, rest);
+            s->npages = npages;
+        }
+    }
+
+    s->sizeclass = sizeclass;
+    pagemap_set_span(s);
+    a->spans_allocated++;
+    if (sizeclass == 0) {
+        a->large_allocs++;
+    }
+
+    thread_mutex_unlock(&a->heap_lock);
+    return s;
+}
+
+static void heap_free(struct tc_arena *a, struct tc_span *s)
+{
+    thread_mutex_lock(&a->heap_lock);
+    a->spans_freed++;
+    heap_release(a, s);
+    thread_mutex_unlock(&a->heap_lock);
+}
+
+/*
+ * Central free lists
+ */
+
+/// Get a fresh span for a size class and thread its objects onto a free list
+static struct tc_span *span_populate(struct tc_arena *a, size_t cl)
+{
+    struct tc_span *s = heap_alloc(a, class_pages[cl], cl);
+    if (s == NULL) {
+        return NULL;
+    }
+
+    size_t size = class_size[cl];
+    size_t count = (s->npages * BASE_PAGE_SIZE) / size;
+    char *obj = (char *)s->start;
+    s->objects = obj;
+    for (size_t i = 1; i < count; i++, obj += size) {
+        obj_set_next(obj, obj + size);
+    }
+    obj_set_next(obj, NULL);
+    s->inuse = 0;
+    return s;
+}
+
+static void span_list_insert(struct tc_span **list, struct tc_span *s)
+{
+    s->prev = NULL;
+    s->next = *list;
+    if (*list != NULL) {
+        (*list)->prev = s;
+    }
+    *list = s;
+}
+
+static void span_list_remove(struct tc_span **list, struct tc_span *s)
+{
+    if (s->prev != NULL) {
+        s->prev->next = s->next;
+    } else {
+        *list = s->next;
+    }
+    if (s->next != NULL) {
+        s->next->prev = s->prev;
+    }
+    s->next = s->prev = NULL;
+}
+
+/**
+ * \brief Fetch up to one batch of objects of a size class.
+ *
+ * \param head Returns a NULL-terminated list of objects
+ * \return Number of objects returned, 0 if out of memory
+ */
+static size_t central_fetch(struct tc_arena *a, size_t cl, void **head)
+{
+    struct tc_central *c = &a->central[cl];
+    size_t batch = class_batch[cl];
+
+    thread_mutex_lock(&c->lock);
+    c->fetches++;
+
+    if (c->ntransfer > 0) {
+        *head = c->transfer[--c->ntransfer];
+        c->transfer_hits++;
+        thread_mutex_unlock(&c->lock);
+        return batch;
+    }
+
+    void *list = NULL;
+    size_t n = 0;
+    while (n < batch) {
+        struct tc_span *s = c->nonempty;
+        if (s == NULL) {
+            s = span_populate(a, cl);
+            if (s == NULL) {
+                break;
+            }
+            span_list_insert(&c->nonempty, s);
+        }
+        while (n < batch && s->objects != NULL) {
+            void *obj = s->objects;
+            s->objects = obj_next(obj);
+            obj_set_next(obj, list);
+            list = obj;
+            s->inuse++;
+            n++;
+        }
+        if (s->objects == NULL) {
+            span_list_remove(&c->nonempty, s);
+        }
+    }
+
+    thread_mutex_unlock(&c->lock);
+    *head = list;
+    return n;
+}
+
+/**
+ * \brief Return a list of objects to their spans.
+ *
+ * Objects may belong to spans of other dispatchers, whose central lists
+ * are locked in turn.
+ */
+static void central_release_to_spans(size_t cl, void *head)
+{
+    struct tc_central *locked = NULL;
+
+    while (head != NULL) {
+        void *obj = head;
+        head = obj_next(obj);
+
+        struct tc_span *s = pagemap_get((lvaddr_t)obj >> BASE_PAGE_BITS);
+        assert(s != NULL && s->sizeclass == cl);
+        struct tc_central *c = &s->arena->central[cl];
+        if (c != locked) {
+            if (locked != NULL) {
+                thread_mutex_unlock(&locked->lock);
+            }
+            thread_mutex_lock(&c->lock);
+            locked = c;
+        }
+
+        if (s->objects == NULL) {
+            span_list_insert(&c->nonempty, s);
+        }
+        obj_set_next(obj, s->objects);
+        s->objects = obj;
+
+        assert(s->inuse > 0);
+        if (--s->inuse == 0) {
+            span_list_remove(&c->nonempty, s);
+            heap_free(s->arena, s);
+        }
+    }
+
+    if (locked != NULL) {
+        thread_mutex_unlock(&locked->lock);
+    }
+}
+
+/// Return n objects of a size class to the calling dispatcher's central list
+static void central_release(struct tc_arena *a, size_t cl, void *head, size_t n)
+{
+    struct tc_central *c = &a->central[cl];
+
+    thread_mutex_lock(&c->lock);
+    c->releases++;
+    if (n == class_batch[cl] && c->ntransfer < TC_TRANSFER_SLOTS) {
+        c->transfer[c->ntransfer++] = head;
+        thread_mutex_unlock(&c->lock);
+        return;
+    }
+    thread_mutex_unlock(&c->lock);
+
+    central_release_to_spans(cl, head);
+}
+
+/*
+ * Thread caches
+ */
+
+static struct tc_threadcache *cache_create(void)
+{
+    thread_mutex_lock(&global_lock);
+    struct tc_threadcache *tc = spare_caches;
+    if (tc != NULL) {
+        spare_caches = tc->next;
+        memset(tc, 0, sizeof(*tc));
+    } else {
+        tc = meta_alloc(sizeof(struct tc_threadcache));
+    }
+    thread_mutex_unlock(&global_lock);
+
+    if (tc != NULL) {
+        for (size_t cl = 1; cl < TC_NUM_CLASSES; cl++) {
+            tc->lists[cl].max_length = class_batch[cl];
+        }
+        tc_cache = tc;
+    }
+    return tc;
+}
+
+/// Move up to n objects of a size class from a thread cache to central
+static void cache_drain(struct tc_threadcache *tc, size_t cl, size_t n)
+{
+    struct tc_freelist *fl = &tc->lists[cl];
+    n = MIN(n, fl->length);
+    if (n == 0) {
+        return;
+    }
+
+    void *head = fl->head;
+    void *tail = head;
+    for (size_t i = 1; i < n; i++) {
+        tail = obj_next(tail);
+    }
+    fl->head = obj_next(tail);
+    obj_set_next(tail, NULL);
+    fl->length -= n;
+    tc->size -= n * class_size[cl];
+
+    central_release(get_arena(), cl, head, n);
+}
+
+/// Halve every list of a thread cache that grew beyond its byte budget
+static void cache_scavenge(struct tc_threadcache *tc)
+{
+    for (size_t cl = 1; cl < TC_NUM_CLASSES; cl++) {
+        struct tc_freelist *fl = &tc->lists[cl];
+        cache_drain(tc, cl, DIVIDE_ROUND_UP(fl->length, 2));
+        if (fl->max_length > class_batch[cl]) {
+            fl->max_length -= class_batch[cl];
+        }
+    }
+}
+
+static void *cache_refill(struct tc_threadcache *tc, size_t cl)
+{
+    struct tc_freelist *fl = &tc->lists[cl];
+    void *head;
+    size_t n = central_fetch(get_arena(), cl, &head);
+    if (n == 0) {
+        return NULL;
+    }
+
+    // slow start: lists of frequently refilled classes may grow longer
+    if (fl->max_length < TC_MAX_LIST_LENGTH) {
+        fl->max_length = MIN(fl->max_length + class_batch[cl],
+                             TC_MAX_LIST_LENGTH);
+    }
+
+    void *obj = head;
+    assert(fl->length == 0);
+    fl->head = obj_next(obj);
+    fl->length = n - 1;
+    tc->size += (n - 1) * class_size[cl];
+    return obj;
+}
+
+static inline void *cache_alloc(size_t cl)
+{
+    struct tc_threadcache *tc = tc_cache;
+    if (tc == NULL && (tc = cache_create()) == NULL) {
+        return NULL;
+    }
+
+    struct tc_freelist *fl = &tc->lists[cl];
+    void *obj = fl->head;
+    if (obj == NULL) {
+        return cache_refill(tc, cl);
+    }
+    fl->head = obj_next(obj);
+    fl->length--;
+    tc->size -= class_size[cl];
+    return obj;
+}
+
+static inline void cache_free(void *obj, size_t cl)
+{
+    struct tc_threadcache *tc = tc_cache;
+    if (tc == NULL) {
+        // exiting thread, or metadata allocation failed: bypass the cache
+        obj_set_next(obj, NULL);
+        central_release(get_arena(), cl, obj, 1);
+        return;
+    }
+
+    struct tc_freelist *fl = &tc->lists[cl];
+    obj_set_next(obj, fl->head);
+    fl->head = obj;
+    fl->length++;
+    tc->size += class_size[cl];
+
+    if (fl->length > fl->max_length) {
+        cache_drain(tc, cl, class_batch[cl]);
+    } else if (tc->size > TC_MAX_THREAD_CACHE) {
+        cache_scavenge(tc);
+    }
+}
+
+/**
+ * \brief Return all objects cached by the calling thread.
+ *
+ * Run automatically on thread exit once tcmalloc_init() was called.
+ */
+void tcmalloc_thread_flush(void)
+{
+    struct tc_threadcache *tc = tc_cache;
+    if (tc == NULL) {
+        return;
+    }
+
+    for (size_t cl = 1; cl < TC_NUM_CLASSES; cl++) {
+        while (tc->lists[cl].length > 0) {
+            cache_drain(tc, cl, class_batch[cl]);
+        }
+    }
+    tc_cache = NULL;
+
+    thread_mutex_lock(&global_lock);
+    tc->next = spare_caches;
+    spare_caches = tc;
+    thread_mutex_unlock(&global_lock);
+}
+
+/*
+ * Blocks allocated by oldmalloc before tcmalloc_init() was called
+ */
+
+static inline size_t foreign_size(void *ptr)
+{
+    Header *bp = (Header *)ptr - 1;
+    return sizeof(Header) * (bp->s.size - 1);
+}
+
+static void foreign_free(void *ptr)
+{
+    struct morecore_state *state = get_morecore_state();
+
+    // memory of another dispatcher's arena is leaked, as oldmalloc does
+    lvaddr_t base = vregion_get_base_addr(&state->mmu_state.vregion);
+    lvaddr_t limit = base + vregion_get_size(&state->mmu_state.vregion);
+    if ((lvaddr_t)ptr < base || (lvaddr_t)ptr >= limit) {
+        return;
+    }
+
+    if (((Header *)ptr)[-1].s.magic != OLDMALLOC_MAGIC) {
+        debug_printf("%s: Trying to free not malloced region %p by %p\n",
+                     __func__, ptr, __builtin_return_address(0));
+        return;
+    }
+    ((Header *)ptr)[-1].s.magic = 0;
+
+    thread_mutex_lock(&state->mutex);
+    __free_locked(ptr);
+    thread_mutex_unlock(&state->mutex);
+}
+
+/*
+ * Public interface
+ */
+
+void *tc_malloc(size_t bytes)
+{
+    if (bytes <= TCMALLOC_MAX_SMALL_SIZE) {
+        return cache_alloc(size_to_class(bytes));
+    }
+
+    struct tc_span *s = heap_alloc(get_arena(),
+                                   DIVIDE_ROUND_UP(bytes, BASE_PAGE_SIZE), 0);
+    return s == NULL ? NULL : (void *)s->start;
+}
+
+void tc_free(void *ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+
+    struct tc_span *s = pagemap_get((lvaddr_t)ptr >> BASE_PAGE_BITS);
+    if (s == NULL) {
+        foreign_free(ptr);
+    } else if (s->sizeclass != 0) {
+        cache_free(ptr, s->sizeclass);
+    } else {
+        assert((lvaddr_t)ptr == s->start && !s->free);
+        heap_free(s->arena, s);
+    }
+}
+
+size_t tc_malloc_usable_size(void *ptr)
+{
+    if (ptr == NULL) {
+        return 0;
+    }
+
+    struct tc_span *s = pagemap_get((lvaddr_t)ptr >> BASE_PAGE_BITS);
+    if (s == NULL) {
+        return foreign_size(ptr);
+    } else if (s->sizeclass != 0) {
+        return class_size[s->sizeclass];
+    } else {
+        return s->npages * BASE_PAGE_SIZE;
+    }
+}
+
+void *tc_realloc(void *ptr, size_t bytes)
+{
+    if (ptr == NULL) {
+        return tc_malloc(bytes);
+    }
+    if (bytes == 0) {
+        tc_free(ptr);
+        return NULL;
+    }
+
+    // keep the block unless it is too small or much too large
+    size_t old = tc_malloc_usable_size(ptr);
+    if (bytes <= old && bytes > old / 2) {
+        return ptr;
+    }
+
+    void *new = tc_malloc(bytes);
+    if (new == NULL) {
+        return NULL;
+    }
+    memcpy(new, ptr, MIN(old, bytes));
+    tc_free(ptr);
+    return new;
+}
+
+void *tc_calloc(size_t nmemb, size_t bytes)
+{
+    if (bytes != 0 && nmemb > SIZE_MAX / bytes) {
+        return NULL;
+    }
+    void *ptr = tc_malloc(nmemb * bytes);
+    if (ptr != NULL) {
+        memset(ptr, 0, nmemb * bytes);
+    }
+    return ptr;
+}
+
+/**
+ * \brief Make tc_malloc() the malloc() of this domain.
+ *
+ * Must be called early in main() while the domain has a single thread.
+ * Requires newlib to be built with oldmalloc (the default), which provides
+ * the hooks; blocks it handed out before are still freed correctly.
+ */
+void tcmalloc_init(void)
+{
+    if (!tc_initialized) {
+        init_size_classes();
+        tc_initialized = true;
+    }
+
+    thread_set_exit_hook(tcmalloc_thread_flush);
+
+    alt_malloc = tc_malloc;
+    alt_free = tc_free;
+    alt_realloc = tc_realloc;
+}
+
+/**
+ * \brief Sum up allocator statistics over all dispatchers.
+ */
+void tcmalloc_get_stats(struct tcmalloc_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+
+    for (size_t core = 0; core < MAX_CPUS; core++) {
+        struct tc_arena *a = arenas[core];
+        if (a == NULL) {
+            continue;
+        }
+
+        for (size_t cl = 1; cl < TC_NUM_CLASSES; cl++) {
+            struct tc_central *c = &a->central[cl];
+            thread_mutex_lock(&c->lock);
+            stats->central_fetches += c->fetches;
+            stats->central_releases += c->releases;
+            stats->transfer_hits += c->transfer_hits;
+            thread_mutex_unlock(&c->lock);
+        }
+
+        thread_mutex_lock(&a->heap_lock);
+        stats->spans_allocated += a->spans_allocated;
+        stats->spans_freed += a->spans_freed;
+        stats->large_allocs += a->large_allocs;
+        stats->heap_bytes += a->heap_bytes;
+        thread_mutex_unlock(&a->heap_lock);
+    }
+
+    thread_mutex_lock(&global_lock);
+    stats->meta_bytes = meta_bytes;
+    thread_mutex_unlock(&global_lock);
+}
@@ -28,20 +28,15 @@
 /**
  * \brief Reset the trace buffer on the current core.
  *
- * Reset head and tail pointers.
+ * Discards all events recorded so far. The sequence numbers keep counting,
+ * so writers never have to be stopped.
  */
 void trace_reset_buffer(void)
 {
-    uintptr_t i, new;
-
     struct trace_buffer *buf = (struct trace_buffer *)trace_buffer_va;
 
     //buf->master = (struct trace_buffer *)trace_buffer_master;
-    do {
-        i = buf->head_index;
-        new = 1;
-    } while (!trace_cas(&buf->head_index, i, new));
-    buf->tail_index = 0;
+    buf->tail_index = buf->head_index;
 
     buf->num_applications = 0;
 }
@@ -49,7 +44,7 @@ void trace_reset_buffer(void)
 /**
  * \brief Reset all trace buffers discarding the current trace
  *
- * Reset head and tail pointers.
+ * Moves the tail pointers to the head pointers.
  */
 void trace_reset_all(void)
 {
@@ -57,9 +52,47 @@ void trace_reset_all(void)
     master->event_counter = 0;
     for (coreid_t core = 0; core < TRACE_COREID_LIMIT; core++) {
         struct trace_buffer *tbuf = (struct trace_buffer *)compute_trace_buf_addr(core);
-        tbuf->head_index = 1;
-        tbuf->tail_index = 0;
+        tbuf->tail_index = tbuf->head_index;
+    }
+}
+
+/**
+ * \brief Read event seq of a trace buffer that may be written concurrently
+ *
+ * \param tbuf  trace buffer of a core
+ * \param seq   sequence number of the event
+ * \param ev    returns the event
+ *
+ * \returns false if the event is still being written or was overwritten
+ */
+bool trace_read_event(struct trace_buffer *tbuf, uintptr_t seq,
+                      struct trace_event *ev)
+{
+    uintptr_t i = seq % TRACE_MAX_EVENTS;
+
+    if (tbuf->commit[i] != seq + 1) {
+        return false;
+    }
+    __asm volatile("" ::: "memory");
+    *ev = tbuf->events[i];
+    __asm volatile("" ::: "memory");
+
+    return tbuf->commit[i] == seq + 1;
+}
+
+/*
+ * Returns the sequence number of the oldest event that has not been consumed
+ * and not been overwritten yet.
+ */
+static uintptr_t trace_first_seq(struct trace_buffer *tbuf)
+{
+    uintptr_t head = tbuf->head_index;
+    uintptr_t tail = tbuf->tail_index;
+
+    if (head - tail > TRACE_MAX_EVENTS) {
+        return head - TRACE_MAX_EVENTS;
     }
+    return tail;
 }
 
 /**
@@ -163,13 +196,7 @@ size_t trace_get_event_count(coreid_t specified_core)
 {
     struct trace_buffer *tbuf = (struct trace_buffer *)compute_trace_buf_addr(specified_core);
 
-    size_t num_events;
-    if (tbuf->head_index > tbuf->tail_index) {
-        num_events = tbuf->head_index - tbuf->tail_index - 1;
-    } else {
-        num_events = (TRACE_MAX_EVENTS - tbuf->tail_index) + tbuf->head_index - 1;
-    }
-    return num_events;
+    return tbuf->head_index - trace_first_seq(tbuf);
 }
 
 
@@ -213,25 +240,19 @@ size_t trace_dump_core(char *buf, size_t buflen, size_t *usedBytes,
             }
             struct trace_buffer *tbuf = (struct trace_buffer *)compute_trace_buf_addr(core);
 
-            int num_events;
-            if (tbuf->head_index > tbuf->tail_index) {
-                num_events = tbuf->head_index - tbuf->tail_index - 1;
-            } else {
-                num_events = (TRACE_MAX_EVENTS - tbuf->tail_index) + tbuf->head_index - 1;
+            // Get the first event, skip ones overwritten in the meantime
+            struct trace_event ev;
+            uintptr_t seq = trace_first_seq(tbuf);
+            while (seq != tbuf->head_index && !trace_read_event(tbuf, seq, &ev)) {
+                seq++;
             }
 
-            if (num_events == 0) {
+            if (seq == tbuf->head_index) {
                 // Ringbuffer is empty.
                 continue;
             }
 
-            // Get the first event
-            int idx = tbuf->tail_index + 1;
-            if (idx == TRACE_MAX_EVENTS) {
-                idx = 0;
-            }
-
-            uint64_t timestamp = tbuf->events[idx].timestamp;
+            uint64_t timestamp = ev.timestamp;
             if (timestamp <= min_timestamp) {
                 min_timestamp = timestamp;
             }
@@ -252,14 +273,9 @@ size_t trace_dump_core(char *buf, size_t buflen, size_t *usedBytes,
 
         struct trace_buffer *tbuf = (struct trace_buffer *)compute_trace_buf_addr(core);
 
-        int num_events;
-        if (tbuf->head_index > tbuf->tail_index) {
-            num_events = tbuf->head_index - tbuf->tail_index - 1;
-            //printf("> , head %ld tail %ld num_events %d\n", tbuf->head_index, tbuf->tail_index, num_events);
-        } else {
-            num_events = (TRACE_MAX_EVENTS - tbuf->tail_index) + tbuf->head_index - 1;
-            //printf("< , head %ld tail %ld num_events %d\n", tbuf->head_index, tbuf->tail_index, num_events);
-        }
+        uintptr_t head = tbuf->head_index;
+        uintptr_t first = trace_first_seq(tbuf);
+        int num_events = head - first;
 
         if (num_events > 0) {
             // Ringbuffer is empty.
@@ -292,19 +308,20 @@ size_t trace_dump_core(char *buf, size_t buflen, size_t *usedBytes,
                 ptr += len; totlen += len;
             }
 
-            for (int i = 0; i < num_events; i++) {
+            for (uintptr_t seq = first; seq != head; seq++) {
 
-                tbuf->tail_index++;
-                if (tbuf->tail_index == TRACE_MAX_EVENTS) {
-                    tbuf->tail_index = 0;
+                // Skip events still being written or overwritten meanwhile
+                struct trace_event ev;
+                if (!trace_read_event(tbuf, seq, &ev)) {
+                    continue;
                 }
 
                 assert(totlen < buflen);
                 len = snprintf(ptr, buflen-totlen,
                         "%d %" PRIu64 " %" PRIx64 "\n",
-                        core, tbuf->events[tbuf->tail_index].timestamp,
-                        //core, tbuf->events[tbuf->tail_index].timestamp - t0,
-                        tbuf->events[tbuf->tail_index].u.raw);
+                        core, ev.timestamp,
+                        //core, ev.timestamp - t0,
+                        ev.u.raw);
                 assert(len >= 0);
                 ptr += len; totlen += len;
 
@@ -312,6 +329,7 @@ size_t trace_dump_core(char *buf, size_t buflen, size_t *usedBytes,
                     (*number_of_events_dumped)++;
                 }
             } // end for:
+            tbuf->tail_index = head;
         } // end if: no. of events > 0
 
 //    } // end for: for each core
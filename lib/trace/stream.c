@@ -0,0 +1,212 @@
+/**
+ * \file
+ * \brief Streaming drain of the trace buffers
+ *
+ * Encodes the events recorded since the last drain in the compact format of
+ * trace_stream.h, while the traced domains keep writing.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <barrelfish/barrelfish.h>
+#include <trace/trace.h>
+#include <trace/trace_stream.h>
+#include <string.h>
+
+static inline size_t put_varint(uint8_t *buf, uint64_t val)
+{
+    size_t len = 0;
+    while (val >= 0x80) {
+        buf[len++] = (uint8_t)(val | 0x80);
+        val >>= 7;
+    }
+    buf[len++] = (uint8_t)val;
+    return len;
+}
+
+static inline size_t put_svarint(uint8_t *buf, int64_t val)
+{
+    return put_varint(buf, ((uint64_t)val << 1) ^ (uint64_t)(val >> 63));
+}
+
+static size_t put_core(struct trace_stream *st, uint8_t *buf, coreid_t core,
+                       struct trace_buffer *tbuf)
+{
+    size_t len = 0;
+    buf[len++] = TRACE_STREAM_CORE;
+    len += put_varint(buf + len, core);
+    len += put_svarint(buf + len, tbuf->t_offset);
+    st->core = core;
+    return len;
+}
+
+static size_t put_event(struct trace_stream *st, uint8_t *buf, coreid_t core,
+                        struct trace_event *ev)
+{
+    size_t len = 0;
+    uint64_t last = st->last_ts[core];
+
+    if (ev->timestamp >= last && (ev->timestamp >> 63) == 0) {
+        buf[len++] = TRACE_STREAM_EVENT;
+        len += put_varint(buf + len, ev->timestamp - last);
+        len += put_varint(buf + len, ev->u.ev.subsystem);
+        len += put_varint(buf + len, ev->u.ev.event);
+        len += put_varint(buf + len, ev->u.ev.arg);
+        st->last_ts[core] = ev->timestamp;
+    } else {
+        buf[len++] = TRACE_STREAM_RAW;
+        len += put_varint(buf + len, ev->timestamp);
+        len += put_varint(buf + len, ev->u.raw);
+        if ((ev->timestamp >> 63) == 0) {
+            st->last_ts[core] = ev->timestamp;
+        }
+    }
+    return len;
+}
+
+/**
+ * \brief Initialize the state of a stream
+ */
+void trace_stream_init(struct trace_stream *st)
+{
+    memset(st, 0, sizeof(*st));
+}
+
+/**
+ * \brief Encode the events recorded since the last call into buf
+ *
+ * \param st      stream state
+ * \param buf     buffer to write the records to
+ * \param buflen  size of buf, at least 3 * TRACE_STREAM_RECORD_MAX
+ *
+ * \returns number of bytes written. Events that did not fit are kept for the
+ *          next call.
+ *
+ * The stream is the only consumer of the trace buffers: trace_dump() must
+ * not be used at the same time.
+ */
+size_t trace_stream_drain(struct trace_stream *st, uint8_t *buf,
+                          size_t buflen)
+{
+    assert(buflen >= 3 * TRACE_STREAM_RECORD_MAX);
+
+    size_t pos = 0;
+
+    if (!st->started) {
+        memcpy(buf, TRACE_STREAM_MAGIC, TRACE_STREAM_HEADER_LEN - 1);
+        buf[TRACE_STREAM_HEADER_LEN - 1] = TRACE_STREAM_VERSION;
+        pos = TRACE_STREAM_HEADER_LEN;
+        st->core = (coreid_t)-1;
+        st->started = true;
+    }
+
+    // start with another core every time, so none is starved of space
+    for (coreid_t i = 0; i < TRACE_COREID_LIMIT; i++) {
+        coreid_t core = (st->first + i) % TRACE_COREID_LIMIT;
+        struct trace_buffer *tbuf =
+            (struct trace_buffer *)compute_trace_buf_addr(core);
+
+        uintptr_t head = tbuf->head_index;
+        uintptr_t seq = tbuf->tail_index;
+        uint64_t lost = 0;
+
+        if (head - seq > TRACE_MAX_EVENTS) {
+            lost = head - TRACE_MAX_EVENTS - seq;
+            seq = head - TRACE_MAX_EVENTS;
+        }
+
+        uint8_t apps = tbuf->num_applications;
+        if (st->apps[core] > apps) {
+            // the buffer was reset
+            st->apps[core] = 0;
+        }
+
+        for (;;) {
+            // room for a CORE record and the next one
+            if (buflen - pos < 2 * TRACE_STREAM_RECORD_MAX) {
+                // the skipped events are reported as lost next time
+                seq -= lost;
+                break;
+            }
+
+            uint8_t *rec = buf + pos;
+            size_t len = 0;
+            if (st->core != core && (lost > 0 || st->apps[core] < apps
+                                     || seq != head)) {
+                len += put_core(st, rec, core, tbuf);
+            }
+
+            if (lost > 0) {
+                rec[len++] = TRACE_STREAM_LOST;
+                len += put_varint(rec + len, lost);
+                st->lost += lost;
+                lost = 0;
+            } else if (st->apps[core] < apps) {
+                struct trace_application *app =
+                    &tbuf->applications[st->apps[core]++];
+                rec[len++] = TRACE_STREAM_APP;
+                len += put_varint(rec + len, app->dcb);
+                memcpy(rec + len, app->name, sizeof(app->name));
+                len += sizeof(app->name);
+            } else if (seq != head) {
+                struct trace_event ev;
+                if (!trace_read_event(tbuf, seq, &ev)) {
+                    if (tbuf->head_index - seq <= TRACE_MAX_EVENTS) {
+                        // still being written, take it next time
+                        pos += len;
+                        break;
+                    }
+                    lost++;
+                    seq++;
+                    pos += len;
+                    continue;
+                }
+                len += put_event(st, rec + len, core, &ev);
+                st->events++;
+                seq++;
+            } else {
+                pos += len;
+                break;
+            }
+
+            assert(len <= 2 * TRACE_STREAM_RECORD_MAX);
+            pos += len;
+        }
+
+        tbuf->tail_index = seq;
+    }
+    st->first = (st->first + 1) % TRACE_COREID_LIMIT;
+
+    return pos;
+}
+
+/**
+ * \brief Record events from now on until tracing is reconfigured
+ *
+ * Unlike trace_control(), tracing does not wait for a start trigger and
+ * never stops. Use with a stream that drains the buffers while tracing.
+ */
+errval_t trace_start_continuous(void)
+{
+    struct trace_buffer *master = (struct trace_buffer*)trace_buffer_master;
+    if (master == NULL) {
+        return TRACE_ERR_NO_BUFFER;
+    }
+
+    master->stop_trigger = 0;
+    master->duration = 0;
+    master->event_counter = 0;
+    master->stop_time = 0xFFFFFFFFFFFFFFFFULL;
+    master->start_trigger = 0;
+    master->t0 = TRACE_TIMESTAMP();
+    master->running = true;
+
+    return SYS_ERR_OK;
+}
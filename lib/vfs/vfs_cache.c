@@ -9,6 +9,7 @@
 
 #include "vfs_cache.h"
 #include <barrelfish/barrelfish.h>
+#include <barrelfish/threads.h>
 #include <string.h>
 #include <stdio.h>
 
@@ -56,46 +57,49 @@
 } while(0)
 
 #define MIN_ALLOC 4
+#define MAX_SHARDS 8
 
 /*
- * Important: all entry indices are 1-based as 0 is used to indicate invalid.
- *
- * Cache entries form an array with various internal linked lists:
- * - For each hash, a linked list of entries with matching hashes exists.
- *   The first element is referenced by the index stored in the map.
- * - A free list is stored for free entries, the first element is referenced by
- *   the first_free index.
- * - An independant list of unused entries is stored. These are entries with
- *   valid data that are no longer referenced. The list acts as an LRU queue,
- *   with first and last element referenced by first_unused and last_unused.
- * 
- * unused_count stores the number of entries in the unused list for heuristics
- * in cache_free_unused.
+ * The cache is split into shards, each with its own lock, so that threads
+ * working on different keys rarely contend. A key always maps to the same
+ * shard.
  *
+ * Every shard owns a fixed array of entries, allocated up front. Entries
+ * holding an item are linked into hash chains; the others form a free list.
+ * Unreferenced entries stay in the cache until they are evicted, which uses
+ * the CLOCK algorithm: every acquire sets an entry's reference bit, and the
+ * clock hand sweeping the entry array gives referenced entries a second
+ * chance by clearing the bit. Entries that are in use are never evicted.
  */
 
 struct cache_entry {
-    size_t prev, next;
-    size_t prev_unused, next_unused;
-    void *item;
+    struct cache_entry *next;   ///< Next entry in hash chain or free list
+    void *item;                 ///< Cached item, NULL if the entry is free
     uint32_t key;
     size_t references;
+    bool accessed;              ///< CLOCK reference bit
 };
 
-struct fs_cache {
-    size_t *map;
+struct cache_shard {
+    struct thread_mutex lock;
+    struct cache_entry **map;   ///< Hash chains
     struct cache_entry *entries;
-    size_t map_size, max_capacity, capacity;
+    struct cache_entry *free;   ///< Free list
+    size_t capacity;
+    size_t hand;                ///< CLOCK hand, index into entries
+    struct fs_cache_stats stats;
+};
 
-    size_t first_free;
-    size_t first_unused, last_unused, unused_count;
+struct fs_cache {
+    struct cache_shard *shards;
+    size_t nshards;
+    size_t map_size;            ///< Hash chains per shard
 };
 
-static size_t
-hash_key(uint32_t key, size_t map_size)
+static uint32_t
+hash_key(uint32_t key)
 {
     TRACE_ENTER();
-    assert((map_size & ~(map_size-1)) == map_size);
     // http://burtleburtle.net/bob/hash/integer.html
     uint32_t a = key;
     a += ~(a<<15);
@@ -104,240 +108,121 @@ hash_key(uint32_t key, size_t map_size)
     a ^=  (a>>6);
     a += ~(a<<11);
     a ^=  (a>>16);
-    return a % map_size;
+    return a;
 }
 
-static void
-free_unused(struct fs_cache *cache, size_t factor, size_t maximum)
+static struct cache_shard *
+get_shard(struct fs_cache *cache, uint32_t hash)
 {
-    TRACE_ENTER_F("factor=%zu, max=%zu", factor, maximum);
-    size_t unused_overburden = 0;
-
-    if (factor == 0) {
-        if (maximum == 0) {
-            unused_overburden = cache->unused_count;
-        }
-        else if (maximum > 0 && cache->unused_count > maximum) {
-            unused_overburden = cache->unused_count - maximum;
-        }
-    }
-    else if (factor == 1) {
-        if (maximum > 0) {
-            if (cache->unused_count > maximum) {
-                unused_overburden = maximum;
-            }
-            else {
-                unused_overburden = cache->unused_count;
-            }
-        }
-    }
-    else if (cache->unused_count > cache->capacity / factor) {
-        unused_overburden = cache->unused_count - cache->capacity/factor;
-        if (maximum > 0 && cache->unused_count > maximum) {
-            unused_overburden = maximum;
-        }
-    }
-
-    for (; unused_overburden > 0; unused_overburden--) {
-        assert(cache->unused_count > 0);
-        assert(cache->first_unused);
-        size_t entry_index = cache->first_unused;
-        struct cache_entry *entry = &cache->entries[entry_index-1];
-        assert(!entry->prev_unused);
-
-        // remove from beginning of unused list
-        if (entry->next_unused) {
-            cache->entries[entry->next_unused-1].prev_unused = 0;
-        }
-        if (entry_index == cache->last_unused) {
-            cache->last_unused = 0;
-        }
-        cache->first_unused = entry->next_unused;
-        assert((cache->first_unused == 0) == (cache->last_unused == 0));
-        cache->unused_count--;
+    // shard by the high bits, the low bits select the hash chain
+    return &cache->shards[(hash >> 16) & (cache->nshards - 1)];
+}
 
-        // remove from hash collision list
-        if (entry->next) {
-            cache->entries[entry->next-1].prev = entry->prev;
-        }
-        if (entry->prev) {
-            cache->entries[entry->prev-1].next = entry->next;
-        }
-        else {
-            // no prev must be first entry for hash, so must be in map
-            size_t hash = hash_key(entry->key, cache->map_size);
-            assert(cache->map[hash] == entry_index);
-            cache->map[hash] = entry->next;
-        }
+static struct cache_entry **
+get_chain(struct fs_cache *cache, struct cache_shard *shard, uint32_t hash)
+{
+    return &shard->map[hash & (cache->map_size - 1)];
+}
 
-        free(entry->item);
-        memset(entry, 0, sizeof(*entry));
+static struct cache_entry *
+find_entry(struct fs_cache *cache, struct cache_shard *shard, uint32_t hash,
+           uint32_t key)
+{
+    struct cache_entry *entry = *get_chain(cache, shard, hash);
+    while (entry && entry->key != key) {
+        entry = entry->next;
+    }
+    return entry;
+}
 
-        if (cache->first_free) {
-            entry->next = cache->first_free;
-            cache->entries[cache->first_free-1].prev = entry_index;
-        }
-        cache->first_free = entry_index;
+static void
+unlink_entry(struct fs_cache *cache, struct cache_shard *shard,
+             struct cache_entry *entry)
+{
+    struct cache_entry **p = get_chain(cache, shard, hash_key(entry->key));
+    while (*p != entry) {
+        assert(*p);
+        p = &(*p)->next;
     }
+    *p = entry->next;
 }
 
-static errval_t
-cache_make_space(struct fs_cache *cache)
+// Evict an unreferenced entry, returns NULL if all entries are in use.
+static struct cache_entry *
+evict_entry(struct fs_cache *cache, struct cache_shard *shard)
 {
     TRACE_ENTER();
 
-    if (cache->capacity == 0) {
-        // no memory at all allocated, create initial space
-        cache->entries = calloc(MIN_ALLOC, sizeof(*cache->entries));
-        if (!cache->entries) {
-            return LIB_ERR_MALLOC_FAIL;
-        }
-        cache->capacity = MIN_ALLOC;
-        cache->first_free = 1;
-        for (size_t i = 1; i < cache->capacity; ++i) {
-            cache->entries[i-1].next = i+1;
-            cache->entries[i].prev = i;
-        }
-        return SYS_ERR_OK;
-    }
+    // two rounds: the first may only clear reference bits
+    for (size_t i = 0; i < 2 * shard->capacity; i++) {
+        struct cache_entry *entry = &shard->entries[shard->hand];
+        shard->hand = (shard->hand + 1) % shard->capacity;
 
-    size_t new_capacity = 2*cache->capacity;
-    if (new_capacity <= cache->max_capacity) {
-        // realloc with new capacity
-        struct cache_entry *new_entries = NULL;
-        new_entries = realloc(cache->entries,
-                new_capacity*sizeof(*cache->entries));
-        if (!new_entries) {
-            return LIB_ERR_MALLOC_FAIL;
+        if (!entry->item || entry->references > 0) {
+            continue;
         }
-
-        // realloc succeeded, initialize new entries
-        cache->entries = new_entries;
-        memset(cache->entries + cache->capacity, 0,
-                cache->capacity*sizeof(*cache->entries));
-        // NOTE: 1-based iteration, leaving out last element!
-        for (size_t i = cache->capacity + 1; i < new_capacity; i++) {
-            cache->entries[i-1].next = i+1;
-            cache->entries[i].prev = i;
+        if (entry->accessed) {
+            entry->accessed = false;
+            continue;
         }
-        cache->first_free = cache->capacity + 1;
-        cache->capacity = new_capacity;
-
-        return SYS_ERR_OK;
-    }
 
-    // try to free a bunch of unreferenced entries
-    free_unused(cache, 2, 10);
-    if (cache->first_free) {
-        return SYS_ERR_OK;
-    }
-
-    // try slightly more aggressive freeing of unreferenced entries
-    for (size_t f = 2; f < 5; f++) {
-        free_unused(cache, f, 0);
-        if (cache->first_free) {
-            return SYS_ERR_OK;
-        }
-    }
-
-    // try freeing all but 10 unreferenced entries
-    free_unused(cache, 0, 10);
-    if (cache->first_free) {
-        return SYS_ERR_OK;
-    }
-
-    // try freeing *all* unreferenced entries
-    free_unused(cache, 0, 0);
-    if (cache->first_free) {
-        return SYS_ERR_OK;
+        CACHE_DEBUG_F("evicting key %"PRIu32, entry->key);
+        unlink_entry(cache, shard, entry);
+        free(entry->item);
+        entry->item = NULL;
+        shard->stats.evictions++;
+        return entry;
     }
 
-    return FS_CACHE_FULL;
+    return NULL;
 }
 
 static errval_t
-get_new_entry(struct fs_cache *cache, size_t hash, struct cache_entry **entry)
+get_new_entry(struct fs_cache *cache, struct cache_shard *shard,
+              struct cache_entry **entry)
 {
     TRACE_ENTER();
 
-    // make sure space is available
-    if (!cache->first_free) {
-        ERRRET(cache_make_space(cache));
-        if (!cache->first_free) {
+    if (shard->free) {
+        *entry = shard->free;
+        shard->free = (*entry)->next;
+    }
+    else {
+        *entry = evict_entry(cache, shard);
+        if (!*entry) {
             return FS_CACHE_FULL;
         }
     }
 
-    // retrieve first element from free list
-    size_t entry_index = cache->first_free;
-    cache->first_free = cache->entries[entry_index-1].next;
-    *entry = &cache->entries[entry_index-1];
     memset(*entry, 0, sizeof(**entry));
-
     return SYS_ERR_OK;
 }
 
-static void
-remove_from_unused(struct fs_cache *cache, struct cache_entry *entry)
-{
-    TRACE_ENTER();
-
-    size_t entry_index = (entry - cache->entries) + 1;
-    if (entry->prev_unused) {
-        assert(cache->first_unused != entry_index);
-        cache->entries[entry->prev_unused-1].next_unused = entry->next_unused;
-    }
-    else {
-        assert(cache->first_unused == entry_index);
-        cache->first_unused = entry->next_unused;
-    }
-    if (entry->next_unused) {
-        assert(cache->last_unused != entry_index);
-        cache->entries[entry->next_unused-1].prev_unused = entry->prev_unused;
-    }
-    else {
-        assert(cache->last_unused == entry_index);
-        cache->last_unused = entry->prev_unused;
-    }
-    entry->next_unused = entry->prev_unused = 0;
-    cache->unused_count--;
-}
-
 errval_t
 fs_cache_acquire(struct fs_cache *cache, uint32_t key, void **item)
 {
     TRACE_ENTER_F("key=%"PRIu32, key);
     assert(cache);
 
-    if (!cache->entries) {
-        return FS_CACHE_NOTPRESENT;
-    }
-
-    size_t hash = hash_key(key, cache->map_size);
-    size_t entry_index = cache->map[hash];
-
-    if (!entry_index) {
-        return FS_CACHE_NOTPRESENT;
-    }
+    errval_t err = SYS_ERR_OK;
+    uint32_t hash = hash_key(key);
+    struct cache_shard *shard = get_shard(cache, hash);
 
-    // find matching entry
-    struct cache_entry *entry = &cache->entries[entry_index-1];
-    while (entry->key != key && entry->next) {
-        entry = &cache->entries[entry->next-1];
-    }
-    if (entry->key != key) {
-        return FS_CACHE_NOTPRESENT;
+    thread_mutex_lock(&shard->lock);
+    struct cache_entry *entry = find_entry(cache, shard, hash, key);
+    if (entry) {
+        entry->references++;
+        entry->accessed = true;
+        *item = entry->item;
+        shard->stats.hits++;
     }
-
-    if (entry->references == 0) {
-        // need to remove entry from unused entries list
-        remove_from_unused(cache, entry);
+    else {
+        shard->stats.misses++;
+        err = FS_CACHE_NOTPRESENT;
     }
+    thread_mutex_unlock(&shard->lock);
 
-    entry->references++;
-    *item = entry->item;
-
-    return SYS_ERR_OK;
+    return err;
 }
 
 errval_t
@@ -345,61 +230,45 @@ fs_cache_put(struct fs_cache *cache, uint32_t key, void *item)
 {
     TRACE_ENTER_F("key=%"PRIu32, key);
     assert(cache);
+    assert(item);
 
     errval_t err = SYS_ERR_OK;
-    size_t hash = hash_key(key, cache->map_size);
-    size_t entry_index = cache->map[hash];
-    struct cache_entry *entry = NULL;
-
-    if (!entry_index) {
-        // the map entry is free, just get a new entry
-        err = get_new_entry(cache, hash, &entry);
-        if (err_is_ok(err)) {
-            entry_index = (entry - cache->entries) + 1;
-            cache->map[hash] = entry_index;
-        }
-    }
-    else {
-        // find matching entry or last entry
-        entry = &cache->entries[entry_index-1];
-        while (entry->key != key && entry->next) {
-            entry = &cache->entries[entry->next-1];
+    uint32_t hash = hash_key(key);
+    struct cache_shard *shard = get_shard(cache, hash);
+
+    thread_mutex_lock(&shard->lock);
+    struct cache_entry *entry = find_entry(cache, shard, hash, key);
+    if (entry) {
+        if (entry->item == item) {
+            // duplicate put, do nothing
+            // XXX: warn?
         }
-
-        if (entry->key == key) {
-            // found matching entry
-            if (entry->item == item) {
-                // duplicate put, do nothing
-                // XXX: warn?
-            }
-            else if (entry->references == 0) {
-                // unused entry with same key, replace item
-                remove_from_unused(cache, entry);
-                free(entry->item);
-                entry->item = NULL;
-            }
-            else {
-                // in-use entry exists with different item, report conflict
-                err = FS_CACHE_CONFLICT;
-            }
+        else if (entry->references == 0) {
+            // unused entry with same key, replace item
+            free(entry->item);
+            entry->item = item;
         }
         else {
-            // reached last entry, append new entry
-            struct cache_entry *prev = entry;
-            err = get_new_entry(cache, hash, &entry);
-            if (err_is_ok(err)) {
-                entry_index = (entry - cache->entries) + 1;
-                prev->next = entry_index;
-                entry->prev = (prev - cache->entries) + 1;
-            }
+            // in-use entry exists with different item, report conflict
+            err = FS_CACHE_CONFLICT;
+        }
+    }
+    else {
+        err = get_new_entry(cache, shard, &entry);
+        if (err_is_ok(err)) {
+            struct cache_entry **chain = get_chain(cache, shard, hash);
+            entry->key = key;
+            entry->item = item;
+            entry->next = *chain;
+            *chain = entry;
         }
     }
 
     if (err_is_ok(err)) {
-        entry->key = key;
-        entry->item = item;
         entry->references++;
+        entry->accessed = true;
     }
+    thread_mutex_unlock(&shard->lock);
 
     return err;
 }
@@ -410,48 +279,56 @@ fs_cache_release(struct fs_cache* cache, uint32_t key)
     TRACE_ENTER_F("key=%"PRIu32, key);
     assert(cache);
 
-    if (!cache->entries) {
-        return FS_CACHE_NOTPRESENT;
+    errval_t err = SYS_ERR_OK;
+    uint32_t hash = hash_key(key);
+    struct cache_shard *shard = get_shard(cache, hash);
+
+    thread_mutex_lock(&shard->lock);
+    struct cache_entry *entry = find_entry(cache, shard, hash, key);
+    if (entry) {
+        assert(entry->references > 0);
+        entry->references--;
+    }
+    else {
+        err = FS_CACHE_NOTPRESENT;
     }
+    thread_mutex_unlock(&shard->lock);
 
-    size_t hash = hash_key(key, cache->map_size);
-    size_t entry_index = cache->map[hash];
+    return err;
+}
 
-    if (!entry_index) {
-        return FS_CACHE_NOTPRESENT;
-    }
+bool
+fs_cache_contains(struct fs_cache *cache, uint32_t key)
+{
+    TRACE_ENTER_F("key=%"PRIu32, key);
+    assert(cache);
 
-    // find entry with matching key
-    struct cache_entry *entry = &cache->entries[entry_index-1];
-    while (entry->key != key && entry->next) {
-        entry = &cache->entries[entry->next-1];
-    }
-    if (entry->key != key) {
-        return FS_CACHE_NOTPRESENT;
-    }
+    uint32_t hash = hash_key(key);
+    struct cache_shard *shard = get_shard(cache, hash);
 
-    assert(entry->references > 0);
-    entry->references--;
-    if (entry->references == 0) {
-        // append to unused list
-        entry_index = (entry - cache->entries) + 1;
-        if (cache->unused_count > 0) {
-            assert(cache->first_unused);
-            assert(cache->last_unused);
-            cache->entries[cache->last_unused-1].next_unused = entry_index;
-        }
-        else {
-            assert(!cache->first_unused);
-            assert(!cache->last_unused);
-            cache->first_unused = entry_index;
-        }
-        entry->prev_unused = cache->last_unused;
-        entry->next_unused = 0;
-        cache->last_unused = entry_index;
-        cache->unused_count++;
-    }
+    thread_mutex_lock(&shard->lock);
+    bool present = find_entry(cache, shard, hash, key) != NULL;
+    thread_mutex_unlock(&shard->lock);
 
-    return SYS_ERR_OK;
+    return present;
+}
+
+void
+fs_cache_get_stats(struct fs_cache *cache, struct fs_cache_stats *stats)
+{
+    TRACE_ENTER();
+    assert(cache);
+    assert(stats);
+
+    memset(stats, 0, sizeof(*stats));
+    for (size_t i = 0; i < cache->nshards; i++) {
+        struct cache_shard *shard = &cache->shards[i];
+        thread_mutex_lock(&shard->lock);
+        stats->hits += shard->stats.hits;
+        stats->misses += shard->stats.misses;
+        stats->evictions += shard->stats.evictions;
+        thread_mutex_unlock(&shard->lock);
+    }
 }
 
 errval_t
@@ -460,29 +337,45 @@ fs_cache_init(size_t max_capacity, size_t map_size, struct fs_cache **cache_p)
     TRACE_ENTER_F("max_capacity=%zu, map_size=%zu", max_capacity, map_size);
     assert(cache_p);
 
-    struct fs_cache *cache;
-    cache = calloc(1, sizeof(*cache));
-    if (!cache) {
-        return LIB_ERR_MALLOC_FAIL;
-    }
-
     assert(max_capacity >= MIN_ALLOC);
     assert((max_capacity & ~(max_capacity-1)) == max_capacity);
-    cache->max_capacity = max_capacity;
-
-    // initialize map. do not need to initialize entries as this is done
-    // lazily.
     if (!map_size) {
         map_size = max_capacity;
     }
     assert((map_size & ~(map_size-1)) == map_size);
-    cache->map_size = map_size;
-    cache->map = calloc(cache->map_size, sizeof(*cache->map));
-    if (!cache->map) {
+
+    struct fs_cache *cache;
+    cache = calloc(1, sizeof(*cache));
+    if (!cache) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+
+    // as many shards as possible, but at least MIN_ALLOC entries in each
+    cache->nshards = MIN(MAX_SHARDS, max_capacity / MIN_ALLOC);
+    cache->map_size = MAX(1, map_size / cache->nshards);
+    cache->shards = calloc(cache->nshards, sizeof(*cache->shards));
+    if (!cache->shards) {
         free(cache);
         return LIB_ERR_MALLOC_FAIL;
     }
 
+    for (size_t i = 0; i < cache->nshards; i++) {
+        struct cache_shard *shard = &cache->shards[i];
+        thread_mutex_init(&shard->lock);
+        shard->capacity = max_capacity / cache->nshards;
+        shard->map = calloc(cache->map_size, sizeof(*shard->map));
+        shard->entries = calloc(shard->capacity, sizeof(*shard->entries));
+        if (!shard->map || !shard->entries) {
+            fs_cache_free(cache);
+            return LIB_ERR_MALLOC_FAIL;
+        }
+
+        for (size_t e = shard->capacity; e > 0; e--) {
+            shard->entries[e-1].next = shard->free;
+            shard->free = &shard->entries[e-1];
+        }
+    }
+
     *cache_p = cache;
     return SYS_ERR_OK;
 }
@@ -496,12 +389,16 @@ fs_cache_free(struct fs_cache *cache)
         return;
     }
 
-    for (size_t i = 0; i < cache->capacity; i++) {
-        if (cache->entries[i].item) {
-            free(cache->entries[i].item);
+    for (size_t i = 0; i < cache->nshards; i++) {
+        struct cache_shard *shard = &cache->shards[i];
+        if (shard->entries) {
+            for (size_t e = 0; e < shard->capacity; e++) {
+                free(shard->entries[e].item);
+            }
         }
+        free(shard->entries);
+        free(shard->map);
     }
-    free(cache->entries);
-    free(cache->map);
+    free(cache->shards);
     free(cache);
 }
@@ -1,12 +1,25 @@
 #ifndef VFS_CACHE_H
 #define VFS_CACHE_H
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <errors/errno.h>
 
 struct fs_cache;
 
-// Initialize cache.
+// Cache statistics, summed over all shards.
+struct fs_cache_stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+};
+
+// All functions are safe to call from multiple threads. Entries are spread
+// over independently locked shards, and unreferenced entries are evicted by
+// CLOCK when a shard is full.
+
+// Initialize cache. max_capacity and map_size must be powers of two.
 // Errors:
 //   - LIB_ERR_MALLOC_FAIL: Allocation failed / out of heap memory.
 errval_t fs_cache_init(size_t max_capacity, size_t map_size, struct fs_cache **cache);
@@ -27,7 +40,6 @@ errval_t fs_cache_acquire(struct fs_cache *cache, uint32_t key, void **item);
 //   - FS_CACHE_CONFLICT: An item with same key but different data pointer is
 //     already present.
 //   - FS_CACHE_FULL: Cache is at max capacity and all entries are referenced.
-//   - LIB_ERR_MALLOC_FAIL: Increasing capacity failed.
 errval_t fs_cache_put(struct fs_cache *cache, uint32_t key, void *item);
 
 // Release an acquired reference. Every call to fs_cache_acquire and
@@ -36,4 +48,11 @@ errval_t fs_cache_put(struct fs_cache *cache, uint32_t key, void *item);
 //   - FS_CACHE_NOTPRESENT: There is no item with the given key in the cache.
 errval_t fs_cache_release(struct fs_cache *cache, uint32_t key);
 
+// Check whether an entry is present, without taking a reference. Does not
+// count as a hit or miss and does not protect the entry from eviction.
+bool fs_cache_contains(struct fs_cache *cache, uint32_t key);
+
+// Get hit, miss and eviction counts since the cache was initialized.
+void fs_cache_get_stats(struct fs_cache *cache, struct fs_cache_stats *stats);
+
 #endif
@@ -89,6 +89,14 @@
 #define fat_offset_for_cluster(cluster, mount) \
     ((cluster) * cluster_entry_size(mount) % (mount)->block_size)
 
+// Sequential read-ahead window in clusters. A handle's window starts at
+// READAHEAD_MIN when a sequential read is detected and doubles with every
+// further sequential read up to READAHEAD_MAX.
+#define READAHEAD_MIN 2
+#define READAHEAD_MAX 32
+// Largest single device read, the sector count limit of 28-bit ATA commands
+#define READAHEAD_MAX_BLOCKS 256
+
 // NOTE: specification says max 255 chars, but format in principle seems to
 // allow 260, so be on the safe side
 #define LFN_CHAR_COUNT 260
@@ -114,6 +122,13 @@ struct fat_handle_common {
 struct fat_handle {
     struct fat_handle_common h;
     size_t offset;
+    // position in cluster chain, avoids walking the FAT from the start
+    size_t chain_index; // file cluster index of chain_cluster
+    uint32_t chain_cluster; // 0 if not yet known
+    // read-ahead state
+    size_t ra_next; // offset at which the next sequential read starts
+    size_t ra_window; // clusters, 0 if access is not sequential
+    size_t ra_end; // file cluster index up to which data was read ahead
 };
 
 struct fat_dirhandle {
@@ -170,15 +185,33 @@ acquire_or_read(struct fat_mount *mount, struct fs_cache *cache,
     else if (err == FS_CACHE_NOTPRESENT) {
         size_t read_size;
         data_ = malloc(size);
+        if (!data_) {
+            return LIB_ERR_MALLOC_FAIL;
+        }
         err = mount->ata_rw28_binding->rpc_tx_vtbl.read_dma(mount->ata_rw28_binding,
                 size, block, data_, &read_size);
         if (err_is_fail(err)) {
+            free(data_);
             return err;
         }
         assert(size == read_size);
 
-        err = fs_cache_put(cache, idx, data_);
+        // another thread may have read the same data concurrently. Use its
+        // copy, or insert ours again if that was evicted in the meantime.
+        while ((err = fs_cache_put(cache, idx, data_)) == FS_CACHE_CONFLICT) {
+            uint8_t *cached;
+            err = fs_cache_acquire(cache, idx, (void**)&cached);
+            if (err != FS_CACHE_NOTPRESENT) {
+                free(data_);
+                if (err_is_fail(err)) {
+                    return err;
+                }
+                data_ = cached;
+                break;
+            }
+        }
         if (err_is_fail(err)) {
+            free(data_);
             return err;
         }
     }
@@ -706,6 +739,165 @@ fat_remove(void *st, const char *path)
     return LIB_ERR_NOT_IMPLEMENTED;
 }
 
+static uint32_t
+start_cluster(struct fat_mount *mount, fat_direntry_t *dirent)
+{
+    uint32_t cluster = fat_direntry_start_rd(dirent);
+    if (mount->fat_type == FAT_TYPE_FAT32) {
+        cluster += (uint32_t)fat_direntry_starth_rd(dirent) << 16;
+    }
+    return cluster;
+}
+
+static errval_t
+file_cluster(struct fat_mount *mount, struct fat_handle *handle,
+        size_t cluster_index, uint32_t *cluster)
+{
+    TRACE_ENTER_F("cluster_index=%zu", cluster_index);
+    errval_t err;
+
+    // restart from the beginning of the chain when seeking backwards
+    if (!handle->chain_cluster || cluster_index < handle->chain_index) {
+        handle->chain_cluster = start_cluster(mount, &handle->h.dirent);
+        handle->chain_index = 0;
+    }
+
+    while (handle->chain_index < cluster_index) {
+        err = next_cluster(mount, handle->chain_cluster, &handle->chain_cluster);
+        if (err_is_fail(err)) {
+            handle->chain_cluster = 0;
+            return err;
+        }
+        handle->chain_index++;
+    }
+
+    *cluster = handle->chain_cluster;
+    return SYS_ERR_OK;
+}
+
+// Probe the cluster cache for read-ahead, leaving the hit statistics and
+// the entry's CLOCK reference bit alone.
+static bool
+cluster_cached(struct fat_mount *mount, uint32_t cluster)
+{
+    return fs_cache_contains(mount->cluster_cache, cluster);
+}
+
+// Read a run of physically contiguous clusters with a single device request
+// and put them into the cluster cache unreferenced.
+static errval_t
+read_cluster_run(struct fat_mount *mount, uint32_t cluster, size_t count)
+{
+    TRACE_ENTER_F("cluster=%"PRIu32", count=%zu", cluster, count);
+    errval_t err;
+    size_t cluster_bytes = mount->cluster_size * mount->block_size;
+    size_t size = count * cluster_bytes, read_size;
+
+    uint8_t *buf = malloc(size);
+    if (!buf) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+    err = mount->ata_rw28_binding->rpc_tx_vtbl.read_dma(mount->ata_rw28_binding,
+            size, cluster_to_block(cluster, mount), buf, &read_size);
+    if (err_is_fail(err)) {
+        goto out;
+    }
+    assert(size == read_size);
+
+    for (size_t i = 0; i < count; i++) {
+        uint8_t *data = malloc(cluster_bytes);
+        if (!data) {
+            err = LIB_ERR_MALLOC_FAIL;
+            goto out;
+        }
+        memcpy(data, buf + i * cluster_bytes, cluster_bytes);
+
+        err = fs_cache_put(mount->cluster_cache, cluster + i, data);
+        if (err_is_fail(err)) {
+            // cluster got cached concurrently or cache is busy, skip it
+            free(data);
+            continue;
+        }
+        err = release_cluster(mount, cluster + i);
+        assert(err_is_ok(err));
+    }
+    err = SYS_ERR_OK;
+
+out:
+    free(buf);
+    return err;
+}
+
+// Read up to count clusters of a file, starting at file cluster
+// cluster_index, into the cluster cache, merging physically contiguous
+// clusters into large device requests.
+static errval_t
+read_ahead(struct fat_mount *mount, struct fat_handle *handle,
+        size_t cluster_index, size_t count)
+{
+    TRACE_ENTER_F("cluster_index=%zu, count=%zu", cluster_index, count);
+    errval_t err;
+    size_t cluster_bytes = mount->cluster_size * mount->block_size;
+    size_t file_clusters = CEIL_DIV(fat_direntry_size_rd(&handle->h.dirent),
+            cluster_bytes);
+    size_t max_run = MAX(1, READAHEAD_MAX_BLOCKS / mount->cluster_size);
+
+    if (cluster_index >= file_clusters) {
+        return SYS_ERR_OK;
+    }
+    count = MIN(count, file_clusters - cluster_index);
+    handle->ra_end = cluster_index + count;
+
+    // file_cluster() advances the handle's cached chain position to the
+    // read-ahead start; put it back so the reader's position stays as it was
+    uint32_t chain_cluster = handle->chain_cluster;
+    size_t chain_index = handle->chain_index;
+    uint32_t cluster;
+    err = file_cluster(mount, handle, cluster_index, &cluster);
+    handle->chain_cluster = chain_cluster;
+    handle->chain_index = chain_index;
+    if (err_is_fail(err)) {
+        return err;
+    }
+
+    uint32_t run_start = 0;
+    size_t run_length = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (i > 0) {
+            err = next_cluster(mount, cluster, &cluster);
+            if (err_is_fail(err)) {
+                return err;
+            }
+        }
+        if (cluster < 2 || cluster >= mount->last_cluster_start) {
+            // corrupt or short chain, let the regular read path deal with it
+            break;
+        }
+
+        bool cached = cluster_cached(mount, cluster);
+        if (run_length > 0 && (cached || cluster != run_start + run_length
+                    || run_length == max_run))
+        {
+            err = read_cluster_run(mount, run_start, run_length);
+            if (err_is_fail(err)) {
+                return err;
+            }
+            run_length = 0;
+        }
+        if (!cached) {
+            if (run_length == 0) {
+                run_start = cluster;
+            }
+            run_length++;
+        }
+    }
+
+    if (run_length > 0) {
+        return read_cluster_run(mount, run_start, run_length);
+    }
+    return SYS_ERR_OK;
+}
+
 static errval_t
 read(void *st, vfs_handle_t fhandle, void *buffer, size_t bytes, size_t *bytes_read)
 {
@@ -735,6 +927,16 @@ read(void *st, vfs_handle_t fhandle, void *buffer, size_t bytes, size_t *bytes_r
         return FS_ERR_NOTFILE;
     }
 
+    // detect sequential access and adapt the read-ahead window
+    if (offset == handle->ra_next) {
+        handle->ra_window = handle->ra_window ?
+            MIN(handle->ra_window * 2, READAHEAD_MAX) : READAHEAD_MIN;
+    }
+    else {
+        handle->ra_window = 0;
+        handle->ra_end = 0;
+    }
+
     size_t remaining = bytes;
     do {
         // split read offset into cluster index and offset within cluster
@@ -756,17 +958,22 @@ read(void *st, vfs_handle_t fhandle, void *buffer, size_t bytes, size_t *bytes_r
         FAT_DEBUG_F("reading %zu from cluster (clus_rem=%zu, f_rem=%zu)",
                 read_size, cluster_remainder, file_remainder);
 
-        // determine cluster corresponding to cluster_index
-        uint32_t cluster = fat_direntry_start_rd(dirent);
-        if (mount->fat_type == FAT_TYPE_FAT32) {
-            cluster += (uint32_t)fat_direntry_starth_rd(dirent) << 16;
-        }
-        for (size_t clsidx = cluster_index; clsidx > 0; clsidx--) {
-            err = next_cluster(mount, cluster, &cluster);
+        // keep the read-ahead window ahead of a sequential reader. Failure
+        // to read ahead is not fatal, the cluster is read on its own below.
+        if (handle->ra_window && cluster_index >= handle->ra_end) {
+            err = read_ahead(mount, handle, cluster_index, handle->ra_window);
             if (err_is_fail(err)) {
-                return err;
+                FAT_DEBUG_F("read-ahead failed: %s", err_getstring(err));
+                handle->ra_window = 0;
             }
         }
+
+        // determine cluster corresponding to cluster_index
+        uint32_t cluster;
+        err = file_cluster(mount, handle, cluster_index, &cluster);
+        if (err_is_fail(err)) {
+            return err;
+        }
         FAT_DEBUG_F("file cluster %zu is cluster %"PRIu32, cluster_index, cluster);
         assert(cluster < mount->last_cluster_start);
 
@@ -795,6 +1002,7 @@ read(void *st, vfs_handle_t fhandle, void *buffer, size_t bytes, size_t *bytes_r
     // read completed, update handle's offset
     FAT_DEBUG_F("read of %zu bytes completed", bytes);
     handle->offset = offset;
+    handle->ra_next = offset;
     return SYS_ERR_OK;
 }
 
@@ -26,11 +26,31 @@ static const bool use_bulk_data = true;
 #define BULK_MEM_SIZE       (1U << 16)      // 64kB
 #define BULK_BLOCK_SIZE     BULK_MEM_SIZE   // (it's RPC)
 
+#define DCACHE_BUCKETS      256     // must be a power of two
+#define DCACHE_MAX          512     // cached lookups before the cache is flushed
+
+/// Cached result of a successful path lookup
+struct dcache_entry {
+    struct dcache_entry *next;
+    uint32_t hash;
+    trivfs_fh_t fh;
+    bool isdir;
+    size_t pos;
+    char path[];
+};
+
 struct ramfs_client {
     struct trivfs_binding *rpc;
     struct bulk_transfer bulk;
     trivfs_fh_t rootfh;
     bool bound;
+
+    /// namespace version, shared by ramfsd and writable by all its clients
+    /// (see trivfs.if); NULL if lookups are not cached
+    volatile uint64_t *nsversion;
+    uint64_t dcache_version;    ///< nsversion the cache contents are valid for
+    struct dcache_entry *dcache[DCACHE_BUCKETS];
+    size_t dcache_count;
 };
 
 struct ramfs_handle {
@@ -39,10 +59,128 @@ struct ramfs_handle {
     bool isdir;
     trivfs_fh_t fh;
     size_t pos;
+
+    // part of the file mapped by read_mapped()
+    uint32_t map_id;            ///< ramfsd's ID of the mapped frame, 0 if none
+    struct capref map_frame;
+    uint8_t *map_buf;
 };
 
-static errval_t resolve_path(struct ramfs_client *cl, const char *path,
-                             trivfs_fh_t *retfh, size_t *retpos, bool *retisdir)
+/*
+ * Lookups of whole paths are cached on the client. The cache is flushed
+ * whenever ramfsd reports a change to the namespace through the version
+ * counter it shares with all clients, so entries never outlive the files
+ * they refer to. Handles can still go stale when ramfsd recycles them, which
+ * callers detect by FS_ERR_INVALID_FH; they then drop the entry and
+ * resolve the path again.
+ */
+
+static uint32_t dcache_hash(const char *path)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (; *path != '\0'; path++) {
+        hash = (hash ^ (uint8_t)*path) * 16777619u;
+    }
+    return hash;
+}
+
+static void dcache_flush(struct ramfs_client *cl)
+{
+    for (int i = 0; i < DCACHE_BUCKETS; i++) {
+        while (cl->dcache[i] != NULL) {
+            struct dcache_entry *e = cl->dcache[i];
+            cl->dcache[i] = e->next;
+            free(e);
+        }
+    }
+    cl->dcache_count = 0;
+}
+
+/// Flush the cache if the namespace changed, returns false if disabled
+static bool dcache_sync(struct ramfs_client *cl)
+{
+    if (cl->nsversion == NULL) {
+        return false;
+    }
+
+    uint64_t version = *cl->nsversion;
+    if (version != cl->dcache_version) {
+        dcache_flush(cl);
+        cl->dcache_version = version;
+    }
+    return true;
+}
+
+static struct dcache_entry *dcache_lookup(struct ramfs_client *cl,
+                                          const char *path)
+{
+    if (!dcache_sync(cl)) {
+        return NULL;
+    }
+
+    uint32_t hash = dcache_hash(path);
+    struct dcache_entry *e = cl->dcache[hash & (DCACHE_BUCKETS - 1)];
+    while (e != NULL && (e->hash != hash || strcmp(e->path, path) != 0)) {
+        e = e->next;
+    }
+    return e;
+}
+
+/// Cache a lookup made while the namespace had the given version
+static void dcache_insert(struct ramfs_client *cl, const char *path,
+                          uint64_t version, trivfs_fh_t fh, bool isdir,
+                          size_t pos)
+{
+    if (!dcache_sync(cl) || version != cl->dcache_version) {
+        return; // disabled, or the namespace changed during the lookup
+    }
+
+    if (cl->dcache_count >= DCACHE_MAX) {
+        dcache_flush(cl);
+    }
+
+    size_t pathlen = strlen(path);
+    struct dcache_entry *e = malloc(sizeof(struct dcache_entry) + pathlen + 1);
+    if (e == NULL) {
+        return; // it's only a cache
+    }
+
+    e->hash = dcache_hash(path);
+    e->fh = fh;
+    e->isdir = isdir;
+    e->pos = pos;
+    memcpy(e->path, path, pathlen + 1);
+
+    struct dcache_entry **bucket = &cl->dcache[e->hash & (DCACHE_BUCKETS - 1)];
+    e->next = *bucket;
+    *bucket = e;
+    cl->dcache_count++;
+}
+
+static void dcache_remove(struct ramfs_client *cl, const char *path)
+{
+    if (cl->nsversion == NULL) {
+        return;
+    }
+
+    uint32_t hash = dcache_hash(path);
+    struct dcache_entry **p = &cl->dcache[hash & (DCACHE_BUCKETS - 1)];
+    for (; *p != NULL; p = &(*p)->next) {
+        struct dcache_entry *e = *p;
+        if (e->hash == hash && strcmp(e->path, path) == 0) {
+            *p = e->next;
+            free(e);
+            cl->dcache_count--;
+            return;
+        }
+    }
+}
+
+/// Resolve a path one component at a time, for paths too long for resolve
+static errval_t resolve_path_walk(struct ramfs_client *cl, const char *path,
+                                  trivfs_fh_t *retfh, size_t *retpos,
+                                  bool *retisdir)
 {
 restart: ;
     errval_t err, msgerr = SYS_ERR_OK;
@@ -124,6 +262,72 @@ out:
     return msgerr;
 }
 
+static errval_t resolve_path(struct ramfs_client *cl, const char *path,
+                             trivfs_fh_t *retfh, size_t *retpos, bool *retisdir)
+{
+    errval_t err, msgerr;
+    trivfs_fh_t fh;
+    bool isdir;
+    uint32_t pos;
+    int restarts = 0;
+
+    if (strlen(path) >= trivfs__resolve_call_path_MAX_ARGUMENT_SIZE) {
+        return resolve_path_walk(cl, path, retfh, retpos, retisdir);
+    }
+
+    struct dcache_entry *e = dcache_lookup(cl, path);
+    if (e != NULL) {
+        fh = e->fh;
+        isdir = e->isdir;
+        pos = e->pos;
+        msgerr = SYS_ERR_OK;
+        goto out;
+    }
+
+    // read the version before the lookup, so we never cache a stale result
+    uint64_t version = cl->nsversion != NULL ? *cl->nsversion : 0;
+
+restart:
+    err = cl->rpc->rpc_tx_vtbl.resolve(cl->rpc, cl->rootfh, path, &msgerr,
+                                       &fh, &isdir, &pos);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "transport error in resolve");
+        return err;
+    } else if (err_no(msgerr) == FS_ERR_INVALID_FH && !restarts++) {
+        // revalidate root
+        err = cl->rpc->rpc_tx_vtbl.getroot(cl->rpc, &cl->rootfh);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "failed to get root fh");
+        }
+        goto restart;
+    } else if (err_is_ok(msgerr)) {
+        dcache_insert(cl, path, version, fh, isdir, pos);
+    } else if (err_no(msgerr) != FS_ERR_NOTFOUND
+               && err_no(msgerr) != FS_ERR_NOTDIR) {
+        DEBUG_ERR(msgerr, "server error in resolve of '%s'", path);
+    }
+
+out:
+    if (retpos != NULL) {
+        *retpos = pos;
+    }
+    if (retfh != NULL) {
+        *retfh = fh;
+    }
+    if (retisdir != NULL) {
+        *retisdir = isdir;
+    }
+    return msgerr;
+}
+
+/// Get a fresh fh for a handle whose fh has become invalid
+static errval_t revalidate_handle(struct ramfs_client *cl,
+                                  struct ramfs_handle *h)
+{
+    dcache_remove(cl, h->path);
+    return resolve_path(cl, h->path, &h->fh, NULL, NULL);
+}
+
 static errval_t open(void *st, const char *path, vfs_handle_t *rethandle)
 {
     struct ramfs_client *cl = st;
@@ -143,6 +347,7 @@ static errval_t open(void *st, const char *path, vfs_handle_t *rethandle)
             assert(handle->path != NULL);
             handle->fh = fh;
             handle->pos = 0;
+            handle->map_id = 0;
             handle->isdir = false;
 
             *rethandle = handle;
@@ -194,6 +399,7 @@ out:
     assert(handle->path != NULL);
     handle->fh = fh;
     handle->pos = 0;
+    handle->map_id = 0;
     handle->isdir = false;
 
     *rethandle = handle;
@@ -206,7 +412,9 @@ static errval_t ramfs_remove(void *st, const char *path)
     trivfs_fh_t fh;
     errval_t err, msgerr;
     bool isdir;
+    int restarts = 0;
 
+restart:
     err = resolve_path(cl, path, &fh, NULL, &isdir);
     if (err_is_fail(err)) {
         return err;
@@ -219,6 +427,11 @@ static errval_t ramfs_remove(void *st, const char *path)
         DEBUG_ERR(err, "transport error in delete");
         return err;
     } else if (err_is_fail(msgerr)) {
+        if (err_no(msgerr) == FS_ERR_INVALID_FH && !restarts++) {
+            // cached fh was stale
+            dcache_remove(cl, path);
+            goto restart;
+        }
         DEBUG_ERR(msgerr, "server error in delete");
         return msgerr;
     }
@@ -245,7 +458,7 @@ restart:
     } else if (err_is_fail(msgerr)) {
         if (err_no(msgerr) == FS_ERR_INVALID_FH && !restarts++) {
             // revalidate handle and try again
-            msgerr = resolve_path(cl, h->path, &h->fh, NULL, NULL);
+            msgerr = revalidate_handle(cl, h);
             if (err_is_ok(msgerr)) {
                 goto restart;
             }
@@ -281,7 +494,7 @@ restart:
     } else if (err_is_fail(msgerr)) {
         if (err_no(msgerr) == FS_ERR_INVALID_FH && !restarts++) {
             // revalidate handle and try again
-            msgerr = resolve_path(cl, h->path, &h->fh, NULL, NULL);
+            msgerr = revalidate_handle(cl, h);
             if (err_is_ok(msgerr)) {
                 goto restart;
             }
@@ -298,13 +511,13 @@ restart:
     return msgerr;
 }
 
-static errval_t read_bulk(void *st, vfs_handle_t handle, void *buffer,
-                          size_t bytes, size_t *ret_bytes_read)
+static errval_t write_bulk(void *st, vfs_handle_t handle, const void *buffer,
+                           size_t bytes, size_t *ret_bytes_written)
 {
     struct ramfs_handle *h = handle;
     struct ramfs_client *cl = st;
-    trivfs_fsize_t reqlen, retlen;
-    size_t bytes_read = 0;
+    size_t bytes_written = 0;
+    trivfs_fsize_t reqlen;
     errval_t err, msgerr, reterr = SYS_ERR_OK;
 
     assert(!h->isdir);
@@ -314,120 +527,140 @@ static errval_t read_bulk(void *st, vfs_handle_t handle, void *buffer,
 
     void *mybuf = bulk_buf_get_mem(buf);
 
-    uintptr_t bufid = bulk_buf_get_id(buf);
-    trivfs_bulkid_t txbufid = bufid;
-    assert(bufid == txbufid);
-
-    while (bytes_read < bytes) {
-        if (bytes - bytes_read > BULK_BLOCK_SIZE) {
+    while (bytes_written < bytes) {
+        if (bytes - bytes_written > BULK_BLOCK_SIZE) {
             reqlen = BULK_BLOCK_SIZE;
         } else {
-            reqlen = bytes - bytes_read;
+            reqlen = bytes - bytes_written;
         }
 
+        memcpy(mybuf, (char *)buffer + bytes_written, reqlen);
+        uintptr_t bufid = bulk_prepare_send(buf);
+
         int restarts = 0;
 
 restart:
-        err = cl->rpc->rpc_tx_vtbl.read_bulk(cl->rpc, h->fh, h->pos, reqlen,
-                                     txbufid, &msgerr, &retlen);
+        err = cl->rpc->rpc_tx_vtbl.write_bulk(cl->rpc, h->fh, h->pos, reqlen, bufid,
+                                      &msgerr);
         if (err_is_fail(err)) {
-            DEBUG_ERR(err, "transport error in read");
+            DEBUG_ERR(err, "transport error in write");
             reterr = err;
             goto out;
         } else if (err_is_fail(msgerr)) {
             if (err_no(msgerr) == FS_ERR_INVALID_FH && !restarts++) {
                 // revalidate handle and try again
-                msgerr = resolve_path(cl, h->path, &h->fh, NULL, NULL);
+                msgerr = revalidate_handle(cl, h);
                 if (err_is_ok(msgerr)) {
                     goto restart;
                 }
             }
-            DEBUG_ERR(msgerr, "server error in read");
+            DEBUG_ERR(msgerr, "server error in write");
             reterr = msgerr;
             goto out;
         }
 
-        bulk_prepare_recv(buf);
-
-        memcpy((char *)buffer + bytes_read, mybuf, retlen);
-        h->pos += retlen;
-        bytes_read += retlen;
-
-        if (retlen < reqlen) { // XXX: this can only mean EOF for ramfs
-            reterr = VFS_ERR_EOF;
-            goto out;
-        }
+        h->pos += reqlen;
+        bytes_written += reqlen;
     }
 
 out:
-    err = bulk_free(&cl->bulk, bufid);
+    err = bulk_free(&cl->bulk, bulk_buf_get_id(buf));
     assert(err_is_ok(err));
 
-    if (ret_bytes_read != NULL) {
-        *ret_bytes_read = bytes_read;
+    if (ret_bytes_written != NULL) {
+        *ret_bytes_written = bytes_written;
     }
 
     return reterr;
 }
 
-static errval_t write_bulk(void *st, vfs_handle_t handle, const void *buffer,
-                           size_t bytes, size_t *ret_bytes_written)
+static void unmap_chunk(struct ramfs_handle *h)
+{
+    if (h->map_id == 0) {
+        return;
+    }
+
+    errval_t err = vspace_unmap(h->map_buf);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "vspace_unmap of file chunk");
+    }
+    cap_destroy(h->map_frame);
+    h->map_id = 0;
+}
+
+/*
+ * Reads by mapping copies of the file data made by ramfsd, so the data is
+ * copied once per change of a chunk rather than once per read. Each copy is
+ * ours alone and stays valid; ramfsd's reply tells us when the data changed
+ * and a new copy is needed.
+ */
+static errval_t read_mapped(void *st, vfs_handle_t handle, void *buffer,
+                            size_t bytes, size_t *ret_bytes_read)
 {
     struct ramfs_handle *h = handle;
     struct ramfs_client *cl = st;
-    size_t bytes_written = 0;
-    trivfs_fsize_t reqlen;
+    size_t bytes_read = 0;
     errval_t err, msgerr, reterr = SYS_ERR_OK;
 
     assert(!h->isdir);
 
-    struct bulk_buf *buf = bulk_alloc(&cl->bulk);
-    assert(buf != NULL); // shouldn't fail; we only ever use one at a time!
-
-    void *mybuf = bulk_buf_get_mem(buf);
-
-    while (bytes_written < bytes) {
-        if (bytes - bytes_written > BULK_BLOCK_SIZE) {
-            reqlen = BULK_BLOCK_SIZE;
-        } else {
-            reqlen = bytes - bytes_written;
-        }
-
-        memcpy(mybuf, (char *)buffer + bytes_written, reqlen);
-        uintptr_t bufid = bulk_prepare_send(buf);
-
+    while (bytes_read < bytes) {
+        struct capref frame;
+        trivfs_offset_t start;
+        trivfs_fsize_t framelen, len;
+        uint32_t id;
         int restarts = 0;
 
 restart:
-        err = cl->rpc->rpc_tx_vtbl.write_bulk(cl->rpc, h->fh, h->pos, reqlen, bufid,
-                                      &msgerr);
+        err = cl->rpc->rpc_tx_vtbl.map(cl->rpc, h->fh, h->pos, h->map_id,
+                                       &msgerr, &frame, &start, &framelen,
+                                       &len, &id);
         if (err_is_fail(err)) {
-            DEBUG_ERR(err, "transport error in write");
+            DEBUG_ERR(err, "transport error in map");
             reterr = err;
-            goto out;
+            break;
         } else if (err_is_fail(msgerr)) {
             if (err_no(msgerr) == FS_ERR_INVALID_FH && !restarts++) {
                 // revalidate handle and try again
-                msgerr = resolve_path(cl, h->path, &h->fh, NULL, NULL);
+                msgerr = revalidate_handle(cl, h);
                 if (err_is_ok(msgerr)) {
                     goto restart;
                 }
             }
-            DEBUG_ERR(msgerr, "server error in write");
+            DEBUG_ERR(msgerr, "server error in map");
             reterr = msgerr;
-            goto out;
+            break;
+        } else if (len == 0) {
+            reterr = VFS_ERR_EOF;
+            break;
         }
 
-        h->pos += reqlen;
-        bytes_written += reqlen;
-    }
+        if (id != h->map_id) {
+            assert(!capref_is_null(frame));
+            unmap_chunk(h);
+
+            void *buf;
+            err = vspace_map_one_frame_attr(&buf, framelen, frame,
+                                            VREGION_FLAGS_READ, NULL, NULL);
+            if (err_is_fail(err)) {
+                cap_destroy(frame);
+                reterr = err_push(err, LIB_ERR_VSPACE_MAP);
+                break;
+            }
+            h->map_frame = frame;
+            h->map_buf = buf;
+            h->map_id = id;
+        }
 
-out:
-    err = bulk_free(&cl->bulk, bulk_buf_get_id(buf));
-    assert(err_is_ok(err));
+        size_t within = h->pos - start;
+        size_t n = MIN(len - within, bytes - bytes_read);
+        memcpy((char *)buffer + bytes_read, h->map_buf + within, n);
+        h->pos += n;
+        bytes_read += n;
+    }
 
-    if (ret_bytes_written != NULL) {
-        *ret_bytes_written = bytes_written;
+    if (ret_bytes_read != NULL) {
+        *ret_bytes_read = bytes_read;
     }
 
     return reterr;
@@ -450,7 +683,7 @@ restart:
     } else if (err_is_fail(msgerr)) {
         if (err_no(msgerr) == FS_ERR_INVALID_FH && !restarts++) {
             // revalidate handle and try again
-            msgerr = resolve_path(cl, h->path, &h->fh, NULL, NULL);
+            msgerr = revalidate_handle(cl, h);
             if (err_is_ok(msgerr)) {
                 goto restart;
             }
@@ -486,7 +719,7 @@ restart:
     } else if (err_is_fail(msgerr)) {
         if (err_no(msgerr) == FS_ERR_INVALID_FH && !restarts++) {
             // revalidate handle and try again
-            msgerr = resolve_path(cl, h->path, &h->fh, NULL, NULL);
+            msgerr = revalidate_handle(cl, h);
             if (err_is_ok(msgerr)) {
                 goto restart;
             }
@@ -542,6 +775,7 @@ static errval_t close(void *st, vfs_handle_t inhandle)
 {
     struct ramfs_handle *handle = inhandle;
     assert(!handle->isdir);
+    unmap_chunk(handle);
     free(handle->path);
     free(handle);
     return SYS_ERR_OK;
@@ -565,6 +799,7 @@ static errval_t opendir(void *st, const char *path, vfs_handle_t *rethandle)
             assert(handle->path != NULL);
             handle->fh = fh;
             handle->pos = 0;
+            handle->map_id = 0;
             handle->isdir = true;
 
             *rethandle = handle;
@@ -605,7 +840,7 @@ restart:
                 h->fh = cl->rootfh;
                 goto restart;
             } else {
-                reply.err = resolve_path(cl, h->path, &h->fh, NULL, NULL);
+                reply.err = revalidate_handle(cl, h);
                 if (err_is_ok(reply.err)) {
                     goto restart;
                 }
@@ -648,17 +883,19 @@ static errval_t mkdir(void *st, const char *path)
     const char *childname;
     errval_t err, msgerr;
     bool isdir;
+    int restarts = 0;
 
     // find parent directory
     char *lastsep = strrchr(path, VFS_PATH_SEP);
+    size_t pathlen = lastsep != NULL ? lastsep - path : 0;
+    char pathbuf[pathlen + 1];
+    memcpy(pathbuf, path, pathlen);
+    pathbuf[pathlen] = '\0';
+
+restart:
     if (lastsep != NULL) {
         childname = lastsep + 1;
 
-        size_t pathlen = lastsep - path;
-        char pathbuf[pathlen + 1];
-        memcpy(pathbuf, path, pathlen);
-        pathbuf[pathlen] = '\0';
-
         // resolve parent directory
         err = resolve_path(cl, pathbuf, &parent, NULL, &isdir);
         if (err_is_fail(err)) {
@@ -677,6 +914,11 @@ static errval_t mkdir(void *st, const char *path)
     if (err_is_fail(err)) {
         DEBUG_ERR(err, "transport error in mkdir");
         return err;
+    } else if (err_no(msgerr) == FS_ERR_INVALID_FH && lastsep != NULL
+               && !restarts++) {
+        // cached fh of the parent was stale
+        dcache_remove(cl, pathbuf);
+        goto restart;
     }
 
     return msgerr;
@@ -688,7 +930,9 @@ static errval_t rmdir(void *st, const char *path)
     trivfs_fh_t fh;
     errval_t err, msgerr;
     bool isdir;
+    int restarts = 0;
 
+restart:
     err = resolve_path(cl, path, &fh, NULL, &isdir);
     if (err_is_fail(err)) {
         return err;
@@ -701,6 +945,11 @@ static errval_t rmdir(void *st, const char *path)
         DEBUG_ERR(err, "transport error in delete");
         return err;
     } else if (err_is_fail(msgerr)) {
+        if (err_no(msgerr) == FS_ERR_INVALID_FH && !restarts++) {
+            // cached fh was stale
+            dcache_remove(cl, path);
+            goto restart;
+        }
         DEBUG_ERR(msgerr, "server error in delete");
         return msgerr;
     }
@@ -730,7 +979,7 @@ static struct vfs_ops ramfsops_bulk = {
     .open = open,
     .create = create,
     .remove = ramfs_remove,
-    .read = read_bulk,
+    .read = read_mapped,
     .write = write_bulk,
     .truncate = truncate,
     .seek = seek,
@@ -820,6 +1069,10 @@ errval_t vfs_ramfs_mount(const char *uri, void **retst, struct vfs_ops **retops)
     assert(client != NULL);
 
     client->bound = false;
+    client->nsversion = NULL;
+    client->dcache_version = 0;
+    memset(client->dcache, 0, sizeof(client->dcache));
+    client->dcache_count = 0;
 
     err = trivfs_bind(iref, bind_cb, client, get_default_waitset(),
                       use_bulk_data
@@ -858,6 +1111,27 @@ errval_t vfs_ramfs_mount(const char *uri, void **retst, struct vfs_ops **retops)
         } else if (err_is_fail(msgerr)) {
             USER_PANIC_ERR(msgerr, "bulk_init failed");
         }
+
+        // Map the namespace version to enable the lookup cache
+        struct capref nsversion_frame;
+        err = client->rpc->rpc_tx_vtbl.nsversion(client->rpc, &msgerr,
+                                                 &nsversion_frame);
+        if (err_is_ok(err) && err_is_ok(msgerr)) {
+            void *buf;
+            err = vspace_map_one_frame_attr(&buf, BASE_PAGE_SIZE,
+                                            nsversion_frame, VREGION_FLAGS_READ,
+                                            NULL, NULL);
+            if (err_is_ok(err)) {
+                client->nsversion = buf;
+                client->dcache_version = *client->nsversion;
+            } else {
+                DEBUG_ERR(err, "mapping namespace version, not caching lookups");
+                cap_destroy(nsversion_frame);
+            }
+        } else {
+            DEBUG_ERR(err_is_fail(err) ? err : msgerr,
+                      "getting namespace version, not caching lookups");
+        }
     }
 
     if (use_bulk_data) {
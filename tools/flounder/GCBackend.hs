@@ -671,8 +671,8 @@ ump_bind_backend ifn cont =
         C.Ex $ C.Assignment errvar $
             C.Call (UMP.bind_fn_name ifn) [binding, bind_iref, cont, C.Variable "b", waitset,
                                            flags,
-                                           C.Variable "DEFAULT_UMP_BUFLEN",
-                                           C.Variable "DEFAULT_UMP_BUFLEN"]
+                                           C.Call "ump_chan_default_buflen" [],
+                                           C.Call "ump_chan_default_buflen" []]
     ],
     test_cb_success = C.Call "err_is_ok" [errvar],
     test_cb_try_next = C.Variable "true",
@@ -689,8 +689,8 @@ ump_ipi_bind_backend ifn cont =
         C.Ex $ C.Assignment errvar $
             C.Call (UMP_IPI.bind_fn_name ifn) [binding, bind_iref, cont, C.Variable "b", waitset,
                                            flags,
-                                           C.Variable "DEFAULT_UMP_BUFLEN",
-                                           C.Variable "DEFAULT_UMP_BUFLEN"]
+                                           C.Call "ump_chan_default_buflen" [],
+                                           C.Call "ump_chan_default_buflen" []]
     ],
     test_cb_success = C.Call "err_is_ok" [errvar],
     test_cb_try_next = C.Variable "true",
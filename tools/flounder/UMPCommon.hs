@@ -1271,6 +1271,9 @@ rx_handler p ifn typedefs msgdefs msgs =
         C.Label "out_no_reregister",
         C.Ex $ C.Variable "__attribute__((unused))",
 
+        C.SComment "return the consumed slots to the sender in one sweep",
+        C.Ex $ C.Call "flounder_stub_ump_free_flush" [stateaddr],
+
         C.If (C.Variable "call_msgnum") [C.Ex $ C.Assignment rx_msgnum_field (C.NumConstant 0)] [],
         C.Ex $ C.Call "thread_mutex_unlock" [C.AddressOf $ C.DerefField bindvar "rxtx_mutex"],
         C.Switch (C.Variable "call_msgnum") call_cases [C.Break]
@@ -1291,6 +1294,7 @@ rx_handler p ifn typedefs msgdefs msgs =
                     [C.SComment "real error",
                      report_user_err $ C.Call "err_push"
                                    [errvar, C.Variable "LIB_ERR_UMP_CHAN_RECV"],
+                     C.Ex $ C.Call "flounder_stub_ump_free_flush" [stateaddr],
                      C.Ex $ C.Call "thread_mutex_unlock" [C.AddressOf $ C.DerefField bindvar "rxtx_mutex"],
                      C.ReturnVoid] ]
                 [],
@@ -1305,10 +1309,12 @@ rx_handler p ifn typedefs msgdefs msgs =
 
             C.SComment "is this a binding message of connect/accept?",
             C.If (C.Binary C.Equals (C.Variable "msgnum") (C.Variable "FL_UMP_BIND")) [
-              C.Ex $ C.Call "ump_chan_free_message" [C.Variable "msg"],
+              C.Ex $ C.Call "flounder_stub_ump_free_deferred" [stateaddr, C.Variable "msg"],
                  C.If ((C.Binary C.Equals (C.DerefField my_bindvar "is_client")) (C.Variable "1")) [
                   C.SComment "Client should not recv bind messages. Ignore.",
                   C.Continue] [],
+              C.SComment "the callback may use the channel, return our slots first",
+              C.Ex $ C.Call "flounder_stub_ump_free_flush" [stateaddr],
               C.SComment "handle bind reply: calling bind callback",
               C.Ex $ C.CallInd (bindvar `C.DerefField` "bind_cont")
                   [bindvar `C.DerefField` "st", errvar, bindvar],
@@ -1318,10 +1324,12 @@ rx_handler p ifn typedefs msgdefs msgs =
 
             C.SComment "is this a binding reply message of connect/accept?",
             C.If (C.Binary C.Equals (C.Variable "msgnum") (C.Variable "FL_UMP_BIND_REPLY")) [
-               C.Ex $ C.Call "ump_chan_free_message" [C.Variable "msg"],
+               C.Ex $ C.Call "flounder_stub_ump_free_deferred" [stateaddr, C.Variable "msg"],
                C.If ((C.Binary C.Equals (C.DerefField my_bindvar "is_client")) (C.Variable "0")) [
                 C.SComment "Server should not recv bind messages. Ignore.",
                 C.Continue] [],
+              C.SComment "the callback may use the channel, return our slots first",
+              C.Ex $ C.Call "flounder_stub_ump_free_flush" [stateaddr],
               C.SComment "handle bind: calling connect callback",
               C.Ex $ C.CallInd (bindvar `C.DerefField` "bind_cont")
                   [bindvar `C.DerefField` "st", errvar, bindvar],
@@ -1330,7 +1338,7 @@ rx_handler p ifn typedefs msgdefs msgs =
 
             C.SComment "is this a cap ack for a pending tx message",
             C.If (C.Binary C.Equals (C.Variable "msgnum") (C.Variable "FL_UMP_CAP_ACK"))
-                [C.Ex $ C.Call "ump_chan_free_message" [C.Variable "msg"],
+                [C.Ex $ C.Call "flounder_stub_ump_free_deferred" [stateaddr, C.Variable "msg"],
                  C.Ex $ C.Call "assert" [C.Unary C.Not (capst `C.FieldOf` "rx_cap_ack")],
                  C.Ex $ C.Assignment (capst `C.FieldOf` "rx_cap_ack") (C.Variable "true"),
                  C.If (capst `C.FieldOf` "monitor_mutex_held")
@@ -1408,7 +1416,7 @@ rx_handler p ifn typedefs msgdefs msgs =
                                  | (afl, word) <- zip wl [0..]],
             (if isFirst then C.Ex $ C.Assignment binding_incoming_token ump_token else C.SBlank),
             C.SBlank,
-            C.Ex $ C.Call "ump_chan_free_message" [C.Variable "msg"],
+            C.Ex $ C.Call "flounder_stub_ump_free_deferred" [stateaddr, C.Variable "msg"],
             C.StmtList $ msgfrag_case_prolog msg caps isLast,
             C.Goto "out"]
             where
@@ -1420,7 +1428,7 @@ rx_handler p ifn typedefs msgdefs msgs =
         msgfrag_case msg@(Message _ mn _ _) (OverflowFragment (StringFragment af)) caps isFirst isLast = [
             C.Ex $ C.Assignment errvar (C.Call "flounder_stub_ump_recv_string" args),
             (if isFirst then C.Ex $ C.Assignment binding_incoming_token ump_token else C.SBlank),
-            C.Ex $ C.Call "ump_chan_free_message" [C.Variable "msg"],
+            C.Ex $ C.Call "flounder_stub_ump_free_deferred" [stateaddr, C.Variable "msg"],
             C.If (C.Call "err_is_ok" [errvar])
                 (msgfrag_case_prolog msg caps isLast)
                 -- error from string receive code, check if it's permanent
@@ -1445,7 +1453,7 @@ rx_handler p ifn typedefs msgdefs msgs =
 
         msgfrag_case msg@(Message _ mn _ _) (OverflowFragment (BufferFragment _ afn afl)) caps isFirst isLast = [
             C.Ex $ C.Assignment errvar (C.Call "flounder_stub_ump_recv_buf" args),
-            C.Ex $ C.Call "ump_chan_free_message" [C.Variable "msg"],
+            C.Ex $ C.Call "flounder_stub_ump_free_deferred" [stateaddr, C.Variable "msg"],
             C.If (C.Call "err_is_ok" [errvar])
                 (msgfrag_case_prolog msg caps isLast)
                 -- error from receive code, check if it's permanent
@@ -252,6 +252,78 @@ def show_event_list(event_list):
 	for e in event_list:
 		print_event(e)
 
+# Binary stream written by trace_stream_drain(), see trace/trace_stream.h
+TRACE_STREAM_MAGIC = "BFTRACE"
+TRACE_STREAM_CORE = 0x01
+TRACE_STREAM_EVENT = 0x02
+TRACE_STREAM_RAW = 0x03
+TRACE_STREAM_LOST = 0x04
+TRACE_STREAM_APP = 0x05
+
+def read_varint(data, pos):
+	val = 0
+	shift = 0
+	while True:
+		b = data[pos]
+		pos = pos + 1
+		val = val | ((b & 0x7f) << shift)
+		shift = shift + 7
+		if b < 0x80:
+			return (val, pos)
+
+def stream_lines(data):
+	"""Decode a binary trace stream into the lines of a text trace dump"""
+	data = bytearray(data)
+	if data[7] != 1:
+		print "Error: unknown trace stream version %d" % data[7]
+		sys.exit(1)
+	pos = 8
+	core = 0
+	last_ts = {}
+	while pos < len(data):
+		tag = data[pos]
+		pos = pos + 1
+		if tag == TRACE_STREAM_CORE:
+			(core, pos) = read_varint(data, pos)
+			(offset, pos) = read_varint(data, pos)
+			offset = (offset >> 1) ^ -(offset & 1)
+			yield "# Offset %d %d\n" % (core, offset)
+		elif tag == TRACE_STREAM_EVENT:
+			(delta, pos) = read_varint(data, pos)
+			(subsys, pos) = read_varint(data, pos)
+			(event, pos) = read_varint(data, pos)
+			(arg, pos) = read_varint(data, pos)
+			ts = last_ts.get(core, 0) + delta
+			last_ts[core] = ts
+			raw = (subsys << 48) | (event << 32) | arg
+			yield "%d %d %x\n" % (core, ts, raw)
+		elif tag == TRACE_STREAM_RAW:
+			(ts, pos) = read_varint(data, pos)
+			(raw, pos) = read_varint(data, pos)
+			if ts >> 63 == 0:
+				last_ts[core] = ts
+			yield "%d %d %x\n" % (core, ts, raw)
+		elif tag == TRACE_STREAM_LOST:
+			(count, pos) = read_varint(data, pos)
+			yield "# Lost %d %d\n" % (core, count)
+		elif tag == TRACE_STREAM_APP:
+			(dcb, pos) = read_varint(data, pos)
+			name = str(data[pos:pos + 8])
+			pos = pos + 8
+			yield "# DCB %d %x %s\n" % (core, dcb, name)
+		else:
+			print "Error: unknown record %x at offset %d" % (tag, pos - 1)
+			sys.exit(1)
+
+def open_trace(filename):
+	"""Return the lines of a text trace dump or of a binary trace stream"""
+	in_f = open(filename, 'rb')
+	data = in_f.read()
+	in_f.close()
+	if data.startswith(TRACE_STREAM_MAGIC):
+		return stream_lines(data)
+	return data.splitlines(True)
+
 def extract_events(in_f):
 	splitter = re.compile(r'[\ ]')
 	event_list = []
@@ -530,13 +602,14 @@ def process_trace(in_f):
 
 def show_usage():
 	print "Usage: " + sys.argv[0] + " <traceFile>"
+	print "       <traceFile> is a text dump or a stream from bfscope"
 
 
 def main():
 	if len(sys.argv) != 2:
 		show_usage()
 		sys.exit(1)
-	inputFile = open(sys.argv[1], 'r')
+	inputFile = open_trace(sys.argv[1])
 	#outputFile = open(sys.argv[2], 'w')
 	process_trace(inputFile)
 
@@ -11,8 +11,8 @@
 
 import sys,string,socket
 
-if len(sys.argv) != 2:
-    print "usage: bfscope.py <host>"
+if len(sys.argv) not in [2, 3] or (len(sys.argv) == 3 and sys.argv[2] != "stream"):
+    print "usage: bfscope.py <host> [stream]"
     sys.exit(1)
 
 #create an INET, STREAMing socket
@@ -20,6 +20,23 @@ s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
 
 s.connect((sys.argv[1], 666))
 
+if len(sys.argv) == 3:
+    # continuous binary trace, written to TRACE until interrupted
+    s.send("stream\n")
+    of=open("TRACE", "wb")
+    try:
+        while True:
+            data = s.recv(1000000)
+            if not data:
+                break
+            of.write(data)
+    except KeyboardInterrupt:
+        pass
+    print "Done"
+    s.close()
+    of.close()
+    sys.exit(0)
+
 s.send("trace\n")
 
 header = s.recv(6)
@@ -36,4 +53,3 @@ s.close()
 
 of=open("TRACE", "w")
 of.write(trace)
-
@@ -0,0 +1,95 @@
+/**
+ * \file
+ * \brief libbomp barrier latency benchmark.
+ *
+ * Measures the cycles per episode of the BARRIER construct for teams of 2 up
+ * to the given number of threads, with every barrier algorithm of libbomp.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <stdio.h>
+#include <omp.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#ifdef POSIX
+static inline uint64_t rdtsc(void)
+{
+    uint32_t eax, edx;
+    __asm volatile ("rdtsc" : "=a" (eax), "=d" (edx));
+    return ((uint64_t)edx << 32) | eax;
+}
+#else
+#include <barrelfish/barrelfish.h>
+#endif
+
+#define ROUNDS  10000
+#define WARMUP  100
+
+static uint64_t run(int nthreads)
+{
+    uint64_t cycles = 0;
+
+#pragma omp parallel num_threads(nthreads)
+    {
+        for (int i = 0; i < WARMUP; i++) {
+#pragma omp barrier
+        }
+
+        uint64_t begin = rdtsc();
+        for (int i = 0; i < ROUNDS; i++) {
+#pragma omp barrier
+        }
+        uint64_t end = rdtsc();
+
+#pragma omp master
+        cycles = (end - begin) / ROUNDS;
+    }
+
+    return cycles;
+}
+
+int main(int argc, char *argv[])
+{
+    assert(argc == 2);
+    int max_threads = atoi(argv[1]);
+    assert(max_threads >= 2 && max_threads <= 64);
+#ifndef POSIX
+    bomp_bomp_init(max_threads);
+#endif
+    omp_set_num_threads(max_threads);
+
+    for (int n = 2; ; n = n * 2 < max_threads ? n * 2 : max_threads) {
+#ifdef POSIX
+        printf("barrier_lat: threads %d gomp %" PRIu64 " cycles\n", n, run(n));
+#else
+        bomp_set_barrier(BOMP_BARRIER_AUTO);
+        uint64_t t_auto = run(n);
+        bomp_set_barrier(BOMP_BARRIER_CENTRAL);
+        uint64_t t_central = run(n);
+        bomp_set_barrier(BOMP_BARRIER_TREE);
+        uint64_t t_tree = run(n);
+        bomp_set_barrier(BOMP_BARRIER_DISSEMINATION);
+        uint64_t t_dissemination = run(n);
+
+        printf("barrier_lat: threads %d auto %" PRIu64 " central %" PRIu64
+               " tree %" PRIu64 " dissemination %" PRIu64 " cycles\n", n,
+               t_auto, t_central, t_tree, t_dissemination);
+#endif
+        if (n == max_threads) {
+            break;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+/**
+ * \file
+ * \brief libbomp loop scheduling benchmark.
+ *
+ * Runs a loop whose iterations get more expensive towards the end with every
+ * schedule kind and reports the cycles taken. Run it with increasing thread
+ * counts to compare how the schedules scale.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <stdio.h>
+#include <omp.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#ifdef POSIX
+static inline uint64_t rdtsc(void)
+{
+    uint32_t eax, edx;
+    __asm volatile ("rdtsc" : "=a" (eax), "=d" (edx));
+    return ((uint64_t)edx << 32) | eax;
+}
+#define OMP_SCHED_STATIC  omp_sched_static
+#define OMP_SCHED_DYNAMIC omp_sched_dynamic
+#define OMP_SCHED_GUIDED  omp_sched_guided
+#else
+#include <barrelfish/barrelfish.h>
+#endif
+
+#define N       20000
+#define ROUNDS  5
+
+static double a[N];
+
+static double work(int i)
+{
+    double x = 0;
+    for (int k = 0; k < i; k++) {
+        x = x * 0.999 + (double)k;
+    }
+    return x;
+}
+
+static uint64_t run(omp_sched_t kind, int chunk)
+{
+    int i;
+    omp_set_schedule(kind, chunk);
+
+    uint64_t begin = rdtsc();
+    for (int r = 0; r < ROUNDS; r++) {
+#pragma omp parallel for schedule(runtime)
+        for (i = 0; i < N; i++) {
+            a[i] = work(i);
+        }
+    }
+    return (rdtsc() - begin) / ROUNDS;
+}
+
+int main(int argc, char *argv[])
+{
+    assert(argc == 2);
+    int nthreads = atoi(argv[1]);
+#ifndef POSIX
+    bomp_bomp_init(nthreads);
+#endif
+    omp_set_num_threads(nthreads);
+
+    uint64_t t_static = run(OMP_SCHED_STATIC, 0);
+    uint64_t t_static_chunk = run(OMP_SCHED_STATIC, 64);
+    uint64_t t_dynamic = run(OMP_SCHED_DYNAMIC, 16);
+    uint64_t t_guided = run(OMP_SCHED_GUIDED, 16);
+
+    printf("loop_sched: threads %d static %" PRIu64 " static,64 %" PRIu64
+           " dynamic,16 %" PRIu64 " guided,16 %" PRIu64 " cycles (%g)\n",
+           nthreads, t_static, t_static_chunk, t_dynamic, t_guided, a[N - 1]);
+    return 0;
+}
@@ -20,4 +20,9 @@ for i in `seq 1 $MAXCORES`; do
     ./ft-bomp $i >> results_ft_bomp.txt
     ./is-gomp $i >> results_is_gomp.txt
     ./is-bomp $i >> results_is_bomp.txt
+    ./loop_sched-gomp $i >> results_loop_sched_gomp.txt
+    ./loop_sched-bomp $i >> results_loop_sched_bomp.txt
 done
+
+./barrier_lat-gomp $MAXCORES >> results_barrier_lat_gomp.txt
+./barrier_lat-bomp $MAXCORES >> results_barrier_lat_bomp.txt
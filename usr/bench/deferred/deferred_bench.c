@@ -0,0 +1,128 @@
+/**
+ * \file
+ * \brief Deferred event (timer) benchmark
+ *
+ * Arms and cancels a large number of deferred events, as kept by servers
+ * with per-connection timeouts, and measures the cost of registration,
+ * cancellation and expiry.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <stdio.h>
+#include <barrelfish/barrelfish.h>
+#include <barrelfish/deferred.h>
+#include <bench/bench.h>
+
+#define NTIMERS         100000
+#define LONG_DELAY_US   1000000     ///< Minimum delay of timers we cancel
+#define SHORT_DELAY_US  50000       ///< Maximum delay of timers we expire
+
+static struct deferred_event *events;
+static uint32_t *order;
+static volatile size_t fired;
+
+static inline uint32_t xorshift(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static void timer_fired(void *arg)
+{
+    fired++;
+}
+
+static void report(const char *phase, cycles_t elapsed)
+{
+    printf("deferred_bench: %-8s %8d timers %8" PRIuCYCLES " cycles/timer "
+           "%8" PRIu64 " us total\n", phase, NTIMERS, elapsed / NTIMERS,
+           bench_tsc_to_us(elapsed));
+}
+
+int main(int argc, char *argv[])
+{
+    errval_t err;
+    struct waitset ws;
+    uint32_t seed = 2463534242U;
+    cycles_t start, end;
+
+    bench_init();
+    waitset_init(&ws);
+
+    events = malloc(NTIMERS * sizeof(*events));
+    order = malloc(NTIMERS * sizeof(*order));
+    if (events == NULL || order == NULL) {
+        USER_PANIC("malloc failed");
+    }
+
+    // random permutation for cancelling timers out of arming order
+    for (uint32_t i = 0; i < NTIMERS; i++) {
+        order[i] = i;
+    }
+    for (uint32_t i = NTIMERS - 1; i > 0; i--) {
+        uint32_t j = xorshift(&seed) % (i + 1);
+        uint32_t tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    for (int i = 0; i < NTIMERS; i++) {
+        deferred_event_init(&events[i]);
+    }
+
+    // arm timers far enough in the future that none of them fires
+    start = bench_tsc();
+    for (int i = 0; i < NTIMERS; i++) {
+        delayus_t delay = LONG_DELAY_US + xorshift(&seed) % (100 * LONG_DELAY_US);
+        err = deferred_event_register(&events[i], &ws, delay,
+                                      MKCLOSURE(timer_fired, NULL));
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "deferred_event_register");
+        }
+    }
+    end = bench_tsc();
+    report("arm", bench_time_diff(start, end));
+
+    start = bench_tsc();
+    for (int i = 0; i < NTIMERS; i++) {
+        err = deferred_event_cancel(&events[order[i]]);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "deferred_event_cancel");
+        }
+    }
+    end = bench_tsc();
+    report("cancel", bench_time_diff(start, end));
+
+    // arm short timers and let them all expire
+    start = bench_tsc();
+    for (int i = 0; i < NTIMERS; i++) {
+        delayus_t delay = xorshift(&seed) % SHORT_DELAY_US;
+        err = deferred_event_register(&events[i], &ws, delay,
+                                      MKCLOSURE(timer_fired, NULL));
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "deferred_event_register");
+        }
+    }
+    while (fired < NTIMERS) {
+        err = event_dispatch(&ws);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "event_dispatch");
+        }
+    }
+    end = bench_tsc();
+    report("expire", bench_time_diff(start, end));
+
+    printf("deferred_bench: done\n");
+    return EXIT_SUCCESS;
+}
@@ -10,10 +10,12 @@
  *
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <barrelfish/barrelfish.h>
 #include <barrelfish/dispatch.h>
+#include <barrelfish/domain.h>
 #include <barrelfish/waitset.h>
 #include <barrelfish/nameservice_client.h>
 #include <bench/bench.h>
@@ -106,6 +108,44 @@ static void prepare(void)
     debug_printf("preparation done.\n");
 }
 
+static volatile bool worker_spanned = false;
+
+static void span_done(void *arg,
+                      errval_t err)
+{
+    EXPECT_SUCCESS(err, "spanning domain");
+    worker_spanned = true;
+}
+
+/*
+ * compares the software DMA engine with memcpy, needs no DMA hardware
+ */
+static int run_sw_bench(coreid_t core)
+{
+    errval_t err;
+
+    if (core != disp_get_core_id()) {
+        err = domain_new_dispatcher(core, span_done, NULL);
+        EXPECT_SUCCESS(err, "domain_new_dispatcher");
+        while (!worker_spanned) {
+            err = event_dispatch(get_default_waitset());
+            EXPECT_SUCCESS(err, "event_dispatch");
+        }
+    }
+
+    debug_printf("memcpy: Numa 0 -> Numa 0\n");
+    err = dma_bench_run_memcpy(buffers[1], buffers[0]);
+    EXPECT_SUCCESS(err, "dma_bench_run_memcpy\n");
+
+    debug_printf("software DMA: Numa 0 -> Numa 0\n");
+    err = dma_bench_run_sw(frame, phys[0], phys[1], core);
+    EXPECT_SUCCESS(err, "dma_bench_run_sw\n");
+
+    debug_printf("DMA Benchmark done.\n");
+
+    return 0;
+}
+
 int main(int argc,
          char *argv[])
 {
@@ -117,6 +157,15 @@ int main(int argc,
 
     bench_init();
 
+    /* usage: dma_bench [sw [worker core]] */
+    if (argc > 1 && strcmp(argv[1], "sw") == 0) {
+        coreid_t core = disp_get_core_id() + 1;
+        if (argc > 2) {
+            core = atoi(argv[2]);
+        }
+        return run_sw_bench(core);
+    }
+
 #if 0
     char svc_name[30];
     uint8_t numa_node = (disp_get_core_id() >= 20);
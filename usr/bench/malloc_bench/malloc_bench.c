@@ -0,0 +1,187 @@
+/**
+ * \file
+ * \brief Malloc contention benchmark
+ *
+ * Runs the same allocation pattern on a number of threads spread across
+ * cores and reports the cost of a malloc/free pair for the selected
+ * allocator: newlib's oldmalloc, dlmalloc (lib/dmalloc) or tcmalloc
+ * (lib/tcmalloc).
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <barrelfish/barrelfish.h>
+#include <barrelfish/dispatch.h>
+#include <bench/bench.h>
+#include <dmalloc/dmalloc.h>
+#include <tcmalloc/tcmalloc.h>
+
+#define ITERATIONS      100000
+#define WINDOW          64      ///< Objects kept live by every thread
+#define MAX_SIZE        1024
+#define MAX_THREADS     64
+
+typedef void *(*malloc_fn_t)(size_t);
+typedef void (*free_fn_t)(void *);
+
+static malloc_fn_t bench_malloc;
+static free_fn_t bench_free;
+
+static coreid_t ncores = 1;
+static unsigned nthreads = 1;
+static volatile unsigned spanned = 1;
+static volatile unsigned ready = 0;
+static volatile bool go = false;
+static volatile unsigned done = 0;
+static cycles_t results[MAX_THREADS];
+
+static void domain_spanned(void *arg, errval_t err)
+{
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "domain_new_dispatcher");
+    }
+    __sync_fetch_and_add(&spanned, 1);
+}
+
+static inline uint32_t xorshift(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static int worker(void *arg)
+{
+    uintptr_t id = (uintptr_t)arg;
+    uint32_t seed = 2463534242U + id;
+    void *live[WINDOW];
+
+    memset(live, 0, sizeof(live));
+
+    __sync_fetch_and_add(&ready, 1);
+    while (!go) {
+        thread_yield();
+    }
+
+    cycles_t start = bench_tsc();
+    for (size_t i = 0; i < ITERATIONS; i++) {
+        size_t slot = i % WINDOW;
+        if (live[slot] != NULL) {
+            bench_free(live[slot]);
+        }
+        live[slot] = bench_malloc(xorshift(&seed) % MAX_SIZE + 1);
+        if (live[slot] == NULL) {
+            USER_PANIC("malloc failed");
+        }
+        // touch the memory so the allocator's cache footprint counts
+        *(volatile char *)live[slot] = (char)i;
+    }
+    cycles_t end = bench_tsc();
+
+    for (size_t slot = 0; slot < WINDOW; slot++) {
+        bench_free(live[slot]);
+    }
+
+    results[id] = bench_time_diff(start, end);
+    __sync_fetch_and_add(&done, 1);
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s <oldmalloc|dlmalloc|tcmalloc> <cores> <threads>\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    errval_t err;
+
+    if (argc != 4) {
+        usage(argv[0]);
+    }
+
+    if (strcmp(argv[1], "oldmalloc") == 0) {
+        bench_malloc = malloc;
+        bench_free = free;
+    } else if (strcmp(argv[1], "dlmalloc") == 0) {
+        bench_malloc = dlmalloc;
+        bench_free = dlfree;
+    } else if (strcmp(argv[1], "tcmalloc") == 0) {
+        tcmalloc_init();
+        bench_malloc = tc_malloc;
+        bench_free = tc_free;
+    } else {
+        usage(argv[0]);
+    }
+
+    ncores = atoi(argv[2]);
+    nthreads = atoi(argv[3]);
+    if (ncores == 0 || nthreads == 0 || nthreads > MAX_THREADS) {
+        usage(argv[0]);
+    }
+
+    bench_init();
+
+    coreid_t my_core = disp_get_core_id();
+    for (coreid_t i = 1; i < ncores; i++) {
+        err = domain_new_dispatcher(my_core + i, domain_spanned, NULL);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "domain_new_dispatcher");
+        }
+    }
+    while (spanned < ncores) {
+        thread_yield();
+    }
+
+    for (uintptr_t i = 0; i < nthreads; i++) {
+        err = domain_thread_create_on(my_core + (i % ncores), worker,
+                                      (void *)i, NULL);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "domain_thread_create_on");
+        }
+    }
+    while (ready < nthreads) {
+        thread_yield();
+    }
+    go = true;
+    while (done < nthreads) {
+        thread_yield();
+    }
+
+    cycles_t total = 0, max = 0;
+    for (unsigned i = 0; i < nthreads; i++) {
+        total += results[i];
+        max = MAX(max, results[i]);
+    }
+
+    printf("malloc_bench: %s cores=%u threads=%u avg=%" PRIuCYCLES
+           " cycles/pair, wall=%" PRIu64 " us\n", argv[1], ncores, nthreads,
+           total / (nthreads * ITERATIONS),
+           bench_tsc_to_us(max));
+
+    if (strcmp(argv[1], "tcmalloc") == 0) {
+        struct tcmalloc_stats stats;
+        tcmalloc_get_stats(&stats);
+        printf("malloc_bench: tcmalloc fetches=%" PRIu64 " releases=%" PRIu64
+               " transfer_hits=%" PRIu64 " spans=%" PRIu64 "/%" PRIu64
+               " heap=%zu meta=%zu\n", stats.central_fetches,
+               stats.central_releases, stats.transfer_hits,
+               stats.spans_allocated, stats.spans_freed, stats.heap_bytes,
+               stats.meta_bytes);
+    }
+
+    printf("malloc_bench: done\n");
+    return EXIT_SUCCESS;
+}
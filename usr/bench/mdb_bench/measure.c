@@ -190,6 +190,131 @@ static cycles_t measure_query_address(struct cte *ctes, size_t count)
 }
 #endif
 
+/**
+ * Turn the second half of the ctes into the result of retyping one RAM cap
+ * into page-sized siblings, placed above all other caps, and insert the first
+ * half. Returns the number of siblings.
+ */
+static size_t setup_run(struct cte *ctes, size_t count)
+{
+    size_t run = count / 2;
+    struct cte *first = &ctes[count - run];
+    genpaddr_t base = (genpaddr_t)1 << 40;
+
+    for (int i = 0; i < run; i++) {
+        memset(&first[i], 0, sizeof(struct cte));
+        struct RAM ram = {
+            .base = base + i * BASE_PAGE_SIZE,
+            .bytes = BASE_PAGE_SIZE,
+        };
+        struct capability cap = {
+            .type = ObjType_RAM,
+            .rights = CAPRIGHTS_ALLRIGHTS,
+            .u.ram = ram,
+        };
+        first[i].cap = cap;
+    }
+    for (int i = 0; i < count - run; i++) {
+        INS(&ctes[i]);
+    }
+
+    return run;
+}
+
+static cycles_t measure_insert_run(struct cte *ctes, size_t count)
+{
+    size_t run = setup_run(ctes, count);
+    struct cte *first = &ctes[count - run];
+
+    __asm volatile ("" : : : "memory");
+
+    cycles_t begin = bench_tsc();
+    for (int i = 0; i < run; i++) {
+        INS(&first[i]);
+    }
+    cycles_t end = bench_tsc();
+
+    return end - begin;
+}
+
+static cycles_t measure_remove_run(struct cte *ctes, size_t count)
+{
+    size_t run = setup_run(ctes, count);
+    struct cte *first = &ctes[count - run];
+    for (int i = 0; i < run; i++) {
+        INS(&first[i]);
+    }
+
+    __asm volatile ("" : : : "memory");
+
+    cycles_t begin = bench_tsc();
+    for (int i = 0; i < run; i++) {
+        REM(&first[i]);
+    }
+    cycles_t end = bench_tsc();
+
+    return end - begin;
+}
+
+#ifndef OLD_MDB
+static cycles_t measure_insert_run_bulk(struct cte *ctes, size_t count)
+{
+    size_t run = setup_run(ctes, count);
+    struct cte *first = &ctes[count - run];
+
+    __asm volatile ("" : : : "memory");
+
+    cycles_t begin = bench_tsc();
+    errval_t err = mdb_insert_bulk(first, run);
+    cycles_t end = bench_tsc();
+    assert_err(err, "mdb_insert_bulk");
+
+    return end - begin;
+}
+
+static cycles_t measure_remove_run_bulk(struct cte *ctes, size_t count)
+{
+    size_t run = setup_run(ctes, count);
+    struct cte *first = &ctes[count - run];
+    errval_t err = mdb_insert_bulk(first, run);
+    assert_err(err, "mdb_insert_bulk");
+
+    __asm volatile ("" : : : "memory");
+
+    cycles_t begin = bench_tsc();
+    err = mdb_remove_bulk(first, run);
+    cycles_t end = bench_tsc();
+    assert_err(err, "mdb_remove_bulk");
+
+    return end - begin;
+}
+
+static cycles_t measure_range_scan(struct cte *ctes, size_t count)
+{
+    size_t run = setup_run(ctes, count);
+    struct cte *first = &ctes[count - run];
+    errval_t err = mdb_insert_bulk(first, run);
+    assert_err(err, "mdb_insert_bulk");
+
+    struct mdb_range_iter iter;
+    size_t found = 0;
+
+    __asm volatile ("" : : : "memory");
+
+    // visit all siblings, as a revoke of their parent would
+    cycles_t begin = bench_tsc();
+    mdb_range_iter_init(&iter, get_type_root(ObjType_RAM),
+                        get_address(&first->cap), run * BASE_PAGE_SIZE);
+    while (mdb_range_iter_next(&iter)) {
+        found++;
+    }
+    cycles_t end = bench_tsc();
+    assert(found == run);
+
+    return end - begin;
+}
+#endif
+
 struct measure_opt measure_opts[] = {
     { "insert_one", measure_insert_one, },
     { "remove_one", measure_remove_one, },
@@ -202,6 +327,13 @@ struct measure_opt measure_opts[] = {
     { "has_descendants", measure_has_descendants, },
 #ifndef OLD_MDB
     { "query_address", measure_query_address, },
+#endif
+    { "insert_run", measure_insert_run, },
+    { "remove_run", measure_remove_run, },
+#ifndef OLD_MDB
+    { "insert_run_bulk", measure_insert_run_bulk, },
+    { "remove_run_bulk", measure_remove_run_bulk, },
+    { "range_scan", measure_range_scan, },
 #endif
     { NULL, NULL, },
 };
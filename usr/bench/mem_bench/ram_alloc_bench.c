@@ -0,0 +1,146 @@
+/**
+ * \file
+ * \brief RAM allocation throughput benchmark
+ *
+ * Runs one instance per core, each repeatedly allocating RAM caps of a fixed
+ * size from its memory server and destroying them again after a window of
+ * live allocations. Destroyed caps find their way back to the memory server
+ * through the monitor, so the benchmark exercises both the allocation and the
+ * free path of the allocator. Reports allocations per second for every core
+ * and for the whole run.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <barrelfish/barrelfish.h>
+#include <barrelfish/spawn_client.h>
+#include <bench/bench.h>
+#include <dist/barrier.h>
+
+#define DEFAULT_BITS        12      ///< Size of every allocation
+#define DEFAULT_ITERATIONS  10000
+#define WINDOW              64      ///< Caps kept live by every instance
+
+#define BARRIER_START   "ram_alloc_bench"
+#define BARRIER_DONE    "ram_alloc_bench_done"
+
+static void run_benchmark(coreid_t core, uint8_t bits, size_t iterations)
+{
+    errval_t err;
+    struct capref live[WINDOW];
+
+    memset(live, 0, sizeof(live));
+
+    cycles_t start = bench_tsc();
+    for (size_t i = 0; i < iterations; i++) {
+        size_t slot = i % WINDOW;
+        if (!capref_is_null(live[slot])) {
+            err = cap_destroy(live[slot]);
+            if (err_is_fail(err)) {
+                USER_PANIC_ERR(err, "cap_destroy");
+            }
+        }
+        err = ram_alloc(&live[slot], bits);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "ram_alloc after %zu allocations", i);
+        }
+    }
+    cycles_t end = bench_tsc();
+
+    for (size_t slot = 0; slot < WINDOW; slot++) {
+        if (!capref_is_null(live[slot])) {
+            cap_destroy(live[slot]);
+        }
+    }
+
+    uint64_t us = bench_tsc_to_us(bench_time_diff(start, end));
+    printf("ram_alloc_bench: core %d: %zu allocs of %u bits, %" PRIuCYCLES
+           " cycles/alloc, %" PRIu64 " allocs/s\n", core, iterations, bits,
+           bench_time_diff(start, end) / iterations,
+           us == 0 ? 0 : iterations * 1000000 / us);
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s <cores> [bits] [iterations]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    errval_t err;
+    coreid_t mycore = disp_get_core_id();
+
+    bench_init();
+
+    if (argc >= 2 && strcmp(argv[1], "worker") == 0) {
+        assert(argc == 4);
+        uint8_t bits = atoi(argv[2]);
+        size_t iterations = atol(argv[3]);
+
+        err = nsb_register_n(mycore, BARRIER_START);
+        assert(err_is_ok(err));
+        err = nsb_wait_ready(BARRIER_START);
+        assert(err_is_ok(err));
+
+        run_benchmark(mycore, bits, iterations);
+
+        err = nsb_register_n(mycore, BARRIER_DONE);
+        assert(err_is_ok(err));
+        return EXIT_SUCCESS;
+    }
+
+    if (argc < 2) {
+        usage(argv[0]);
+    }
+
+    int ncores = atoi(argv[1]);
+    uint8_t bits = argc > 2 ? atoi(argv[2]) : DEFAULT_BITS;
+    size_t iterations = argc > 3 ? atol(argv[3]) : DEFAULT_ITERATIONS;
+    if (ncores <= 0 || bits < BASE_PAGE_BITS || iterations == 0) {
+        usage(argv[0]);
+    }
+
+    char bits_str[4], iter_str[24];
+    snprintf(bits_str, sizeof(bits_str), "%u", bits);
+    snprintf(iter_str, sizeof(iter_str), "%zu", iterations);
+    char *worker_argv[] = { argv[0], "worker", bits_str, iter_str, NULL };
+    for (int i = 1; i < ncores; i++) {
+        err = spawn_program(mycore + i, argv[0], worker_argv, NULL, 0, NULL);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "spawning on core %d", mycore + i);
+        }
+    }
+
+    // release all instances at once
+    err = nsb_master(mycore + 1, mycore + ncores - 1, BARRIER_START);
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "start barrier");
+    }
+
+    cycles_t start = bench_tsc();
+    run_benchmark(mycore, bits, iterations);
+    err = nsb_master(mycore + 1, mycore + ncores - 1, BARRIER_DONE);
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "done barrier");
+    }
+    cycles_t end = bench_tsc();
+
+    uint64_t us = bench_tsc_to_us(bench_time_diff(start, end));
+    printf("ram_alloc_bench: %d cores, %zu allocs in %" PRIu64 " us, %" PRIu64
+           " allocs/s\n", ncores, ncores * iterations, us,
+           us == 0 ? 0 : ncores * iterations * 1000000 / us);
+    printf("ram_alloc_bench: done\n");
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,190 @@
+/**
+ * \file
+ * \brief Name service lookup latency and domain startup
+ *
+ * Registers a set of names and measures uncached, cached and batched lookups
+ * in the benchmark domain. Then repeatedly spawns a copy of itself that
+ * resolves every name twice, as a domain binding to the services it needs at
+ * startup does, either one name at a time or with a single batched lookup.
+ * The child reports the time from the spawn request to main() and to the
+ * point where all names are resolved.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <barrelfish/barrelfish.h>
+#include <barrelfish/nameservice_client.h>
+#include <barrelfish/spawn_client.h>
+#include <bench/bench.h>
+
+#define DEFAULT_NAMES       8
+#define DEFAULT_RUNS        10
+#define MAX_NAMES           64
+#define NAME_LEN            32
+#define IREF_BASE           1000 ///< Registered IREFs are never bound
+
+static char names[MAX_NAMES][NAME_LEN];
+static const char *name_ptrs[MAX_NAMES];
+
+static void make_names(size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        snprintf(names[i], NAME_LEN, "ns_bench.%zu", i);
+        name_ptrs[i] = names[i];
+    }
+}
+
+static void lookup_all(size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        iref_t iref;
+        errval_t err = nameservice_lookup(names[i], &iref);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "nameservice_lookup %s", names[i]);
+        }
+        assert(iref == IREF_BASE + i);
+    }
+}
+
+static int run_child(bool batch, size_t count, cycles_t spawned)
+{
+    cycles_t start = bench_tsc();
+
+    make_names(count);
+    if (batch) {
+        iref_t irefs[MAX_NAMES];
+        errval_t err = nameservice_lookup_batch(name_ptrs, count, irefs);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "nameservice_lookup_batch");
+        }
+    }
+    // once to find the services, once more when binding to them
+    lookup_all(count);
+    lookup_all(count);
+
+    cycles_t end = bench_tsc();
+    printf("ns_bench: child: %s spawn-to-main %" PRIu64 " us, "
+           "spawn-to-ready %" PRIu64 " us\n", batch ? "batch " : "single",
+           bench_tsc_to_us(bench_time_diff(spawned, start)),
+           bench_tsc_to_us(bench_time_diff(spawned, end)));
+
+    return EXIT_SUCCESS;
+}
+
+static void report(const char *phase, size_t ops, cycles_t cycles)
+{
+    printf("ns_bench: %-8s %zu lookups, %" PRIu64 " us per lookup\n", phase,
+           ops, bench_tsc_to_us(cycles / ops));
+}
+
+static cycles_t spawn_children(const char *prog, const char *mode,
+                               size_t count, size_t runs)
+{
+    errval_t err;
+    char count_str[24];
+    snprintf(count_str, sizeof(count_str), "%zu", count);
+
+    cycles_t total = 0;
+    for (size_t i = 0; i < runs; i++) {
+        domainid_t domid;
+        uint8_t exitcode;
+
+        char start_str[24];
+        cycles_t start = bench_tsc();
+        snprintf(start_str, sizeof(start_str), "%" PRIu64, start);
+        char *child_argv[] = { (char *)prog, "child", (char *)mode, count_str,
+                               start_str, NULL };
+
+        err = spawn_program(disp_get_core_id(), prog, child_argv, NULL, 0,
+                            &domid);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "spawn_program");
+        }
+        err = spawn_wait(domid, &exitcode, false);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "spawn_wait");
+        }
+        total += bench_time_diff(start, bench_tsc());
+    }
+
+    return total;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [names] [runs]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    errval_t err;
+
+    bench_init();
+
+    if (argc == 5 && strcmp(argv[1], "child") == 0) {
+        return run_child(strcmp(argv[2], "batch") == 0, atol(argv[3]),
+                         strtoull(argv[4], NULL, 10));
+    }
+
+    size_t count = argc > 1 ? atol(argv[1]) : DEFAULT_NAMES;
+    size_t runs = argc > 2 ? atol(argv[2]) : DEFAULT_RUNS;
+    if (argc > 3 || count == 0 || count > MAX_NAMES || runs == 0) {
+        usage(argv[0]);
+    }
+
+    make_names(count);
+    for (size_t i = 0; i < count; i++) {
+        err = nameservice_register(names[i], IREF_BASE + i);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "nameservice_register");
+        }
+    }
+
+    cycles_t start = bench_tsc();
+    lookup_all(count);
+    report("first", count, bench_time_diff(start, bench_tsc()));
+
+    start = bench_tsc();
+    for (size_t i = 0; i < runs; i++) {
+        lookup_all(count);
+    }
+    report("cached", count * runs, bench_time_diff(start, bench_tsc()));
+
+    // re-registering drops the names from our cache
+    for (size_t i = 0; i < count; i++) {
+        err = nameservice_register(names[i], IREF_BASE + i);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "nameservice_register");
+        }
+    }
+    iref_t irefs[MAX_NAMES];
+    start = bench_tsc();
+    err = nameservice_lookup_batch(name_ptrs, count, irefs);
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "nameservice_lookup_batch");
+    }
+    report("batch", count, bench_time_diff(start, bench_tsc()));
+    for (size_t i = 0; i < count; i++) {
+        assert(irefs[i] == IREF_BASE + i);
+    }
+
+    cycles_t single = spawn_children(argv[0], "single", count, runs);
+    cycles_t batch = spawn_children(argv[0], "batch", count, runs);
+    printf("ns_bench: names=%zu runs=%zu spawn-to-exit single=%" PRIu64
+           " us batch=%" PRIu64 " us\n", count, runs,
+           bench_tsc_to_us(single / runs), bench_tsc_to_us(batch / runs));
+    printf("ns_bench: done\n");
+
+    return EXIT_SUCCESS;
+}
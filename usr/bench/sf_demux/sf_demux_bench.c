@@ -0,0 +1,183 @@
+/**
+ * \file
+ * \brief Packet classification cost of the soft filters
+ *
+ * Installs one filter per open port, built the same way the port manager
+ * builds them for the soft filter service, and replays synthetic TCP and UDP
+ * packets to a random mix of open and closed ports. Every packet is
+ * classified both by interpreting the filter list, newest filter first, and
+ * by the compiled demultiplexer the queue manager uses, and the results are
+ * checked against each other. Reports cycles per packet for both.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <barrelfish/barrelfish.h>
+#include <bench/bench.h>
+#include <bfdmuxtools/tools.h>
+#include <bfdmuxtools/codegen.h>
+#include <bfdmuxvm/vm.h>
+#include <bfdmuxvm/demux.h>
+
+#define DEFAULT_PORTS       256
+#define DEFAULT_PACKETS     100000
+#define PACKET_SET          1024    ///< Distinct packets replayed
+#define PACKET_LEN          64
+#define FIRST_PORT          1024
+#define LOCAL_IP            0x0a000001
+
+#define IP_PROTO_TCP        6
+#define IP_PROTO_UDP        17
+
+struct bench_filter {
+    uint8_t *code;
+    int32_t len;
+    struct demux_filter *demux;
+};
+
+static struct eth_addr mac = {{ 0x00, 0x0c, 0x29, 0x12, 0x34, 0x56 }};
+static struct demux dm;
+static uint8_t packets[PACKET_SET][PACKET_LEN];
+
+static void put_be16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+static void put_be32(uint8_t *p, uint32_t v)
+{
+    put_be16(p, v >> 16);
+    put_be16(p + 2, v);
+}
+
+static void build_packet(uint8_t *p, uint8_t proto, uint32_t srcip,
+                         uint16_t srcport, uint16_t dstport)
+{
+    memset(p, 0, PACKET_LEN);
+    memcpy(p, mac.addr, sizeof(mac.addr));
+    put_be16(p + 12, 0x0800);       // ethertype IPv4
+    p[14] = 0x45;                   // version and header length
+    p[23] = proto;
+    put_be32(p + 26, srcip);
+    put_be32(p + 30, LOCAL_IP);
+    put_be16(p + 34, srcport);
+    put_be16(p + 36, dstport);
+}
+
+/// Classify the way the queue manager did before the demultiplexer
+static int match_list(struct bench_filter *filters, int nfilters, uint8_t *p)
+{
+    for (int i = nfilters - 1; i >= 0; i--) {
+        if (execute_filter(filters[i].code, filters[i].len, p, PACKET_LEN,
+                           NULL)) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [ports] [packets]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    errval_t err;
+
+    bench_init();
+
+    int nports = argc > 1 ? atoi(argv[1]) : DEFAULT_PORTS;
+    size_t npackets = argc > 2 ? atol(argv[2]) : DEFAULT_PACKETS;
+    if (argc > 3 || nports <= 0 || npackets == 0) {
+        usage(argv[0]);
+    }
+
+    struct bench_filter *filters = calloc(nports, sizeof(*filters));
+    if (filters == NULL) {
+        USER_PANIC("calloc failed");
+    }
+
+    demux_init(&dm);
+    for (int i = 0; i < nports; i++) {
+        char *expr;
+        if (i % 2 == 0) {
+            expr = build_ether_dst_ipv4_tcp_filter(mac, BFDMUX_IP_ADDR_ANY,
+                                                   LOCAL_IP, PORT_ANY,
+                                                   FIRST_PORT + i);
+        } else {
+            expr = build_ether_dst_ipv4_udp_filter(mac, BFDMUX_IP_ADDR_ANY,
+                                                   LOCAL_IP, PORT_ANY,
+                                                   FIRST_PORT + i);
+        }
+        compile_filter(expr, &filters[i].code, &filters[i].len);
+        free(expr);
+
+        err = demux_add_filter(&dm, filters[i].code, filters[i].len, i + 1,
+                               (void *)(uintptr_t)(i + 1), &filters[i].demux);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "demux_add_filter");
+        }
+    }
+    printf("sf_demux_bench: %d filters, %zu compiled, %zu interpreted\n",
+           nports, dm.ncompiled, dm.ninterpreted);
+
+    // an eighth of the packets go to closed ports
+    srand(42);
+    for (int i = 0; i < PACKET_SET; i++) {
+        uint16_t port = FIRST_PORT + rand() % (nports + nports / 8 + 1);
+        uint8_t proto = (port - FIRST_PORT) % 2 == 0 ? IP_PROTO_TCP
+                                                     : IP_PROTO_UDP;
+        build_packet(packets[i], proto, 0x0a000100 + rand() % 256,
+                     32768 + rand() % 1024, port);
+    }
+
+    for (int i = 0; i < PACKET_SET; i++) {
+        int expected = match_list(filters, nports, packets[i]);
+        int got = (uintptr_t)demux_match(&dm, packets[i], PACKET_LEN);
+        if (got != expected) {
+            USER_PANIC("packet %d: demux matched filter %d, list %d", i, got,
+                       expected);
+        }
+    }
+
+    volatile int sink = 0;
+
+    cycles_t start = bench_tsc();
+    for (size_t i = 0; i < npackets; i++) {
+        sink += match_list(filters, nports, packets[i % PACKET_SET]);
+    }
+    cycles_t list = bench_time_diff(start, bench_tsc());
+
+    start = bench_tsc();
+    for (size_t i = 0; i < npackets; i++) {
+        sink += (uintptr_t)demux_match(&dm, packets[i % PACKET_SET],
+                                       PACKET_LEN);
+    }
+    cycles_t demux = bench_time_diff(start, bench_tsc());
+
+    printf("sf_demux_bench: %zu packets, list %" PRIuCYCLES " cycles/pkt, "
+           "demux %" PRIuCYCLES " cycles/pkt\n", npackets, list / npackets,
+           demux / npackets);
+    printf("sf_demux_bench: done\n");
+
+    for (int i = 0; i < nports; i++) {
+        demux_remove_filter(&dm, filters[i].demux);
+        free(filters[i].code);
+    }
+    free(filters);
+
+    return EXIT_SUCCESS;
+}
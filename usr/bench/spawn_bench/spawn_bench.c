@@ -0,0 +1,108 @@
+/**
+ * \file
+ * \brief Startup time of large domains
+ *
+ * Repeatedly spawns a copy of itself that grows its heap to a given size,
+ * touching every page, and exits. Reports the time from the spawn request
+ * to the exit of the child, which is dominated by the RAM allocations of
+ * spawnd and of the child itself.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <barrelfish/barrelfish.h>
+#include <barrelfish/spawn_client.h>
+#include <bench/bench.h>
+
+#define DEFAULT_HEAP_MB     64
+#define DEFAULT_RUNS        10
+#define CHUNK_SIZE          (1UL << 20) ///< Granularity of heap allocations
+
+static int run_child(size_t heap_mb)
+{
+    cycles_t start = bench_tsc();
+
+    for (size_t i = 0; i < heap_mb; i++) {
+        volatile char *buf = malloc(CHUNK_SIZE);
+        if (buf == NULL) {
+            USER_PANIC("malloc failed after %zu MB", i);
+        }
+        for (size_t off = 0; off < CHUNK_SIZE; off += BASE_PAGE_SIZE) {
+            buf[off] = (char)off;
+        }
+    }
+
+    cycles_t end = bench_tsc();
+    printf("spawn_bench: child: %zu MB heap in %" PRIu64 " us\n", heap_mb,
+           bench_tsc_to_us(bench_time_diff(start, end)));
+
+    return EXIT_SUCCESS;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [heap MB] [runs]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    errval_t err;
+
+    bench_init();
+
+    if (argc == 3 && strcmp(argv[1], "child") == 0) {
+        return run_child(atol(argv[2]));
+    }
+
+    size_t heap_mb = argc > 1 ? atol(argv[1]) : DEFAULT_HEAP_MB;
+    size_t runs = argc > 2 ? atol(argv[2]) : DEFAULT_RUNS;
+    if (argc > 3 || runs == 0) {
+        usage(argv[0]);
+    }
+
+    char heap_str[24];
+    snprintf(heap_str, sizeof(heap_str), "%zu", heap_mb);
+    char *child_argv[] = { argv[0], "child", heap_str, NULL };
+
+    cycles_t total = 0, min = (cycles_t)-1, max = 0;
+    for (size_t i = 0; i < runs; i++) {
+        domainid_t domid;
+        uint8_t exitcode;
+
+        cycles_t start = bench_tsc();
+        err = spawn_program(disp_get_core_id(), argv[0], child_argv, NULL, 0,
+                            &domid);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "spawn_program");
+        }
+        err = spawn_wait(domid, &exitcode, false);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "spawn_wait");
+        }
+        cycles_t end = bench_tsc();
+
+        cycles_t t = bench_time_diff(start, end);
+        total += t;
+        min = MIN(min, t);
+        max = MAX(max, t);
+    }
+
+    printf("spawn_bench: heap=%zu MB runs=%zu avg=%" PRIu64 " us min=%" PRIu64
+           " us max=%" PRIu64 " us\n", heap_mb, runs,
+           bench_tsc_to_us(total / runs), bench_tsc_to_us(min),
+           bench_tsc_to_us(max));
+    printf("spawn_bench: done\n");
+
+    return EXIT_SUCCESS;
+}
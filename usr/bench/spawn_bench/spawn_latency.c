@@ -0,0 +1,93 @@
+/**
+ * \file
+ * \brief Latency from a spawn request to main() of the new domain
+ *
+ * Spawns copies of itself on the same core, passing the time of the request
+ * on the command line. Every child prints the time it took to reach main(),
+ * the parent the latency of the spawn request and of the whole run until the
+ * child exited.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <barrelfish/barrelfish.h>
+#include <barrelfish/spawn_client.h>
+#include <bench/bench.h>
+
+#define DEFAULT_RUNS    20
+
+static int run_child(const char *start)
+{
+    cycles_t now = bench_tsc();
+    cycles_t t = bench_time_diff(strtoull(start, NULL, 10), now);
+
+    printf("spawn_latency: to main=%" PRIu64 " us\n", bench_tsc_to_us(t));
+    return EXIT_SUCCESS;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [runs]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    errval_t err;
+
+    bench_init();
+
+    if (argc == 3 && strcmp(argv[1], "child") == 0) {
+        return run_child(argv[2]);
+    }
+
+    size_t runs = argc > 1 ? atol(argv[1]) : DEFAULT_RUNS;
+    if (argc > 2 || runs == 0) {
+        usage(argv[0]);
+    }
+
+    char start[24];
+    char *child_argv[] = { argv[0], "child", start, NULL };
+
+    cycles_t spawn_total = 0, run_total = 0;
+    for (size_t i = 0; i < runs; i++) {
+        cycles_t t0 = bench_tsc();
+        snprintf(start, sizeof(start), "%" PRIu64, (uint64_t)t0);
+
+        domainid_t domid;
+        err = spawn_program(disp_get_core_id(), argv[0], child_argv, NULL, 0,
+                            &domid);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "spawn_program of run %zu", i);
+        }
+        cycles_t t1 = bench_tsc();
+
+        uint8_t exitcode;
+        err = spawn_wait(domid, &exitcode, false);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "spawn_wait of run %zu", i);
+        }
+        cycles_t t2 = bench_tsc();
+
+        spawn_total += bench_time_diff(t0, t1);
+        run_total += bench_time_diff(t0, t2);
+    }
+
+    printf("spawn_latency: runs=%zu spawn avg=%" PRIu64 " us run avg=%"
+           PRIu64 " us\n", runs, bench_tsc_to_us(spawn_total / runs),
+           bench_tsc_to_us(run_total / runs));
+    printf("spawn_latency: done\n");
+
+    return EXIT_SUCCESS;
+}
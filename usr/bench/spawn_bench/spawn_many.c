@@ -0,0 +1,125 @@
+/**
+ * \file
+ * \brief Spawn latency and memory footprint of many instances of one binary
+ *
+ * Spawns copies of itself that stay alive until they are killed, and reports
+ * the latency of every spawn request and the RAM taken per instance. The
+ * first spawn loads the binary into the image cache of spawnd, the following
+ * ones share its read-only segments.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <barrelfish/barrelfish.h>
+#include <barrelfish/spawn_client.h>
+#include <bench/bench.h>
+
+#define DEFAULT_INSTANCES   100
+
+static int run_child(void)
+{
+    // stay around until we are killed
+    struct waitset *ws = get_default_waitset();
+    for (;;) {
+        errval_t err = event_dispatch(ws);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "event_dispatch");
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+static genpaddr_t free_ram(void)
+{
+    genpaddr_t available, total;
+    errval_t err = ram_available(&available, &total);
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "ram_available");
+    }
+    return available;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [instances]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    errval_t err;
+
+    bench_init();
+
+    if (argc == 2 && strcmp(argv[1], "child") == 0) {
+        return run_child();
+    }
+
+    size_t instances = argc > 1 ? atol(argv[1]) : DEFAULT_INSTANCES;
+    if (argc > 2 || instances == 0) {
+        usage(argv[0]);
+    }
+
+    domainid_t *domids = calloc(instances, sizeof(domainid_t));
+    assert(domids != NULL);
+
+    char *child_argv[] = { argv[0], "child", NULL };
+
+    genpaddr_t ram_before = free_ram();
+
+    cycles_t first = 0, total = 0, min = (cycles_t)-1, max = 0;
+    for (size_t i = 0; i < instances; i++) {
+        cycles_t start = bench_tsc();
+        err = spawn_program(disp_get_core_id(), argv[0], child_argv, NULL, 0,
+                            &domids[i]);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "spawn_program of instance %zu", i);
+        }
+        cycles_t end = bench_tsc();
+
+        cycles_t t = bench_time_diff(start, end);
+        if (i == 0) {
+            first = t;
+            continue;
+        }
+        total += t;
+        min = MIN(min, t);
+        max = MAX(max, t);
+    }
+
+    genpaddr_t ram_after = free_ram();
+
+    printf("spawn_many: instances=%zu first=%" PRIu64 " us\n", instances,
+           bench_tsc_to_us(first));
+    if (instances > 1) {
+        printf("spawn_many: others avg=%" PRIu64 " us min=%" PRIu64
+               " us max=%" PRIu64 " us\n",
+               bench_tsc_to_us(total / (instances - 1)),
+               bench_tsc_to_us(min), bench_tsc_to_us(max));
+    }
+    printf("spawn_many: ram used=%" PRIuGENPADDR " kB per instance=%"
+           PRIuGENPADDR " kB\n", (ram_before - ram_after) / 1024,
+           (ram_before - ram_after) / 1024 / instances);
+
+    for (size_t i = 0; i < instances; i++) {
+        err = spawn_kill(domids[i]);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "spawn_kill of instance %zu", i);
+        }
+    }
+    free(domids);
+
+    printf("spawn_many: done\n");
+
+    return EXIT_SUCCESS;
+}
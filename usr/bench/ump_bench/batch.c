@@ -0,0 +1,84 @@
+/**
+ * \file
+ * \brief UMP batched send/receive benchmark
+ *
+ * Sends runs of messages that are published with a single barrier and
+ * received with coalesced acknowledgements, and reports round-trip latency
+ * and per-message cost for increasing batch sizes. A batch size of one
+ * measures the same path as the single-message benchmarks.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include "ump_bench.h"
+
+#define MAX_COUNT 1000
+#define MAX_BATCH 64
+
+static cycles_t round_trip(struct ump_chan_state *send,
+                           struct ump_chan_state *recv, ump_index_t batch)
+{
+    volatile struct ump_message *msgs[MAX_BATCH];
+    struct ump_control ctrls[MAX_BATCH];
+    ump_index_t n;
+
+    cycles_t start = bench_tsc();
+
+    /* Publish the whole batch, reserving slots as the receiver frees them */
+    for (ump_index_t sent = 0; sent < batch; sent += n) {
+        while (!(n = ump_impl_get_next_batch(send, msgs, ctrls, batch - sent)));
+        for (ump_index_t i = 0; i < n; i++) {
+            msgs[i]->data[0] = sent + i;
+        }
+        ump_impl_publish_batch(msgs, ctrls, n);
+    }
+
+    /* Collect the replies, acknowledging every run at once */
+    for (ump_index_t got = 0; got < batch; got += n) {
+        while (!(n = ump_impl_recv_batch(recv, msgs, batch - got)));
+        ump_impl_free_batch(msgs, n);
+    }
+
+    return bench_tsc() - start;
+}
+
+void experiment(coreid_t idx)
+{
+    struct bench_ump_binding *bu = (struct bench_ump_binding*)array[idx];
+    struct flounder_ump_state *fus = &bu->ump_state;
+    struct ump_chan *chan = &fus->chan;
+
+    struct ump_chan_state *send = &chan->send_chan;
+    struct ump_chan_state *recv = &chan->endpoint.chan;
+
+    printf("Running batched UMP between core %"PRIuCOREID" and core %"
+           PRIuCOREID", ring %u/%u messages\n", my_core_id, idx,
+           chan->max_send_msgs, chan->max_recv_msgs);
+
+    ump_index_t limit = MIN(MIN(chan->max_send_msgs, chan->max_recv_msgs),
+                            MAX_BATCH);
+    for (ump_index_t batch = 1; batch <= limit; batch *= 2) {
+        cycles_t total = 0, min = (cycles_t)-1;
+
+        for (int i = 0; i < MAX_COUNT; i++) {
+            cycles_t t = round_trip(send, recv, batch) - bench_tscoverhead();
+            /* skip the warm-up rounds */
+            if (i >= MAX_COUNT / 10) {
+                total += t;
+                min = MIN(min, t);
+            }
+        }
+
+        cycles_t avg = total / (MAX_COUNT - MAX_COUNT / 10);
+        printf("batch %3u: round-trip avg %"PRIuCYCLES" min %"PRIuCYCLES
+               " cycles, %"PRIuCYCLES" cycles/msg\n", batch, avg, min,
+               avg / batch);
+    }
+}
@@ -59,14 +59,17 @@ static void bind_cb(void *st, errval_t binderr, struct bench_binding *b)
     struct ump_chan_state *send = &chan->send_chan;
     struct ump_chan_state *recv = &chan->endpoint.chan;
 
-    /* Wait for and reply to msgs */
+    /* Wait for and reply to msgs, one reply per message received */
     while (1) {
-        volatile struct ump_message *msg;
-        struct ump_control ctrl;
-        while (!(msg = ump_impl_recv(recv)));
-        ump_impl_free_message(msg);
-        while (!(msg = ump_impl_get_next(send, &ctrl)));
-        msg->header.control = ctrl;
+        volatile struct ump_message *msgs[NUM_MSGS];
+        struct ump_control ctrls[NUM_MSGS];
+        ump_index_t pending, n;
+        while (!(pending = ump_impl_recv_batch(recv, msgs, NUM_MSGS)));
+        ump_impl_free_batch(msgs, pending);
+        for (; pending > 0; pending -= n) {
+            while (!(n = ump_impl_get_next_batch(send, msgs, ctrls, pending)));
+            ump_impl_publish_batch(msgs, ctrls, n);
+        }
     }
 }
 
@@ -104,7 +107,9 @@ int main(int argc, char *argv[])
 
     bench_init();
 
-    if (argc == 1) { /* bsp core */
+    if (argc < 2 || strcmp(argv[1], "dummy") != 0) { /* bsp core */
+        /* Optional argument: UMP ring size in bytes per direction */
+        char *buflen = argc > 1 ? argv[1] : "0";
 
         /* 1. spawn domains,
            2. setup a server,
@@ -112,7 +117,7 @@ int main(int argc, char *argv[])
            4. run experiments
         */
         // Spawn domains
-        char *xargv[] = {my_name, "dummy", NULL};
+        char *xargv[] = {my_name, "dummy", buflen, NULL};
         err = spawn_program_on_all_cores(false, xargv[0], xargv, NULL,
                                          SPAWN_FLAGS_DEFAULT, NULL, &num_cores);
         DEBUG_ERR(err, "spawn program on all cores (%"PRIuCOREID")", num_cores);
@@ -126,6 +131,15 @@ int main(int argc, char *argv[])
         /* Connect to the server */
         iref_t iref;
 
+        size_t buflen = argc > 2 ? strtoul(argv[2], NULL, 0) : 0;
+        if (buflen != 0) {
+            err = ump_chan_set_default_buflen(buflen);
+            if (err_is_fail(err)) {
+                DEBUG_ERR(err, "invalid UMP ring size %zu", buflen);
+                abort();
+            }
+        }
+
         err = nameservice_blocking_lookup("ump_server", &iref);
         if (err_is_fail(err)) {
             DEBUG_ERR(err, "nameservice_blocking_lookup failed");
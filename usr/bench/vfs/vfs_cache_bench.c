@@ -0,0 +1,171 @@
+/**
+ * \file
+ * \brief Block cache benchmark for vfs
+ *
+ * Runs a number of threads that look up blocks in one shared fs_cache the way
+ * vfs_fat does: acquire, and on a miss allocate and put the block, then
+ * release it. Keys are drawn from a skewed distribution, so that a small set
+ * of hot blocks fits in the cache while the rest causes evictions. Reports
+ * lookups per second and the cache's hit, miss and eviction counters.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <barrelfish/barrelfish.h>
+#include <barrelfish/threads.h>
+#include <bench/bench.h>
+#include "vfs_cache.h"
+
+#define DEFAULT_THREADS     4
+#define DEFAULT_OPS         1000000
+#define CACHE_CAPACITY      (1 << 7)    ///< Same as the vfs_fat caches
+#define CACHE_MAP_SIZE      (1 << 8)
+#define KEY_RANGE           (CACHE_CAPACITY * 8)
+#define HOT_KEYS            (CACHE_CAPACITY / 2)
+#define HOT_PERCENT         90          ///< Share of lookups to hot keys
+#define BLOCK_SIZE          512
+
+static struct fs_cache *cache;
+static size_t ops_per_thread;
+
+struct worker {
+    struct thread *thread;
+    uint32_t seed;
+    size_t full;                ///< Puts that failed because of FS_CACHE_FULL
+};
+
+static uint32_t next_random(uint32_t *seed)
+{
+    // xorshift32
+    uint32_t x = *seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *seed = x;
+}
+
+static int worker_run(void *arg)
+{
+    struct worker *w = arg;
+    errval_t err;
+
+    for (size_t i = 0; i < ops_per_thread; i++) {
+        uint32_t r = next_random(&w->seed);
+        uint32_t key = (r % 100 < HOT_PERCENT) ? (r >> 8) % HOT_KEYS
+                                              : (r >> 8) % KEY_RANGE;
+        uint32_t *block;
+
+        err = fs_cache_acquire(cache, key, (void **)&block);
+        if (err == FS_CACHE_NOTPRESENT) {
+            block = malloc(BLOCK_SIZE);
+            if (block == NULL) {
+                USER_PANIC("malloc failed");
+            }
+            block[0] = key;
+
+            err = fs_cache_put(cache, key, block);
+            if (err_is_fail(err)) {
+                free(block);
+                if (err == FS_CACHE_FULL) {
+                    w->full++;
+                    continue;
+                }
+                if (err != FS_CACHE_CONFLICT) {
+                    USER_PANIC_ERR(err, "fs_cache_put");
+                }
+                err = fs_cache_acquire(cache, key, (void **)&block);
+                if (err_is_fail(err)) {
+                    continue;
+                }
+            }
+        } else if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "fs_cache_acquire");
+        }
+
+        if (block[0] != key) {
+            USER_PANIC("key %" PRIu32 ": got block %" PRIu32, key, block[0]);
+        }
+
+        err = fs_cache_release(cache, key);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "fs_cache_release");
+        }
+    }
+
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [threads] [ops per thread]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    errval_t err;
+
+    bench_init();
+
+    int nthreads = argc > 1 ? atoi(argv[1]) : DEFAULT_THREADS;
+    ops_per_thread = argc > 2 ? atol(argv[2]) : DEFAULT_OPS;
+    if (argc > 3 || nthreads <= 0 || ops_per_thread == 0) {
+        usage(argv[0]);
+    }
+
+    err = fs_cache_init(CACHE_CAPACITY, CACHE_MAP_SIZE, &cache);
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "fs_cache_init");
+    }
+
+    struct worker *workers = calloc(nthreads, sizeof(*workers));
+    if (workers == NULL) {
+        USER_PANIC("calloc failed");
+    }
+
+    cycles_t start = bench_tsc();
+    for (int i = 0; i < nthreads; i++) {
+        workers[i].seed = 0x9e3779b9 * (i + 1);
+        workers[i].thread = thread_create(worker_run, &workers[i]);
+        if (workers[i].thread == NULL) {
+            USER_PANIC("thread_create failed");
+        }
+    }
+
+    size_t full = 0;
+    for (int i = 0; i < nthreads; i++) {
+        err = thread_join(workers[i].thread, NULL);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "thread_join");
+        }
+        full += workers[i].full;
+    }
+    uint64_t ms = bench_tsc_to_ms(bench_time_diff(start, bench_tsc()));
+
+    struct fs_cache_stats stats;
+    fs_cache_get_stats(cache, &stats);
+
+    size_t ops = ops_per_thread * nthreads;
+    printf("vfs_cache_bench: %d threads, %zu lookups in %" PRIu64 " ms, %"
+           PRIu64 " lookups/s\n", nthreads, ops, ms,
+           ms == 0 ? 0 : (uint64_t)ops * 1000 / ms);
+    printf("vfs_cache_bench: %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64
+           " evictions, %zu full\n", stats.hits, stats.misses,
+           stats.evictions, full);
+
+    fs_cache_free(cache);
+    free(workers);
+
+    printf("vfs_cache_bench: done\n");
+    return EXIT_SUCCESS;
+}
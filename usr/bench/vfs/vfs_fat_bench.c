@@ -0,0 +1,143 @@
+/**
+ * \file
+ * \brief Read throughput benchmark for vfs_fat
+ *
+ * Mounts a FAT file system and reads an existing file on it, sequentially
+ * with small and large requests and then with small requests at random
+ * offsets, which defeats read-ahead. The file should be much larger than the
+ * cluster cache, so that every phase has to go to the device. Reports KiB/s
+ * for every phase.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <barrelfish/barrelfish.h>
+#include <bench/bench.h>
+#include <vfs/vfs.h>
+
+#define DEFAULT_URI         "fat32://0+0"
+#define MOUNTPOINT          "/fat"
+#define SMALL_REQUEST       (4 * 1024)
+#define LARGE_REQUEST       (256 * 1024)
+#define MB                  (1024 * 1024)
+
+static void report(const char *phase, size_t bytes, cycles_t cycles)
+{
+    uint64_t ms = bench_tsc_to_ms(cycles);
+    printf("vfs_fat_bench: %-12s %zu KiB in %" PRIu64 " ms, %" PRIu64
+           " KiB/s\n", phase, bytes / 1024, ms,
+           ms == 0 ? 0 : (uint64_t)bytes / 1024 * 1000 / ms);
+}
+
+static void read_file(const char *path, const char *phase, size_t size,
+                      size_t reqsize, bool random)
+{
+    errval_t err;
+    vfs_handle_t handle;
+
+    uint8_t *buf = malloc(reqsize);
+    if (buf == NULL) {
+        USER_PANIC("malloc failed");
+    }
+
+    err = vfs_open(path, &handle);
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "vfs_open %s", path);
+    }
+
+    size_t requests = size / reqsize;
+    cycles_t start = bench_tsc();
+    for (size_t i = 0; i < requests; i++) {
+        size_t bytes_read;
+
+        if (random) {
+            size_t pos = (rand() % requests) * reqsize;
+            err = vfs_seek(handle, VFS_SEEK_SET, pos);
+            if (err_is_fail(err)) {
+                USER_PANIC_ERR(err, "vfs_seek to %zu", pos);
+            }
+        }
+
+        err = vfs_read(handle, buf, reqsize, &bytes_read);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "vfs_read");
+        }
+        if (bytes_read != reqsize) {
+            USER_PANIC("short read: %zu of %zu bytes", bytes_read, reqsize);
+        }
+    }
+    cycles_t cycles = bench_time_diff(start, bench_tsc());
+
+    vfs_close(handle);
+    report(phase, requests * reqsize, cycles);
+    free(buf);
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s <file> [uri]\n", prog);
+    printf("  file is relative to the FAT root, uri defaults to "
+           DEFAULT_URI "\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    errval_t err;
+
+    vfs_init();
+    bench_init();
+
+    if (argc < 2 || argc > 3) {
+        usage(argv[0]);
+    }
+    const char *uri = argc > 2 ? argv[2] : DEFAULT_URI;
+
+    vfs_mkdir(MOUNTPOINT);
+    err = vfs_mount(MOUNTPOINT, uri);
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "vfs_mount %s", uri);
+    }
+
+    char *path = malloc(strlen(MOUNTPOINT) + strlen(argv[1]) + 2);
+    if (path == NULL) {
+        USER_PANIC("malloc failed");
+    }
+    sprintf(path, "%s/%s", MOUNTPOINT, argv[1]);
+
+    vfs_handle_t handle;
+    struct vfs_fileinfo info;
+    err = vfs_open(path, &handle);
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "vfs_open %s", path);
+    }
+    err = vfs_stat(handle, &info);
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "vfs_stat %s", path);
+    }
+    vfs_close(handle);
+
+    size_t size = info.size - info.size % LARGE_REQUEST;
+    if (size == 0) {
+        USER_PANIC("%s is smaller than %d bytes", path, LARGE_REQUEST);
+    }
+    printf("vfs_fat_bench: reading %zu MiB of %s\n", size / MB, path);
+
+    read_file(path, "seq 4k", size, SMALL_REQUEST, false);
+    read_file(path, "seq 256k", size, LARGE_REQUEST, false);
+    read_file(path, "random 4k", size / 16, SMALL_REQUEST, true);
+
+    free(path);
+    printf("vfs_fat_bench: done\n");
+    return EXIT_SUCCESS;
+}
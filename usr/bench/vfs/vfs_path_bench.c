@@ -0,0 +1,174 @@
+/**
+ * \file
+ * \brief Path lookup benchmark for vfs
+ *
+ * Builds a directory chain of the given depth with a number of files at the
+ * bottom, then repeatedly opens and stats every file by its full path. A
+ * second phase creates and removes a file in the same directory between
+ * lookups, which changes the namespace and defeats any lookup caching.
+ * Reports cycles per open/stat/close for both phases.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <barrelfish/barrelfish.h>
+#include <bench/bench.h>
+#include <vfs/vfs.h>
+
+#define DEFAULT_DEPTH       8
+#define DEFAULT_FILES       16
+#define DEFAULT_ROUNDS      100
+
+#define BASEDIR             "/vfs_path_bench"
+#define NAME_LEN            16      ///< Max length of one path component
+
+static char *file_path(const char *dir, int i)
+{
+    char *path = malloc(strlen(dir) + NAME_LEN + 2);
+    if (path == NULL) {
+        USER_PANIC("malloc failed");
+    }
+    sprintf(path, "%s/file%d", dir, i);
+    return path;
+}
+
+static void open_stat_close(const char *path)
+{
+    errval_t err;
+    vfs_handle_t handle;
+    struct vfs_fileinfo info;
+
+    err = vfs_open(path, &handle);
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "vfs_open %s", path);
+    }
+    err = vfs_stat(handle, &info);
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "vfs_stat %s", path);
+    }
+    err = vfs_close(handle);
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "vfs_close %s", path);
+    }
+}
+
+static cycles_t run_lookups(char **files, int nfiles, int rounds,
+                            const char *scratch)
+{
+    errval_t err;
+    cycles_t total = 0;
+
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < nfiles; i++) {
+            if (scratch != NULL) {
+                vfs_handle_t handle;
+                err = vfs_create(scratch, &handle);
+                if (err_is_fail(err)) {
+                    USER_PANIC_ERR(err, "vfs_create %s", scratch);
+                }
+                vfs_close(handle);
+                err = vfs_remove(scratch);
+                if (err_is_fail(err)) {
+                    USER_PANIC_ERR(err, "vfs_remove %s", scratch);
+                }
+            }
+
+            cycles_t start = bench_tsc();
+            open_stat_close(files[i]);
+            total += bench_time_diff(start, bench_tsc());
+        }
+    }
+
+    return total / ((cycles_t)rounds * nfiles);
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [depth] [files] [rounds]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    errval_t err;
+
+    vfs_init();
+    bench_init();
+
+    int depth = argc > 1 ? atoi(argv[1]) : DEFAULT_DEPTH;
+    int nfiles = argc > 2 ? atoi(argv[2]) : DEFAULT_FILES;
+    int rounds = argc > 3 ? atoi(argv[3]) : DEFAULT_ROUNDS;
+    if (argc > 4 || depth < 0 || nfiles <= 0 || rounds <= 0) {
+        usage(argv[0]);
+    }
+
+    // build the directory chain
+    char *dir = malloc(sizeof(BASEDIR) + depth * NAME_LEN);
+    if (dir == NULL) {
+        USER_PANIC("malloc failed");
+    }
+    strcpy(dir, BASEDIR);
+    err = vfs_mkdir(dir);
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "vfs_mkdir %s", dir);
+    }
+    for (int d = 0; d < depth; d++) {
+        sprintf(dir + strlen(dir), "/dir%d", d);
+        err = vfs_mkdir(dir);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "vfs_mkdir %s", dir);
+        }
+    }
+
+    char **files = malloc(nfiles * sizeof(char *));
+    if (files == NULL) {
+        USER_PANIC("malloc failed");
+    }
+    for (int i = 0; i < nfiles; i++) {
+        vfs_handle_t handle;
+        files[i] = file_path(dir, i);
+        err = vfs_create(files[i], &handle);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "vfs_create %s", files[i]);
+        }
+        vfs_close(handle);
+    }
+    char *scratch = file_path(dir, nfiles);
+
+    cycles_t stable = run_lookups(files, nfiles, rounds, NULL);
+    cycles_t changing = run_lookups(files, nfiles, rounds, scratch);
+
+    printf("vfs_path_bench: depth %d, %d files, %d rounds\n", depth, nfiles,
+           rounds);
+    printf("vfs_path_bench: stable namespace:   %" PRIuCYCLES
+           " cycles/lookup\n", stable);
+    printf("vfs_path_bench: changing namespace: %" PRIuCYCLES
+           " cycles/lookup\n", changing);
+
+    // clean up
+    for (int i = 0; i < nfiles; i++) {
+        vfs_remove(files[i]);
+        free(files[i]);
+    }
+    free(files);
+    free(scratch);
+    for (int d = depth; d >= 0; d--) {
+        vfs_rmdir(dir);
+        char *sep = strrchr(dir, '/');
+        *sep = '\0';
+    }
+    free(dir);
+
+    printf("vfs_path_bench: done\n");
+    return EXIT_SUCCESS;
+}
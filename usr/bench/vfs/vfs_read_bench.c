@@ -0,0 +1,155 @@
+/**
+ * \file
+ * \brief Sequential file throughput benchmark for vfs
+ *
+ * Writes a file of the given size and reads it back sequentially, first with
+ * small and then with large requests, checking the data. On the root ramfs
+ * reads go through the frames mapped from ramfsd. Reports MiB/s for every
+ * phase.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <barrelfish/barrelfish.h>
+#include <bench/bench.h>
+#include <vfs/vfs.h>
+
+#define DEFAULT_FILENAME    "/vfs_read_bench"
+#define DEFAULT_SIZE_MB     1024
+#define SMALL_REQUEST       (64 * 1024)
+#define LARGE_REQUEST       (4 * 1024 * 1024)
+#define MB                  (1024 * 1024)
+
+static void report(const char *phase, size_t bytes, cycles_t cycles)
+{
+    uint64_t ms = bench_tsc_to_ms(cycles);
+    printf("vfs_read_bench: %-12s %zu MiB in %" PRIu64 " ms, %" PRIu64
+           " MiB/s\n", phase, bytes / MB, ms,
+           ms == 0 ? 0 : (uint64_t)bytes / MB * 1000 / ms);
+}
+
+static void fill(uint8_t *buf, size_t len, size_t offset)
+{
+    uint32_t *words = (uint32_t *)buf;
+    for (size_t i = 0; i < len / sizeof(uint32_t); i++) {
+        words[i] = (offset / sizeof(uint32_t)) + i;
+    }
+}
+
+static void read_file(const char *filename, const char *phase, size_t size,
+                      size_t reqsize)
+{
+    errval_t err;
+    vfs_handle_t handle;
+
+    uint8_t *buf = malloc(reqsize);
+    uint8_t *expected = malloc(reqsize);
+    if (buf == NULL || expected == NULL) {
+        USER_PANIC("malloc failed");
+    }
+
+    err = vfs_open(filename, &handle);
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "vfs_open %s", filename);
+    }
+
+    cycles_t cycles = 0;
+    for (size_t pos = 0; pos < size; pos += reqsize) {
+        size_t len = MIN(reqsize, size - pos);
+        size_t bytes_read;
+
+        cycles_t start = bench_tsc();
+        err = vfs_read(handle, buf, len, &bytes_read);
+        cycles += bench_time_diff(start, bench_tsc());
+
+        if (err_is_fail(err) && err_no(err) != VFS_ERR_EOF) {
+            USER_PANIC_ERR(err, "vfs_read at %zu", pos);
+        }
+        if (bytes_read != len) {
+            USER_PANIC("short read at %zu: %zu of %zu bytes", pos, bytes_read,
+                       len);
+        }
+
+        // check the first page of every request, to keep the check cheap
+        size_t check = MIN(len, BASE_PAGE_SIZE);
+        fill(expected, check, pos);
+        if (memcmp(buf, expected, check) != 0) {
+            USER_PANIC("bad data at %zu", pos);
+        }
+    }
+
+    vfs_close(handle);
+    report(phase, size, cycles);
+
+    free(buf);
+    free(expected);
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [size MB] [filename]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    errval_t err;
+    vfs_handle_t handle;
+
+    vfs_init();
+    bench_init();
+
+    size_t size = (argc > 1 ? atol(argv[1]) : DEFAULT_SIZE_MB) * MB;
+    const char *filename = argc > 2 ? argv[2] : DEFAULT_FILENAME;
+    if (argc > 3 || size == 0) {
+        usage(argv[0]);
+    }
+
+    uint8_t *buf = malloc(LARGE_REQUEST);
+    if (buf == NULL) {
+        USER_PANIC("malloc failed");
+    }
+
+    err = vfs_create(filename, &handle);
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "vfs_create %s", filename);
+    }
+
+    cycles_t cycles = 0;
+    for (size_t pos = 0; pos < size; pos += LARGE_REQUEST) {
+        size_t len = MIN(LARGE_REQUEST, size - pos), written;
+        fill(buf, len, pos);
+
+        cycles_t start = bench_tsc();
+        err = vfs_write(handle, buf, len, &written);
+        cycles += bench_time_diff(start, bench_tsc());
+
+        if (err_is_fail(err) || written != len) {
+            USER_PANIC_ERR(err, "vfs_write at %zu", pos);
+        }
+    }
+    vfs_close(handle);
+    free(buf);
+    report("write", size, cycles);
+
+    read_file(filename, "read 64k", size, SMALL_REQUEST);
+    read_file(filename, "read 4M", size, LARGE_REQUEST);
+
+    err = vfs_remove(filename);
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "vfs_remove %s", filename);
+    }
+
+    printf("vfs_read_bench: done\n");
+    return EXIT_SUCCESS;
+}
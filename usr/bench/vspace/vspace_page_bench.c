@@ -0,0 +1,112 @@
+/**
+ * \file
+ * \brief Page-granularity map/unmap throughput benchmark
+ *
+ * Maps a 1 GiB region one 4 KiB page at a time through the pmap interface,
+ * looks every page up again and unmaps it, which stresses the per-level
+ * vnode child lookup of the pmap. A second pass does the same with only one
+ * page per last-level page table to cover sparse tables.
+ */
+
+/*
+ * Copyright (c) 2016 ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetsstrasse 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+#include <stdio.h>
+#include <barrelfish/barrelfish.h>
+
+#include <bench/bench.h>
+
+#define REGION_SIZE     (1UL << 30)
+
+#define EXPECT_SUCCESS(err, msg) \
+    if (err_is_fail(err)) {USER_PANIC_ERR(err, msg);}
+
+static void report(const char *phase, size_t npages, cycles_t elapsed)
+{
+    uint64_t us = bench_tsc_to_us(elapsed);
+    debug_printf("%-12s %8zu pages %10" PRIuCYCLES " cycles/page "
+                 "%10" PRIu64 " pages/s\n", phase, npages, elapsed / npages,
+                 us == 0 ? 0 : (uint64_t)npages * 1000000 / us);
+}
+
+static void run(struct pmap *pmap, genvaddr_t base, struct capref frame,
+                size_t stride, const char *name)
+{
+    errval_t err;
+    cycles_t tsc_start, tsc_end;
+    size_t npages = REGION_SIZE / stride;
+    char phase[32];
+
+    tsc_start = bench_tsc();
+    for (genvaddr_t va = base; va < base + REGION_SIZE; va += stride) {
+        err = pmap->f.map(pmap, va, frame, 0, BASE_PAGE_SIZE,
+                          VREGION_FLAGS_READ_WRITE, NULL, NULL);
+        EXPECT_SUCCESS(err, "pmap map");
+    }
+    tsc_end = bench_tsc();
+    snprintf(phase, sizeof(phase), "%s map", name);
+    report(phase, npages, bench_time_diff(tsc_start, tsc_end));
+
+    tsc_start = bench_tsc();
+    for (genvaddr_t va = base; va < base + REGION_SIZE; va += stride) {
+        struct pmap_mapping_info info;
+        err = pmap->f.lookup(pmap, va, &info);
+        EXPECT_SUCCESS(err, "pmap lookup");
+    }
+    tsc_end = bench_tsc();
+    snprintf(phase, sizeof(phase), "%s lookup", name);
+    report(phase, npages, bench_time_diff(tsc_start, tsc_end));
+
+    tsc_start = bench_tsc();
+    for (genvaddr_t va = base; va < base + REGION_SIZE; va += stride) {
+        err = pmap->f.unmap(pmap, va, BASE_PAGE_SIZE, NULL);
+        EXPECT_SUCCESS(err, "pmap unmap");
+    }
+    tsc_end = bench_tsc();
+    snprintf(phase, sizeof(phase), "%s unmap", name);
+    report(phase, npages, bench_time_diff(tsc_start, tsc_end));
+}
+
+int main(int argc, char *argv[])
+{
+    errval_t err;
+
+    bench_init();
+
+    debug_printf("=======================================\n");
+    debug_printf("VSPACE page map benchmark started\n");
+    debug_printf("=======================================\n");
+
+    // reserve the virtual region with a lazily backed anonymous mapping,
+    // then populate it directly through the pmap
+    void *addr;
+    struct memobj *memobj;
+    struct vregion *vregion;
+    err = vspace_map_anon_aligned(&addr, &memobj, &vregion, REGION_SIZE, NULL,
+                                  VREGION_FLAGS_READ_WRITE, LARGE_PAGE_SIZE);
+    EXPECT_SUCCESS(err, "vspace reserve");
+
+    // all pages map the same frame, so we only pay for the meta-data
+    struct capref frame;
+    err = frame_alloc(&frame, BASE_PAGE_SIZE, NULL);
+    EXPECT_SUCCESS(err, "frame alloc");
+
+    struct pmap *pmap = get_current_pmap();
+    genvaddr_t base = vspace_lvaddr_to_genvaddr((lvaddr_t)addr);
+
+    run(pmap, base, frame, BASE_PAGE_SIZE, "dense");
+    run(pmap, base, frame, LARGE_PAGE_SIZE, "sparse");
+
+    err = vspace_unmap(addr);
+    EXPECT_SUCCESS(err, "vspace unmap");
+
+    debug_printf("=======================================\n");
+    debug_printf("benchmark done\n");
+    debug_printf("=======================================\n");
+    return EXIT_SUCCESS;
+}
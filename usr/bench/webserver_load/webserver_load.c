@@ -0,0 +1,263 @@
+/**
+ * \file
+ * \brief Load generator for the web server
+ *
+ * Keeps a number of HTTP/1.0 requests in flight, each one on its own
+ * connection, for URLs picked at random out of a large set of distinct
+ * ones, and reports the request rate and latency. With more distinct URLs
+ * than fit into the cache of the web server this measures the cost of
+ * lookups, misses and evictions rather than only the hit path.
+ *
+ * The URLs are /page000000.html, /page000001.html, ... which have to exist
+ * in the root of the NFS export served by the web server.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <barrelfish/barrelfish.h>
+#include <barrelfish/waitset.h>
+#include <lwip/init.h>
+#include <lwip/tcp.h>
+#include <lwip/ip_addr.h>
+#include <lwip/inet.h>
+#include <bench/bench.h>
+
+#define DEFAULT_URLS        100000
+#define DEFAULT_REQUESTS    1000000
+#define DEFAULT_CONCURRENCY 16
+#define HTTP_PORT           80
+
+#define URL_FORMAT          "GET /page%06u.html HTTP/1.0\r\n\r\n"
+#define STATUS_OK           "HTTP/1.0 200"
+
+/// one request in flight
+struct load_conn {
+    struct tcp_pcb *pcb;
+    cycles_t start;             ///< when the connection was opened
+    size_t received;            ///< bytes of the reply received so far
+    char status[sizeof(STATUS_OK)]; ///< start of the status line
+    char request[64];           ///< request to send
+    size_t request_len;
+};
+
+static struct ip_addr server_ip;
+static uint32_t urls = DEFAULT_URLS;
+static uint64_t requests = DEFAULT_REQUESTS;
+
+static uint64_t started = 0;
+static uint64_t completed = 0;
+static uint64_t not_found = 0;
+static uint64_t failed = 0;
+static uint64_t bytes = 0;
+static cycles_t lat_total = 0, lat_min = (cycles_t)-1, lat_max = 0;
+
+static uint64_t rand_state = 88172645463325252ULL;
+
+/* xorshift, good enough for picking URLs */
+static uint32_t next_url(void)
+{
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 7;
+    rand_state ^= rand_state << 17;
+    return (uint32_t)(rand_state % urls);
+}
+
+static void start_request(struct load_conn *lc);
+
+static void finish_request(struct load_conn *lc, bool ok)
+{
+    if (lc->pcb != NULL) {
+        tcp_arg(lc->pcb, NULL);
+        tcp_recv(lc->pcb, NULL);
+        tcp_err(lc->pcb, NULL);
+        tcp_close(lc->pcb);
+        lc->pcb = NULL;
+    }
+
+    if (!ok) {
+        failed++;
+    } else {
+        cycles_t t = bench_time_diff(lc->start, bench_tsc());
+        lat_total += t;
+        lat_min = MIN(lat_min, t);
+        lat_max = MAX(lat_max, t);
+        if (strncmp(lc->status, STATUS_OK, strlen(STATUS_OK)) != 0) {
+            not_found++;
+        }
+    }
+    completed++;
+
+    if (started < requests) {
+        start_request(lc);
+    }
+}
+
+static err_t load_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p,
+                       err_t err)
+{
+    struct load_conn *lc = arg;
+
+    if (p == NULL) {
+        // the server closes the connection after the reply
+        finish_request(lc, true);
+        return ERR_OK;
+    }
+
+    for (struct pbuf *pb = p; pb != NULL; pb = pb->next) {
+        if (lc->received < sizeof(lc->status) - 1) {
+            size_t n = MIN(pb->len, sizeof(lc->status) - 1 - lc->received);
+            memcpy(lc->status + lc->received, pb->payload, n);
+        }
+        lc->received += pb->len;
+    }
+    bytes += p->tot_len;
+
+    tcp_recved(pcb, p->tot_len);
+    pbuf_free(p);
+
+    return ERR_OK;
+}
+
+static void load_err(void *arg, err_t err)
+{
+    struct load_conn *lc = arg;
+
+    // the pcb is already freed by lwip
+    lc->pcb = NULL;
+    finish_request(lc, false);
+}
+
+static err_t load_connected(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+    struct load_conn *lc = arg;
+
+    if (err == ERR_OK) {
+        tcp_recv(pcb, load_recv);
+        err = tcp_write(pcb, lc->request, lc->request_len,
+                        TCP_WRITE_FLAG_COPY);
+    }
+    if (err != ERR_OK) {
+        tcp_err(pcb, NULL);
+        tcp_abort(pcb);
+        lc->pcb = NULL;
+        finish_request(lc, false);
+        return ERR_ABRT;
+    }
+    tcp_output(pcb);
+
+    return ERR_OK;
+}
+
+static void start_request(struct load_conn *lc)
+{
+    started++;
+
+    lc->received = 0;
+    memset(lc->status, 0, sizeof(lc->status));
+    lc->request_len = snprintf(lc->request, sizeof(lc->request), URL_FORMAT,
+                               next_url());
+    lc->start = bench_tsc();
+
+    lc->pcb = tcp_new();
+    if (lc->pcb == NULL) {
+        USER_PANIC("tcp_new failed");
+    }
+    tcp_arg(lc->pcb, lc);
+    tcp_err(lc->pcb, load_err);
+
+    err_t err = tcp_connect(lc->pcb, &server_ip, HTTP_PORT, load_connected);
+    if (err != ERR_OK) {
+        USER_PANIC("tcp_connect failed: %d", err);
+    }
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s ServerIP [urls] [requests] [concurrency]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    errval_t err;
+
+    bench_init();
+
+    if (argc < 2 || argc > 5) {
+        usage(argv[0]);
+    }
+
+    struct in_addr addr;
+    if (inet_aton(argv[1], &addr) == 0) {
+        printf("Invalid IP addr: %s\n", argv[1]);
+        usage(argv[0]);
+    }
+    server_ip.addr = addr.s_addr;
+
+    if (argc > 2) {
+        urls = strtoul(argv[2], NULL, 10);
+    }
+    if (argc > 3) {
+        requests = strtoull(argv[3], NULL, 10);
+    }
+    uint32_t concurrency = argc > 4 ? strtoul(argv[4], NULL, 10)
+                                    : DEFAULT_CONCURRENCY;
+    if (urls == 0 || requests == 0 || concurrency == 0) {
+        usage(argv[0]);
+    }
+    concurrency = MIN(concurrency, requests);
+
+    if (lwip_init_auto() == false) {
+        USER_PANIC("lwip_init_auto failed");
+    }
+
+    struct load_conn *conns = calloc(concurrency, sizeof(*conns));
+    assert(conns != NULL);
+
+    printf("webserver_load: %" PRIu64 " requests for %u URLs, %u in flight\n",
+           requests, urls, concurrency);
+
+    cycles_t start = bench_tsc();
+    for (uint32_t i = 0; i < concurrency; i++) {
+        start_request(&conns[i]);
+    }
+
+    struct waitset *ws = get_default_waitset();
+    while (completed < requests) {
+        wrapper_perform_lwip_work();
+        err = event_dispatch(ws);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "event_dispatch");
+        }
+    }
+    cycles_t elapsed = bench_time_diff(start, bench_tsc());
+
+    uint64_t us = bench_tsc_to_us(elapsed);
+    uint64_t ok = completed - failed;
+    printf("webserver_load: %" PRIu64 " ok (%" PRIu64 " not found), %" PRIu64
+           " failed, %" PRIu64 " kB in %" PRIu64 " ms\n", ok, not_found,
+           failed, bytes / 1024, us / 1000);
+    if (us > 0) {
+        printf("webserver_load: %" PRIu64 " requests/s\n",
+               completed * 1000000 / us);
+    }
+    if (ok > 0) {
+        printf("webserver_load: latency avg=%" PRIu64 " us min=%" PRIu64
+               " us max=%" PRIu64 " us\n", bench_tsc_to_us(lat_total / ok),
+               bench_tsc_to_us(lat_min), bench_tsc_to_us(lat_max));
+    }
+
+    free(conns);
+
+    return EXIT_SUCCESS;
+}
@@ -21,8 +21,11 @@
 #include <barrelfish/dispatcher_arch.h>
 #include <barrelfish/lmp_endpoints.h>
 #include <barrelfish/event_queue.h>
+#include <barrelfish/deferred.h>
 #include <barrelfish/nameservice_client.h>
 #include <trace/trace.h>
+#include <trace/trace_stream.h>
+#include <vfs/vfs.h>
 
 #include <flounder/flounder.h>
 #include <if/monitor_defs.h>
@@ -41,6 +44,9 @@
 
 #define BFSCOPE_BUFLEN (2<<20)
 
+/// Time between two drains of the trace buffers to a file
+#define BFSCOPE_STREAM_INTERVAL_US 10000
+
 extern struct waitset *lwip_waitset;
 
 static char *trace_buf = NULL;
@@ -58,6 +64,12 @@ static struct tcp_pcb *bfscope_client = NULL;
 /// that case, we don't want to notify anyone after doing a locally initiated flush.
 static bool local_flush = false;
 
+/// Is the client receiving a continuous stream instead of trace dumps?
+static bool streaming = false;
+
+/// State of the stream sent to the client
+static struct trace_stream stream;
+
 
 #define DEBUG if (0) printf
 
@@ -71,6 +83,7 @@ static void bfscope_connection_close(struct tcp_pcb *tpcb)
     DEBUG("bfscope: close\n");
     printf("%s:%s:%d:\n", __FILE__, __FUNCTION__, __LINE__);
     trace_length = 0;
+    streaming = false;
     //tcp_arg(tpcb, NULL);
     //tcp_close(tpcb);
     //bfscope_client = NULL;
@@ -235,6 +248,79 @@ static void bfscope_trace_dump(void)
     }
 }
 
+/*
+ * \brief Send the events recorded since the last chunk to the client
+ */
+static void bfscope_trace_stream(void)
+{
+    if (dump_in_progress || bfscope_client == NULL) {
+        return;
+    }
+
+    trace_length = trace_stream_drain(&stream, (uint8_t *)trace_buf,
+                                      BFSCOPE_BUFLEN);
+    if (trace_length == 0) {
+        return;
+    }
+
+    dump_in_progress = true;
+    local_flush = true;
+    trace_sent = 0;
+
+    bfscope_trace_send(bfscope_client);
+
+    tcp_output(bfscope_client);
+}
+
+/*
+ * \brief Stream the trace buffers into a file until bfscope is killed
+ */
+static int bfscope_stream_file(const char *path)
+{
+    errval_t err;
+    vfs_handle_t vh;
+
+    vfs_init();
+
+    err = vfs_create(path, &vh);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "vfs_create %s", path);
+        return EXIT_FAILURE;
+    }
+
+    err = trace_start_continuous();
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "trace_start_continuous");
+        return EXIT_FAILURE;
+    }
+
+    printf("bfscope: streaming trace to %s\n", path);
+
+    trace_stream_init(&stream);
+    while (1) {
+        size_t length = trace_stream_drain(&stream, (uint8_t *)trace_buf,
+                                           BFSCOPE_BUFLEN);
+        size_t written = 0;
+        while (written < length) {
+            size_t bytes;
+            err = vfs_write(vh, trace_buf + written, length - written, &bytes);
+            if (err_is_fail(err)) {
+                DEBUG_ERR(err, "vfs_write");
+                vfs_close(vh);
+                return EXIT_FAILURE;
+            }
+            written += bytes;
+        }
+
+        if (length < BFSCOPE_BUFLEN / 2) {
+            vfs_flush(vh);
+            barrelfish_usleep(BFSCOPE_STREAM_INTERVAL_US);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
 /*
  * \brief Callback from LWIP when we receive TCP data
  */
@@ -260,6 +346,15 @@ static err_t recv_cb(void *arg, struct tcp_pcb *tpcb, struct pbuf *p,
 
             // NOOP
 
+        } else if (strncmp(p->payload, "stream", strlen("stream")) == 0) {
+
+            DEBUG("bfscope: stream request\n");
+
+            if (!streaming && err_is_ok(trace_start_continuous())) {
+                trace_stream_init(&stream);
+                streaming = true;
+            }
+
         } else {
             DEBUG("bfscope: could not understand request\n");
         }
@@ -335,6 +430,12 @@ static void bfscope_handle_flush_msg(struct monitor_binding *mb, iref_t iref)
 {
     printf("bfscope flush request message received!\n");
 
+    if (streaming) {
+        // The events reach the client with the stream anyway
+        bfscope_send_flush_ack_to_monitor();
+        return;
+    }
+
     bfscope_trace_dump();
 }
 
@@ -430,6 +531,11 @@ int main(int argc, char**argv)
     struct dispatcher_generic *disp = get_dispatcher_generic(handle);
     disp->trace_buf = NULL;
 
+    /* bfscope stream <file>: write a continuous stream instead of serving */
+    if (argc == 3 && strcmp(argv[1], "stream") == 0) {
+        return bfscope_stream_file(argv[2]);
+    }
+
     printf("%.*s running on core %d\n", DISP_NAME_LEN, disp_name(),
            disp_get_core_id());
 
@@ -471,7 +577,9 @@ int main(int argc, char**argv)
         DEBUG("bfscope: dispatched event, autoflush: %d\n",((struct trace_buffer*) trace_buffer_master)->autoflush);
 
         // Check if we are in autoflush mode
-        if(((struct trace_buffer*) trace_buffer_master)->autoflush) {
+        if (streaming) {
+            bfscope_trace_stream();
+        } else if(((struct trace_buffer*) trace_buffer_master)->autoflush) {
             local_flush = true;
             bfscope_trace_dump();
         }
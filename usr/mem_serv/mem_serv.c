@@ -133,7 +133,8 @@ static errval_t mymm_free(struct capref ramcap, genpaddr_t base, uint8_t bits)
 struct pending_reply {
     struct mem_binding *b;
     errval_t err;
-    struct capref *cap;
+    struct capref *cap;     ///< Cap, or array of caps for batched replies
+    uint8_t allocated;      ///< Number of caps allocated in a batch
 };
 
 
@@ -196,6 +197,54 @@ static void retry_reply(void *arg)
 
 
 
+static void allocate_batch_response_done(void *arg)
+{
+    struct capref *caps = arg;
+
+    for (int i = 0; i < RAM_ALLOC_BATCH_MAX; i++) {
+        if(!capref_is_null(caps[i])) {
+            errval_t err = cap_delete(caps[i]);
+            if(err_is_fail(err) && err_no(err) != SYS_ERR_CAP_NOT_FOUND) {
+                DEBUG_ERR(err, "cap_delete after send. This memory will leak.");
+            }
+        }
+    }
+
+    free(caps);
+}
+
+static errval_t send_allocate_batch_reply(struct mem_binding *b, errval_t ret,
+                                          uint8_t allocated,
+                                          struct capref *caps)
+{
+    return b->tx_vtbl.allocate_batch_response(b,
+                MKCONT(allocate_batch_response_done, caps), ret, allocated,
+                caps[0], caps[1], caps[2], caps[3], caps[4], caps[5], caps[6],
+                caps[7]);
+}
+
+static void retry_batch_reply(void *arg)
+{
+    struct pending_reply *r = arg;
+    assert(r != NULL);
+    struct mem_binding *b = r->b;
+    errval_t err;
+
+    err = send_allocate_batch_reply(b, r->err, r->allocated, r->cap);
+    if (err_is_ok(err)) {
+        b->st = NULL;
+        free(r);
+    } else if (err_no(err) == FLOUNDER_ERR_TX_BUSY) {
+        err = b->register_send(b, get_default_waitset(),
+                               MKCONT(retry_batch_reply,r));
+        assert(err_is_ok(err));
+    } else {
+        DEBUG_ERR(err, "failed to reply to memory request");
+        allocate_batch_response_done(r->cap);
+        free(r);
+    }
+}
+
 static void mem_free_handler(struct mem_binding *b,
                              struct capref ramcap, genpaddr_t base,
                              uint8_t bits)
@@ -235,23 +284,9 @@ static void mem_available_handler(struct mem_binding *b)
 }
 
 // FIXME: error handling (not asserts) needed in this function
-static void mem_allocate_handler(struct mem_binding *b, uint8_t bits,
-                                 genpaddr_t minbase, genpaddr_t maxlimit)
+static void refill_allocator(void)
 {
-    struct capref *cap = malloc(sizeof(struct capref));
-    errval_t err, ret;
-
-    // TODO: do this properly and inform caller, -SG 2016-04-20
-    // XXX: Do we even want to have this restriction here? It's not necessary
-    // for types that are not mappable (e.g. Dispatcher)
-    //if (bits < BASE_PAGE_BITS) {
-    //    bits = BASE_PAGE_BITS;
-    //}
-    //if (bits < BASE_PAGE_BITS) {
-    //    debug_printf("WARNING: ALLOCATING RAM CAP WITH %u BITS\n", bits);
-    //}
-
-    trace_event(TRACE_SUBSYS_MEMSERV, TRACE_EVENT_MEMSERV_ALLOC, bits);
+    errval_t err;
 
     /* refill slot allocator if needed */
     err = slot_prealloc_refill(mm_ram.slot_alloc_inst);
@@ -275,6 +310,27 @@ static void mem_allocate_handler(struct mem_binding *b, uint8_t bits,
         }
         slab_grow(&mm_ram.slabs, buf, BASE_PAGE_SIZE * 8);
     }
+}
+
+static void mem_allocate_handler(struct mem_binding *b, uint8_t bits,
+                                 genpaddr_t minbase, genpaddr_t maxlimit)
+{
+    struct capref *cap = malloc(sizeof(struct capref));
+    errval_t err, ret;
+
+    // TODO: do this properly and inform caller, -SG 2016-04-20
+    // XXX: Do we even want to have this restriction here? It's not necessary
+    // for types that are not mappable (e.g. Dispatcher)
+    //if (bits < BASE_PAGE_BITS) {
+    //    bits = BASE_PAGE_BITS;
+    //}
+    //if (bits < BASE_PAGE_BITS) {
+    //    debug_printf("WARNING: ALLOCATING RAM CAP WITH %u BITS\n", bits);
+    //}
+
+    trace_event(TRACE_SUBSYS_MEMSERV, TRACE_EVENT_MEMSERV_ALLOC, bits);
+
+    refill_allocator();
 
     ret = mymm_alloc(cap, bits, minbase, maxlimit);
     if (err_is_ok(ret)) {
@@ -304,6 +360,58 @@ static void mem_allocate_handler(struct mem_binding *b, uint8_t bits,
     }
 }
 
+static void mem_allocate_batch_handler(struct mem_binding *b, uint8_t bits,
+                                       genpaddr_t minbase, genpaddr_t maxlimit,
+                                       uint8_t count)
+{
+    struct capref *caps = malloc(RAM_ALLOC_BATCH_MAX * sizeof(struct capref));
+    assert(caps != NULL);
+    errval_t err, ret = SYS_ERR_OK;
+    uint8_t allocated = 0;
+
+    trace_event(TRACE_SUBSYS_MEMSERV, TRACE_EVENT_MEMSERV_ALLOC, bits);
+
+    for (int i = 0; i < RAM_ALLOC_BATCH_MAX; i++) {
+        caps[i] = NULL_CAP;
+    }
+
+    count = MIN(count, RAM_ALLOC_BATCH_MAX);
+    while (allocated < count) {
+        refill_allocator();
+        ret = mymm_alloc(&caps[allocated], bits, minbase, maxlimit);
+        if (err_is_fail(ret)) {
+            caps[allocated] = NULL_CAP;
+            break;
+        }
+        mem_avail -= 1UL << bits;
+        allocated++;
+    }
+
+    // a partial batch is still a success
+    if (allocated > 0) {
+        ret = SYS_ERR_OK;
+    }
+
+    /* Reply */
+    err = send_allocate_batch_reply(b, ret, allocated, caps);
+    if (err_is_fail(err)) {
+        if (err_no(err) == FLOUNDER_ERR_TX_BUSY) {
+            struct pending_reply *r = malloc(sizeof(struct pending_reply));
+            assert(r != NULL);
+            r->b = b;
+            r->err = ret;
+            r->cap = caps;
+            r->allocated = allocated;
+            err = b->register_send(b, get_default_waitset(),
+                                   MKCONT(retry_batch_reply,r));
+            assert(err_is_ok(err));
+        } else {
+            DEBUG_ERR(err, "failed to reply to memory request");
+            allocate_batch_response_done(caps);
+        }
+    }
+}
+
 static void dump_ram_region(int idx, struct mem_region* m)
 {
 #if 0
@@ -486,6 +594,7 @@ static void export_callback(void *st, errval_t err, iref_t iref)
 
 static struct mem_rx_vtbl rx_vtbl = {
     .allocate_call = mem_allocate_handler,
+    .allocate_batch_call = mem_allocate_batch_handler,
     .available_call = mem_available_handler,
     .free_monitor_call = mem_free_handler,
 };
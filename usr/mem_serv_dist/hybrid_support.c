@@ -47,6 +47,7 @@ struct pending_reply {
     struct capref *acap, cap;
     memsize_t mem_avail, mem_total;
     errval_t err;
+    uint8_t allocated;
 };
 
 
@@ -64,6 +65,32 @@ static void allocate_response_done(void *arg)
     free(cap);
 }
 
+static void allocate_batch_response_done(void *arg)
+{
+    struct capref *caps = arg;
+
+    for (int i = 0; i < RAM_ALLOC_BATCH_MAX; i++) {
+        if(!capref_is_null(caps[i])) {
+            errval_t err = cap_delete(caps[i]);
+            if(err_is_fail(err)) {
+                DEBUG_ERR(err, "cap_delete after send. This memory will leak.");
+            }
+        }
+    }
+
+    free(caps);
+}
+
+static errval_t send_allocate_batch_reply(struct mem_binding *b, errval_t ret,
+                                          uint8_t allocated,
+                                          struct capref *caps)
+{
+    return b->tx_vtbl.allocate_batch_response(b,
+                MKCONT(allocate_batch_response_done, caps), ret, allocated,
+                caps[0], caps[1], caps[2], caps[3], caps[4], caps[5], caps[6],
+                caps[7]);
+}
+
 // The various send retry functions
 
 static void retry_allocate_reply(void *arg)
@@ -90,6 +117,30 @@ static void retry_allocate_reply(void *arg)
     }
 }
 
+static void retry_allocate_batch_reply(void *arg)
+{
+    struct pending_reply *r = arg;
+    assert(r != NULL);
+    struct mem_binding *b = r->b;
+    errval_t err;
+
+    err = send_allocate_batch_reply(b, r->err, r->allocated, r->acap);
+    if (err_is_ok(err)) {
+        b->st = NULL;
+        free(r);
+        return;
+    } else if (err_no(err) == FLOUNDER_ERR_TX_BUSY) {
+        err = b->register_send(b, get_default_waitset(),
+                               MKCONT(retry_allocate_batch_reply,r));
+    }
+
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "failed to reply to memory request");
+        allocate_batch_response_done(r->acap);
+        free(r);
+    }
+}
+
 static void retry_steal_reply(void *arg)
 {
     struct pending_reply *r = arg;
@@ -271,6 +322,55 @@ static void percore_allocate_handler(struct mem_binding *b,
     trace_event(TRACE_SUBSYS_MEMSERV, TRACE_EVENT_MEMSERV_PERCORE_ALLOC_COMPLETE, 0);
 }
 
+static void percore_allocate_batch_handler(struct mem_binding *b,
+                                           uint8_t bits, genpaddr_t minbase,
+                                           genpaddr_t maxlimit, uint8_t count)
+{
+    errval_t ret = SYS_ERR_OK;
+    uint8_t allocated = 0;
+    struct capref *caps = malloc(RAM_ALLOC_BATCH_MAX * sizeof(struct capref));
+    assert(caps != NULL);
+
+    for (int i = 0; i < RAM_ALLOC_BATCH_MAX; i++) {
+        caps[i] = NULL_CAP;
+    }
+
+    count = MIN(count, RAM_ALLOC_BATCH_MAX);
+    while (allocated < count) {
+        ret = percore_allocate_handler_common(bits, minbase, maxlimit,
+                                              &caps[allocated]);
+        if (err_is_fail(ret)) {
+            caps[allocated] = NULL_CAP;
+            break;
+        }
+        allocated++;
+    }
+
+    // a partial batch is still a success
+    if (allocated > 0) {
+        ret = SYS_ERR_OK;
+    }
+
+    errval_t err;
+    err = send_allocate_batch_reply(b, ret, allocated, caps);
+    if (err_is_fail(err)) {
+        if (err_no(err) == FLOUNDER_ERR_TX_BUSY) {
+            struct pending_reply *r = malloc(sizeof(struct pending_reply));
+            assert(r != NULL);
+            r->b = b;
+            r->err = ret;
+            r->acap = caps;
+            r->allocated = allocated;
+            err = b->register_send(b, get_default_waitset(),
+                                   MKCONT(retry_allocate_batch_reply,r));
+            assert(err_is_ok(err));
+        } else {
+            DEBUG_ERR(err, "failed to reply to memory request");
+            allocate_batch_response_done(caps);
+        }
+    }
+}
+
 
 // Various startup procedures
 
@@ -299,6 +399,7 @@ static void percore_export_callback(void *st, errval_t err, iref_t iref)
 
 static struct mem_rx_vtbl percore_rx_vtbl = {
     .allocate_call = percore_allocate_handler,
+    .allocate_batch_call = percore_allocate_batch_handler,
     .available_call = mem_available_handler,
     .free_monitor_call = percore_free_handler,
     .steal_call = percore_steal_handler,
@@ -71,6 +71,15 @@ static struct slot_prealloc percore_slot_alloc;
 
 static struct mm *mm_slots = &mm_percore;
 
+/// Magazine of free caps of a single size
+struct magazine {
+    size_t count;                       ///< Number of valid entries
+    struct mem_cap caps[MAGAZINE_SIZE]; ///< Cached caps, most recent last
+};
+
+/// Recently freed small caps, handed out again before asking mm_percore
+static struct magazine magazines[MAGAZINE_MAXBITS - MAGAZINE_MINBITS + 1];
+
 #if 0
 static void dump_ram_region(int index, struct mem_region* m)
 {
@@ -161,6 +170,47 @@ static errval_t do_free(struct mm *mm, struct capref ramcap,
     return SYS_ERR_OK;
 }
 
+static bool magazine_put(struct capref cap, genpaddr_t base, uint8_t bits)
+{
+    if (bits < MAGAZINE_MINBITS || bits > MAGAZINE_MAXBITS) {
+        return false;
+    }
+
+    struct magazine *mag = &magazines[bits - MAGAZINE_MINBITS];
+    if (mag->count == MAGAZINE_SIZE) {
+        return false;
+    }
+
+    mag->caps[mag->count].cap = cap;
+    mag->caps[mag->count].sizebits = bits;
+    mag->caps[mag->count].base = base;
+    mag->count++;
+
+    return true;
+}
+
+static bool magazine_get(struct capref *ret, uint8_t bits,
+                         genpaddr_t minbase, genpaddr_t maxlimit)
+{
+    if (bits < MAGAZINE_MINBITS || bits > MAGAZINE_MAXBITS) {
+        return false;
+    }
+
+    struct magazine *mag = &magazines[bits - MAGAZINE_MINBITS];
+    for (size_t i = mag->count; i > 0; i--) {
+        struct mem_cap *mc = &mag->caps[i - 1];
+        if (maxlimit != 0 && (mc->base < minbase
+                              || mc->base + ((memsize_t)1 << bits) > maxlimit)) {
+            continue;
+        }
+        *ret = mc->cap;
+        *mc = mag->caps[--mag->count];
+        return true;
+    }
+
+    return false;
+}
+
 static errval_t percore_free(struct capref ramcap)
 {
     struct capability info;
@@ -189,6 +239,12 @@ static errval_t percore_free(struct capref ramcap)
 errval_t percore_free_handler_common(struct capref ramcap, genpaddr_t base,
                                      uint8_t bits)
 {
+    // keep small caps around for the next allocation of the same size
+    if (magazine_put(ramcap, base, bits)) {
+        mem_avail += (memsize_t)1 << bits;
+        return SYS_ERR_OK;
+    }
+
     return do_free(&mm_percore, ramcap, base, bits, &mem_avail);
 }
 
@@ -227,6 +283,11 @@ static errval_t do_alloc(struct mm *mm, struct capref *ret, uint8_t bits,
 errval_t percore_alloc(struct capref *ret, uint8_t bits,
                               genpaddr_t minbase, genpaddr_t maxlimit)
 {
+    if (magazine_get(ret, bits, minbase, maxlimit)) {
+        mem_avail -= (memsize_t)1 << bits;
+        return SYS_ERR_OK;
+    }
+
     return do_alloc(&mm_percore, ret, bits, minbase, maxlimit, &mem_avail);
 }
 
@@ -470,9 +531,15 @@ static errval_t init_mm(struct mm *mm, char nodebuf[], memsize_t nodebuf_size,
     struct capability info;
 
     /* XXX Base shouldn't need to be 0 ? */
+#ifdef MEMSERV_BUDDY
+    /* keep the chunked caps, so freed buddies can be merged again */
+    err = mm_init_buddy(mm, ObjType_RAM, 0, MAXSIZEBITS, NULL,
+                        slot_alloc_prealloc, NULL, slot_alloc_inst, false);
+#else
     err = mm_init(mm, ObjType_RAM,
                   0, MAXSIZEBITS, MAXCHILDBITS, NULL,
                   slot_alloc_prealloc, NULL, slot_alloc_inst, true);
+#endif
     if (err_is_fail(err)) {
         return err_push(err, MM_ERR_MM_INIT);
     }
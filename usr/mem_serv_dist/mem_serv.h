@@ -24,6 +24,7 @@
 
 #define MEMSERV_PERCORE_DYNAMIC
 #define MEMSERV_AFFINITY
+#define MEMSERV_BUDDY      ///< Use the buddy backend of lib/mm
 
 // appropriate size type for available RAM
 typedef genpaddr_t memsize_t;
@@ -71,6 +72,11 @@ typedef genpaddr_t memsize_t;
 // size of initial RAM cap to fill allocator
 #define SMALLCAP_BITS 20
 
+/* Per-core magazines of recently freed caps, kept in front of the allocator */
+#define MAGAZINE_MINBITS  MINSIZEBITS   ///< Smallest size cached
+#define MAGAZINE_MAXBITS  16            ///< Largest size cached
+#define MAGAZINE_SIZE     32            ///< Caps cached per size
+
 
 /**
  * \brief Size of CNodes to be created by slot allocator.
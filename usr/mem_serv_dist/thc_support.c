@@ -88,6 +88,46 @@ static void percore_allocate_handler(struct mem_thc_service_binding_t *sv,
     trace_event(TRACE_SUBSYS_MEMSERV, TRACE_EVENT_MEMSERV_PERCORE_ALLOC_COMPLETE, 0);
 }
 
+static void percore_allocate_batch_handler(struct mem_thc_service_binding_t *sv,
+                                           uint8_t bits, genpaddr_t minbase,
+                                           genpaddr_t maxlimit, uint8_t count)
+{
+    errval_t ret = SYS_ERR_OK;
+    uint8_t allocated = 0;
+    struct capref caps[RAM_ALLOC_BATCH_MAX];
+
+    for (int i = 0; i < RAM_ALLOC_BATCH_MAX; i++) {
+        caps[i] = NULL_CAP;
+    }
+
+    count = MIN(count, RAM_ALLOC_BATCH_MAX);
+    while (allocated < count) {
+        ret = percore_allocate_handler_common(bits, minbase, maxlimit,
+                                              &caps[allocated]);
+        if (err_is_fail(ret)) {
+            caps[allocated] = NULL_CAP;
+            break;
+        }
+        allocated++;
+    }
+
+    // a partial batch is still a success
+    if (allocated > 0) {
+        ret = SYS_ERR_OK;
+    }
+
+    sv->send.allocate_batch(sv, ret, allocated, caps[0], caps[1], caps[2],
+                            caps[3], caps[4], caps[5], caps[6], caps[7]);
+    for (int i = 0; i < allocated; i++) {
+        errval_t err = cap_delete(caps[i]);
+        if(err_is_fail(err)) {
+            DEBUG_ERR(err, "cap_delete after send. This memory will leak.");
+        }
+    }
+
+    trace_event(TRACE_SUBSYS_MEMSERV, TRACE_EVENT_MEMSERV_PERCORE_ALLOC_COMPLETE, 0);
+}
+
 // Various startup procedures
 
 static void run_server(struct mem_thc_service_binding_t *sv)
@@ -98,6 +138,7 @@ static void run_server(struct mem_thc_service_binding_t *sv)
     // this is the bitmap of messages we are interested in receiving
     struct mem_service_selector selector = {
         .allocate = 1,
+        .allocate_batch = 1,
         .available = 1,
         .free = 1,
         .steal = 1,
@@ -114,6 +155,13 @@ static void run_server(struct mem_thc_service_binding_t *sv)
                                      msg.args.allocate.in.minbase,
                                      msg.args.allocate.in.maxlimit);
             break;
+        case mem_allocate_batch:
+            percore_allocate_batch_handler(sv,
+                                    msg.args.allocate_batch.in.bits,
+                                    msg.args.allocate_batch.in.minbase,
+                                    msg.args.allocate_batch.in.maxlimit,
+                                    msg.args.allocate_batch.in.count);
+            break;
         case mem_steal:
             percore_steal_handler(sv, msg.args.allocate.in.bits,
                                      msg.args.allocate.in.minbase,
@@ -1,6 +1,14 @@
 /**
  * \file
  * \brief Trivial RAMFS implementation
+ *
+ * File contents live in frames, so that clients can map them instead of
+ * having the data copied through the bulk transfer buffer. A file is a
+ * sequence of chunks, each backed by one frame: the first chunks double in
+ * size from one page, the remaining ones are all CHUNK_MAX_BITS large, so
+ * small files stay small and the chunk holding an offset is found in
+ * constant time. Once a chunk has been handed out to a client it is never
+ * written again; a later write first moves the chunk to a new frame.
  */
 
 /*
@@ -18,6 +26,18 @@
 #include <if/trivfs_defs.h>
 #include "ramfs.h"
 
+#define CHUNK_MIN_BITS  BASE_PAGE_BITS  ///< Size of the first chunk of a file
+#define CHUNK_MAX_BITS  20              ///< Size of all later chunks
+#define CHUNK_STEPS     (CHUNK_MAX_BITS - CHUNK_MIN_BITS) ///< Growing chunks
+
+/// Part of a file's contents, backed by one frame
+struct ramfs_chunk {
+    struct capref frame;    ///< Backing frame
+    uint8_t *buf;           ///< Local mapping of the frame
+    uint32_t id;            ///< Unique ID of this frame's contents
+    bool shared;            ///< ID handed to a client, change before writing
+};
+
 struct dirent {
     struct dirent *next;   ///< next entry in same directory
     struct dirent **prevp; ///< locn where the preceding child / parent links us
@@ -28,8 +48,9 @@ struct dirent {
     unsigned refcount;  ///< outstanding references (handles and/or ongoing IDCs)
     union {
         struct {
-            uint8_t *data;  ///< on heap
-            size_t size;    ///< size of data
+            struct ramfs_chunk *chunks; ///< on heap
+            size_t nchunks;     ///< number of allocated chunks
+            size_t size;        ///< size of data
         } file;
         struct {
             struct dirent *entries; ///< children of this dir
@@ -38,6 +59,141 @@ struct dirent {
     } u;
 };
 
+static uint32_t next_chunk_id = 1; ///< 0 is never a valid chunk ID
+
+static inline size_t chunk_bits(size_t idx)
+{
+    return idx < CHUNK_STEPS ? CHUNK_MIN_BITS + idx : CHUNK_MAX_BITS;
+}
+
+static inline size_t chunk_start(size_t idx)
+{
+    if (idx <= CHUNK_STEPS) {
+        return (((size_t)1 << idx) - 1) << CHUNK_MIN_BITS;
+    }
+    return chunk_start(CHUNK_STEPS) + ((idx - CHUNK_STEPS) << CHUNK_MAX_BITS);
+}
+
+/// Index of the chunk holding the given offset
+static inline size_t chunk_index(size_t offset)
+{
+    if (offset < chunk_start(CHUNK_STEPS)) {
+        return 63 - __builtin_clzll((offset >> CHUNK_MIN_BITS) + 1);
+    }
+    return CHUNK_STEPS
+        + ((offset - chunk_start(CHUNK_STEPS)) >> CHUNK_MAX_BITS);
+}
+
+static errval_t chunk_alloc(struct ramfs_chunk *c, size_t bits)
+{
+    errval_t err;
+
+    err = frame_alloc(&c->frame, (size_t)1 << bits, NULL);
+    if (err_is_fail(err)) {
+        return err_push(err, LIB_ERR_FRAME_ALLOC);
+    }
+
+    void *buf;
+    err = vspace_map_one_frame(&buf, (size_t)1 << bits, c->frame, NULL, NULL);
+    if (err_is_fail(err)) {
+        cap_destroy(c->frame);
+        return err_push(err, LIB_ERR_VSPACE_MAP);
+    }
+
+    c->buf = buf;
+    c->id = next_chunk_id++;
+    c->shared = false;
+    return SYS_ERR_OK;
+}
+
+static void chunk_free(struct ramfs_chunk *c)
+{
+    errval_t err = vspace_unmap(c->buf);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "vspace_unmap of file chunk");
+    }
+    cap_destroy(c->frame);
+}
+
+/// Give a chunk a new ID before writing to it if clients hold a copy
+static void chunk_modify(struct ramfs_chunk *c)
+{
+    if (c->shared) {
+        c->id = next_chunk_id++;
+        c->shared = false;
+    }
+}
+
+/// Free all chunks from the given index on
+static void file_shrink_chunks(struct dirent *f, size_t nchunks)
+{
+    while (f->u.file.nchunks > nchunks) {
+        chunk_free(&f->u.file.chunks[--f->u.file.nchunks]);
+    }
+    if (nchunks == 0) {
+        free(f->u.file.chunks);
+        f->u.file.chunks = NULL;
+    }
+}
+
+/// Allocate chunks to hold at least the given number of bytes
+static errval_t file_reserve(struct dirent *f, size_t size)
+{
+    if (size == 0) {
+        return SYS_ERR_OK;
+    }
+
+    size_t nchunks = chunk_index(size - 1) + 1;
+    if (nchunks <= f->u.file.nchunks) {
+        return SYS_ERR_OK;
+    }
+
+    struct ramfs_chunk *chunks = realloc(f->u.file.chunks,
+                                         nchunks * sizeof(struct ramfs_chunk));
+    if (chunks == NULL) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+    f->u.file.chunks = chunks;
+
+    while (f->u.file.nchunks < nchunks) {
+        size_t idx = f->u.file.nchunks;
+        errval_t err = chunk_alloc(&chunks[idx], chunk_bits(idx));
+        if (err_is_fail(err)) {
+            return err;
+        }
+        f->u.file.nchunks++;
+    }
+
+    return SYS_ERR_OK;
+}
+
+/// Copy data into reserved space of a file, or zero it if src is NULL
+static errval_t file_copy_in(struct dirent *f, size_t offset,
+                             const uint8_t *src, size_t len)
+{
+    while (len > 0) {
+        size_t idx = chunk_index(offset);
+        size_t bits = chunk_bits(idx);
+        size_t within = offset - chunk_start(idx);
+        size_t n = MIN(((size_t)1 << bits) - within, len);
+        struct ramfs_chunk *c = &f->u.file.chunks[idx];
+
+        assert(idx < f->u.file.nchunks);
+        chunk_modify(c);
+
+        if (src != NULL) {
+            memcpy(c->buf + within, src, n);
+            src += n;
+        } else {
+            memset(c->buf + within, 0, n);
+        }
+        offset += n;
+        len -= n;
+    }
+
+    return SYS_ERR_OK;
+}
+
 struct dirent *ramfs_init(void)
 {
     struct dirent *root = malloc(sizeof(struct dirent));
@@ -74,7 +230,7 @@ void ramfs_decref(struct dirent *e)
             assert(e->u.dir.nentries == 0);
             assert(e->u.dir.entries == NULL);
         } else {
-            free(e->u.file.data);
+            file_shrink_chunks(e, 0);
         }
         free(e);
     }
@@ -147,8 +303,9 @@ errval_t ramfs_lookup(struct dirent *dir, const char *name, struct dirent **ret)
     return FS_ERR_NOTFOUND;
 }
 
-errval_t ramfs_read(struct dirent *f, off_t offset, uint8_t **retbuf,
-                    size_t *maxlen)
+/// Copy up to len bytes from the given offset of a file
+errval_t ramfs_read(struct dirent *f, off_t offset, uint8_t *buf, size_t len,
+                    size_t *retlen)
 {
     assert(f->islive && f->refcount > 0);
 
@@ -156,23 +313,33 @@ errval_t ramfs_read(struct dirent *f, off_t offset, uint8_t **retbuf,
         return FS_ERR_NOTFILE;
     }
 
+    *retlen = 0;
     if (offset < 0 || offset >= f->u.file.size) {
-        *retbuf = NULL;
-        *maxlen = 0;
-    } else {
-        assert(f->u.file.data != NULL);
-        *retbuf = &f->u.file.data[offset];
-        *maxlen = f->u.file.size - offset;
+        return SYS_ERR_OK;
+    }
+
+    len = MIN(len, f->u.file.size - offset);
+    while (len > 0) {
+        size_t idx = chunk_index(offset);
+        size_t within = offset - chunk_start(idx);
+        size_t n = MIN(((size_t)1 << chunk_bits(idx)) - within, len);
+
+        memcpy(buf, f->u.file.chunks[idx].buf + within, n);
+        buf += n;
+        offset += n;
+        len -= n;
+        *retlen += n;
     }
 
     return SYS_ERR_OK;
 }
 
-/// Ensure that the file has at least space for a write of the given size at
-/// the given offset, return buffer pointer
-errval_t ramfs_grow(struct dirent *f, off_t offset, size_t len,
-                    uint8_t **retbuf)
+/// Write data at the given offset, growing the file (with zeroes) as needed
+errval_t ramfs_write(struct dirent *f, off_t offset, const uint8_t *buf,
+                     size_t len)
 {
+    errval_t err;
+
     assert(f->islive && f->refcount > 0);
 
     if (f->isdir) {
@@ -181,48 +348,126 @@ errval_t ramfs_grow(struct dirent *f, off_t offset, size_t len,
 
     assert(offset >= 0);
 
-    // do we need to grow the file? if not, we're done
-    if (offset + len <= f->u.file.size) {
-        *retbuf = &f->u.file.data[offset];
-        return SYS_ERR_OK;
+    err = file_reserve(f, (size_t)offset + len);
+    if (err_is_fail(err)) {
+        return err;
     }
 
-    uint8_t *newdata = realloc(f->u.file.data, (size_t)offset + len);
-    if (newdata == NULL) {
-        return LIB_ERR_MALLOC_FAIL;
-    } else {
-        f->u.file.data = newdata;
-        f->u.file.size = (size_t)offset + len;
-        *retbuf = &newdata[offset];
-        // XXX: new data is not initialised, we rely on the caller to do this!
-        return SYS_ERR_OK;
+    // zero any gap between the old end of the file and the new data
+    if (offset > f->u.file.size) {
+        err = file_copy_in(f, f->u.file.size, NULL,
+                           offset - f->u.file.size);
+        if (err_is_fail(err)) {
+            return err;
+        }
     }
+
+    err = file_copy_in(f, offset, buf, len);
+    if (err_is_fail(err)) {
+        return err;
+    }
+
+    f->u.file.size = MAX(f->u.file.size, (size_t)offset + len);
+    return SYS_ERR_OK;
 }
 
 errval_t ramfs_resize(struct dirent *f, size_t newlen)
 {
+    errval_t err;
+
     assert(f->islive && f->refcount > 0);
 
     if (f->isdir) {
         return FS_ERR_NOTFILE;
     }
 
-    uint8_t *newdata = realloc(f->u.file.data, newlen);
-    if (newdata == NULL) {
-        return LIB_ERR_MALLOC_FAIL;
-    }
-
     if (newlen > f->u.file.size) {
         // zero-fill new data
-        memset(&newdata[f->u.file.size], 0, newlen - f->u.file.size);
+        err = file_reserve(f, newlen);
+        if (err_is_fail(err)) {
+            return err;
+        }
+        err = file_copy_in(f, f->u.file.size, NULL, newlen - f->u.file.size);
+        if (err_is_fail(err)) {
+            return err;
+        }
+    } else {
+        file_shrink_chunks(f, newlen == 0 ? 0 : chunk_index(newlen - 1) + 1);
     }
 
-    f->u.file.data = newdata;
     f->u.file.size = newlen;
 
     return SYS_ERR_OK;
 }
 
+/**
+ * \brief Copy the chunk holding the given offset of a file into a new frame
+ *
+ * The chunk's own frame is never handed out, as clients could write to it.
+ * The copy belongs to the caller and stays valid for as long as it likes;
+ * the next write to the chunk changes its ID.
+ *
+ * \param f         File
+ * \param offset    Offset in the file, must be below the file size
+ * \param cached_id ID of a copy the caller still has, or 0
+ * \param frame     Returns the new frame, owned by the caller, or NULL_CAP if
+ *                  the chunk's ID is cached_id
+ * \param start     Returns the offset in the file of the start of the frame
+ * \param framelen  Returns the size of the frame
+ * \param len       Returns the number of bytes of the file in the frame
+ * \param id        Returns an ID that changes whenever the chunk does
+ */
+errval_t ramfs_map(struct dirent *f, off_t offset, uint32_t cached_id,
+                   struct capref *frame, size_t *start, size_t *framelen,
+                   size_t *len, uint32_t *id)
+{
+    assert(f->islive && f->refcount > 0);
+
+    if (f->isdir) {
+        return FS_ERR_NOTFILE;
+    }
+
+    if (offset < 0 || offset >= f->u.file.size) {
+        return FS_ERR_INDEX_BOUNDS;
+    }
+
+    size_t idx = chunk_index(offset);
+    struct ramfs_chunk *c = &f->u.file.chunks[idx];
+    size_t bytes = (size_t)1 << chunk_bits(idx);
+    size_t used = MIN(bytes, f->u.file.size - chunk_start(idx));
+
+    *frame = NULL_CAP;
+    *start = chunk_start(idx);
+    *framelen = bytes;
+    *len = used;
+    *id = c->id;
+    if (c->id == cached_id) {
+        return SYS_ERR_OK;
+    }
+
+    struct capref copy;
+    errval_t err = frame_alloc(&copy, bytes, NULL);
+    if (err_is_fail(err)) {
+        return err_push(err, LIB_ERR_FRAME_ALLOC);
+    }
+
+    void *buf;
+    err = vspace_map_one_frame(&buf, bytes, copy, NULL, NULL);
+    if (err_is_fail(err)) {
+        cap_destroy(copy);
+        return err_push(err, LIB_ERR_VSPACE_MAP);
+    }
+    memcpy(buf, c->buf, used);
+    err = vspace_unmap(buf);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "vspace_unmap of chunk copy");
+    }
+
+    c->shared = true;
+    *frame = copy;
+    return SYS_ERR_OK;
+}
+
 static errval_t addchild(struct dirent *dir, struct dirent *child)
 {
     assert(child->refcount == 1);
@@ -269,7 +514,8 @@ errval_t ramfs_create(struct dirent *dir, const char *name, struct dirent **ret)
     f->isdir = false;
     f->refcount = 1;
     f->islive = true;
-    f->u.file.data = NULL;
+    f->u.file.chunks = NULL;
+    f->u.file.nchunks = 0;
     f->u.file.size = 0;
 
     errval_t err = addchild(dir, f);
@@ -343,6 +589,8 @@ errval_t ramfs_delete(struct dirent *e)
     if (e->next != NULL) {
         e->next->prevp = e->prevp;
     }
+    e->next = NULL;
+    e->prevp = NULL;
 
     // update parent's child count
     assert(e->parent != NULL && e->parent->isdir);
@@ -24,7 +24,7 @@
 
 #define SERVICE_NAME    "ramfs"
 
-#define FHTAB_SIZE_BITS 8
+#define FHTAB_SIZE_BITS 10
 #define FHTAB_SIZE_MASK ((1U << FHTAB_SIZE_BITS) - 1)
 #define FHTAB_LEN       (1U << FHTAB_SIZE_BITS)
 #define FH_BITS         (sizeof(trivfs_fh_t) * NBBY)
@@ -32,6 +32,8 @@
 
 #define NULL_FH         ((trivfs_fh_t)-1u)
 
+#define PATH_SEP        '/'
+
 struct msgq_elem {
     enum trivfs_msg_enum msgnum;
     union trivfs_rx_arg_union a;
@@ -46,8 +48,27 @@ struct client_state {
     struct msgq_elem *qstart, *qend; ///< queue of pending replies
     struct bulk_transfer_slave bulk;
     struct vregion *bulk_vregion;
+    struct capref map_copy; ///< Chunk copy sent in the last map reply
 };
 
+/*
+ * The namespace version is published in a frame mapped by every client.
+ * Frame caps cannot be reduced to read-only, so any client can write to it
+ * and thereby delay the cache invalidation of the others until the next
+ * change; clients of one ramfsd are trusted in this respect. The version
+ * itself is kept here and only copied out, so writes by clients never
+ * affect ramfsd.
+ */
+static struct capref nsversion_frame;  ///< Frame holding the namespace version
+static volatile uint64_t *nsversion;    ///< Mapping of nsversion_frame
+static uint64_t nsversion_current;      ///< Authoritative namespace version
+
+/// Invalidate the path lookups cached by clients
+static void nsversion_bump(void)
+{
+    *nsversion = ++nsversion_current;
+}
+
 /* ------------------------------------------------------------------------- */
 
 static void client_state_init(struct client_state *st, struct dirent *root)
@@ -58,6 +79,7 @@ static void client_state_init(struct client_state *st, struct dirent *root)
     st->fhgen = 0;
     st->qstart = st->qend = NULL;
     st->bulk_vregion = NULL;
+    st->map_copy = NULL_CAP;
 }
 
 static trivfs_fh_t fh_set(struct client_state *st, struct dirent *d)
@@ -229,6 +251,82 @@ static errval_t lookup(struct trivfs_binding *b, trivfs_fh_t dir, const char *na
     return SYS_ERR_OK;
 }
 
+static errval_t resolve(struct trivfs_binding *b, trivfs_fh_t dir,
+                        const char *path, errval_t *reterr, trivfs_fh_t *retfh,
+                        bool *isdir, uint32_t *retpos)
+{
+    errval_t err;
+    *reterr = SYS_ERR_OK;
+    struct client_state *st = b->st;
+    *retfh = NULL_FH;
+    *isdir = false;
+    *retpos = 0;
+
+    struct dirent *e = fh_get(st, dir);
+    if (e == NULL) {
+        *reterr = FS_ERR_INVALID_FH;
+        return SYS_ERR_OK;
+    }
+
+    if (path == NULL) {
+        path = "";
+    }
+
+    // skip leading /
+    size_t pos = 0;
+    if (path[0] == PATH_SEP) {
+        pos++;
+    }
+
+    while (path[pos] != '\0') {
+        const char *nextsep = strchr(&path[pos], PATH_SEP);
+        size_t nextlen;
+        if (nextsep == NULL) {
+            nextlen = strlen(&path[pos]);
+        } else {
+            nextlen = nextsep - &path[pos];
+        }
+
+        char name[nextlen + 1];
+        memcpy(name, &path[pos], nextlen);
+        name[nextlen] = '\0';
+
+        struct dirent *next;
+        err = ramfs_lookup(e, name, &next);
+        if (err_is_fail(err)) {
+            *reterr = err;
+            break;
+        }
+
+        e = next;
+        if (nextsep == NULL) {
+            break;
+        }
+
+        pos += nextlen + 1;
+        if (!ramfs_isdir(e)) {
+            // not a directory, don't bother going further
+            *reterr = FS_ERR_NOTDIR;
+            break;
+        }
+    }
+
+    *retfh = fh_set(st, e);
+    *isdir = ramfs_isdir(e);
+    *retpos = pos;
+    return SYS_ERR_OK;
+}
+
+static errval_t get_nsversion(struct trivfs_binding *b, errval_t *reterr,
+                              struct capref *frame)
+{
+    *reterr = SYS_ERR_OK;
+    *frame = nsversion_frame;
+    // repair the page, in case a client wrote to it
+    *nsversion = nsversion_current;
+    return SYS_ERR_OK;
+}
+
 static errval_t getattr(struct trivfs_binding *b, trivfs_fh_t fh,
                         errval_t *reterr, bool *isdir, trivfs_fsize_t *size)
 {
@@ -255,7 +353,6 @@ static errval_t read(struct trivfs_binding *b, trivfs_fh_t fh,
     errval_t err;
     *reterr = SYS_ERR_OK;
     struct client_state *st = b->st;
-    uint8_t *buf = NULL;
     *len = 0;
 
     struct dirent *f = fh_get(st, fh);
@@ -264,16 +361,16 @@ static errval_t read(struct trivfs_binding *b, trivfs_fh_t fh,
         return SYS_ERR_OK;
     }
 
-    err = ramfs_read(f, offset, &buf, len);
+    if (maxlen > trivfs__read_response_data_MAX_ARGUMENT_SIZE) {
+        maxlen = trivfs__read_response_data_MAX_ARGUMENT_SIZE;
+    }
+
+    err = ramfs_read(f, offset, data, maxlen, len);
     if (err_is_fail(err)) {
         *reterr = err;
         return SYS_ERR_OK;
     }
 
-    if (*len > maxlen) {
-        *len = maxlen;
-    }
-    memcpy(data, buf, *len);
     ramfs_incref(f);
     return SYS_ERR_OK;
 }
@@ -292,15 +389,10 @@ static errval_t write(struct trivfs_binding *b, trivfs_fh_t fh,
         return SYS_ERR_OK;
     }
 
-    uint8_t *buf;
-
-    err = ramfs_grow(f, offset, len, &buf);
+    err = ramfs_write(f, offset, data, len);
     if (err_is_fail(err)) {
         *reterr = err;
-        return SYS_ERR_OK;
     }
-
-    memcpy(buf, data, len);
     return SYS_ERR_OK;
 }
 
@@ -312,7 +404,6 @@ static errval_t read_bulk(struct trivfs_binding *b, trivfs_fh_t fh,
     errval_t err;
     *reterr = SYS_ERR_OK;
     struct client_state *st = b->st;
-    uint8_t *ramfsbuf = NULL;
     size_t len = 0;
 
     if (st->bulk_vregion == NULL) {
@@ -326,12 +417,6 @@ static errval_t read_bulk(struct trivfs_binding *b, trivfs_fh_t fh,
         return SYS_ERR_OK;
     }
 
-    err = ramfs_read(f, offset, &ramfsbuf, &len);
-    if (err_is_fail(err)) {
-        *reterr = err;
-        return SYS_ERR_OK;
-    }
-
     // determine local address of bulk buffer
     size_t bulk_size;
     void *bulkbuf = bulk_slave_buf_get_mem(&st->bulk, bulkid, &bulk_size);
@@ -341,14 +426,14 @@ static errval_t read_bulk(struct trivfs_binding *b, trivfs_fh_t fh,
         maxlen = bulk_size;
     }
 
-    // limit read len to maxlen
-    if (len > maxlen) {
-        len = maxlen;
+    // copy data to bulk buffer
+    err = ramfs_read(f, offset, bulkbuf, maxlen, &len);
+    if (err_is_fail(err)) {
+        *reterr = err;
+        return SYS_ERR_OK;
     }
 
     *retlen = len;
-    // copy data to bulk buffer
-    memcpy(bulkbuf, ramfsbuf, len);
     // prepare bulk buffer for reply
     bulk_slave_prepare_send(&st->bulk, bulkid);
     return SYS_ERR_OK;
@@ -382,16 +467,56 @@ static errval_t write_bulk(struct trivfs_binding *b, trivfs_fh_t fh,
         len = maxlen;
     }
 
-    uint8_t *ramfsbuf;
-    err = ramfs_grow(f, offset, len, &ramfsbuf);
+    bulk_slave_prepare_recv(&st->bulk, bulkid);
+
+    err = ramfs_write(f, offset, bulkbuf, len);
     if (err_is_fail(err)) {
         *reterr = err;
+    }
+    return SYS_ERR_OK;
+}
+
+static errval_t map(struct trivfs_binding *b, trivfs_fh_t fh,
+                    trivfs_offset_t offset, uint32_t cached_id,
+                    errval_t *reterr, struct capref *frame,
+                    trivfs_offset_t *start, trivfs_fsize_t *framelen,
+                    trivfs_fsize_t *len, uint32_t *id)
+{
+    errval_t err;
+    *reterr = SYS_ERR_OK;
+    struct client_state *st = b->st;
+    *frame = NULL_CAP;
+    *start = *framelen = *len = 0;
+    *id = 0;
+
+    // the client has received the previous reply, so its copy is sent
+    if (!capref_is_null(st->map_copy)) {
+        cap_destroy(st->map_copy);
+        st->map_copy = NULL_CAP;
+    }
+
+    struct dirent *f = fh_get(st, fh);
+    if (f == NULL) {
+        *reterr = FS_ERR_INVALID_FH;
         return SYS_ERR_OK;
     }
 
-    bulk_slave_prepare_recv(&st->bulk, bulkid);
+    if (offset >= ramfs_get_size(f)) {
+        return SYS_ERR_OK; // EOF
+    }
 
-    memcpy(ramfsbuf, bulkbuf, len);
+    // no frame is copied if the client still has the chunk mapped
+    size_t chunkstart, chunkframelen, chunklen;
+    err = ramfs_map(f, offset, cached_id, &st->map_copy, &chunkstart,
+                    &chunkframelen, &chunklen, id);
+    if (err_is_fail(err)) {
+        *reterr = err;
+        return SYS_ERR_OK;
+    }
+    *frame = st->map_copy;
+    *start = chunkstart;
+    *framelen = chunkframelen;
+    *len = chunklen;
     return SYS_ERR_OK;
 }
 
@@ -436,6 +561,8 @@ static errval_t create(struct trivfs_binding *b, trivfs_fh_t dir, const char *na
         return SYS_ERR_OK;
     }
 
+    nsversion_bump();
+
     *fh = fh_set(st, newf);
     return SYS_ERR_OK;
 }
@@ -466,6 +593,8 @@ static errval_t mkdir(struct trivfs_binding *b, trivfs_fh_t dir, const char *nam
         return SYS_ERR_OK;
     }
 
+    nsversion_bump();
+
     *fh = fh_set(st, newd);
     return SYS_ERR_OK;
 }
@@ -480,6 +609,9 @@ static errval_t delete(struct trivfs_binding *b, trivfs_fh_t fh, errval_t *reter
         *reterr = FS_ERR_INVALID_FH;
     } else {
         *reterr = ramfs_delete(d);
+        if (err_is_ok(*reterr)) {
+            nsversion_bump();
+        }
     }
     return SYS_ERR_OK;
 }
@@ -491,11 +623,14 @@ static struct trivfs_rpc_rx_vtbl rpc_rx_vtbl = {
     .getroot_call = getroot,
     .readdir_call = readdir,
     .lookup_call = lookup,
+    .resolve_call = resolve,
+    .nsversion_call = get_nsversion,
     .getattr_call = getattr,
     .read_call = read,
     .write_call = write,
     .read_bulk_call = read_bulk,
     .write_bulk_call = write_bulk,
+    .map_call = map,
     .truncate_call = truncate,
     .create_call = create,
     .mkdir_call = mkdir,
@@ -533,6 +668,24 @@ static errval_t connect_cb(void *st, struct trivfs_binding *b)
 
 errval_t start_service(struct dirent *root)
 {
+    errval_t err;
+
+    // Create the namespace version page shared with all clients
+    err = frame_alloc(&nsversion_frame, BASE_PAGE_SIZE, NULL);
+    if (err_is_fail(err)) {
+        return err_push(err, LIB_ERR_FRAME_ALLOC);
+    }
+    void *buf;
+    err = vspace_map_one_frame(&buf, BASE_PAGE_SIZE, nsversion_frame, NULL,
+                               NULL);
+    if (err_is_fail(err)) {
+        cap_destroy(nsversion_frame);
+        return err_push(err, LIB_ERR_VSPACE_MAP);
+    }
+    nsversion = buf;
+    nsversion_current = 0;
+    *nsversion = nsversion_current;
+
     // Offer the fs service
     return trivfs_export(root, export_cb, connect_cb, get_default_waitset(),
                          IDC_EXPORT_FLAGS_DEFAULT);
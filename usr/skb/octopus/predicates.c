@@ -26,6 +26,7 @@
 #include <octopus/trigger.h> // for trigger modes
 
 #include "predicates.h"
+#include "record_store.h"
 #include "skiplist.h"
 #include "bitfield.h"
 #include "fnv.h"
@@ -56,6 +57,71 @@ static inline void init_index(void) {
 }
 
 
+struct skip_list* record_index_find(char* attribute)
+{
+    if (record_index == NULL) {
+        return NULL;
+    }
+
+    uint64_t key = fnv_64a_str(attribute, FNV1A_64_INIT);
+    return (struct skip_list*) collections_hash_find(record_index, key);
+}
+
+/**
+ * Converts a val(Key, Value) list to record attributes for the native
+ * record store. Values other than integers, atoms and strings can only be
+ * handled by Prolog, in that case native is set to false.
+ */
+static errval_t record_attributes(pword list, struct record_attribute** attrs,
+        size_t* count, bool* native)
+{
+    pword cur, rest;
+    size_t n = 0;
+    for (pword l = list; ec_get_list(l, &cur, &rest) == PSUCCEED; l = rest) {
+        n++;
+    }
+
+    *attrs = calloc(n, sizeof(struct record_attribute));
+    if (*attrs == NULL && n > 0) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+    *count = n;
+    *native = true;
+
+    size_t i = 0;
+    for (pword l = list; ec_get_list(l, &cur, &rest) == PSUCCEED; l = rest, i++) {
+        struct record_attribute* a = &(*attrs)[i];
+        pword key_term, value_term;
+        ec_get_arg(1, cur, &key_term);
+        ec_get_arg(2, cur, &value_term);
+
+        int res = ec_get_string(key_term, &a->key);
+        assert(res == PSUCCEED);
+
+        long int integer;
+        dident atom;
+        if (ec_get_long(value_term, &integer) == PSUCCEED) {
+            a->type = RECORD_VALUE_INTEGER;
+            a->value.integer = integer;
+        }
+        else if (ec_get_atom(value_term, &atom) == PSUCCEED) {
+            a->type = RECORD_VALUE_ATOM;
+            ec_get_string(value_term, &a->value.str);
+        }
+        else if (ec_get_string(value_term, &a->value.str) == PSUCCEED) {
+            a->type = RECORD_VALUE_STRING;
+        }
+        else {
+            // floats, variables, ...
+            a->type = RECORD_VALUE_ATOM;
+            a->value.str = "";
+            *native = false;
+        }
+    }
+
+    return SYS_ERR_OK;
+}
+
 static int skip_index_insert(collections_hash_table* ht, uint64_t key, char* value)
 {
     assert(ht != NULL);
@@ -101,6 +167,21 @@ int p_save_index(void)
     int res = ec_get_string(ec_arg(3), &value);
     assert(res == PSUCCEED);
 
+    struct record_attribute* attrs = NULL;
+    size_t count = 0;
+    bool native = false;
+    errval_t err = record_attributes(ec_arg(2), &attrs, &count, &native);
+    if (err_is_fail(err)) {
+        // keep the name, queries for the record are left to Prolog
+        count = 0;
+        native = false;
+    }
+    err = record_store_set(value, attrs, count, native);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "native record store is incomplete");
+    }
+    free(attrs);
+
     char* record_name = strdup(value);
     bool inserted = false;
 
@@ -135,6 +216,7 @@ int p_remove_index(void)
     char* name = NULL;
     res = ec_get_string(ec_arg(3), &name);
     assert(res == PSUCCEED);
+    record_store_del(name);
 
     pword list, cur, rest;
     pword attribute_term;
@@ -15,6 +15,8 @@
 #ifndef PREDICATES_H_
 #define PREDICATES_H_
 
+struct skip_list;
+
 int p_notify_client(void);
 int p_trigger_watch(void);
 
@@ -23,6 +25,8 @@ int p_remove_index(void);
 int p_index_intersect(void);
 int p_index_union(void);
 
+struct skip_list* record_index_find(char* attribute);
+
 int p_bitfield_add(void);
 int p_bitfield_remove(void);
 int p_bitfield_union(void);
@@ -0,0 +1,513 @@
+/**
+ * \file
+ * \brief Native record store for octopus queries.
+ *
+ * Prolog (objects3.pl) remains the authoritative store of records and still
+ * handles all modifications, watches and subscriptions. Every time it stores
+ * or deletes a record it updates the attribute index through the external
+ * predicates save_index/remove_index, which also keep a copy of the record
+ * here. Get queries that only consist of an exact name and/or simple
+ * attribute constraints are answered from this copy, everything else is
+ * passed on to Prolog.
+ *
+ * Results are identical to the ones computed by Prolog: Records are matched
+ * with the semantics of match_constraints/2, candidates for queries without
+ * a record name come from the same attribute index in the same (sorted)
+ * order, and the output uses the format of print_object/1 and print_names/1.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include <barrelfish/barrelfish.h>
+#include <octopus_server/debug.h>
+
+#include "record_store.h"
+#include "predicates.h"
+#include "skiplist.h"
+#include "fnv.h"
+
+#define RECORD_BUCKETS_MIN 1024
+
+struct record {
+    struct record* next;
+    char* name;
+    bool native;
+    size_t count;
+    struct record_attribute attrs[];
+};
+
+static struct record_store {
+    struct record** buckets;
+    size_t nbuckets; ///< Power of two
+    size_t records;
+    bool incomplete; ///< A record is missing, Prolog has to answer everything
+} store;
+
+enum match {
+    MATCH_NO,
+    MATCH_YES,
+    MATCH_PROLOG, ///< Prolog has to decide
+};
+
+static inline struct record** bucket_for(const char* name)
+{
+    uint64_t hash = fnv_64a_str((char*) name, FNV1A_64_INIT);
+    return &store.buckets[hash & (store.nbuckets - 1)];
+}
+
+static struct record* find_record(const char* name)
+{
+    if (store.buckets == NULL) {
+        return NULL;
+    }
+
+    struct record* r = *bucket_for(name);
+    while (r != NULL && strcmp(r->name, name) != 0) {
+        r = r->next;
+    }
+    return r;
+}
+
+static void free_record(struct record* r)
+{
+    for (size_t i = 0; i < r->count; i++) {
+        free(r->attrs[i].key);
+        if (r->attrs[i].type != RECORD_VALUE_INTEGER) {
+            free(r->attrs[i].value.str);
+        }
+    }
+    free(r->name);
+    free(r);
+}
+
+static errval_t grow_store(void)
+{
+    size_t nbuckets = store.nbuckets ? store.nbuckets * 2 : RECORD_BUCKETS_MIN;
+    struct record** old = store.buckets;
+    size_t old_nbuckets = store.nbuckets;
+
+    store.buckets = calloc(nbuckets, sizeof(struct record*));
+    if (store.buckets == NULL) {
+        store.buckets = old;
+        return LIB_ERR_MALLOC_FAIL;
+    }
+    store.nbuckets = nbuckets;
+
+    for (size_t i = 0; i < old_nbuckets; i++) {
+        struct record* r = old[i];
+        while (r != NULL) {
+            struct record* next = r->next;
+            struct record** b = bucket_for(r->name);
+            r->next = *b;
+            *b = r;
+            r = next;
+        }
+    }
+    free(old);
+
+    return SYS_ERR_OK;
+}
+
+static void unlink_record(struct record* r)
+{
+    struct record** p = bucket_for(r->name);
+    while (*p != r) {
+        p = &(*p)->next;
+    }
+    *p = r->next;
+
+    store.records--;
+}
+
+errval_t record_store_set(const char* name, struct record_attribute* attrs,
+        size_t count, bool native)
+{
+    assert(name != NULL);
+    assert(attrs != NULL || count == 0);
+
+    if (store.records >= store.nbuckets) {
+        errval_t err = grow_store();
+        if (err_is_fail(err) && store.buckets == NULL) {
+            store.incomplete = true;
+            return err;
+        }
+    }
+
+    struct record* r = calloc(1, sizeof(struct record) +
+            count * sizeof(struct record_attribute));
+    if (r == NULL) {
+        record_store_del(name);
+        store.incomplete = true;
+        return LIB_ERR_MALLOC_FAIL;
+    }
+
+    r->name = strdup(name);
+    r->native = native;
+    bool ok = r->name != NULL;
+    for (size_t i = 0; ok && i < count; i++, r->count++) {
+        r->attrs[i] = attrs[i];
+        r->attrs[i].key = strdup(attrs[i].key);
+        if (attrs[i].type != RECORD_VALUE_INTEGER) {
+            r->attrs[i].value.str = strdup(attrs[i].value.str);
+            ok = r->attrs[i].value.str != NULL;
+        }
+        ok = ok && r->attrs[i].key != NULL;
+    }
+    if (!ok) {
+        free_record(r);
+        record_store_del(name);
+        store.incomplete = true;
+        return LIB_ERR_MALLOC_FAIL;
+    }
+
+    record_store_del(name);
+
+    struct record** b = bucket_for(name);
+    r->next = *b;
+    *b = r;
+    store.records++;
+
+    return SYS_ERR_OK;
+}
+
+void record_store_del(const char* name)
+{
+    struct record* r = find_record(name);
+    if (r != NULL) {
+        unlink_record(r);
+        free_record(r);
+    }
+}
+
+/**
+ * Matches a single constraint against a record, see match_constraints/2
+ * in objects3.pl.
+ */
+static enum match match_constraint(struct record* r, const char* key,
+        enum constraint_type op, struct ast_object* value)
+{
+    struct record_attribute* a = NULL;
+    for (size_t i = 0; i < r->count; i++) {
+        if (strcmp(r->attrs[i].key, key) == 0) {
+            a = &r->attrs[i];
+            break;
+        }
+    }
+
+    switch (value->type) {
+    case nodeType_Variable:
+        if (op != constraint_EQ) {
+            return MATCH_PROLOG;
+        }
+        return a != NULL ? MATCH_YES : MATCH_NO;
+
+    case nodeType_Constant:
+        if (a == NULL || a->type != RECORD_VALUE_INTEGER) {
+            return MATCH_NO;
+        }
+        int64_t v = value->u.cn.value;
+        int64_t sv = a->value.integer;
+        return constraint_holds(op, (sv > v) - (sv < v)) ?
+                MATCH_YES : MATCH_NO;
+
+    case nodeType_Ident:
+    case nodeType_String:
+        if (a == NULL || a->type == RECORD_VALUE_INTEGER) {
+            return MATCH_NO;
+        }
+        // atoms and strings compare by their text (see string_compare/3)
+        const char* s = value->type == nodeType_Ident ?
+                value->u.in.str : value->u.sn.str;
+        return constraint_holds(op, strcmp(a->value.str, s)) ?
+                MATCH_YES : MATCH_NO;
+
+    default:
+        // floats, regular expressions
+        return MATCH_PROLOG;
+    }
+}
+
+static enum match match_record(struct record* r, struct ast_object* ast)
+{
+    struct ast_object* iter = ast->u.on.attrs;
+    if (!r->native && iter != NULL) {
+        return MATCH_PROLOG;
+    }
+
+    enum match result = MATCH_YES;
+    for (; iter != NULL; iter = iter->u.an.next) {
+        assert(iter->type == nodeType_Attribute);
+        struct ast_object* left = iter->u.an.attr->u.pn.left;
+        struct ast_object* right = iter->u.an.attr->u.pn.right;
+
+        enum constraint_type op = constraint_EQ;
+        if (right->type == nodeType_Constraint) {
+            if (right->u.cnsn.op == constraint_REGEX) {
+                return MATCH_PROLOG;
+            }
+            op = right->u.cnsn.op;
+            right = right->u.cnsn.value;
+        }
+
+        enum match m = match_constraint(r, left->u.in.str, op, right);
+        if (m == MATCH_PROLOG) {
+            return MATCH_PROLOG;
+        }
+        if (m == MATCH_NO) {
+            // keep checking, a later constraint may still need Prolog
+            result = MATCH_NO;
+        }
+    }
+
+    return result;
+}
+
+static bool writer_append(struct skb_writer* w, const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(w->buffer + w->length, MAX_QUERY_LENGTH - w->length,
+            fmt, args);
+    va_end(args);
+
+    if (len < 0 || w->length + len >= MAX_QUERY_LENGTH) {
+        w->buffer[w->length] = '\0';
+        return false;
+    }
+    w->length += len;
+    return true;
+}
+
+/// Formats a record like format_object/2
+static bool format_record(struct record* r, struct skb_writer* w)
+{
+    bool ok = writer_append(w, "%s { ", r->name);
+    for (size_t i = 0; ok && i < r->count; i++) {
+        struct record_attribute* a = &r->attrs[i];
+        const char* sep = i + 1 < r->count ? ", " : "";
+        switch (a->type) {
+        case RECORD_VALUE_INTEGER:
+            ok = writer_append(w, "%s: %"PRId64"%s", a->key, a->value.integer,
+                    sep);
+            break;
+        case RECORD_VALUE_ATOM:
+            ok = writer_append(w, "%s: %s%s", a->key, a->value.str, sep);
+            break;
+        case RECORD_VALUE_STRING:
+            ok = writer_append(w, "%s: '%s'%s", a->key, a->value.str, sep);
+            break;
+        }
+    }
+
+    return ok && writer_append(w, " }");
+}
+
+static bool has_attributes(struct ast_object* ast)
+{
+    return ast->u.on.attrs != NULL;
+}
+
+/**
+ * Finds the next record name in the intersection of the index lists of all
+ * attributes mentioned in the query, in the order of p_index_intersect.
+ *
+ * \param prev Previously returned name or NULL to start.
+ */
+static char* next_candidate(struct ast_object* ast, char* prev)
+{
+    struct skip_list* smallest = NULL;
+    struct ast_object* iter = ast->u.on.attrs;
+    for (; iter != NULL; iter = iter->u.an.next) {
+        struct ast_object* left = iter->u.an.attr->u.pn.left;
+        struct skip_list* sl = record_index_find(left->u.in.str);
+        if (sl == NULL) {
+            return NULL;
+        }
+        if (smallest == NULL || sl->entries < smallest->entries) {
+            smallest = sl;
+        }
+    }
+    assert(smallest != NULL);
+
+    // find the first element greater than prev in the smallest list
+    struct skip_node* cur = smallest->header;
+    if (prev != NULL) {
+        for (int64_t k = smallest->level; k >= 0; k--) {
+            while (cur->forward[k] != NULL &&
+                    strcmp(cur->forward[k]->element, prev) <= 0) {
+                cur = cur->forward[k];
+            }
+        }
+    }
+
+    for (cur = cur->forward[0]; cur != NULL; cur = cur->forward[0]) {
+        bool in_all = true;
+        for (iter = ast->u.on.attrs; in_all && iter != NULL;
+                iter = iter->u.an.next) {
+            struct ast_object* left = iter->u.an.attr->u.pn.left;
+            struct skip_list* sl = record_index_find(left->u.in.str);
+            in_all = sl == smallest || skip_contains(sl, cur->element);
+        }
+        if (in_all) {
+            return cur->element;
+        }
+    }
+
+    return NULL;
+}
+
+bool record_store_get(struct ast_object* ast, struct skb_writer* out,
+        errval_t* err)
+{
+    assert(ast != NULL);
+    assert(out != NULL);
+    assert(err != NULL);
+    assert(ast->type == nodeType_Object);
+
+    if (store.incomplete) {
+        return false;
+    }
+
+    struct ast_object* name = ast->u.on.name;
+    struct record* found = NULL;
+
+    if (name->type == nodeType_Ident) {
+        struct record* r = find_record(name->u.in.str);
+        if (r != NULL) {
+            enum match m = match_record(r, ast);
+            if (m == MATCH_PROLOG) {
+                return false;
+            }
+            found = m == MATCH_YES ? r : NULL;
+        }
+    }
+    else if (name->type == nodeType_Variable && has_attributes(ast)) {
+        char* candidate = NULL;
+        while ((candidate = next_candidate(ast, candidate)) != NULL) {
+            struct record* r = find_record(candidate);
+            assert(r != NULL);
+            enum match m = match_record(r, ast);
+            if (m == MATCH_PROLOG) {
+                return false;
+            }
+            if (m == MATCH_YES) {
+                found = r;
+                break;
+            }
+        }
+    }
+    else {
+        // name regex, or all records in Prolog's hash order
+        return false;
+    }
+
+    if (found == NULL) {
+        *err = err_push(SKB_ERR_GOAL_FAILURE, OCT_ERR_NO_RECORD);
+        return true;
+    }
+    if (!found->native) {
+        // values Prolog has to format
+        return false;
+    }
+
+    out->length = 0;
+    if (!format_record(found, out)) {
+        return false;
+    }
+
+    OCT_DEBUG("record_store_get: %s\n", out->buffer);
+    *err = SYS_ERR_OK;
+    return true;
+}
+
+static int compare_names(const void* a, const void* b)
+{
+    return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+bool record_store_get_names(struct ast_object* ast, struct skb_writer* out,
+        errval_t* err)
+{
+    assert(ast != NULL);
+    assert(out != NULL);
+    assert(err != NULL);
+    assert(ast->type == nodeType_Object);
+
+    if (store.incomplete) {
+        return false;
+    }
+
+    struct ast_object* name = ast->u.on.name;
+    out->length = 0;
+    out->buffer[0] = '\0';
+
+    if (name->type == nodeType_Ident) {
+        struct record* r = find_record(name->u.in.str);
+        if (r != NULL) {
+            enum match m = match_record(r, ast);
+            if (m == MATCH_PROLOG) {
+                return false;
+            }
+            if (m == MATCH_YES && !writer_append(out, "%s", r->name)) {
+                return false;
+            }
+        }
+    }
+    else if (name->type == nodeType_Variable && has_attributes(ast)) {
+        // candidates are sorted already, like the output of prune_instances/2
+        char* candidate = NULL;
+        while ((candidate = next_candidate(ast, candidate)) != NULL) {
+            struct record* r = find_record(candidate);
+            assert(r != NULL);
+            enum match m = match_record(r, ast);
+            if (m == MATCH_PROLOG) {
+                return false;
+            }
+            if (m == MATCH_YES && !writer_append(out, "%s%s",
+                    out->length > 0 ? ", " : "", r->name)) {
+                return false;
+            }
+        }
+    }
+    else if (name->type == nodeType_Variable) {
+        char** names = malloc(store.records * sizeof(char*));
+        if (names == NULL && store.records > 0) {
+            return false;
+        }
+        size_t n = 0;
+        for (size_t i = 0; i < store.nbuckets; i++) {
+            for (struct record* r = store.buckets[i]; r != NULL; r = r->next) {
+                names[n++] = r->name;
+            }
+        }
+        assert(n == store.records);
+        qsort(names, n, sizeof(char*), compare_names);
+
+        bool ok = true;
+        for (size_t i = 0; ok && i < n; i++) {
+            ok = writer_append(out, "%s%s", i > 0 ? ", " : "", names[i]);
+        }
+        free(names);
+        if (!ok) {
+            return false;
+        }
+    }
+    else {
+        return false;
+    }
+
+    OCT_DEBUG("record_store_get_names: %s\n", out->buffer);
+    *err = out->length > 0 ? SYS_ERR_OK : OCT_ERR_NO_RECORD;
+    return true;
+}
@@ -0,0 +1,115 @@
+/**
+ * \file
+ * \brief Native record store for octopus queries.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef RECORD_STORE_H_
+#define RECORD_STORE_H_
+
+#include <barrelfish/barrelfish.h>
+#include <octopus_server/service.h>
+#include <octopus/parser/ast.h>
+
+enum record_value_type {
+    RECORD_VALUE_INTEGER,
+    RECORD_VALUE_ATOM,
+    RECORD_VALUE_STRING,
+};
+
+struct record_attribute {
+    char* key;
+    enum record_value_type type;
+    union {
+        int64_t integer;
+        char* str; ///< Used for atoms and strings
+    } value;
+};
+
+/**
+ * \brief Evaluates a comparison like number_compare/3 and string_compare/3.
+ *
+ * \param op Comparison operator, regular expressions are not supported.
+ * \param cmp Result of comparing the left with the right value (<0, 0, >0).
+ */
+static inline bool constraint_holds(enum constraint_type op, int cmp)
+{
+    switch (op) {
+    case constraint_GT:
+        return cmp > 0;
+    case constraint_GE:
+        return cmp >= 0;
+    case constraint_LT:
+        return cmp < 0;
+    case constraint_LE:
+        return cmp <= 0;
+    case constraint_EQ:
+        return cmp == 0;
+    case constraint_NE:
+        return cmp != 0;
+    default:
+        assert(!"Unexpected constraint type");
+        return false;
+    }
+}
+
+/**
+ * \brief Mirrors a record stored by Prolog.
+ *
+ * Called by the index predicates whenever objects3.pl stores a record, with
+ * the attributes in the order Prolog keeps them (sorted by key, no duplicate
+ * keys). Replaces any previous record with the same name.
+ *
+ * \param name Record name.
+ * \param attrs Attributes, copied by the store.
+ * \param count Number of attributes.
+ * \param native False if some value could not be converted, queries for this
+ * record are then left to Prolog.
+ *
+ * \retval SYS_ERR_OK
+ * \retval LIB_ERR_MALLOC_FAIL
+ */
+errval_t record_store_set(const char* name, struct record_attribute* attrs,
+        size_t count, bool native);
+
+/**
+ * \brief Forgets a record deleted by Prolog.
+ */
+void record_store_del(const char* name);
+
+/**
+ * \brief Answers a get query without Prolog, if possible.
+ *
+ * \param ast Query.
+ * \param out Receives the record in the format of print_object/1.
+ * \param err Result of the query if it was answered.
+ *
+ * \retval true Query was answered, err is set.
+ * \retval false Query needs Prolog (regular expressions, floating point
+ * values or an unspecified result order).
+ */
+bool record_store_get(struct ast_object* ast, struct skb_writer* out,
+        errval_t* err);
+
+/**
+ * \brief Answers a get_names query without Prolog, if possible.
+ *
+ * \param ast Query.
+ * \param out Receives the record names in the format of print_names/1.
+ * \param err Result of the query if it was answered.
+ *
+ * \retval true Query was answered, err is set.
+ * \retval false Query needs Prolog.
+ */
+bool record_store_get_names(struct ast_object* ast, struct skb_writer* out,
+        errval_t* err);
+
+#endif /* RECORD_STORE_H_ */
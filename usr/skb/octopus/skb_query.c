@@ -17,6 +17,7 @@
 //#include <eclipse.h>
 
 #include <barrelfish/barrelfish.h>
+#include <skb/skb.h> // read list
 #include <include/skb_debug.h>
 
 #include <if/octopus_defs.h>
@@ -28,6 +29,8 @@
 #include <octopus/parser/ast.h>
 #include <octopus/getset.h> // for SET_SEQUENTIAL define
 #include "code_generator.h"
+#include "record_store.h"
+#include "subscription_index.h"
 #include "bitfield.h"
 
 #include <bench/bench.h>
@@ -142,8 +145,13 @@ errval_t get_record(struct ast_object* ast, struct oct_query_state* sqs)
     assert(ast != NULL);
     assert(sqs != NULL);
 
+    errval_t err;
+    if (record_store_get(ast, &sqs->std_out, &err)) {
+        return err;
+    }
+
     struct skb_ec_terms sr;
-    errval_t err = transform_record(ast, &sr);
+    err = transform_record(ast, &sr);
     if (err_is_ok(err)) {
         // Calling get_object(Name, Attrs, Constraints, Y), print_object(Y).
         dident get_object = ec_did("get_first_object", 4);
@@ -174,8 +182,13 @@ errval_t get_record_names(struct ast_object* ast, struct oct_query_state* dqs)
     assert(ast != NULL);
     assert(dqs != NULL);
 
+    errval_t err;
+    if (record_store_get_names(ast, &dqs->std_out, &err)) {
+        return err;
+    }
+
     struct skb_ec_terms sr;
-    errval_t err = transform_record(ast, &sr);
+    err = transform_record(ast, &sr);
     if (err_is_ok(err)) {
         // Calling findall(X, get_object(X, Attrs, Constraints, _), L),
         // prune_instances(L, PL), print_names(PL).
@@ -437,11 +450,18 @@ errval_t add_subscription(struct octopus_binding* b, struct ast_object* ast,
     struct skb_ec_terms sr;
     err = transform_record(ast, &sr);
     if (err_is_ok(err)) {
+        struct oct_subscriber recipient = {
+            .binding = (uintptr_t) get_event_binding(b),
+            .client_handler = trigger_fn,
+            .client_state = state,
+            .server_id = drs->server_id,
+        };
+
         // Calling add_subscription(ps, ServerID,
         // template(Name, Attributes, Constraints),
         // subscriber(EventBinding, TriggerFn, ClientState))
         dident subscriber = ec_did("subscriber", 4);
-        pword binding_term = ec_long((long int) get_event_binding(b));
+        pword binding_term = ec_long((long int) recipient.binding);
         pword storage = ec_atom(ec_did("ps", 0));
         pword subscriber_term = ec_term(subscriber, binding_term,
                 ec_long(trigger_fn), ec_long(state),
@@ -454,6 +474,12 @@ errval_t add_subscription(struct octopus_binding* b, struct ast_object* ast,
             assert(!"add_subscription failed - should not happen!");
             bitfield_off(subscriber_ids, drs->server_id);
         }
+        if (err_is_ok(err)) {
+            errval_t index_err = subscription_index_add(ast, &recipient);
+            if (err_is_fail(index_err)) {
+                DEBUG_ERR(index_err, "subscription index is incomplete");
+            }
+        }
 
         OCT_DEBUG("add_subscription\n");
         debug_skb_output(&drs->query_state);
@@ -479,6 +505,7 @@ errval_t del_subscription(struct octopus_binding* b, uint64_t id,
     if (err_is_ok(err)) {
         assert(subscriber_ids != NULL); // should not happen if eclipse succeeds
         bitfield_off(subscriber_ids, id);
+        subscription_index_del(id);
     }
     if (err_no(err) == SKB_ERR_GOAL_FAILURE) {
         err = err_push(err, OCT_ERR_NO_SUBSCRIPTION);
@@ -490,10 +517,51 @@ errval_t del_subscription(struct octopus_binding* b, uint64_t id,
     return err;
 }
 
-errval_t find_subscribers(struct ast_object* ast, struct oct_query_state* sqs)
+/**
+ * Parses the subscriber(Binding, TriggerFn, ClientState, Id) list written
+ * by find_subscriber/3.
+ */
+static errval_t read_subscribers(char* output,
+        struct oct_subscriber** subscribers, size_t* count)
 {
+    size_t capacity = 0;
+    struct oct_subscriber s;
+    struct list_parser_status status;
+    skb_read_list_init_offset(&status, output, 0);
+
+    while (skb_read_list(&status, "subscriber(%"SCNu64", %"SCNu64", %"SCNu64", %"SCNu64")",
+            &s.binding, &s.client_handler, &s.client_state, &s.server_id)) {
+        if (*count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            struct oct_subscriber* grown = realloc(*subscribers,
+                    capacity * sizeof(struct oct_subscriber));
+            if (grown == NULL) {
+                free(*subscribers);
+                *subscribers = NULL;
+                *count = 0;
+                return LIB_ERR_MALLOC_FAIL;
+            }
+            *subscribers = grown;
+        }
+        (*subscribers)[(*count)++] = s;
+    }
+
+    return SYS_ERR_OK;
+}
+
+errval_t find_subscribers(struct ast_object* ast, struct oct_query_state* sqs,
+        struct oct_subscriber** subscribers, size_t* count)
+{
+    *subscribers = NULL;
+    *count = 0;
+
+    errval_t err;
+    if (subscription_index_find(ast, subscribers, count, &err)) {
+        return err;
+    }
+
     struct skb_ec_terms sr;
-    errval_t err = transform_record(ast, &sr);
+    err = transform_record(ast, &sr);
     // TODO error if we have constraints here?
     if (err_is_ok(err)) {
         // Calling findall(X, find_subscriber(object(Name, Attributes), X), L), write(L)
@@ -517,6 +585,9 @@ errval_t find_subscribers(struct ast_object* ast, struct oct_query_state* sqs)
         if (err_no(err) == SKB_ERR_GOAL_FAILURE) {
             err = err_push(err, OCT_ERR_NO_SUBSCRIBERS);
         }
+        if (err_is_ok(err)) {
+            err = read_subscribers(sqs->std_out.buffer, subscribers, count);
+        }
     }
 
     OCT_DEBUG("find_subscribers\n");
@@ -0,0 +1,577 @@
+/**
+ * \file
+ * \brief Native index of octopus subscriptions.
+ *
+ * Prolog (pubsub3.pl) keeps the authoritative list of subscriptions. Every
+ * subscription added or removed through add_subscription/del_subscription is
+ * mirrored here, so the subscribers of a published record can be found
+ * without running a Prolog goal for every publish.
+ *
+ * Subscriptions are kept in a trie over the sorted set of attribute keys they
+ * have constraints on. A subscription only matches records that have all of
+ * its keys (see match_attributes/2), so matching a record only has to look
+ * at the trie paths made of its own keys and never touches subscriptions on
+ * unrelated attributes. Records and subscriptions the index can not evaluate
+ * exactly like Prolog (regular expressions, floats) are passed on to Prolog.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <barrelfish/barrelfish.h>
+#include <octopus_server/debug.h>
+
+#include "subscription_index.h"
+#include "record_store.h"
+
+#define SUBSCRIPTION_IDS_MIN 64
+#define CHILDREN_MIN 4
+#define SUBSCRIBERS_MIN 16
+
+struct constraint {
+    enum constraint_type op;
+    bool any; ///< Variable, matches every value of the attribute
+    struct record_attribute attr;
+};
+
+struct subscription {
+    struct subscription* next; ///< Next subscription in the same trie node
+    struct trie_node* node;
+    char* name; ///< Record name or NULL to match any name
+    bool native; ///< False if only Prolog can evaluate the subscription
+    struct oct_subscriber subscriber;
+    size_t count;
+    struct constraint constraints[]; ///< Sorted by key
+};
+
+/**
+ * The path from the root to a node spells a sorted set of attribute keys,
+ * the node holds the subscriptions constraining exactly these keys.
+ */
+struct trie_node {
+    char* key; ///< Last key of the path, NULL for the root
+    struct trie_node* parent;
+    struct trie_node** children; ///< Sorted by key
+    size_t nchildren;
+    size_t capacity;
+    struct subscription* subscriptions;
+};
+
+static struct subscription_index {
+    struct trie_node root;
+    struct subscription** by_id;
+    size_t ids; ///< Size of by_id
+    bool incomplete; ///< A subscription is missing, Prolog has to answer
+} subs;
+
+enum match {
+    MATCH_NO,
+    MATCH_YES,
+    MATCH_PROLOG, ///< Prolog has to decide
+};
+
+struct match_state {
+    const char* name;
+    struct record_attribute* attrs; ///< Sorted by key
+    size_t count;
+    struct oct_subscriber* found;
+    size_t nfound;
+    size_t capacity;
+    bool prolog; ///< Prolog has to answer the lookup
+};
+
+static int compare_constraints(const void* a, const void* b)
+{
+    return strcmp(((const struct constraint*) a)->attr.key,
+            ((const struct constraint*) b)->attr.key);
+}
+
+static int compare_attributes(const void* a, const void* b)
+{
+    return strcmp(((const struct record_attribute*) a)->key,
+            ((const struct record_attribute*) b)->key);
+}
+
+static int compare_subscribers(const void* a, const void* b)
+{
+    uint64_t ia = ((const struct oct_subscriber*) a)->server_id;
+    uint64_t ib = ((const struct oct_subscriber*) b)->server_id;
+    return (ia > ib) - (ia < ib);
+}
+
+/**
+ * \brief Binary search for the child with the given key.
+ *
+ * \param pos Set to the position of the child, or where it would have to be
+ * inserted.
+ */
+static struct trie_node* find_child(struct trie_node* node, const char* key,
+        size_t* pos)
+{
+    size_t lo = 0, hi = node->nchildren;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(node->children[mid]->key, key);
+        if (cmp == 0) {
+            *pos = mid;
+            return node->children[mid];
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    *pos = lo;
+    return NULL;
+}
+
+static struct trie_node* add_child(struct trie_node* node, const char* key)
+{
+    size_t pos;
+    struct trie_node* child = find_child(node, key, &pos);
+    if (child != NULL) {
+        return child;
+    }
+
+    if (node->nchildren == node->capacity) {
+        size_t capacity = node->capacity ? node->capacity * 2 : CHILDREN_MIN;
+        struct trie_node** children = realloc(node->children,
+                capacity * sizeof(struct trie_node*));
+        if (children == NULL) {
+            return NULL;
+        }
+        node->children = children;
+        node->capacity = capacity;
+    }
+
+    child = calloc(1, sizeof(struct trie_node));
+    if (child == NULL) {
+        return NULL;
+    }
+    child->key = strdup(key);
+    if (child->key == NULL) {
+        free(child);
+        return NULL;
+    }
+    child->parent = node;
+
+    memmove(&node->children[pos + 1], &node->children[pos],
+            (node->nchildren - pos) * sizeof(struct trie_node*));
+    node->children[pos] = child;
+    node->nchildren++;
+
+    return child;
+}
+
+/// Removes empty nodes from the leaf upwards
+static void prune(struct trie_node* node)
+{
+    while (node->parent != NULL && node->subscriptions == NULL &&
+            node->nchildren == 0) {
+        struct trie_node* parent = node->parent;
+
+        size_t pos;
+        struct trie_node* child = find_child(parent, node->key, &pos);
+        assert(child == node);
+        memmove(&parent->children[pos], &parent->children[pos + 1],
+                (parent->nchildren - pos - 1) * sizeof(struct trie_node*));
+        parent->nchildren--;
+
+        free(node->children);
+        free(node->key);
+        free(node);
+        node = parent;
+    }
+}
+
+static void free_subscription(struct subscription* s)
+{
+    for (size_t i = 0; i < s->count; i++) {
+        free(s->constraints[i].attr.key);
+        if (s->constraints[i].attr.type != RECORD_VALUE_INTEGER) {
+            free(s->constraints[i].attr.value.str);
+        }
+    }
+    free(s->name);
+    free(s);
+}
+
+static errval_t grow_ids(uint64_t id)
+{
+    size_t ids = subs.ids ? subs.ids : SUBSCRIPTION_IDS_MIN;
+    while (ids <= id) {
+        ids *= 2;
+    }
+
+    struct subscription** by_id = realloc(subs.by_id,
+            ids * sizeof(struct subscription*));
+    if (by_id == NULL) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+    memset(&by_id[subs.ids], 0, (ids - subs.ids) * sizeof(struct subscription*));
+    subs.by_id = by_id;
+    subs.ids = ids;
+
+    return SYS_ERR_OK;
+}
+
+/**
+ * Converts the template to constraints, the same way make_all_constraints/3
+ * does in Prolog.
+ */
+static struct subscription* new_subscription(struct ast_object* ast)
+{
+    size_t count = 0;
+    struct ast_object* iter = ast->u.on.attrs;
+    for (; iter != NULL; iter = iter->u.an.next) {
+        count++;
+    }
+
+    struct subscription* s = calloc(1, sizeof(struct subscription) +
+            count * sizeof(struct constraint));
+    if (s == NULL) {
+        return NULL;
+    }
+    s->native = true;
+
+    struct ast_object* name = ast->u.on.name;
+    if (name->type == nodeType_Ident) {
+        s->name = strdup(name->u.in.str);
+        if (s->name == NULL) {
+            goto fail;
+        }
+    }
+    else if (name->type != nodeType_Variable) {
+        // name regex
+        s->native = false;
+    }
+
+    for (iter = ast->u.on.attrs; iter != NULL; iter = iter->u.an.next) {
+        assert(iter->type == nodeType_Attribute);
+        struct ast_object* left = iter->u.an.attr->u.pn.left;
+        struct ast_object* right = iter->u.an.attr->u.pn.right;
+        struct constraint* c = &s->constraints[s->count++];
+
+        c->attr.type = RECORD_VALUE_INTEGER;
+        c->attr.key = strdup(left->u.in.str);
+        if (c->attr.key == NULL) {
+            goto fail;
+        }
+
+        c->op = constraint_EQ;
+        if (right->type == nodeType_Constraint) {
+            c->op = right->u.cnsn.op;
+            right = right->u.cnsn.value;
+        }
+
+        switch (right->type) {
+        case nodeType_Constant:
+            c->attr.value.integer = right->u.cn.value;
+            break;
+
+        case nodeType_Ident:
+        case nodeType_String:
+            c->attr.type = right->type == nodeType_Ident ?
+                    RECORD_VALUE_ATOM : RECORD_VALUE_STRING;
+            c->attr.value.str = strdup(right->type == nodeType_Ident ?
+                    right->u.in.str : right->u.sn.str);
+            if (c->attr.value.str == NULL) {
+                goto fail;
+            }
+            break;
+
+        case nodeType_Variable:
+            c->any = true;
+            break;
+
+        default:
+            // floats
+            c->any = true;
+            s->native = false;
+            break;
+        }
+
+        if (c->op == constraint_REGEX || (c->any && c->op != constraint_EQ)) {
+            s->native = false;
+        }
+    }
+
+    qsort(s->constraints, s->count, sizeof(struct constraint),
+            compare_constraints);
+    return s;
+
+fail:
+    free_subscription(s);
+    return NULL;
+}
+
+errval_t subscription_index_add(struct ast_object* ast,
+        struct oct_subscriber* subscriber)
+{
+    assert(ast != NULL);
+    assert(ast->type == nodeType_Object);
+    assert(subscriber != NULL);
+
+    if (subs.incomplete) {
+        return SYS_ERR_OK;
+    }
+
+    uint64_t id = subscriber->server_id;
+    subscription_index_del(id);
+
+    errval_t err = SYS_ERR_OK;
+    if (id >= subs.ids) {
+        err = grow_ids(id);
+        if (err_is_fail(err)) {
+            goto fail;
+        }
+    }
+
+    struct subscription* s = new_subscription(ast);
+    if (s == NULL) {
+        err = LIB_ERR_MALLOC_FAIL;
+        goto fail;
+    }
+    s->subscriber = *subscriber;
+
+    // walk down the path of the distinct keys
+    struct trie_node* node = &subs.root;
+    for (size_t i = 0; node != NULL && i < s->count; i++) {
+        if (i == 0 || strcmp(s->constraints[i-1].attr.key,
+                s->constraints[i].attr.key) != 0) {
+            node = add_child(node, s->constraints[i].attr.key);
+        }
+    }
+    if (node == NULL) {
+        free_subscription(s);
+        err = LIB_ERR_MALLOC_FAIL;
+        goto fail;
+    }
+
+    s->node = node;
+    s->next = node->subscriptions;
+    node->subscriptions = s;
+    subs.by_id[id] = s;
+
+    OCT_DEBUG("subscription_index_add: id=%"PRIu64" native=%d\n", id,
+            s->native);
+    return SYS_ERR_OK;
+
+fail:
+    subs.incomplete = true;
+    return err;
+}
+
+void subscription_index_del(uint64_t id)
+{
+    if (id >= subs.ids || subs.by_id[id] == NULL) {
+        return;
+    }
+
+    struct subscription* s = subs.by_id[id];
+    subs.by_id[id] = NULL;
+
+    struct subscription** p = &s->node->subscriptions;
+    while (*p != s) {
+        p = &(*p)->next;
+    }
+    *p = s->next;
+
+    prune(s->node);
+    free_subscription(s);
+}
+
+/**
+ * Matches a subscription against a record, see match_message/2 in
+ * pubsub3.pl.
+ */
+static enum match match_subscription(struct subscription* s,
+        struct match_state* st)
+{
+    if (!s->native) {
+        return MATCH_PROLOG;
+    }
+    if (s->name != NULL && strcmp(s->name, st->name) != 0) {
+        return MATCH_NO;
+    }
+
+    for (size_t i = 0; i < s->count; i++) {
+        struct constraint* c = &s->constraints[i];
+        struct record_attribute* a = bsearch(&c->attr, st->attrs, st->count,
+                sizeof(struct record_attribute), compare_attributes);
+        // the trie only leads to subscriptions on keys of the record
+        assert(a != NULL);
+
+        if (c->any) {
+            continue;
+        }
+
+        bool holds = false;
+        if (c->attr.type == RECORD_VALUE_INTEGER) {
+            int64_t v = c->attr.value.integer;
+            int64_t av = a->value.integer;
+            holds = a->type == RECORD_VALUE_INTEGER &&
+                    constraint_holds(c->op, (av > v) - (av < v));
+        }
+        else {
+            // atoms and strings compare by their text (see string_compare/3)
+            holds = a->type != RECORD_VALUE_INTEGER &&
+                    constraint_holds(c->op, strcmp(a->value.str,
+                            c->attr.value.str));
+        }
+        if (!holds) {
+            return MATCH_NO;
+        }
+    }
+
+    return MATCH_YES;
+}
+
+static bool add_found(struct match_state* st, struct oct_subscriber* s)
+{
+    if (st->nfound == st->capacity) {
+        size_t capacity = st->capacity ? st->capacity * 2 : SUBSCRIBERS_MIN;
+        struct oct_subscriber* found = realloc(st->found,
+                capacity * sizeof(struct oct_subscriber));
+        if (found == NULL) {
+            return false;
+        }
+        st->found = found;
+        st->capacity = capacity;
+    }
+
+    st->found[st->nfound++] = *s;
+    return true;
+}
+
+/**
+ * Visits all nodes whose path is a subset of the record keys, starting at
+ * key index first.
+ */
+static void visit(struct trie_node* node, size_t first, struct match_state* st)
+{
+    for (struct subscription* s = node->subscriptions; s != NULL;
+            s = s->next) {
+        enum match m = match_subscription(s, st);
+        if (m == MATCH_PROLOG || (m == MATCH_YES &&
+                !add_found(st, &s->subscriber))) {
+            st->prolog = true;
+            return;
+        }
+    }
+
+    for (size_t i = first; node->nchildren > 0 && i < st->count; i++) {
+        size_t pos;
+        struct trie_node* child = find_child(node, st->attrs[i].key, &pos);
+        if (child != NULL) {
+            visit(child, i + 1, st);
+            if (st->prolog) {
+                return;
+            }
+        }
+    }
+}
+
+bool subscription_index_find(struct ast_object* ast,
+        struct oct_subscriber** subscribers, size_t* count, errval_t* err)
+{
+    assert(ast != NULL);
+    assert(ast->type == nodeType_Object);
+    assert(subscribers != NULL);
+    assert(count != NULL);
+    assert(err != NULL);
+
+    if (subs.incomplete || ast->u.on.name->type != nodeType_Ident) {
+        return false;
+    }
+
+    struct match_state st = {
+        .name = ast->u.on.name->u.in.str,
+    };
+
+    size_t n = 0;
+    struct ast_object* iter = ast->u.on.attrs;
+    for (; iter != NULL; iter = iter->u.an.next) {
+        n++;
+    }
+    st.attrs = malloc(n * sizeof(struct record_attribute));
+    if (st.attrs == NULL && n > 0) {
+        return false;
+    }
+
+    // only plain attributes are published, constraints are ignored
+    for (iter = ast->u.on.attrs; iter != NULL; iter = iter->u.an.next) {
+        struct ast_object* left = iter->u.an.attr->u.pn.left;
+        struct ast_object* right = iter->u.an.attr->u.pn.right;
+        struct record_attribute* a = &st.attrs[st.count];
+
+        a->key = left->u.in.str;
+        switch (right->type) {
+        case nodeType_Constraint:
+            continue;
+
+        case nodeType_Constant:
+            a->type = RECORD_VALUE_INTEGER;
+            a->value.integer = right->u.cn.value;
+            break;
+
+        case nodeType_Ident:
+            a->type = RECORD_VALUE_ATOM;
+            a->value.str = right->u.in.str;
+            break;
+
+        case nodeType_String:
+            a->type = RECORD_VALUE_STRING;
+            a->value.str = right->u.sn.str;
+            break;
+
+        default:
+            // floats and variables
+            st.prolog = true;
+            break;
+        }
+        st.count++;
+    }
+
+    if (st.count > 0) {
+        qsort(st.attrs, st.count, sizeof(struct record_attribute),
+                compare_attributes);
+    }
+    for (size_t i = 1; !st.prolog && i < st.count; i++) {
+        // a key with several values
+        st.prolog = strcmp(st.attrs[i-1].key, st.attrs[i].key) == 0;
+    }
+
+    if (!st.prolog) {
+        visit(&subs.root, 0, &st);
+    }
+    free(st.attrs);
+
+    if (st.prolog) {
+        free(st.found);
+        return false;
+    }
+
+    if (st.nfound > 0) {
+        qsort(st.found, st.nfound, sizeof(struct oct_subscriber),
+                compare_subscribers);
+    }
+
+    OCT_DEBUG("subscription_index_find: %zu subscribers\n", st.nfound);
+    *subscribers = st.found;
+    *count = st.nfound;
+    *err = SYS_ERR_OK;
+    return true;
+}
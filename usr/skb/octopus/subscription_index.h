@@ -0,0 +1,56 @@
+/**
+ * \file
+ * \brief Native index of octopus subscriptions.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef SUBSCRIPTION_INDEX_H_
+#define SUBSCRIPTION_INDEX_H_
+
+#include <barrelfish/barrelfish.h>
+#include <octopus_server/query.h>
+#include <octopus/parser/ast.h>
+
+/**
+ * \brief Mirrors a subscription stored by Prolog.
+ *
+ * \param ast Subscription template.
+ * \param subscriber Recipient of matching records, server_id is the id of
+ * the subscription.
+ *
+ * \retval SYS_ERR_OK
+ * \retval LIB_ERR_MALLOC_FAIL
+ */
+errval_t subscription_index_add(struct ast_object* ast,
+        struct oct_subscriber* subscriber);
+
+/**
+ * \brief Forgets a subscription deleted by Prolog.
+ */
+void subscription_index_del(uint64_t id);
+
+/**
+ * \brief Finds the subscribers of a published record without Prolog, if
+ * possible.
+ *
+ * \param ast Published record.
+ * \param subscribers Matching subscribers, ordered by subscription id.
+ * \param count Number of matching subscribers.
+ * \param err Result of the lookup if it was answered.
+ *
+ * \retval true Lookup was answered, err is set.
+ * \retval false Lookup needs Prolog (regular expressions, floating point
+ * values or variables in the record or in a candidate subscription).
+ */
+bool subscription_index_find(struct ast_object* ast,
+        struct oct_subscriber** subscribers, size_t* count, errval_t* err);
+
+#endif /* SUBSCRIPTION_INDEX_H_ */
@@ -396,7 +396,8 @@ errval_t del_subscription(struct octopus_binding* b, uint64_t id,
     return OCT_ERR_NO_SUBSCRIPTION;
 }
 
-errval_t find_subscribers(struct ast_object* ast, struct oct_query_state* sqs)
+errval_t find_subscribers(struct ast_object* ast, struct oct_query_state* sqs,
+        struct oct_subscriber** subscribers, size_t* count)
 {
     assert(!"NYI");
     return OCT_ERR_NO_SUBSCRIBERS;
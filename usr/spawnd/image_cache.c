@@ -0,0 +1,196 @@
+/**
+ * \file
+ * \brief Cache of the images spawned from the file system
+ *
+ * Keeps the binaries spawnd loaded as shared images, so spawning the same
+ * binary again neither reads the file nor copies its read-only segments.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <barrelfish/barrelfish.h>
+#include <spawndomain/spawndomain.h>
+#include <vfs/vfs.h>
+
+#include "internal.h"
+
+/// number of images kept, the least recently spawned one is replaced
+#define IMAGE_CACHE_ENTRIES 16
+
+static struct image_cache_entry cache[IMAGE_CACHE_ENTRIES];
+
+/// incremented for every lookup, orders the entries by their last use
+static uint64_t cache_clock;
+
+static errval_t read_file(vfs_handle_t fh, size_t size, uint8_t **retimage)
+{
+    errval_t err;
+
+    uint8_t *image = malloc(size);
+    if (image == NULL) {
+        return LIB_ERR_MALLOC_FAIL;
+    }
+
+    size_t pos = 0, readlen;
+    do {
+        err = vfs_read(fh, &image[pos], size - pos, &readlen);
+        if (err_is_fail(err)) {
+            free(image);
+            return err;
+        } else if (readlen == 0) {
+            free(image);
+            return SPAWN_ERR_LOAD; // XXX
+        } else {
+            pos += readlen;
+        }
+    } while (err_is_ok(err) && readlen > 0 && pos < size);
+
+    *retimage = image;
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Read a file into memory
+ *
+ * \param path      Path of the file
+ * \param retimage  Returns the contents, to be freed by the caller
+ * \param retsize   Returns the size of the file
+ */
+errval_t image_read(const char *path, uint8_t **retimage, size_t *retsize)
+{
+    errval_t err;
+
+    vfs_handle_t fh;
+    err = vfs_open(path, &fh);
+    if (err_is_fail(err)) {
+        return err_push(err, SPAWN_ERR_LOAD);
+    }
+
+    struct vfs_fileinfo info;
+    err = vfs_stat(fh, &info);
+    if (err_is_fail(err)) {
+        vfs_close(fh);
+        return err_push(err, SPAWN_ERR_LOAD);
+    }
+
+    assert(info.type == VFS_FILE);
+    err = read_file(fh, info.size, retimage);
+    if (err_is_fail(err)) {
+        vfs_close(fh);
+        return err_push(err, SPAWN_ERR_LOAD);
+    }
+    *retsize = info.size;
+
+    err = vfs_close(fh);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "failed to close file %s", path);
+    }
+
+    return SYS_ERR_OK;
+}
+
+static void cache_evict(struct image_cache_entry *e)
+{
+    if (e->shared) {
+        errval_t err = spawn_image_destroy(&e->image);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "failed to free image of %s", e->path);
+        }
+    }
+    free(e->binary);
+    free(e->path);
+    memset(e, 0, sizeof(*e));
+}
+
+/**
+ * \brief Look up the image of a binary, loading it on a miss
+ *
+ * \param path      Path of the binary
+ * \param retentry  Returns the cache entry, valid until the next lookup
+ *
+ * Binaries that cannot be loaded into a shared image are cached as read
+ * from the file. An entry is reloaded if the size of the file changed, the
+ * file system does not tell us about other modifications.
+ */
+errval_t image_cache_lookup(const char *path,
+                            struct image_cache_entry **retentry)
+{
+    errval_t err;
+
+    vfs_handle_t fh;
+    err = vfs_open(path, &fh);
+    if (err_is_fail(err)) {
+        return err_push(err, SPAWN_ERR_LOAD);
+    }
+
+    struct vfs_fileinfo info;
+    err = vfs_stat(fh, &info);
+    if (err_is_fail(err)) {
+        vfs_close(fh);
+        return err_push(err, SPAWN_ERR_LOAD);
+    }
+    assert(info.type == VFS_FILE);
+
+    cache_clock++;
+
+    struct image_cache_entry *e = NULL, *victim = &cache[0];
+    for (int i = 0; i < IMAGE_CACHE_ENTRIES; i++) {
+        if (cache[i].path != NULL && strcmp(cache[i].path, path) == 0) {
+            e = &cache[i];
+            break;
+        }
+        if (cache[i].last_use < victim->last_use) {
+            victim = &cache[i];
+        }
+    }
+
+    if (e != NULL && e->size == info.size) {
+        vfs_close(fh);
+        e->last_use = cache_clock;
+        *retentry = e;
+        return SYS_ERR_OK;
+    }
+
+    if (e != NULL) {
+        victim = e;
+    }
+    if (victim->path != NULL) {
+        cache_evict(victim);
+    }
+    e = victim;
+
+    uint8_t *binary;
+    err = read_file(fh, info.size, &binary);
+    vfs_close(fh);
+    if (err_is_fail(err)) {
+        return err_push(err, SPAWN_ERR_LOAD);
+    }
+
+    e->path = strdup(path);
+    if (e->path == NULL) {
+        free(binary);
+        return LIB_ERR_MALLOC_FAIL;
+    }
+    e->size = info.size;
+    e->last_use = cache_clock;
+
+    err = spawn_image_create(&e->image, (lvaddr_t)binary, info.size);
+    if (err_is_ok(err)) {
+        e->shared = true;
+        free(binary);
+    } else {
+        e->binary = binary;
+    }
+
+    *retentry = e;
+    return SYS_ERR_OK;
+}
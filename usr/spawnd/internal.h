@@ -15,6 +15,8 @@
 #ifndef INTERNAL_H_
 #define INTERNAL_H_
 
+#include <spawndomain/spawndomain.h>
+
 #define SERVICE_BASENAME    "spawn" // the core ID is appended to this
 #define ALL_SPAWNDS_UP 	    "all_spawnds_up"
 
@@ -23,4 +25,18 @@ extern const char *gbootmodules;
 
 errval_t start_service(void);
 
+/// an image in the cache of spawnd
+struct image_cache_entry {
+    char *path;                 ///< path of the binary
+    size_t size;                ///< size of the binary when it was loaded
+    bool shared;                ///< image is valid, binary is NULL
+    struct spawn_image image;   ///< loaded binary
+    uint8_t *binary;            ///< file contents if it cannot be shared
+    uint64_t last_use;          ///< cache clock of the last lookup
+};
+
+errval_t image_read(const char *path, uint8_t **retimage, size_t *retsize);
+errval_t image_cache_lookup(const char *path,
+                            struct image_cache_entry **retentry);
+
 #endif //INTERNAL_H_
@@ -32,6 +32,7 @@ struct ps_entry {
     char *argbuf;
     size_t argbytes;
     struct capref rootcn_cap, dcb;
+    struct capref sharedcn_cap;     ///< shared image frames, or NULL_CAP
     struct cnoderef rootcn;
     uint8_t exitcode;
     enum ps_status status;
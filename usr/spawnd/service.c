@@ -25,80 +25,93 @@
 #include <if/monitor_blocking_defs.h>
 #include <barrelfish/dispatcher_arch.h>
 #include <barrelfish/invocations_arch.h>
+#include <barrelfish/deferred.h>
 
 #include "internal.h"
 #include "ps.h"
 
 
-static errval_t spawn(const char *path, char *const argv[], const char *argbuf,
-                      size_t argbytes, char *const envp[],
-                      struct capref inheritcn_cap, struct capref argcn_cap,
-                      uint8_t flags, domainid_t *domainid)
+/// domain set up ahead of the next spawn request, NULL if there is none
+static struct spawninfo *prepared_si;
+static struct deferred_event prepare_event;
+static bool prepare_pending;
+
+static void prepare_next(void *arg)
 {
-    errval_t err, msgerr;
+    errval_t err;
 
-    /* read file into memory */
-    vfs_handle_t fh;
-    err = vfs_open(path, &fh);
-    if (err_is_fail(err)) {
-        return err_push(err, SPAWN_ERR_LOAD);
+    prepare_pending = false;
+    if (prepared_si != NULL) {
+        return;
     }
 
-    struct vfs_fileinfo info;
-    err = vfs_stat(fh, &info);
+    struct spawninfo *si = malloc(sizeof(struct spawninfo));
+    if (si == NULL) {
+        DEBUG_ERR(LIB_ERR_MALLOC_FAIL, "preparing next domain");
+        return;
+    }
+    err = spawn_prepare(si, CURRENT_CPU_TYPE);
     if (err_is_fail(err)) {
-        vfs_close(fh);
-        return err_push(err, SPAWN_ERR_LOAD);
+        DEBUG_ERR(err, "preparing next domain");
+        free(si);
+        return;
     }
+    prepared_si = si;
+}
 
-    assert(info.type == VFS_FILE);
-    uint8_t *image = malloc(info.size);
-    if (image == NULL) {
-        vfs_close(fh);
-        return err_push(err, SPAWN_ERR_LOAD);
+/**
+ * \brief Prepare the next domain once the current request is answered
+ */
+static void schedule_prepare(void)
+{
+    if (prepare_pending) {
+        return;
     }
 
-    size_t pos = 0, readlen;
-    do {
-        err = vfs_read(fh, &image[pos], info.size - pos, &readlen);
-        if (err_is_fail(err)) {
-            vfs_close(fh);
-            free(image);
-            return err_push(err, SPAWN_ERR_LOAD);
-        } else if (readlen == 0) {
-            vfs_close(fh);
-            free(image);
-            return SPAWN_ERR_LOAD; // XXX
-        } else {
-            pos += readlen;
-        }
-    } while (err_is_ok(err) && readlen > 0 && pos < info.size);
-
-    err = vfs_close(fh);
+    errval_t err = deferred_event_register(&prepare_event,
+                                           get_default_waitset(), 0,
+                                           MKCLOSURE(prepare_next, NULL));
     if (err_is_fail(err)) {
-        DEBUG_ERR(err, "failed to close file %s", path);
+        DEBUG_ERR(err, "deferred_event_register");
+        return;
     }
+    prepare_pending = true;
+}
 
-    // find short name (last part of path)
-    const char *name = strrchr(path, VFS_PATH_SEP);
-    if (name == NULL) {
-        name = path;
-    } else {
-        name++;
-    }
+/**
+ * \brief Returns a domain with its cspace and vspace set up
+ *
+ * Usually the one prepared after the previous request, so the cspace setup
+ * is off the path of a spawn request.
+ */
+static errval_t take_prepared(struct spawninfo **retsi)
+{
+    errval_t err;
 
-    /* spawn the image */
-    struct spawninfo si;
-    si.flags = flags;
-    err = spawn_load_image(&si, (lvaddr_t)image, info.size, CURRENT_CPU_TYPE,
-                           name, my_core_id, argv, envp, inheritcn_cap,
-                           argcn_cap);
-    if (err_is_fail(err)) {
-        free(image);
-        return err;
+    struct spawninfo *si = prepared_si;
+    prepared_si = NULL;
+    if (si == NULL) {
+        si = malloc(sizeof(struct spawninfo));
+        if (si == NULL) {
+            return LIB_ERR_MALLOC_FAIL;
+        }
+        err = spawn_prepare(si, CURRENT_CPU_TYPE);
+        if (err_is_fail(err)) {
+            free(si);
+            return err;
+        }
     }
 
-    free(image);
+    schedule_prepare();
+    *retsi = si;
+    return SYS_ERR_OK;
+}
+
+static errval_t start_domain(struct spawninfo *si, const char *path,
+                             char *const argv[], const char *argbuf,
+                             size_t argbytes, domainid_t *domainid)
+{
+    errval_t err, msgerr;
 
     /* request connection from monitor */
     struct monitor_blocking_binding *mrpc = get_monitor_blocking_binding();
@@ -116,12 +129,12 @@ static errval_t spawn(const char *path, char *const argv[], const char *argbuf,
 
     /* copy connection into the new domain */
     struct capref destep = {
-        .cnode = si.taskcn,
+        .cnode = si->taskcn,
         .slot  = TASKCN_SLOT_MONITOREP,
     };
     err = cap_copy(destep, monep);
     if (err_is_fail(err)) {
-        spawn_free(&si);
+        spawn_free(si);
         cap_destroy(monep);
         return err_push(err, SPAWN_ERR_MONITOR_CLIENT);
     }
@@ -135,7 +148,7 @@ static errval_t spawn(const char *path, char *const argv[], const char *argbuf,
 
     /* give the perfmon capability */
     struct capref dest, src;
-    dest.cnode = si.taskcn;
+    dest.cnode = si->taskcn;
     dest.slot = TASKCN_SLOT_PERF_MON;
     src.cnode = cnode_task;
     src.slot = TASKCN_SLOT_PERF_MON;
@@ -145,9 +158,9 @@ static errval_t spawn(const char *path, char *const argv[], const char *argbuf,
     }
 
     /* run the domain */
-    err = spawn_run(&si);
+    err = spawn_run(si);
     if (err_is_fail(err)) {
-        spawn_free(&si);
+        spawn_free(si);
         return err_push(err, SPAWN_ERR_RUN);
     }
 
@@ -168,13 +181,22 @@ static errval_t spawn(const char *path, char *const argv[], const char *argbuf,
      */
     err = slot_alloc(&pe->rootcn_cap);
     assert(err_is_ok(err));
-    err = cap_copy(pe->rootcn_cap, si.rootcn_cap);
-    pe->rootcn = si.rootcn;
+    err = cap_copy(pe->rootcn_cap, si->rootcn_cap);
+    pe->rootcn = si->rootcn;
     assert(err_is_ok(err));
     err = slot_alloc(&pe->dcb);
     assert(err_is_ok(err));
-    err = cap_copy(pe->dcb, si.dcb);
+    err = cap_copy(pe->dcb, si->dcb);
     assert(err_is_ok(err));
+    // the caps to the shared frames of the image and their mappings live
+    // in a CNode of ours, which goes away together with the domain
+    pe->sharedcn_cap = NULL_CAP;
+    if (!capref_is_null(si->sharedcn_cap)) {
+        err = slot_alloc(&pe->sharedcn_cap);
+        assert(err_is_ok(err));
+        err = cap_copy(pe->sharedcn_cap, si->sharedcn_cap);
+        assert(err_is_ok(err));
+    }
     pe->status = PS_STATUS_RUNNING;
     err = ps_allocate(pe, domainid);
     if(err_is_fail(err)) {
@@ -182,11 +204,11 @@ static errval_t spawn(const char *path, char *const argv[], const char *argbuf,
     }
 
     // Store in target dispatcher frame
-    struct dispatcher_generic *dg = get_dispatcher_generic(si.handle);
+    struct dispatcher_generic *dg = get_dispatcher_generic(si->handle);
     dg->domain_id = *domainid;
 
     /* cleanup */
-    err = spawn_free(&si);
+    err = spawn_free(si);
     if (err_is_fail(err)) {
         return err_push(err, SPAWN_ERR_FREE);
     }
@@ -194,6 +216,68 @@ static errval_t spawn(const char *path, char *const argv[], const char *argbuf,
     return SYS_ERR_OK;
 }
 
+static errval_t spawn(const char *path, char *const argv[], const char *argbuf,
+                      size_t argbytes, char *const envp[],
+                      struct capref inheritcn_cap, struct capref argcn_cap,
+                      uint8_t flags, domainid_t *domainid)
+{
+    errval_t err;
+
+    /* find the image, read the file only if it is not cached */
+    struct image_cache_entry *cached = NULL;
+    uint8_t *image = NULL;
+    size_t image_size = 0;
+    if (flags & SPAWN_FLAGS_OMP) {
+        // the OpenMP functions are looked up in the binary itself
+        err = image_read(path, &image, &image_size);
+    } else {
+        err = image_cache_lookup(path, &cached);
+        if (err_is_ok(err) && !cached->shared) {
+            image = cached->binary;
+            image_size = cached->size;
+        }
+    }
+    if (err_is_fail(err)) {
+        return err;
+    }
+
+    // find short name (last part of path)
+    const char *name = strrchr(path, VFS_PATH_SEP);
+    if (name == NULL) {
+        name = path;
+    } else {
+        name++;
+    }
+
+    /* spawn the image */
+    struct spawninfo *si;
+    err = take_prepared(&si);
+    if (err_is_fail(err)) {
+        if (cached == NULL) {
+            free(image);
+        }
+        return err;
+    }
+    si->flags = flags;
+    if (cached != NULL && cached->shared) {
+        err = spawn_load_shared_image(si, &cached->image, name, my_core_id,
+                                      argv, envp, inheritcn_cap, argcn_cap);
+    } else {
+        err = spawn_load_prepared_image(si, (lvaddr_t)image, image_size,
+                                        name, my_core_id, argv, envp,
+                                        inheritcn_cap, argcn_cap);
+    }
+    if (cached == NULL) {
+        free(image);
+    }
+    if (err_is_ok(err)) {
+        err = start_domain(si, path, argv, argbuf, argbytes, domainid);
+    }
+
+    free(si);
+    return err;
+}
+
 static void retry_use_local_memserv_response(void *a)
 {
     errval_t err;
@@ -386,6 +470,9 @@ static errval_t kill_domain(domainid_t domainid, uint8_t exitcode)
     // Garbage collect victim's capabilities
     cleanup_cap(ps->dcb);       // Deschedule dispatcher (do this first!)
     cleanup_cap(ps->rootcn_cap);
+    if (!capref_is_null(ps->sharedcn_cap)) {
+        cleanup_cap(ps->sharedcn_cap);
+    }
 
     // XXX: why only when waiters exist? -SG
     if(ps->waiters != NULL) {
@@ -584,6 +671,9 @@ static errval_t connect_cb(void *st, struct spawn_binding *b)
 
 errval_t start_service(void)
 {
+    deferred_event_init(&prepare_event);
+    schedule_prepare();
+
     return spawn_export(NULL, export_cb, connect_cb, get_default_waitset(),
                          IDC_EXPORT_FLAGS_DEFAULT);
 }
@@ -0,0 +1,137 @@
+/**
+ * \file
+ * \brief Buddy backend of the memory manager: merging of freed blocks
+ *
+ * Sets up an allocator like mem_serv_dist does (buddy backend, chunked caps
+ * kept), splits a RAM region into its smallest blocks, frees them in an
+ * interleaved order and checks that the whole region can be allocated again,
+ * which only works if all buddies were merged. Does so twice, to check that
+ * merged blocks can be split again. The buddy backend does not implement
+ * mm_realloc_range(), so that is only checked to fail cleanly.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <barrelfish/barrelfish.h>
+#include <barrelfish/debug.h>
+#include <mm/mm.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define REGION_BITS     16
+#define BLOCK_BITS      BASE_PAGE_BITS
+#define NBLOCKS         (1UL << (REGION_BITS - BLOCK_BITS))
+#define ROUNDS          2
+
+static char nodebuf[SLAB_STATIC_SIZE(4 * NBLOCKS, MM_BUDDY_NODE_SIZE)];
+
+/// hands out consecutive slots of a single L2 CNode
+static errval_t test_slot_alloc(void *inst, uint64_t nslots,
+                                struct capref *ret)
+{
+    struct capref *next = inst;
+    if (next->slot + nslots > L2_CNODE_SLOTS) {
+        return LIB_ERR_SLOT_ALLOC_NO_SPACE;
+    }
+    *ret = *next;
+    next->slot += nslots;
+    return SYS_ERR_OK;
+}
+
+int main(int argc, char **argv)
+{
+    errval_t err;
+
+    struct capref ram;
+    err = ram_alloc(&ram, REGION_BITS);
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "ram_alloc");
+    }
+
+    struct capability info;
+    err = debug_cap_identify(ram, &info);
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "debug_cap_identify");
+    }
+    genpaddr_t base = info.u.ram.base;
+
+    struct capref cnode_cap, next_slot;
+    err = cnode_create_l2(&cnode_cap, &next_slot.cnode);
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "cnode_create_l2");
+    }
+    next_slot.slot = 0;
+
+    struct mm mm;
+    err = mm_init_buddy(&mm, ObjType_RAM, base, REGION_BITS, NULL,
+                        test_slot_alloc, NULL, &next_slot, false);
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "mm_init_buddy");
+    }
+    slab_grow(&mm.slabs, nodebuf, sizeof(nodebuf));
+
+    err = mm_add(&mm, ram, REGION_BITS, base);
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "mm_add");
+    }
+
+    struct capref caps[NBLOCKS];
+    genpaddr_t bases[NBLOCKS];
+
+    for (int round = 0; round < ROUNDS; round++) {
+        genpaddr_t seen = 0;
+        for (size_t i = 0; i < NBLOCKS; i++) {
+            err = mm_alloc(&mm, BLOCK_BITS, &caps[i], &bases[i]);
+            if (err_is_fail(err)) {
+                USER_PANIC_ERR(err, "mm_alloc of block %zu", i);
+            }
+            size_t index = (bases[i] - base) >> BLOCK_BITS;
+            assert(index < NBLOCKS);
+            assert(!(seen & ((genpaddr_t)1 << index)));
+            seen |= (genpaddr_t)1 << index;
+        }
+
+        struct capref extra;
+        err = mm_alloc(&mm, BLOCK_BITS, &extra, NULL);
+        assert(err_no(err) == MM_ERR_NOT_FOUND);
+
+        // free every other block first, so no merge happens before the
+        // second half is freed
+        for (size_t i = 0; i < NBLOCKS; i += 2) {
+            err = mm_free(&mm, caps[i], bases[i], BLOCK_BITS);
+            assert(err_is_ok(err));
+        }
+        for (size_t i = 1; i < NBLOCKS; i += 2) {
+            err = mm_free(&mm, caps[i], bases[i], BLOCK_BITS);
+            assert(err_is_ok(err));
+        }
+
+        struct capref whole;
+        genpaddr_t wholebase;
+        err = mm_alloc(&mm, REGION_BITS, &whole, &wholebase);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "freed blocks were not merged in round %d",
+                           round);
+        }
+        assert(wholebase == base);
+
+        err = mm_free(&mm, whole, wholebase, REGION_BITS);
+        assert(err_is_ok(err));
+    }
+
+    // reallocating a given range is not supported by the buddy backend
+    struct capref range;
+    err = mm_realloc_range(&mm, BLOCK_BITS, base, &range);
+    assert(err_no(err) == LIB_ERR_NOT_IMPLEMENTED);
+
+    printf("mm_buddy: merging test passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,126 @@
+/**
+ * \file
+ * \brief Affinity mode of waitsets: events for a thread waiting in an RPC
+ *
+ * One thread dispatches events on a waitset in affinity mode, another one
+ * owns the local queue of a channel and blocks waiting for the reply of an
+ * RPC. The reply is only sent by the handler of that channel's event, so the
+ * event has to be handled by the dispatching thread, not queued for the
+ * thread in the RPC.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <barrelfish/barrelfish.h>
+#include <barrelfish/waitset.h>
+#include <barrelfish/waitset_chan.h>
+#include <barrelfish/threads.h>
+
+#define YIELDS_BEFORE_TRIGGER   16
+#define YIELDS_FOR_REPLY        10000
+
+static struct waitset ws;
+static struct waitset_chanstate request, reply;
+static struct thread *dispatcher, *handled_by;
+static volatile bool replied = false;
+
+static void request_handler(void *arg)
+{
+    handled_by = thread_self();
+
+    // answer the RPC
+    errval_t err = waitset_chan_trigger(&reply);
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "waitset_chan_trigger");
+    }
+}
+
+static void reply_handler(void *arg)
+{
+    USER_PANIC("reply must be received by the waiting thread");
+}
+
+static int dispatcher_thread(void *arg)
+{
+    for (;;) {
+        errval_t err = event_dispatch(&ws);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "event_dispatch");
+        }
+    }
+    return 0;
+}
+
+static int rpc_thread(void *arg)
+{
+    errval_t err, rpc_err = SYS_ERR_OK;
+
+    // the request channel sticks to us, like a binding we used before
+    err = waitset_chan_set_affinity(&request, thread_self());
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "waitset_chan_set_affinity");
+    }
+
+    reply.wait_for = thread_self();
+    err = wait_for_channel(&ws, &reply, &rpc_err);
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "wait_for_channel");
+    }
+    replied = true;
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    errval_t err;
+
+    waitset_init(&ws);
+    err = waitset_enable_affinity(&ws);
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "waitset_enable_affinity");
+    }
+
+    waitset_chanstate_init(&request, CHANTYPE_OTHER);
+    err = waitset_chan_register(&ws, &request,
+                                MKCLOSURE(request_handler, NULL));
+    assert(err_is_ok(err));
+    waitset_chanstate_init(&reply, CHANTYPE_OTHER);
+    err = waitset_chan_register(&ws, &reply, MKCLOSURE(reply_handler, NULL));
+    assert(err_is_ok(err));
+
+    dispatcher = thread_create(dispatcher_thread, NULL);
+    struct thread *rpc = thread_create(rpc_thread, NULL);
+    assert(dispatcher != NULL && rpc != NULL);
+
+    // let both threads block on the waitset
+    for (int i = 0; i < YIELDS_BEFORE_TRIGGER; i++) {
+        thread_yield();
+    }
+
+    err = waitset_chan_trigger(&request);
+    assert(err_is_ok(err));
+
+    for (int i = 0; i < YIELDS_FOR_REPLY && !replied; i++) {
+        thread_yield();
+    }
+    if (!replied) {
+        printf("waitset_affinity: FAILED, event stuck with the RPC thread\n");
+        return EXIT_FAILURE;
+    }
+    assert(handled_by == dispatcher);
+
+    err = thread_join(rpc, NULL);
+    assert(err_is_ok(err));
+
+    printf("waitset_affinity: test passed\n");
+    return EXIT_SUCCESS;
+}
@@ -21,6 +21,8 @@ struct thread *threads[256];
 static int server_threads = 10;
 static int client_threads = 1;
 static int iteration_count = 1000;
+static bool affinity = false;
+static cycles_t server_start;
 
 static int client_counter = 0;
 static int64_t server_calls[256];
@@ -34,6 +36,24 @@ static void show_stats(void)
         server_calls[8], server_calls[9]);
 }
 
+static void show_waitset_stats(void)
+{
+    struct waitset_stats st;
+    cycles_t elapsed = bench_tsc() - server_start;
+    uint64_t calls = (uint64_t)num_cores * client_threads * iteration_count;
+
+    waitset_get_stats(get_default_waitset(), &st);
+    debug_printf("%s waitset, %d server threads: %" PRIu64 " calls in %" PRIu64
+                 " us, %" PRIuCYCLES " cycles/call\n",
+                 affinity ? "affinity" : "shared", server_threads, calls,
+                 bench_tsc_to_us(elapsed), elapsed / calls);
+    debug_printf("Waitset: events %" PRIu64 " local %" PRIu64 " stolen %" PRIu64
+                 " blocks %" PRIu64 " wakeups %" PRIu64 " avg wakeup %" PRIu64
+                 " cycles\n", st.events, st.local_events, st.stolen_events,
+                 st.blocks, st.wakeups,
+                 st.wakeups ? st.wakeup_time / st.wakeups : 0);
+}
+
 static void show_client_stats(void)
 {
     int i, j, s;
@@ -167,6 +187,9 @@ static errval_t server_rpc_method_call(struct mt_waitset_binding *b, uint64_t i1
         }
     }
 
+    if (calls == 0) {
+        server_start = bench_tsc();
+    }
     if (i2 == 65536) {
         count++;    // client has finished
     } else
@@ -188,6 +211,7 @@ static errval_t server_rpc_method_call(struct mt_waitset_binding *b, uint64_t i1
         debug_printf("Final statistics\n");
         show_stats();
         show_client_stats();
+        show_waitset_stats();
         for (i = 0; i < num_cores; i++) {
             for (j = 0; j < client_threads; j++) {
                 if (client_calls[i][j] != iteration_count) {
@@ -252,6 +276,13 @@ static void start_server(void)
 
     debug_printf("Start server\n");
 
+    if (affinity) {
+        err = waitset_enable_affinity(ws);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "waitset_enable_affinity");
+        }
+    }
+
     err = mt_waitset_export(NULL, export_cb, connect_cb, ws,
                             IDC_EXPORT_FLAGS_DEFAULT);
     if (err_is_fail(err)) {
@@ -273,13 +304,17 @@ int main(int argc, char *argv[])
     memset(client_calls, 0, sizeof(client_calls));
 
     if (argc == 1) {
-        debug_printf("Usage: %s server_threads client_threads iteration_count\n", argv[0]);
-    } else if (argc == 4) {
+        debug_printf("Usage: %s server_threads client_threads iteration_count"
+                     " [affinity]\n", argv[0]);
+    } else if (argc == 4 || argc == 5) {
         char *xargv[] = {my_name, argv[2], argv[3], NULL};
 
         server_threads = atoi(argv[1]);
         client_threads = atoi(argv[2]);
         iteration_count = atoi(argv[3]);
+        affinity = argc == 5 && strcmp(argv[4], "affinity") == 0;
+
+        bench_init();
 
         err = spawn_program_on_all_cores(true, xargv[0], xargv, NULL,
             SPAWN_FLAGS_DEFAULT, NULL, &num_cores);
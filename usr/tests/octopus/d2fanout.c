@@ -0,0 +1,129 @@
+/**
+ * \file
+ * \brief Benchmark publish fan-out to many subscribers.
+ *
+ * Installs the given number of subscriptions that match every published
+ * record, plus as many subscriptions on unrelated attributes, then publishes
+ * records and waits until every matching subscription has been notified.
+ * Reports the time from the first publish to the last notification.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <barrelfish/barrelfish.h>
+#include <barrelfish/threads.h>
+#include <bench/bench.h>
+#include <octopus/octopus.h>
+
+#define DEFAULT_SUBSCRIBERS 1000
+#define DEFAULT_PUBLISHES   100
+
+static struct thread_mutex lock;
+static struct thread_cond done;
+static size_t received = 0;
+static size_t expected = 0;
+
+static void message_handler(octopus_mode_t mode, const char* record,
+        void* state)
+{
+    if (mode & OCT_ON_PUBLISH) {
+        free((char*) record);
+
+        thread_mutex_lock(&lock);
+        if (++received == expected) {
+            thread_cond_signal(&done);
+        }
+        thread_mutex_unlock(&lock);
+    }
+}
+
+/**
+ * Usage: d2fanout [#subscribers] [#publishes]
+ */
+int main(int argc, char** argv)
+{
+    errval_t err;
+
+    int subscribers = argc > 1 ? atoi(argv[1]) : DEFAULT_SUBSCRIBERS;
+    int publishes = argc > 2 ? atoi(argv[2]) : DEFAULT_PUBLISHES;
+    if (argc > 3 || subscribers <= 0 || publishes <= 0) {
+        printf("Usage: %s [#subscribers] [#publishes]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    oct_init();
+    bench_init();
+    thread_mutex_init(&lock);
+    thread_cond_init(&done);
+
+    subscription_t* ids = calloc(2 * subscribers, sizeof(subscription_t));
+    if (ids == NULL) {
+        USER_PANIC("calloc failed");
+    }
+
+    for (int i = 0; i < subscribers; i++) {
+        // alternate between templates with one and with two attributes
+        if (i % 2 == 0) {
+            err = oct_subscribe(message_handler, NULL, &ids[i],
+                    "_ { type: 'fanout' }");
+        }
+        else {
+            err = oct_subscribe(message_handler, NULL, &ids[i],
+                    "_ { type: 'fanout', seq >= 0 }");
+        }
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "oct_subscribe");
+        }
+
+        err = oct_subscribe(message_handler, NULL, &ids[subscribers + i],
+                "_ { unrelated%d: 1 }", i);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "oct_subscribe");
+        }
+    }
+
+    thread_mutex_lock(&lock);
+    expected = (size_t) subscribers * publishes;
+    thread_mutex_unlock(&lock);
+
+    cycles_t start = bench_tsc();
+    for (int i = 0; i < publishes; i++) {
+        err = oct_publish("fanout_msg { type: 'fanout', seq: %d }", i);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "oct_publish");
+        }
+    }
+    cycles_t published = bench_time_diff(start, bench_tsc());
+
+    thread_mutex_lock(&lock);
+    while (received < expected) {
+        thread_cond_wait(&done, &lock);
+    }
+    thread_mutex_unlock(&lock);
+    cycles_t delivered = bench_time_diff(start, bench_tsc());
+
+    uint64_t ms = bench_tsc_to_ms(delivered);
+    printf("d2fanout: %d subscribers, %d publishes\n", subscribers, publishes);
+    printf("d2fanout: publish %" PRIu64 " ms, all delivered %" PRIu64 " ms, "
+           "%" PRIu64 " notifications/s\n", bench_tsc_to_ms(published), ms,
+           ms == 0 ? 0 : (uint64_t) expected * 1000 / ms);
+
+    for (int i = 0; i < 2 * subscribers; i++) {
+        oct_unsubscribe(ids[i]);
+    }
+    free(ids);
+
+    printf("d2fanout: done\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,119 @@
+/**
+ * \file
+ * \brief Benchmark query throughput of the octopus record store.
+ *
+ * Populates the store with a number of records and then measures exact-name
+ * gets, attribute gets, attribute name queries and sets. Reports operations
+ * per second for every phase.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+
+#include <barrelfish/barrelfish.h>
+#include <bench/bench.h>
+#include <octopus/octopus.h>
+
+#define DEFAULT_RECORDS 1000
+#define DEFAULT_OPS     10000
+#define GROUPS          16
+
+static void report(const char *phase, size_t ops, cycles_t cycles)
+{
+    uint64_t ms = bench_tsc_to_ms(cycles);
+    printf("d2query: %-10s %zu ops in %" PRIu64 " ms, %" PRIu64 " ops/s\n",
+           phase, ops, ms, ms == 0 ? 0 : (uint64_t)ops * 1000 / ms);
+}
+
+/**
+ * Usage: d2query [#records] [#ops]
+ */
+int main(int argc, char** argv)
+{
+    errval_t err;
+
+    int records = argc > 1 ? atoi(argv[1]) : DEFAULT_RECORDS;
+    size_t ops = argc > 2 ? atol(argv[2]) : DEFAULT_OPS;
+    if (argc > 3 || records <= 0 || ops == 0) {
+        printf("Usage: %s [#records] [#ops]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    oct_init();
+    bench_init();
+
+    cycles_t start = bench_tsc();
+    for (int i = 0; i < records; i++) {
+        err = oct_set("d2query%d { type: 'dev', idx: %d, group: %d }", i, i,
+                      i % GROUPS);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "oct_set");
+        }
+    }
+    report("populate", records, bench_time_diff(start, bench_tsc()));
+
+    char* record;
+    start = bench_tsc();
+    for (size_t i = 0; i < ops; i++) {
+        err = oct_get(&record, "d2query%d", (int)(i % records));
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "oct_get by name");
+        }
+        free(record);
+    }
+    report("get name", ops, bench_time_diff(start, bench_tsc()));
+
+    start = bench_tsc();
+    for (size_t i = 0; i < ops; i++) {
+        err = oct_get(&record, "_ { type: 'dev', idx: %d }",
+                      (int)(i % records));
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "oct_get by attribute");
+        }
+        free(record);
+    }
+    report("get attr", ops, bench_time_diff(start, bench_tsc()));
+
+    char** names;
+    size_t len;
+    start = bench_tsc();
+    for (size_t i = 0; i < ops; i++) {
+        err = oct_get_names(&names, &len, "_ { group: %d }",
+                            (int)(i % GROUPS));
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "oct_get_names");
+        }
+        assert(len > 0);
+        oct_free_names(names, len);
+    }
+    report("get names", ops, bench_time_diff(start, bench_tsc()));
+
+    start = bench_tsc();
+    for (size_t i = 0; i < ops; i++) {
+        int idx = i % records;
+        err = oct_set("d2query%d { type: 'dev', idx: %d, group: %d }", idx,
+                      idx, idx % GROUPS);
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "oct_set");
+        }
+    }
+    report("set", ops, bench_time_diff(start, bench_tsc()));
+
+    for (int i = 0; i < records; i++) {
+        oct_del("d2query%d", i);
+    }
+
+    printf("d2query: done\n");
+    return EXIT_SUCCESS;
+}
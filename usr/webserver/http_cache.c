@@ -2,9 +2,12 @@
  * \file
  * \brief NFS-populated file cache for HTTP server
  *
- * This very stupid "cache" assumes that:
- *  All regular files in a hardcoded NFS mount point are cached at startup
- *  The contents of the cache never change nor expire
+ * Regular files in a hardcoded NFS mount point are cached at startup and
+ * loaded on demand afterwards. Cachelines are indexed by a hash of the file
+ * name and kept in LRU order; the least recently used ones are evicted once
+ * the cached data exceeds a byte budget. A hit on a cacheline that was not
+ * validated recently is answered from the cache and triggers a getattr in
+ * the background, which reloads the file only if it changed on the server.
  */
 
 /*
@@ -23,7 +26,6 @@
 #include <lwip/ip_addr.h>
 #include <trace/trace.h>
 #include <trace_definitions/trace_defs.h>
-#include <timer/timer.h>
 #include <netbench/netbench.h>
 #include "webserver_network.h"
 #include "webserver_debug.h"
@@ -41,8 +43,19 @@
 //#define MAX_NFS_READ       14000
 #define MAX_NFS_READ      1330 /* 14000 */ /* to avoid packet reassembly inside driver */
 
-/* Maximum staleness allowed */
-#define MAX_STALENESS ((cycles_t)9000000)
+/* Maximum staleness allowed before a cacheline is revalidated
+    (about a second at 3 GHz) */
+#define MAX_STALENESS ((cycles_t)3000000000ULL)
+
+/* Default limit on the file data held by the cache */
+#define DEFAULT_CACHE_BYTES (256UL * 1024 * 1024)
+
+/* Number of buckets of the hash table indexing the cachelines */
+#define CACHE_HASH_BITS 17
+#define CACHE_HASH_SIZE (1UL << CACHE_HASH_BITS)
+
+/* Number of unused buff_holders kept around for reuse */
+#define MAX_FREE_BUFF_HOLDERS 256
 
 static void (*init_callback)(void);
 
@@ -50,22 +63,41 @@ static void (*init_callback)(void);
 struct http_cache_entry {
     int                 valid;      /* flag for validity of the data */
     char                *name;      /* name of the cached file */
+    uint32_t            hash;       /* hash of the name */
     size_t              copied;     /* how much data is copied? */
     int                 loading;    /* flag indicating if data is loading */
+    int                 revalidating; /* flag indicating a getattr in flight */
     struct buff_holder  *hbuff;      /* holder for buffer */
+    struct buff_holder  *nbuff;      /* holder for buffer being loaded */
     struct nfs_fh3      file_handle;    /* for NFS purpose */
+    nfstime3            mtime;      /* modification time of the data */
+    cycles_t            checked;    /* when the data was last validated */
     struct http_conn *conn;     /* list of connections waiting for data */
     struct http_conn *last;        /* for quick insertions at end */
-    struct http_cache_entry *next;   /* for linked list */
+    struct http_cache_entry *next;   /* next cacheline in the hash bucket */
+    struct http_cache_entry *lru_prev; /* more recently used cacheline */
+    struct http_cache_entry *lru_next; /* less recently used cacheline */
 };
 
 /* global states */
 static struct nfs_fh3 nfs_root_fh;  /* reference to the root dir of NFS */
 static struct nfs_client *my_nfs_client; /* The NFS client */
 
-static struct http_cache_entry *cache_table = NULL; /*root cached entry array */
+/* hash table of all cachelines */
+static struct http_cache_entry *cache_table[CACHE_HASH_SIZE];
 static struct http_cache_entry *error_cache = NULL; /* cache entry for error */
 
+/* all cachelines, most recently used first */
+static struct http_cache_entry *lru_head = NULL;
+static struct http_cache_entry *lru_tail = NULL;
+
+static size_t cache_bytes = 0;  /* file data held by the cache */
+static size_t cache_budget = DEFAULT_CACHE_BYTES; /* limit on cache_bytes */
+
+/* buff_holders released by their last user, linked by their next field */
+static struct buff_holder *free_buff_holders = NULL;
+static int free_buff_holder_count = 0;
+
 
 #ifdef PRELOAD_WEB_CACHE
 /* Initial cache loading state variables */
@@ -84,8 +116,14 @@ static uint64_t last_ts = 0;
 static struct buff_holder *allocate_buff_holder (size_t len)
 {
     struct buff_holder *result = NULL;
-    result = (struct buff_holder *) malloc (sizeof (struct buff_holder));
-    assert (result != NULL );
+    if (free_buff_holders != NULL) {
+        result = free_buff_holders;
+        free_buff_holders = result->next;
+        --free_buff_holder_count;
+    } else {
+        result = (struct buff_holder *) malloc (sizeof (struct buff_holder));
+        assert (result != NULL );
+    }
     memset (result, 0, sizeof(struct buff_holder));
     if ( len > 0) {
         result->data = malloc (len);
@@ -118,14 +156,63 @@ long decrement_buff_holder_ref (struct buff_holder *bh)
         return (bh->r_counter);
     }
 
-    if (bh->len > 0 && bh->data != NULL) {
+    if (bh->data != NULL) {
         free (bh->data);
     }
+    /* keep the holder for the next cacheline being loaded */
+    if (free_buff_holder_count < MAX_FREE_BUFF_HOLDERS) {
+        bh->next = free_buff_holders;
+        free_buff_holders = bh;
+        ++free_buff_holder_count;
+        return 0;
+    }
     free (bh);
     return 0;
 } /* end Function: increment_buff_holder_ref */
 
 
+/* FNV-1a hash of the name of a cacheline */
+static uint32_t cache_hash (const char *name)
+{
+    uint32_t h = 2166136261U;
+    for (const char *c = name; *c != '\0'; c++) {
+        h ^= (uint8_t)*c;
+        h *= 16777619U;
+    }
+    return h;
+} /* end function: cache_hash */
+
+/* removes the cacheline e from the LRU list */
+static void lru_unlink (struct http_cache_entry *e)
+{
+    if (e->lru_prev != NULL) {
+        e->lru_prev->lru_next = e->lru_next;
+    } else {
+        lru_head = e->lru_next;
+    }
+    if (e->lru_next != NULL) {
+        e->lru_next->lru_prev = e->lru_prev;
+    } else {
+        lru_tail = e->lru_prev;
+    }
+    e->lru_prev = NULL;
+    e->lru_next = NULL;
+} /* end function: lru_unlink */
+
+/* inserts the cacheline e as the most recently used one */
+static void lru_push_front (struct http_cache_entry *e)
+{
+    e->lru_prev = NULL;
+    e->lru_next = lru_head;
+    if (lru_head != NULL) {
+        lru_head->lru_prev = e;
+    } else {
+        lru_tail = e;
+    }
+    lru_head = e;
+} /* end function: lru_push_front */
+
+
 /* allocates the memory for the cacheline */
 static struct http_cache_entry * cache_entry_allocate (void)
 {
@@ -174,14 +261,21 @@ static void add_connection(struct http_cache_entry *e, struct http_conn *cs)
 static struct http_cache_entry *find_cacheline (const char *name)
 {
     struct http_cache_entry *e;
+    uint32_t h = cache_hash(name);
+    struct http_cache_entry **bucket = &cache_table[h & (CACHE_HASH_SIZE - 1)];
     int l;
-    // FIXME: simple linear search
-    for (e = cache_table; e != NULL; e = e->next) {
-        if (strcmp(name, e->name) == 0) {
+
+    for (e = *bucket; e != NULL; e = e->next) {
+        if (e->hash == h && strcmp(name, e->name) == 0) {
             DEBUGPRINT ("cache-hit for [%s] == [%s]\n", name, e->name);
+            /* move to the front of the LRU list */
+            if (e != lru_head) {
+                lru_unlink(e);
+                lru_push_front(e);
+            }
             return e;
         }
-    } /* end for : for each cacheline */
+    } /* end for : for each cacheline in the bucket */
     /* create new cacheline */
     e = cache_entry_allocate();
     /* copying the filename */
@@ -189,32 +283,64 @@ static struct http_cache_entry *find_cacheline (const char *name)
     e->name = (char *)malloc(sizeof(char)*(l+1));
     assert(e->name != NULL);
     strcpy(e->name, name);
+    e->hash = h;
     DEBUGPRINT ("cache-miss for [%s] so, created [%s]\n", name, e->name);
-    e->next = cache_table;
-    cache_table = e;
+    e->next = *bucket;
+    *bucket = e;
+    lru_push_front(e);
     return e;
 } /* end function: find_cacheline */
 
 static void delete_cacheline_from_cachelist (struct http_cache_entry *target)
 {
-    struct http_cache_entry *prev;
-    struct http_cache_entry *e;
+    struct http_cache_entry **prev;
 
-    if (cache_table == target){
-        cache_table = target->next;
-        return;
+    prev = &cache_table[target->hash & (CACHE_HASH_SIZE - 1)];
+    for (; *prev != NULL; prev = &(*prev)->next) {
+        if (*prev == target) {
+            *prev = target->next;
+            break;
+        }
+    } /* end for : for each cacheline in the bucket */
+    lru_unlink(target);
+} /* end function: delete_cacheline_from_cachelist */
+
+/* drops the cacheline e and its reference to the cached data,
+    connections still sending the data keep their own references */
+static void free_cacheline (struct http_cache_entry *e)
+{
+    assert (e->conn == NULL);
+    assert (e->nbuff == NULL);
+
+    delete_cacheline_from_cachelist (e);
+    if (e->hbuff != NULL) {
+        cache_bytes -= e->hbuff->len;
+        decrement_buff_holder_ref (e->hbuff);
     }
+    if (e->file_handle.data_val != NULL) {
+        nfs_freefh (e->file_handle);
+    }
+    if (e->name != NULL ) free(e->name);
+    free(e);
+} /* end function: free_cacheline */
 
-    // FIXME: simple linear search
-    prev = NULL;
-    for (e = cache_table; e != NULL; e = e->next) {
-        if (e == target) {
-            prev->next = e->next;
-            return;
+/* evicts least recently used cachelines until the cached data fits into
+    cache_budget again, skipping the ones with NFS operations in flight */
+static void cache_evict (void)
+{
+    struct http_cache_entry *e = lru_tail;
+    struct http_cache_entry *prev;
+
+    while (cache_bytes > cache_budget && e != NULL) {
+        prev = e->lru_prev;
+        if (e->valid && !e->loading && !e->revalidating) {
+            DEBUGPRINT ("evicting cacheline [%s] of %zu bytes\n", e->name,
+                    e->hbuff->len);
+            free_cacheline (e);
         }
-        prev = e;
-    } /* end for : for each cacheline */
-} /* end function: delete_cacheline_from_cachelist */
+        e = prev;
+    } /* end while: over budget */
+} /* end function: cache_evict */
 
 
 static void trigger_callback (struct http_conn *cs, struct http_cache_entry *e)
@@ -268,6 +394,7 @@ static void read_callback (void *arg, struct nfs_client *client,
                           READ3res *result)
 {
     struct http_cache_entry *e = arg;
+    struct buff_holder *old;
     assert( e != NULL);
 
     assert (result != NULL);
@@ -275,11 +402,24 @@ static void read_callback (void *arg, struct nfs_client *client,
     READ3resok *res = &result->READ3res_u.resok;
     assert(res->count == res->data.data_len);
 
-    assert (e->hbuff != NULL);
-    assert (e->hbuff->data != NULL );
+    assert (e->nbuff != NULL);
 
-    assert (e->hbuff->len >= e->copied + res->data.data_len);
-    memcpy (e->hbuff->data + e->copied, res->data.data_val, res->data.data_len);
+    if (e->nbuff->len < e->copied + res->data.data_len) {
+        /* the file grew since its size was taken, make room for the rest */
+        size_t len = e->copied + res->data.data_len;
+        if (len < 2 * e->nbuff->len) {
+            len = 2 * e->nbuff->len;
+        }
+        void *data = realloc (e->nbuff->data, len);
+        assert (data != NULL);
+        e->nbuff->data = data;
+        cache_bytes += len - e->nbuff->len;
+        e->nbuff->len = len;
+    }
+    if (res->data.data_len > 0) {
+        memcpy (e->nbuff->data + e->copied, res->data.data_val,
+                res->data.data_len);
+    }
     e->copied += res->data.data_len;
 
     DEBUGPRINT ("got response of len %d, filesize %lu for file %s\n",
@@ -297,13 +437,29 @@ static void read_callback (void *arg, struct nfs_client *client,
     }
 
     /* This is the end-of-file, so deal with it. */
+    /* the file may be shorter than the buffer if it changed meanwhile */
+    if (e->nbuff->len > e->copied) {
+        cache_bytes -= e->nbuff->len - e->copied;
+        e->nbuff->len = e->copied;
+    }
+
+    /* replace the data served so far, connections still sending the old
+        data keep it alive through their references */
+    old = e->hbuff;
+    e->hbuff = e->nbuff;
+    e->nbuff = NULL;
+    if (old != NULL) {
+        cache_bytes -= old->len;
+        decrement_buff_holder_ref (old);
+    }
     e->valid = 1;
     e->loading = 0;
-    decrement_buff_holder_ref (e->hbuff);
+    e->checked = rdtsc();
 
 #ifdef PRELOAD_WEB_CACHE
     if (!cache_loading_phase) {
         handle_pending_list (e); /* done! */
+        cache_evict();
         return;
     }
 
@@ -311,19 +467,43 @@ static void read_callback (void *arg, struct nfs_client *client,
     printf("Copied %zu bytes for file [%s] of length: %zu\n",
             e->copied, e->name, e->hbuff->len);
     ++cache_loaded_counter;
+    cache_evict();
     handle_cache_load_done();
 
 #else // PRELOAD_WEB_CACHE
     handle_pending_list(e); /* done! */
+    cache_evict();
 #endif // PRELOAD_WEB_CACHE
 }
 
+/* starts reading the len bytes of the file behind cacheline e into a new
+    buffer, the current data (if any) is served until the read completes */
+static void start_read (struct http_cache_entry *e, size_t len)
+{
+    err_t r;
+
+    assert (e->nbuff == NULL);
+    /* Allocate memory for holding the file-content */
+    /* NOTE: this memory will be freed by decrement_buff_holder_ref */
+    e->nbuff = allocate_buff_holder (len);
+    cache_bytes += len;
+
+    /* Set the size of the how much data is read till now. */
+    e->copied = 0;
+
+    r = nfs_read (my_nfs_client, e->file_handle, 0, MAX_NFS_READ,
+            read_callback, e);
+    assert (r == ERR_OK);
+
+    /* make room for the new data */
+    cache_evict();
+} /* end function: start_read */
+
 
 static void lookup_callback (void *arg, struct nfs_client *client,
                             LOOKUP3res *result)
 {
     LOOKUP3resok *resok = &result->LOOKUP3res_u.resok;
-    err_t r;
     struct http_cache_entry *e = arg;
 
     DEBUGPRINT ("inside lookup_callback_file for file %s\n", e->name);
@@ -334,35 +514,18 @@ static void lookup_callback (void *arg, struct nfs_client *client,
         resok->obj_attributes.attributes_follow &&
         resok->obj_attributes.post_op_attr_u.attributes.type == NF3REG) {
 
-    	/* FIXME: check if the file is recently modified or not. */
-		// resok->obj_attributes.post_op_attr_u.attributes.ctime;
-
-
         DEBUGPRINT("Copying %s of size %lu\n", e->name,
                     resok->obj_attributes.post_op_attr_u.attributes.size );
 
         /* Store the nfs directory handle in current_session (cs) */
         nfs_copyfh (&e->file_handle, resok->object);
         /* GLOBAL: Storing the global reference for cache entry */
-        /* NOTE: this memory is freed in reset_cache_entry() */
-
-        /* Allocate memory for holding the file-content */
-        /* Allocate the buff_holder */
-        e->hbuff = allocate_buff_holder(
-            resok->obj_attributes.post_op_attr_u.attributes.size );
-        /* NOTE: this memory will be freed by decrement_buff_holder_ref */
-
-        /* increment buff_holder reference */
-        increment_buff_holder_ref (e->hbuff);
-
-        e->hbuff->len = resok->obj_attributes.post_op_attr_u.attributes.size;
+        /* NOTE: this memory is freed in free_cacheline() */
 
-        /* Set the size of the how much data is read till now. */
-        e->copied = 0;
+        /* remember the version of the file for revalidation */
+        e->mtime = resok->obj_attributes.post_op_attr_u.attributes.mtime;
 
-        r = nfs_read (client, e->file_handle, 0, MAX_NFS_READ,
-                read_callback, e);
-        assert (r == ERR_OK);
+        start_read (e, resok->obj_attributes.post_op_attr_u.attributes.size);
 
         // free arguments
         xdr_LOOKUP3res(&xdr_free, result);
@@ -372,34 +535,27 @@ static void lookup_callback (void *arg, struct nfs_client *client,
     /* Most probably the file does not exist */
     DEBUGPRINT ("Error: file [%s] does not exist, or wrong type\n", e->name);
 
-#ifdef PRELOAD_WEB_CACHE
-    if (cache_loading_phase){
-    	++cache_loading_probs;
-    	handle_cache_load_done();
-    	return;
-    }
-#endif // PRELOAD_WEB_CACHE
-
-    if (e->conn == NULL) {
-    	/* No connection is waiting for this loading */
-    	return;
-    }
-
     /*	as file does not exist, send all the http_conns to error page. */
-    error_cache->conn = e->conn;
-    error_cache->last = e->last;
-    handle_pending_list (error_cache); /* done! */
+    if (e->conn != NULL) {
+        error_cache->conn = e->conn;
+        error_cache->last = e->last;
+        handle_pending_list (error_cache); /* done! */
+        e->conn = NULL;
+        e->last = NULL;
+    }
 
     /* free this cache entry as it is pointing to invalid page */
-    e->conn = NULL;
-    e->last = NULL;
-    delete_cacheline_from_cachelist (e);
-    if (e->name != NULL ) free(e->name);
-    free(e);
+    free_cacheline (e);
 
     // free arguments
     xdr_LOOKUP3res(&xdr_free, result);
-    return;
+
+#ifdef PRELOAD_WEB_CACHE
+    if (cache_loading_phase){
+    	++cache_loading_probs;
+    	handle_cache_load_done();
+    }
+#endif // PRELOAD_WEB_CACHE
 } /* end function: lookup_callback_file */
 
 static err_t async_load_cache_entry(struct http_cache_entry *e)
@@ -417,6 +573,61 @@ static err_t async_load_cache_entry(struct http_cache_entry *e)
 } /* end function : async_load_cache_entry */
 
 
+static void getattr_callback (void *arg, struct nfs_client *client,
+                             GETATTR3res *result)
+{
+    struct http_cache_entry *e = arg;
+    assert (e != NULL);
+
+    e->revalidating = 0;
+
+    if (result == NULL) {
+        /* RPC failure, keep serving the data and retry on a later hit */
+        DEBUGPRINT ("revalidation of [%s] failed\n", e->name);
+        return;
+    }
+
+    if (result->status != NFS3_OK ||
+        result->GETATTR3res_u.resok.obj_attributes.type != NF3REG) {
+        /* the file is gone, forget about it */
+        DEBUGPRINT ("revalidation: [%s] disappeared\n", e->name);
+        xdr_GETATTR3res(&xdr_free, result);
+        free_cacheline (e);
+        return;
+    }
+
+    fattr3 *attr = &result->GETATTR3res_u.resok.obj_attributes;
+    if (attr->mtime.seconds == e->mtime.seconds &&
+        attr->mtime.nseconds == e->mtime.nseconds &&
+        attr->size == e->hbuff->len) {
+        /* unchanged, keep using the cached buffer */
+        e->checked = rdtsc();
+    } else {
+        /* modified, fetch the new version while serving the old one */
+        DEBUGPRINT ("revalidation: reloading modified file [%s]\n", e->name);
+        e->mtime = attr->mtime;
+        e->loading = 1;
+        start_read (e, attr->size);
+    }
+
+    // free arguments
+    xdr_GETATTR3res(&xdr_free, result);
+} /* end function: getattr_callback */
+
+/* checks in the background whether the file behind the cacheline e
+    changed on the NFS server */
+static void async_revalidate_cache_entry(struct http_cache_entry *e)
+{
+    err_t r;
+    assert(e != NULL);
+
+    DEBUGPRINT ("revalidating [%s] with nfs_getattr\n", e->name);
+    e->revalidating = 1;
+    r = nfs_getattr(my_nfs_client, e->file_handle, getattr_callback, e);
+    assert(r == ERR_OK);
+} /* end function : async_revalidate_cache_entry */
+
+
 err_t http_cache_lookup (const char *name, struct http_conn *cs)
 {
     struct http_cache_entry *e;
@@ -424,10 +635,16 @@ err_t http_cache_lookup (const char *name, struct http_conn *cs)
 
     e = find_cacheline(name);
     if (e->valid == 1) {
-        /* fresh matching cache-entry found */
+        /* matching cache-entry found */
         DEBUGPRINT ("%d: Fresh cache-entry, returning page [%s]\n",
                 cs->request_no, name);
         trigger_callback (cs, e);
+
+        /* answered from the cache, check for a newer version afterwards */
+        if (!e->loading && !e->revalidating &&
+            rdtsc() - e->checked > MAX_STALENESS) {
+            async_revalidate_cache_entry(e);
+        }
         return ERR_OK;
     } /* end if: valid cacheline */
 
@@ -449,28 +666,12 @@ err_t http_cache_lookup (const char *name, struct http_conn *cs)
     return ERR_OK;
 } /* end function: http_cache_lookup */
 
-
-
-
-static void cache_timeout_event (struct timer *timer, void *arg)
+/* sets the limit on the file data held by the cache */
+void http_cache_set_budget (size_t bytes)
 {
-    struct http_cache_entry *cache = arg;
-    struct http_cache_entry *e;
-
-    DEBUGPRINT ("CACHE_TIMEOUT: marking all cache entries for reload\n");
-    for (e = cache; e != NULL; e = e->next) {
-        if (e->valid == 1) {
-            /* this if is to avoid any complications that might come because
-                of getting cache_timeout when cacheline was in loading */
-            e->valid = 0;
-            e->loading = 0;
-
-            decrement_buff_holder_ref (e->hbuff); /* Decrement buffer ref.  */
-            e->hbuff = NULL;    /* loosing the pointer to buff */
-        } /* end if: if cacheline is valid  */
-    } /* end for : for each cacheline */
-    DEBUGPRINT ("CACHE_TIMEOUT: Done with invalidating the cache entries\n");
-} /* end function : cache_timeout_event */
+    cache_budget = bytes;
+    cache_evict();
+} /* end function: http_cache_set_budget */
 
 
 #ifdef PRELOAD_WEB_CACHE
@@ -643,7 +844,6 @@ static void mount_callback(void *arg, struct nfs_client *client,
 err_t http_cache_init(struct ip_addr server, const char *path,
                      void (*callback)(void))
 {
-    struct timer *cache_timer;      /* timer for triggering cache timeouts */
     init_callback = callback;
 
     DEBUGPRINT ("nfs_mount calling.\n");
@@ -652,20 +852,12 @@ err_t http_cache_init(struct ip_addr server, const char *path,
 
     assert(my_nfs_client != NULL);
     /* creating the empty cache */
-    cache_table = NULL;
+    memset(cache_table, 0, sizeof(cache_table));
+    lru_head = NULL;
+    lru_tail = NULL;
+    cache_bytes = 0;
     create_404_page_cache();
 
-
-    cache_timer = timer_create(MAX_STALENESS, true, cache_timeout_event,
-            cache_table);
-    assert (cache_timer != NULL);
-    if (cache_timer == NULL) {
-        printf ("http_cache_init failed in timer_create\n");
-        return ERR_MEM;
-    }
-    timer_start(cache_timer);
     DEBUGPRINT ("http_cache_init done\n");
     return ERR_OK;
 } /* end function: http_cache_init */
-
-
@@ -18,6 +18,7 @@
 err_t http_cache_init (struct ip_addr server, const char *path,
                      void (*callback)(void));
 err_t http_cache_lookup (const char *name, struct http_conn *cs);
+void http_cache_set_budget (size_t bytes);
 long decrement_buff_holder_ref (struct buff_holder *bh);
 long decrement_reference (struct http_conn *cs);
 #endif // HTTP_CACHE_H
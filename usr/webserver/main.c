@@ -16,6 +16,7 @@
 #include <barrelfish/waitset.h>
 #include <barrelfish/nameservice_client.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <lwip/netif.h>
 #include <lwip/dhcp.h>
 #include <netif/etharp.h>
@@ -28,6 +29,7 @@
 
 #include "webserver_network.h"
 #include "webserver_debug.h"
+#include "http_cache.h"
 
 static struct ip_addr serverip;
 static const char *serverpath;
@@ -43,8 +45,8 @@ int main(int argc, char**argv)
     errval_t err;
 
     // Parse args
-    if (argc != 4) {
-        printf("Usage: %s CardName NFSIP NFSpath\n", argv[0]);
+    if (argc != 4 && argc != 5) {
+        printf("Usage: %s CardName NFSIP NFSpath [CacheMB]\n", argv[0]);
         return 1;
     }
 //    char *card_name = argv[1];
@@ -56,6 +58,9 @@ int main(int argc, char**argv)
     }
     serverip.addr = server1.s_addr; // XXX
     serverpath = argv[3];
+    if (argc == 5) {
+        http_cache_set_budget(strtoul(argv[4], NULL, 10) * 1024 * 1024);
+    }
 
     // Boot up
     DEBUGPRINT("init start\n");
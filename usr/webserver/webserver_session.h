@@ -30,6 +30,7 @@ struct buff_holder {
     long                r_counter;   /* reference counter */
     void                *data;      /* cached data (file-contents) */
     size_t              len;        /* length of data */
+    struct buff_holder  *next;      /* for the list of unused holders */
 };
 
 struct http_conn {